@@ -0,0 +1,128 @@
+#!/usr/bin/python
+# -*- mode: python-mode; py-indent-tabs-mode: nil -*-
+"""
+Receive the measurement report feed of the MSC and print the records of
+the version 2 (batched) format. Version 1 datagrams are only counted.
+Every second the received records, datagrams and lost datagrams are
+printed to stderr.
+
+ meas_feed_decode.py [-p PORT] [-q]
+
+Configure the sender with:
+
+ mncc-int
+  meas-feed destination 127.0.0.1 8888
+  meas-feed version 2
+"""
+
+from __future__ import print_function
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+MEAS_FEED_MEAS = 0
+MEAS_FEED_MEAS_BATCH = 1
+
+MEAS_FEED_VERSION_BATCH = 2
+
+# struct meas_feed_hdr, the version is in the byte order of the sender
+# like in version 1
+HDR = struct.Struct('=BBH')
+# the rest of struct meas_feed_batch, see include/openbsc/meas_feed.h
+BATCH_HDR = struct.Struct('!IHH32s')
+# struct meas_feed_rec without the neighbor cells
+REC = struct.Struct('!QBBBBBBBBBBBBBBBBBbBBh')
+CELL = struct.Struct('!HBB')
+
+REC_FIELDS = ('imsi', 'bts_nr', 'trx_nr', 'ts_nr', 'ss_nr',
+              'lchan_type', 'pchan_type', 'nr', 'flags',
+              'ul_full_rx_lev', 'ul_full_rx_qual',
+              'ul_sub_rx_lev', 'ul_sub_rx_qual',
+              'dl_full_rx_lev', 'dl_full_rx_qual',
+              'dl_sub_rx_lev', 'dl_sub_rx_qual',
+              'bs_power', 'ms_pwr', 'ms_ta', 'num_cell',
+              'ms_timing_offset')
+
+
+def decode_batch(data):
+    msg_type, _, version = HDR.unpack_from(data)
+    if version != MEAS_FEED_VERSION_BATCH:
+        raise ValueError('unknown version %u' % version)
+    seq, num_rec, rec_len, scenario = BATCH_HDR.unpack_from(data, HDR.size)
+    scenario = scenario.split(b'\0')[0].decode('ascii', 'replace')
+    recs = []
+    off = HDR.size + BATCH_HDR.size
+    for i in range(num_rec):
+        if off + rec_len > len(data) or rec_len < REC.size:
+            raise ValueError('truncated record %d' % i)
+        rec = dict(zip(REC_FIELDS, REC.unpack_from(data, off)))
+        cells = []
+        for c in range(min(rec['num_cell'], 6)):
+            arfcn, bsic, rxlev = CELL.unpack_from(data, off + REC.size + c * CELL.size)
+            cells.append((arfcn, bsic, rxlev))
+        rec['cells'] = cells
+        rec['scenario'] = scenario
+        recs.append(rec)
+        off += rec_len
+    return seq, recs
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the measurement feed')
+    parser.add_argument('-p', '--port', type=int, default=8888,
+                        help='UDP port to listen on')
+    parser.add_argument('-q', '--quiet', action='store_true',
+                        help='only print the statistics')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('0.0.0.0', args.port))
+    sock.settimeout(1.0)
+
+    next_seq = None
+    records = datagrams = lost = 0
+    last = time.time()
+
+    while True:
+        try:
+            data = sock.recv(65535)
+        except socket.timeout:
+            data = None
+
+        if data:
+            datagrams += 1
+            if data[0:1] == struct.pack('B', MEAS_FEED_MEAS_BATCH):
+                try:
+                    seq, recs = decode_batch(data)
+                except (ValueError, struct.error) as e:
+                    print('Bad datagram: %s' % e, file=sys.stderr)
+                    continue
+                if next_seq is not None and seq != next_seq:
+                    lost += (seq - next_seq) & 0xffffffff
+                next_seq = (seq + 1) & 0xffffffff
+                records += len(recs)
+                if not args.quiet:
+                    for rec in recs:
+                        print('%(imsi)015d bts=%(bts_nr)u trx=%(trx_nr)u '
+                              'ts=%(ts_nr)u ss=%(ss_nr)u nr=%(nr)u '
+                              'ul=%(ul_full_rx_lev)u/%(ul_full_rx_qual)u '
+                              'dl=%(dl_full_rx_lev)u/%(dl_full_rx_qual)u '
+                              'ta=%(ms_ta)u' % rec,
+                              ' '.join('%u/%u:%u' % c for c in rec['cells']))
+            elif data[0:1] == struct.pack('B', MEAS_FEED_MEAS):
+                records += 1
+
+        now = time.time()
+        if now - last >= 1.0:
+            print('%.0f records/s, %.0f datagrams/s, %u datagrams lost' %
+                  (records / (now - last), datagrams / (now - last), lost),
+                  file=sys.stderr)
+            records = datagrams = 0
+            last = now
+
+
+if __name__ == '__main__':
+    main()
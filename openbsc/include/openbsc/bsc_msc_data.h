@@ -99,6 +99,13 @@ struct bsc_msc_data {
 	/* ussd msc connection lost text */
 	char *ussd_msc_lost_txt;
 
+	/* SCCP connections to this MSC and those that are being cleared */
+	struct llist_head sccp_cons;
+	struct llist_head sccp_closing;
+	struct osmo_timer_list sccp_close_timer;
+	/* a RESET waits for sccp_closing to become empty */
+	int reset_ack_pending;
+
 	/* ussd text when MSC has entered the grace period */
 	char *ussd_grace_txt;
 
@@ -138,6 +145,7 @@ int osmo_bsc_audio_init(struct gsm_network *network);
 struct bsc_msc_data *osmo_msc_data_find(struct gsm_network *, int);
 struct bsc_msc_data *osmo_msc_data_alloc(struct gsm_network *, int);
 
-void bsc_notify_and_close_conns(struct bsc_msc_connection *msc_con);
+void bsc_notify_and_close_conns(struct bsc_msc_data *msc);
+void bsc_close_conns_cb(void *msc);
 
 #endif
@@ -48,6 +48,8 @@ struct bsc_nat_parsed;
 struct bsc_nat;
 struct bsc_nat_ussd_con;
 struct nat_rewrite_rule;
+struct nat_rewrite_loader;
+struct bsc_nat_num_rewr_node;
 
 /*
  * Is this terminated to the MSC, to the local machine (release
@@ -74,6 +76,35 @@ struct bsc_cmd_list {
 	struct ctrl_cmd *cmd;
 };
 
+/*
+ * Batched IPA I/O on the BSC and MSC links. A single read() can carry
+ * many frames and the pending writes are handed to one writev().
+ */
+#define NAT_LINK_RX_SIZE	4096
+#define NAT_LINK_BATCH_DEFAULT	32
+#define NAT_LINK_BATCH_MAX	64
+
+struct bsc_nat_link {
+	void *ctx;
+
+	/* incoming stream, the complete frames are handed out in place */
+	uint8_t *rx_data;
+	unsigned int rx_len;
+	unsigned int rx_off;
+
+	/* a frame larger than rx_data and the length it will have */
+	struct msgb *rx_big;
+	unsigned int rx_big_len;
+
+	/* statistics */
+	uint64_t rx_bytes;
+	uint64_t rx_msgs;
+	uint64_t rx_calls;
+	uint64_t tx_bytes;
+	uint64_t tx_msgs;
+	uint64_t tx_calls;
+};
+
 /*
  * Per BSC data structure
  */
@@ -87,8 +118,8 @@ struct bsc_connection {
 	/* the fd we use to communicate */
 	struct osmo_wqueue write_queue;
 
-	/* incoming message buffer */
-	struct msgb *pending_msg;
+	/* incoming message buffer and I/O statistics */
+	struct bsc_nat_link link;
 
 	/* the BSS associated */
 	struct bsc_config *cfg;
@@ -102,6 +133,9 @@ struct bsc_connection {
 
 	/* mgcp related code */
 	char *_endpoint_status;
+	/* free timeslots per multiplex and the multiplexes with any */
+	uint32_t *_endpoint_free;
+	uint32_t _multiplex_free;
 	int number_multiplexes;
 	int max_endpoints;
 	int last_endpoint;
@@ -210,6 +244,8 @@ struct bsc_endpoint {
 	char *transaction_id;
 	/* the bsc we are talking to */
 	struct bsc_connection *bsc;
+	/* the connection the MSC assigned this endpoint to */
+	struct nat_sccp_connection *con;
 };
 
 /**
@@ -233,6 +269,20 @@ struct bsc_nat_statistics {
 	struct {
 		struct osmo_counter *reconn;
 	} ussd;
+
+	struct {
+		struct osmo_counter *fast;
+		struct osmo_counter *slow;
+	} fwd;
+};
+
+/**
+ * A list of number rewrite rules. The rules are kept in the order of
+ * the file and are indexed by the literal start of their IMSI match.
+ */
+struct bsc_nat_num_rewr {
+	struct llist_head entries;
+	struct bsc_nat_num_rewr_node *index;
 };
 
 /**
@@ -268,8 +318,12 @@ struct bsc_nat {
 	struct llist_head dests;
 	struct bsc_msc_dest *main_dest;
 	struct bsc_msc_connection *msc_con;
+	struct bsc_nat_link msc_link;
 	char *token;
 
+	/* maximum number of queued messages per writev() */
+	int write_batch;
+
 	/* timeouts */
 	int auth_timeout;
 	int ping_timeout;
@@ -291,22 +345,23 @@ struct bsc_nat {
 
 	/* number rewriting */
 	char *num_rewr_name;
-	struct llist_head num_rewr;
+	struct bsc_nat_num_rewr num_rewr;
 	char *num_rewr_post_name;
-	struct llist_head num_rewr_post;
+	struct bsc_nat_num_rewr num_rewr_post;
 
 	char *smsc_rewr_name;
-	struct llist_head smsc_rewr;
+	struct bsc_nat_num_rewr smsc_rewr;
 	char *tpdest_match_name;
-	struct llist_head tpdest_match;
+	struct bsc_nat_num_rewr tpdest_match;
 	char *sms_clear_tp_srr_name;
-	struct llist_head sms_clear_tp_srr;
+	struct bsc_nat_num_rewr sms_clear_tp_srr;
 	char *sms_num_rewr_name;
-	struct llist_head sms_num_rewr;
+	struct bsc_nat_num_rewr sms_num_rewr;
 
 	/* more rewriting */
 	char *num_rewr_trie_name;
 	struct nat_rewrite *num_rewr_trie;
+	struct nat_rewrite_loader *num_rewr_trie_loader;
 
 	/* USSD messages  we want to match */
 	char *ussd_lst_name;
@@ -357,6 +412,7 @@ void bsc_close_connection(struct bsc_connection *);
 const char *bsc_con_type_to_string(int type);
 
 int bsc_nat_parse(struct msgb *msg, struct bsc_nat_parsed *parsed);
+int bsc_nat_parse_fast(struct msgb *msg, struct bsc_nat_parsed *parsed);
 
 /**
  * filter based on IP Access header in both directions
@@ -374,6 +430,8 @@ void remove_sccp_src_ref(struct bsc_connection *bsc, struct msgb *msg, struct bs
 struct nat_sccp_connection *patch_sccp_src_ref_to_bsc(struct msgb *, struct bsc_nat_parsed *, struct bsc_nat *);
 struct nat_sccp_connection *patch_sccp_src_ref_to_msc(struct msgb *, struct bsc_nat_parsed *, struct bsc_connection *);
 struct nat_sccp_connection *bsc_nat_find_con_by_bsc(struct bsc_nat *, struct sccp_source_reference *);
+struct nat_sccp_connection *bsc_nat_fast_path_to_msc(struct bsc_connection *, struct msgb *, struct bsc_nat_parsed *);
+struct nat_sccp_connection *bsc_nat_fast_path_to_bsc(struct bsc_nat *, struct msgb *, struct bsc_nat_parsed *);
 
 /**
  * MGCP/Audio handling
@@ -387,7 +445,7 @@ void bsc_mgcp_free_endpoints(struct bsc_nat *nat);
 int bsc_mgcp_nat_init(struct bsc_nat *nat);
 
 struct nat_sccp_connection *bsc_mgcp_find_con(struct bsc_nat *, int endpoint_number);
-struct msgb *bsc_mgcp_rewrite(char *input, int length, int endp, const char *ip,
+struct msgb *bsc_mgcp_rewrite(const char *input, int length, int endp, const char *ip,
 			      int port, int osmux, int *first_payload_type, int mode_set);
 void bsc_mgcp_forward(struct bsc_connection *bsc, struct msgb *msg);
 
@@ -401,6 +459,14 @@ int bsc_do_write(struct osmo_wqueue *queue, struct msgb *msg, int id);
 int bsc_write_msg(struct osmo_wqueue *queue, struct msgb *msg);
 int bsc_write_cb(struct osmo_fd *bfd, struct msgb *msg);
 
+int bsc_nat_link_init(void *ctx, struct bsc_nat_link *link);
+void bsc_nat_link_free(struct bsc_nat_link *link);
+void bsc_nat_link_reset(struct bsc_nat_link *link);
+int bsc_nat_link_read(struct bsc_nat_link *link, int fd);
+struct msgb *bsc_nat_link_dequeue(struct bsc_nat_link *link, int *rc);
+int bsc_nat_link_write(struct bsc_nat_link *link, struct osmo_fd *bfd,
+		       struct msgb *msg, int batch);
+
 int bsc_nat_msc_is_connected(struct bsc_nat *nat);
 
 int bsc_conn_type_to_ctr(struct nat_sccp_connection *conn);
@@ -413,6 +479,7 @@ int bsc_ussd_check(struct nat_sccp_connection *con, struct bsc_nat_parsed *parse
 int bsc_ussd_close_connections(struct bsc_nat *nat);
 
 struct msgb *bsc_nat_rewrite_msg(struct bsc_nat *nat, struct msgb *msg, struct bsc_nat_parsed *, const char *imsi);
+int bsc_nat_rewrite_configured(struct bsc_nat *nat);
 
 /** paging group handling */
 struct bsc_nat_paging_group *bsc_nat_paging_group_num(struct bsc_nat *nat, int group);
@@ -432,9 +499,21 @@ struct bsc_nat_num_rewr_entry {
 
 	char *replace;
 	uint8_t is_prefix_lookup;
+
+	/* position in the list */
+	unsigned int nr;
+
+	/*
+	 * Digits both expressions have to start with. If the IMSI
+	 * expression is nothing but its prefix regexec can be skipped.
+	 */
+	char imsi_prefix[16];
+	uint8_t imsi_prefix_only;
+	char num_prefix[32];
 };
 
-void bsc_nat_num_rewr_entry_adapt(void *ctx, struct llist_head *head, const struct osmo_config_list *);
+void bsc_nat_num_rewr_init(struct bsc_nat_num_rewr *rewr);
+void bsc_nat_num_rewr_entry_adapt(void *ctx, struct bsc_nat_num_rewr *rewr, const struct osmo_config_list *);
 
 void bsc_nat_send_mgcp_to_msc(struct bsc_nat *bsc_nat, struct msgb *msg);
 void bsc_nat_handle_mgcp(struct bsc_nat *bsc, struct msgb *msg);
@@ -16,8 +16,18 @@ struct bsc_subscr {
 	char imsi[GSM23003_IMSI_MAX_DIGITS+1];
 	uint32_t tmsi;
 	uint16_t lac;
+
+	/* list of struct gsm_paging_request pending for this subscriber */
+	struct llist_head paging_requests;
+
+	/* IMSI and TMSI hash index, see bsc_subscriber.c */
+	struct llist_head *list;
+	struct bsc_subscr *imsi_next;
+	struct bsc_subscr *tmsi_next;
 };
 
+struct llist_head *bsc_subscr_list_alloc(void *ctx);
+
 const char *bsc_subscr_name(struct bsc_subscr *bsub);
 
 struct bsc_subscr *bsc_subscr_find_or_create_by_imsi(struct llist_head *list,
@@ -31,6 +41,7 @@ struct bsc_subscr *bsc_subscr_find_by_tmsi(struct llist_head *list,
 					   uint32_t tmsi);
 
 void bsc_subscr_set_imsi(struct bsc_subscr *bsub, const char *imsi);
+void bsc_subscr_set_tmsi(struct bsc_subscr *bsub, uint32_t tmsi);
 
 struct bsc_subscr *_bsc_subscr_get(struct bsc_subscr *bsub,
 				   const char *file, int line);
@@ -0,0 +1,32 @@
+#ifndef _CTR_SNAPSHOT_H
+#define _CTR_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* One counter value. The names point into the counter descriptions and
+ * are only valid until the counter is freed. A plain osmo_counter has
+ * no prefix and an index of zero. */
+struct ctr_sample {
+	const char *prefix;
+	const char *name;
+	unsigned int idx;
+	uint64_t value;
+};
+
+/* All counters of the process at one point in time */
+struct ctr_snapshot {
+	time_t time;
+
+	struct ctr_sample *counters;
+	unsigned int num_counters;
+
+	struct ctr_sample *rate_ctrs;
+	unsigned int num_rate_ctrs;
+};
+
+int ctr_snapshot_take(void *ctx, struct ctr_snapshot *snap);
+int ctr_snapshot_write_csv(const struct ctr_snapshot *snap, FILE *file);
+
+#endif /* _CTR_SNAPSHOT_H */
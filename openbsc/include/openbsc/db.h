@@ -21,6 +21,7 @@
 #define _DB_H
 
 #include <stdbool.h>
+#include <time.h>
 
 #include "gsm_subscriber.h"
 
@@ -42,7 +43,10 @@ struct gsm_subscriber *db_create_subscriber(const char *imsi, uint64_t smin,
 struct gsm_subscriber *db_get_subscriber(enum gsm_subscriber_field field,
 					 const char *subscr);
 int db_sync_subscriber(struct gsm_subscriber *subscriber);
-int db_subscriber_expire(void *priv, void (*callback)(void *priv, long long unsigned int id));
+int db_subscriber_expire(void *priv,
+			 int (*callback)(void *priv, long long unsigned int id),
+			 unsigned int max);
+int db_subscriber_expire_backlog(void);
 int db_subscriber_alloc_tmsi(struct gsm_subscriber *subscriber);
 int db_subscriber_alloc_exten(struct gsm_subscriber *subscriber, uint64_t smin,
 			      uint64_t smax);
@@ -69,6 +73,11 @@ struct gsm_sms *db_sms_get(struct gsm_network *net, unsigned long long id);
 struct gsm_sms *db_sms_get_unsent(struct gsm_network *net, unsigned long long min_id);
 struct gsm_sms *db_sms_get_unsent_by_subscr(struct gsm_network *net, unsigned long long min_subscr_id, unsigned int failed);
 struct gsm_sms *db_sms_get_unsent_for_subscr(struct gsm_subscriber *subscr);
+int db_sms_get_unsent_batch(struct gsm_network *net,
+			    unsigned long long min_subscr_id,
+			    unsigned int failed,
+			    struct gsm_sms **sms, unsigned int max);
+unsigned long long db_query_count(void);
 int db_sms_mark_delivered(struct gsm_sms *sms);
 int db_sms_inc_deliver_attempts(struct gsm_sms *sms);
 
@@ -82,5 +91,9 @@ struct osmo_counter;
 int db_store_counter(struct osmo_counter *ctr);
 struct rate_ctr_group;
 int db_store_rate_ctr_group(struct rate_ctr_group *ctrg);
+struct ctr_snapshot;
+int db_store_ctr_snapshot(const struct ctr_snapshot *snap);
+int db_trim_counters(time_t now, unsigned int rollup_age,
+		     unsigned int max_age, unsigned int limit);
 
 #endif /* _DB_H */
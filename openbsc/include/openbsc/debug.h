@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 #include <osmocom/core/linuxlist.h>
 
 #define DEBUG
@@ -47,3 +48,43 @@ void log_set_filter_vlr_subscr(struct log_target *target,
 			       struct gsm_subscriber *vlr_subscr);
 
 extern const struct log_info log_info;
+
+/*
+ * The lowest level any log target might print for each category. It is
+ * rebuilt on the first message after the logging configuration changed,
+ * so LOGP and DEBUGP of a disabled category cost a compare and a branch
+ * instead of a walk over all targets and their filters.
+ */
+#define BSC_LOG_CACHE_SIZE	(Debug_LastEntry + OSMO_NUM_DLIB)
+
+extern uint8_t bsc_log_level_cache[BSC_LOG_CACHE_SIZE];
+extern int bsc_log_level_cache_valid;
+
+void bsc_log_level_cache_update(void);
+void bsc_log_level_cache_invalidate(void);
+
+static inline int bsc_log_check_level(int subsys, unsigned int level)
+{
+	/* the categories of the libraries are negative */
+	unsigned int idx = subsys < 0 ? Debug_LastEntry - 1 - subsys : subsys;
+
+	if (idx >= BSC_LOG_CACHE_SIZE)
+		return log_check_level(subsys, level);
+	if (!bsc_log_level_cache_valid)
+		bsc_log_level_cache_update();
+	return level >= bsc_log_level_cache[idx];
+}
+
+#undef LOGP
+#define LOGP(ss, level, fmt, args...) \
+	do { \
+		if (bsc_log_check_level(ss, level)) \
+			logp2(ss, level, __FILE__, __LINE__, 0, fmt, ##args); \
+	} while (0)
+
+#undef LOGPC
+#define LOGPC(ss, level, fmt, args...) \
+	do { \
+		if (bsc_log_check_level(ss, level)) \
+			logp2(ss, level, __FILE__, __LINE__, 1, fmt, ##args); \
+	} while (0)
@@ -116,6 +116,29 @@ struct neigh_meas_proc {
 	uint8_t rxlev[MAX_WIN_NEIGH_AVG];
 	unsigned int rxlev_cnt;
 	uint8_t last_seen_nr;
+	/* running sums of the newest rxlev values, maintained on every
+	 * update so the averages don't have to walk the ring */
+	unsigned int rxlev_sum_max;	/* over MAX_WIN_NEIGH_AVG values */
+	unsigned int rxlev_sum_win;	/* over rxlev_sum_win_len values */
+	uint8_t rxlev_sum_win_len;
+};
+
+/* entry of the network wide (ARFCN, BSIC) lookup table */
+struct gsm_bts_neigh_entry {
+	uint32_t key;
+	struct gsm_bts *bts;
+};
+
+/* entry of the network wide (LAC, CI) lookup table */
+struct gsm_bts_cell_entry {
+	uint32_t key;
+	struct gsm_bts *bts;
+};
+
+/* entry of the network wide IPA unit ID hash */
+struct gsm_bts_unitid_entry {
+	uint32_t key;
+	struct gsm_bts *bts;
 };
 
 enum ran_type {
@@ -180,6 +203,7 @@ struct gsm_subscriber_connection {
 enum {
 	BTS_STAT_CHAN_LOAD_AVERAGE,
 	BTS_STAT_T3122,
+	BTS_STAT_RACH_LOAD,
 };
 
 enum {
@@ -203,6 +227,12 @@ enum {
 	BSC_CTR_CODEC_EFR,
 	BSC_CTR_CODEC_V1_FR,
 	BSC_CTR_CODEC_V1_HR,
+	BSC_CTR_CHREQ_STORM,
+	BSC_CTR_CHREQ_LOG_SUPPRESSED,
+	BSC_CTR_CHREQ_REJ_MSGS,
+	BSC_CTR_PAGING_REFRESHED,
+	BSC_CTR_PAGING_BTS_PAGED,
+	BSC_CTR_PCU_DROPPED,
 };
 
 static const struct rate_ctr_desc bsc_ctr_description[] = {
@@ -226,6 +256,12 @@ static const struct rate_ctr_desc bsc_ctr_description[] = {
 	[BSC_CTR_CODEC_EFR] = 			{"bts:codec_efr", "Count the usage of EFR codec by channel mode requested."},
 	[BSC_CTR_CODEC_V1_FR] =			{"bts:codec_fr", "Count the usage of FR codec by channel mode requested."},
 	[BSC_CTR_CODEC_V1_HR] =			{"bts:codec_hr", "Count the usage of HR codec by channel mode requested."},
+	[BSC_CTR_CHREQ_STORM] = 		{"chreq:storm", "Detected bursts of channel requests."},
+	[BSC_CTR_CHREQ_LOG_SUPPRESSED] = 	{"chreq:log_suppressed", "Channel request log messages suppressed during a burst."},
+	[BSC_CTR_CHREQ_REJ_MSGS] = 		{"chreq:rej_msgs", "Sent IMMEDIATE ASSIGNMENT REJECT messages."},
+	[BSC_CTR_PAGING_REFRESHED] = 		{"paging:refreshed", "Repeated paging for a MS already being paged."},
+	[BSC_CTR_PAGING_BTS_PAGED] = 		{"paging:bts_paged", "BTS a paging was started on, summed over all paging attempts."},
+	[BSC_CTR_PCU_DROPPED] =			{"pcu:dropped", "Messages to the PCU dropped because its queue was full."},
 };
 
 enum {
@@ -248,6 +284,7 @@ enum {
 	MSC_CTR_CALL_ACTIVE,
 	MSC_CTR_CALL_COMPLETE,
 	MSC_CTR_CALL_INCOMPLETE,
+	MSC_CTR_SUBSCR_EXPIRED,
 };
 
 static const struct rate_ctr_desc msc_ctr_description[] = {
@@ -271,6 +308,7 @@ static const struct rate_ctr_desc msc_ctr_description[] = {
 	[MSC_CTR_CALL_ACTIVE] =			{"call:active", "Count total amount of calls that ever reached active state."},
 	[MSC_CTR_CALL_COMPLETE] = 		{"call:complete", "Count total amount of calls which got terminated by disconnect req or ind after reaching active state."},
 	[MSC_CTR_CALL_INCOMPLETE] = 		{"call:incomplete", "Count total amount of call which got terminated by any other reason after reaching active state."},
+	[MSC_CTR_SUBSCR_EXPIRED] = 		{"subscr:expired", "Subscribers detached because their location update expired."},
 };
 
 
@@ -310,6 +348,9 @@ enum gsm_auth_policy {
 #define GSM_T3122_DEFAULT 10
 #define GSM_T3141_DEFAULT 10
 
+/* CHAN RQD per second and BTS that engage the RACH load controller */
+#define GSM_RACH_STORM_THRESHOLD_DEFAULT 100
+
 struct gsm_tz {
 	int override; /* if 0, use system's time zone instead. */
 	int hr; /* hour */
@@ -359,6 +400,21 @@ struct gsm_network {
 
 	unsigned int num_bts;
 	struct llist_head bts_list;
+	/* (ARFCN, BSIC) -> BTS, built on demand and dropped whenever ARFCN
+	 * or BSIC of a BTS in bts_list changes */
+	struct gsm_bts_neigh_entry *neigh_tbl;
+	unsigned int neigh_tbl_len;
+	/* (LAC, CI) -> BTS, built on demand and dropped whenever LAC or CI
+	 * of a BTS in bts_list changes */
+	struct gsm_bts_cell_entry *cell_tbl;
+	unsigned int cell_tbl_len;
+	/* BTS by number, grows with bts_list */
+	struct gsm_bts **bts_by_nr;
+	unsigned int bts_by_nr_size;
+	/* IPA unit ID -> BTS, built on demand and dropped whenever the
+	 * unit ID or the type of a BTS in bts_list changes */
+	struct gsm_bts_unitid_entry *unitid_tbl;
+	unsigned int unitid_tbl_mask;
 
 	/* timer values */
 	int T3101;
@@ -376,6 +432,8 @@ struct gsm_network {
 
 	/* timer to expire old location updates */
 	struct osmo_timer_list subscr_expire_timer;
+	/* subscribers left to expire after the last run */
+	unsigned int subscr_expire_backlog;
 
 	/* Timer for periodic channel load measurements to maintain each BTS's T3122. */
 	struct osmo_timer_list t3122_chan_load_timer;
@@ -421,7 +479,8 @@ struct gsm_network {
 	struct gsm_tz tz;
 
 	/* List of all struct bsc_subscr used in libbsc. This llist_head is
-	 * allocated so that the llist_head pointer itself can serve as a
+	 * allocated by bsc_subscr_list_alloc(), which keeps the lookup
+	 * tables next to it, so that the llist_head pointer itself can serve as a
 	 * talloc context (useful to not have to pass the entire gsm_network
 	 * struct to the bsc_subscr_* API, and for bsc_susbscr unit tests to
 	 * not require gsm_data.h). In an MSC-without-BSC environment, this
@@ -497,11 +556,18 @@ int gsm_set_bts_type(struct gsm_bts *bts, enum gsm_bts_type type);
 /* Get reference to a neighbor cell on a given BCCH ARFCN */
 struct gsm_bts *gsm_bts_neighbor(const struct gsm_bts *bts,
 				 uint16_t arfcn, uint8_t bsic);
+void gsm_net_neigh_tbl_invalidate(struct gsm_network *net);
 
 enum gsm_bts_type parse_btstype(const char *arg);
 const char *btstype2str(enum gsm_bts_type type);
 struct gsm_bts *gsm_bts_by_lac(struct gsm_network *net, unsigned int lac,
 				struct gsm_bts *start_bts);
+int gsm_bts_by_lac_ci(struct gsm_network *net, uint16_t lac, int ci,
+		      const struct gsm_bts_cell_entry **first);
+void gsm_net_cell_tbl_invalidate(struct gsm_network *net);
+struct gsm_bts *gsm_bts_by_unitid(struct gsm_network *net, uint16_t site_id,
+				  uint16_t bts_id);
+void gsm_net_unitid_tbl_invalidate(struct gsm_network *net);
 
 extern void *tall_bsc_ctx;
 extern int ipacc_rtp_direct;
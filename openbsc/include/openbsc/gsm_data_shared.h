@@ -100,6 +100,7 @@ struct gsm_mncc;
 struct osmo_rtp_socket;
 struct rtp_socket;
 struct bsc_api;
+struct bsc_handover;
 
 /* Network Management State */
 struct gsm_nm_state {
@@ -288,6 +289,12 @@ struct gsm_lchan {
 
 	struct gsm_subscriber_connection *conn;
 
+	/* pending RLL establishment requests, see bsc_rll.c */
+	struct llist_head rll_reqs;
+	/* handover away from and onto this lchan */
+	struct bsc_handover *ho_from;
+	struct bsc_handover *ho_to;
+
 	struct {
 		/* channel activation type and handover ref */
 		uint8_t act_type;
@@ -924,6 +931,35 @@ struct gsm_bts {
 	int chan_load_samples_idx;
 	uint8_t chan_load_avg; /* current channel load average in percent (0 - 100). */
 
+	/* RACH load controller: detects bursts of CHAN RQD, coalesces
+	 * IMMEDIATE ASSIGNMENT REJECTs and summarizes per-request logging. */
+	struct {
+		/* CHAN RQD per second to consider a storm, 0 to disable */
+		unsigned int threshold;
+		/* scale the wait indication with the observed load */
+		bool dynamic_t3122;
+
+		/* current one second measurement window */
+		struct timeval window_start;
+		unsigned int window_rqd;
+		unsigned int window_rej;
+		unsigned int window_rej_msgs;
+		unsigned int window_log_suppressed;
+		/* CHAN RQD count of the last completed window */
+		unsigned int rate;
+		bool storm;
+
+		/* (lctype, is_lu) combinations lchan_alloc() has failed
+		 * for since the last lchan_free() on this BTS */
+		uint32_t alloc_failed;
+
+		/* request references waiting for a shared IMM ASS REJ */
+		struct gsm48_req_ref rej_ref[4];
+		uint8_t rej_wait_ind[4];
+		unsigned int rej_count;
+		struct osmo_timer_list rej_timer;
+	} rach_load;
+
 #endif /* ROLE_BSC */
 	void *role;
 };
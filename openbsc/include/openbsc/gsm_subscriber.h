@@ -19,9 +19,13 @@
 
 #define GSM_SUBSCRIBER_NO_EXPIRATION	0x0
 
+/* the most subscribers to expire in one go */
+#define SUBSCR_EXPIRE_BATCH	256
+
 struct vty;
 
 struct subscr_request;
+struct subscr_ext_entry;
 
 struct gsm_subscriber_group {
 	struct gsm_network *net;
@@ -65,6 +69,11 @@ struct gsm_subscriber {
 	/* for internal management */
 	int use_count;
 	struct llist_head entry;
+	struct subscr_ext_entry *ext_entry;
+
+	/* the oldest connection using this subscriber, if any */
+	struct gsm_subscriber_connection *conn;
+	int num_conns;
 
 	/* pending requests */
 	int is_paging;
@@ -101,14 +110,24 @@ struct gsm_subscriber *subscr_get_or_create(struct gsm_subscriber_group *sgrp,
 int subscr_update(struct gsm_subscriber *s, struct gsm_bts *bts, int reason);
 struct gsm_subscriber *subscr_active_by_tmsi(struct gsm_subscriber_group *sgrp,
 					     uint32_t tmsi);
+struct gsm_subscriber *subscr_active_by_id(struct gsm_subscriber_group *sgrp,
+					   unsigned long long id);
 struct gsm_subscriber *subscr_active_by_imsi(struct gsm_subscriber_group *sgrp,
 					     const char *imsi);
 
 char *subscr_name(struct gsm_subscriber *subscr);
 
 int subscr_purge_inactive(struct gsm_subscriber_group *sgrp);
+struct gsm_subscriber *subscr_ext_lookup(const char *ext, bool *absent);
+void subscr_ext_add(struct gsm_subscriber *subscr);
+void subscr_ext_add_absent(const char *ext);
+void subscr_ext_update(struct gsm_subscriber *subscr);
+void subscr_ext_invalidate(struct gsm_subscriber *subscr);
+void subscr_con_attach(struct gsm_subscriber_connection *conn,
+		       struct gsm_subscriber *subscr);
+struct gsm_subscriber *subscr_con_detach(struct gsm_subscriber_connection *conn);
 void subscr_update_from_db(struct gsm_subscriber *subscr);
-void subscr_expire(struct gsm_subscriber_group *sgrp);
+int subscr_expire(struct gsm_subscriber_group *sgrp);
 int subscr_update_expire_lu(struct gsm_subscriber *subscr, struct gsm_bts *bts);
 
 /*
@@ -31,11 +31,66 @@ struct meas_feed_meas {
 	uint8_t ss_nr;
 };
 
+/*
+ * Version 2 packs many fixed layout records into one datagram. There is
+ * no padding and all multi-byte fields after the common header are in
+ * network byte order. hdr.version stays in host byte order like in
+ * version 1, so both can be told apart the same way. A decoder must use
+ * rec_len to step over records so that fields can be appended in the
+ * future.
+ */
+struct meas_feed_batch {
+	struct meas_feed_hdr hdr;
+	/* sequence number of the datagram to detect losses */
+	uint32_t seq;
+	uint16_t num_rec;
+	uint16_t rec_len;
+	char scenario[31+1];
+	uint8_t data[0];
+} __attribute__((packed));
+
+struct meas_feed_cell {
+	uint16_t arfcn;
+	uint8_t bsic;
+	uint8_t rxlev;
+} __attribute__((packed));
+
+struct meas_feed_rec {
+	/* the IMSI as a decimal number */
+	uint64_t imsi;
+	uint8_t bts_nr;
+	uint8_t trx_nr;
+	uint8_t ts_nr;
+	uint8_t ss_nr;
+	uint8_t lchan_type;
+	uint8_t pchan_type;
+	/* number of the measurement report */
+	uint8_t nr;
+	/* MEAS_REP_F_* */
+	uint8_t flags;
+	uint8_t ul_full_rx_lev;
+	uint8_t ul_full_rx_qual;
+	uint8_t ul_sub_rx_lev;
+	uint8_t ul_sub_rx_qual;
+	uint8_t dl_full_rx_lev;
+	uint8_t dl_full_rx_qual;
+	uint8_t dl_sub_rx_lev;
+	uint8_t dl_sub_rx_qual;
+	uint8_t bs_power;
+	int8_t ms_pwr;
+	uint8_t ms_ta;
+	uint8_t num_cell;
+	int16_t ms_timing_offset;
+	struct meas_feed_cell cell[6];
+} __attribute__((packed));
+
 enum meas_feed_msgtype {
 	MEAS_FEED_MEAS		= 0,
+	MEAS_FEED_MEAS_BATCH	= 1,
 };
 
 #define MEAS_FEED_VERSION	1
+#define MEAS_FEED_VERSION_BATCH	2
 
 
 #endif
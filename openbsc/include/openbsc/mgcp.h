@@ -69,6 +69,7 @@ struct mgcp_endpoint;
 struct mgcp_config;
 struct mgcp_trunk_config;
 struct mgcp_rtp_end;
+struct mgcp_trans_cache;
 
 #define MGCP_ENDP_CRCX 1
 #define MGCP_ENDP_DLCX 2
@@ -242,6 +243,9 @@ struct mgcp_config {
 	/* Minimum and maximum buffer size for the jitter buffer, in ms */
 	uint32_t bts_jitter_delay_min;
 	uint32_t bts_jitter_delay_max;
+
+	/* responses for answering retransmitted commands */
+	struct mgcp_trans_cache *trans_cache;
 };
 
 /* config management */
@@ -182,9 +182,8 @@ struct mgcp_endpoint {
 	struct mgcp_rtp_state net_state;
 	struct mgcp_rtp_state bts_state;
 
-	/* fields for re-transmission */
-	char *last_trans;
-	char *last_response;
+	/* bumped on allocation and release to scope transaction ids */
+	uint32_t trans_gen;
 
 	/* tap for the endpoint */
 	struct mgcp_rtp_tap taps[MGCP_TAP_COUNT];
@@ -328,6 +327,14 @@ enum {
 #define DEFAULT_RTP_AUDIO_DEFAULT_CHANNELS 1
 
 #define PTYPE_UNDEFINED (-1)
+const char *mgcp_trans_cache_lookup(struct mgcp_config *cfg,
+				    const struct mgcp_endpoint *endp,
+				    const char *trans, size_t *len);
+void mgcp_trans_cache_store(struct mgcp_config *cfg,
+			    const struct mgcp_endpoint *endp,
+			    const char *trans, const char *resp, size_t len);
+unsigned int mgcp_trans_cache_hits(const struct mgcp_config *cfg);
+
 int mgcp_parse_sdp_data(struct mgcp_endpoint *endp, struct mgcp_rtp_end *rtp, struct mgcp_parse_data *p);
 int mgcp_set_audio_info(void *ctx, struct mgcp_rtp_codec *codec,
 			int payload_type, const char *audio_name);
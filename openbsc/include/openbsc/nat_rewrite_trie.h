@@ -20,28 +20,49 @@
 #ifndef NAT_REWRITE_FILE_H
 #define NAT_REWRITE_FILE_H
 
-#include <osmocom/core/linuxrbtree.h>
+#include <stdint.h>
+#include <stddef.h>
 
 struct vty;
+struct nat_rewrite_loader;
 
 struct nat_rewrite_rule {
-	/* For digits 0-9 and + */
-	struct nat_rewrite_rule *rules[11];
-
-	char empty;
 	char prefix[14];
 	char rewrite[6];
 };
 
+/*
+ * A node of the compact trie. The children of a node are stored next
+ * to each other starting at first_child. The bitmap tells which of the
+ * digits 0-9 and + are present.
+ */
+struct nat_rewrite_node {
+	uint32_t first_child;
+	/* index into the rules plus one, zero for an empty node */
+	uint32_t rule;
+	uint16_t children;
+};
+
 struct nat_rewrite {
-	struct nat_rewrite_rule rule;
 	size_t prefixes;
+	size_t nodes;
+
+	const struct nat_rewrite_node *node;
+	const struct nat_rewrite_rule *rules;
+
+	/* the nodes and rules are stored in one image */
+	const void *image;
+	size_t image_len;
 };
 
+typedef void (*nat_rewrite_loaded_cb)(struct nat_rewrite *rewr, void *data);
 
 struct nat_rewrite *nat_rewrite_parse(void *ctx, const char *filename);
-struct nat_rewrite_rule *nat_rewrite_lookup(struct nat_rewrite *, const char *prefix);
-void nat_rewrite_dump(struct nat_rewrite *rewr);
-void nat_rewrite_dump_vty(struct vty *vty, struct nat_rewrite *rewr);
+struct nat_rewrite_loader *nat_rewrite_parse_bg(void *ctx, const char *filename,
+						nat_rewrite_loaded_cb cb, void *data);
+const struct nat_rewrite_rule *nat_rewrite_lookup(const struct nat_rewrite *,
+						  const char *prefix);
+void nat_rewrite_dump(const struct nat_rewrite *rewr);
+void nat_rewrite_dump_vty(struct vty *vty, const struct nat_rewrite *rewr);
 
 #endif
@@ -24,8 +24,9 @@ struct osmo_bsc_sccp_con {
 
 	int ciphering_handled;
 
-	/* for audio handling */
+	/* for audio handling, see bsc_sccp_con_set_cic */
 	uint16_t cic;
+	struct llist_head cic_entry;
 	int rtp_port;
 
 	/* for advanced ping/pong */
@@ -53,6 +54,8 @@ int bsc_open_connection(struct osmo_bsc_sccp_con *sccp, struct msgb *msg);
 enum bsc_con bsc_create_new_connection(struct gsm_subscriber_connection *conn,
 				       struct bsc_msc_data *msc, int send_ping);
 int bsc_delete_connection(struct osmo_bsc_sccp_con *sccp);
+void bsc_sccp_con_set_cic(struct osmo_bsc_sccp_con *sccp, uint16_t cic);
+struct osmo_bsc_sccp_con *bsc_sccp_con_find_by_cic(uint16_t cic);
 
 struct bsc_msc_data *bsc_find_msc(struct gsm_subscriber_connection *conn, struct msgb *);
 int bsc_scan_bts_msg(struct gsm_subscriber_connection *conn, struct msgb *msg);
@@ -60,6 +63,7 @@ int bsc_scan_msc_msg(struct gsm_subscriber_connection *conn, struct msgb *msg);
 int bsc_send_welcome_ussd(struct gsm_subscriber_connection *conn);
 
 int bsc_handle_udt(struct bsc_msc_data *msc, struct msgb *msg, unsigned int length);
+int bssmap_send_reset_ack(struct bsc_msc_data *msc);
 int bsc_handle_dt1(struct osmo_bsc_sccp_con *conn, struct msgb *msg, unsigned int len);
 
 int bsc_ctrl_cmds_install();
@@ -28,6 +28,7 @@
 
 #include <openbsc/gsm_data.h>
 #include <openbsc/bsc_subscriber.h>
+#include <openbsc/timer_wheel.h>
 
 /**
  * A pending paging request
@@ -35,6 +36,8 @@
 struct gsm_paging_request {
 	/* list_head for list of all paging requests */
 	struct llist_head entry;
+	/* list_head for the requests of one subscriber */
+	struct llist_head bsub_entry;
 	/* the subscriber which we're paging. Later gsm_paging_request
 	 * should probably become a part of the bsc_subsrc struct? */
 	struct bsc_subscr *bsub;
@@ -44,7 +47,7 @@ struct gsm_paging_request {
 	int chan_type;
 
 	/* Timer 3113: how long do we try to page? */
-	struct osmo_timer_list T3113;
+	struct wheel_timer T3113;
 
 	/* How often did we ask the BTS to page? */
 	int attempts;
@@ -60,6 +63,9 @@ int paging_request(struct gsm_network *network, struct bsc_subscr *bsub,
 int paging_request_bts(struct gsm_bts *bts, struct bsc_subscr *bsub,
 		       int type, gsm_cbfn *cbfn, void *data);
 
+/* restart the requests already pending for a subscriber */
+int paging_request_refresh(struct bsc_subscr *bsub);
+
 /* stop paging requests */
 void paging_request_stop(struct llist_head *bts_list,
 			 struct gsm_bts *_bts, struct bsc_subscr *bsub,
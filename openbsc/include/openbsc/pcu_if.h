@@ -1,15 +1,26 @@
 #ifndef _PCU_IF_H
 #define _PCU_IF_H
 
+#include <time.h>
+
 #include <osmocom/gsm/l1sap.h>
 
 extern int pcu_direct;
 
+struct gsm_pcu_if;
+
+/* messages queued for a PCU that does not read */
+#define PCU_SOCK_QUEUE_MAX	1024
+
 struct pcu_sock_state {
 	struct gsm_network *net;
 	struct osmo_fd listen_bfd;	/* fd for listen socket */
 	struct osmo_fd conn_bfd;	/* fd for connection to lcr */
 	struct llist_head upqueue;	/* queue for sending messages */
+	unsigned int upqueue_len;	/* messages in the upqueue */
+	unsigned int drops;		/* dropped since the last log */
+	time_t drop_log_time;		/* when the drops were logged */
+	struct gsm_pcu_if *rx_buf;	/* primitives read in one go */
 };
 
 /* PCU relevant information has changed; Inform PCU (if connected) */
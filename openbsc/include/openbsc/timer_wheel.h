@@ -0,0 +1,60 @@
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/timer.h>
+
+/*
+ * A hierarchical timer wheel for timeouts that are armed and cancelled
+ * far more often than they expire and that do not need more precision
+ * than a tick. Arming and cancelling is O(1) and the whole wheel is
+ * driven by a single osmo_timer_list.
+ */
+
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SLOTS	(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS	4
+
+/* the tick of the default wheel in milliseconds */
+#define TIMER_WHEEL_TICK_MS	100
+
+struct timer_wheel {
+	struct llist_head slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+	/* length of a tick, the tick the wheel is at and the one it is
+	 * advancing to, they only differ while a late tick catches up */
+	unsigned int tick_ms;
+	uint32_t now;
+	uint32_t until;
+
+	/* monotonic time of the tick the wheel is advancing to */
+	struct timespec last;
+	struct osmo_timer_list timer;
+
+	unsigned int pending;
+};
+
+struct wheel_timer {
+	struct llist_head entry;
+	struct timer_wheel *wheel;
+	uint32_t expires;
+	int active;
+
+	void (*cb)(void *data);
+	void *data;
+};
+
+void timer_wheel_init(struct timer_wheel *wheel, unsigned int tick_ms);
+struct timer_wheel *timer_wheel_default(void);
+
+void wheel_timer_setup(struct wheel_timer *timer, struct timer_wheel *wheel,
+		       void (*cb)(void *data), void *data);
+void wheel_timer_schedule(struct wheel_timer *timer, int seconds,
+			  int microseconds);
+void wheel_timer_del(struct wheel_timer *timer);
+int wheel_timer_pending(const struct wheel_timer *timer);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _TMSI_SET_H
+#define _TMSI_SET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* A set of TMSIs in use, with GSM_RESERVED_TMSI marking a free slot */
+struct tmsi_set {
+	uint32_t *slots;
+	unsigned int size;
+	unsigned int count;
+};
+
+void tmsi_set_clear(struct tmsi_set *set);
+int tmsi_set_add(struct tmsi_set *set, uint32_t tmsi);
+bool tmsi_set_contains(const struct tmsi_set *set, uint32_t tmsi);
+int tmsi_set_alloc(struct tmsi_set *set, uint32_t *tmsi);
+
+#endif /* _TMSI_SET_H */
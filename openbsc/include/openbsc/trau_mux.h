@@ -68,3 +68,6 @@ void trau_encode_fr(struct decoded_trau_frame *tf,
 	const unsigned char *data);
 void trau_encode_efr(struct decoded_trau_frame *tf,
 	const unsigned char *data);
+
+/* uplink to downlink without decoding the frame */
+int trau_up2down_bits(uint8_t *out, const uint8_t *in);
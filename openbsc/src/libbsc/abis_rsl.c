@@ -1750,13 +1750,15 @@ static void t3109_expired(void *data)
 }
 
 /* Format an IMM ASS REJ according to 04.08 Chapter 9.1.20 */
-static int rsl_send_imm_ass_rej(struct gsm_bts *bts,
+static int rsl_send_imm_ass_rej(struct gsm_bts *bts, unsigned int num,
 				struct gsm48_req_ref *rqd_ref,
-				uint8_t wait_ind)
+				uint8_t *wait_ind)
 {
 	uint8_t buf[GSM_MACBLOCK_LEN];
 	struct gsm48_imm_ass_rej *iar = (struct gsm48_imm_ass_rej *)buf;
 
+	OSMO_ASSERT(num >= 1 && num <= 4);
+
 	/* create IMMEDIATE ASSIGN REJECT 04.08 message */
 	memset(iar, 0, sizeof(*iar));
 	iar->proto_discr = GSM48_PDISC_RR;
@@ -1764,29 +1766,200 @@ static int rsl_send_imm_ass_rej(struct gsm_bts *bts,
 	iar->page_mode = GSM48_PM_SAME;
 
 	/*
-	 * Set all request references and wait indications to the same value.
 	 * 3GPP TS 44.018 v4.5.0 release 4 (section 9.1.20.2) requires that
-	 * we duplicate reference and wait indication to fill the message.
-	 * The BTS will aggregate up to 4 of our ASS REJ messages if possible.
+	 * all four request references and wait indications are present.
+	 * Unused ones are filled by duplicating the last one we have.
 	 */
-	memcpy(&iar->req_ref1, rqd_ref, sizeof(iar->req_ref1));
-	iar->wait_ind1 = wait_ind;
+#define REJ_IDX(n)	((n) < num ? (n) : num - 1)
+	memcpy(&iar->req_ref1, &rqd_ref[REJ_IDX(0)], sizeof(iar->req_ref1));
+	iar->wait_ind1 = wait_ind[REJ_IDX(0)];
 
-	memcpy(&iar->req_ref2, rqd_ref, sizeof(iar->req_ref2));
-	iar->wait_ind2 = wait_ind;
+	memcpy(&iar->req_ref2, &rqd_ref[REJ_IDX(1)], sizeof(iar->req_ref2));
+	iar->wait_ind2 = wait_ind[REJ_IDX(1)];
 
-	memcpy(&iar->req_ref3, rqd_ref, sizeof(iar->req_ref3));
-	iar->wait_ind3 = wait_ind;
+	memcpy(&iar->req_ref3, &rqd_ref[REJ_IDX(2)], sizeof(iar->req_ref3));
+	iar->wait_ind3 = wait_ind[REJ_IDX(2)];
 
-	memcpy(&iar->req_ref4, rqd_ref, sizeof(iar->req_ref4));
-	iar->wait_ind4 = wait_ind;
+	memcpy(&iar->req_ref4, &rqd_ref[REJ_IDX(3)], sizeof(iar->req_ref4));
+	iar->wait_ind4 = wait_ind[REJ_IDX(3)];
+#undef REJ_IDX
 
 	/* we need to subtract 1 byte from sizeof(*iar) since ia includes the l2_plen field */
 	iar->l2_plen = GSM48_LEN2PLEN((sizeof(*iar)-1));
 
+	rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_CHREQ_REJ_MSGS]);
+	bts->rach_load.window_rej_msgs++;
+
 	return rsl_imm_assign_cmd(bts, sizeof(*iar), (uint8_t *) iar);
 }
 
+/*
+ * RACH load controller
+ *
+ * After an outage a whole cell full of MS will access the RACH at the
+ * same time. While the number of CHAN RQD per second exceeds the
+ * configured threshold we consider the BTS to be in a RACH storm and
+ * a) coalesce up to four rejects into one IMM ASS REJ to save AGCH
+ * blocks, b) replace the per-request log messages by a summary per
+ * second, c) do not retry lchan_alloc() for a channel type that was
+ * found to be exhausted and d) optionally scale T3122 with the load.
+ */
+
+/* length of the measurement window */
+#define RACH_LOAD_WINDOW_SEC	1
+/* how long a partially filled IMM ASS REJ waits for more references */
+#define RACH_REJ_FLUSH_USEC	50000
+/* upper limit of the load dependent wait indication, ~2 minutes */
+#define RACH_DYN_T3122_MAX	128
+
+static void rach_load_rej_flush(struct gsm_bts *bts)
+{
+	osmo_timer_del(&bts->rach_load.rej_timer);
+
+	if (!bts->rach_load.rej_count)
+		return;
+
+	rsl_send_imm_ass_rej(bts, bts->rach_load.rej_count,
+			     bts->rach_load.rej_ref, bts->rach_load.rej_wait_ind);
+	bts->rach_load.rej_count = 0;
+}
+
+static void rach_load_rej_timer_cb(void *data)
+{
+	rach_load_rej_flush(data);
+}
+
+static void rach_load_window_close(struct gsm_bts *bts, struct timeval *now)
+{
+	struct timeval elapsed;
+	uint64_t elapsed_ms;
+
+	timersub(now, &bts->rach_load.window_start, &elapsed);
+	elapsed_ms = elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
+	if (elapsed_ms < RACH_LOAD_WINDOW_SEC * 1000)
+		elapsed_ms = RACH_LOAD_WINDOW_SEC * 1000;
+
+	/* normalize in case no CHAN RQD arrived for a while */
+	bts->rach_load.rate = (uint64_t) bts->rach_load.window_rqd * 1000 / elapsed_ms;
+	osmo_stat_item_set(bts->bts_statg->items[BTS_STAT_RACH_LOAD],
+			   bts->rach_load.rate);
+
+	if (bts->rach_load.storm) {
+		LOGP(DRSL, LOGL_NOTICE, "(bts=%d) RACH storm: %u CHAN RQD, "
+		     "%u rejected in %u IMM ASS REJ, %u log messages suppressed\n",
+		     bts->nr, bts->rach_load.window_rqd,
+		     bts->rach_load.window_rej, bts->rach_load.window_rej_msgs,
+		     bts->rach_load.window_log_suppressed);
+
+		/* some hysteresis to not flap around the threshold */
+		if (bts->rach_load.rate <= bts->rach_load.threshold / 2) {
+			LOGP(DRSL, LOGL_NOTICE, "(bts=%d) RACH storm is over\n",
+			     bts->nr);
+			bts->rach_load.storm = false;
+			rach_load_rej_flush(bts);
+		}
+	}
+
+	bts->rach_load.window_start = *now;
+	bts->rach_load.window_rqd = 0;
+	bts->rach_load.window_rej = 0;
+	bts->rach_load.window_rej_msgs = 0;
+	bts->rach_load.window_log_suppressed = 0;
+
+	/* timeslots might have become usable without a lchan_free() */
+	bts->rach_load.alloc_failed = 0;
+}
+
+/* Account a CHAN RQD, returns true while the BTS is in a RACH storm */
+static bool rach_load_account(struct gsm_bts *bts)
+{
+	struct timeval now, elapsed;
+
+	osmo_gettimeofday(&now, NULL);
+	timersub(&now, &bts->rach_load.window_start, &elapsed);
+	if (elapsed.tv_sec >= RACH_LOAD_WINDOW_SEC || elapsed.tv_sec < 0)
+		rach_load_window_close(bts, &now);
+
+	bts->rach_load.window_rqd++;
+
+	if (!bts->rach_load.threshold) {
+		/* disabled while a storm was going on */
+		if (bts->rach_load.storm) {
+			bts->rach_load.storm = false;
+			rach_load_rej_flush(bts);
+		}
+		return false;
+	}
+
+	if (!bts->rach_load.storm
+	    && bts->rach_load.window_rqd > bts->rach_load.threshold) {
+		LOGP(DRSL, LOGL_NOTICE, "(bts=%d) RACH storm: more than %u "
+		     "CHAN RQD per second, coalescing rejects\n",
+		     bts->nr, bts->rach_load.threshold);
+		rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_CHREQ_STORM]);
+		bts->rach_load.storm = true;
+	}
+
+	return bts->rach_load.storm;
+}
+
+static void rach_load_log_suppressed(struct gsm_bts *bts)
+{
+	bts->rach_load.window_log_suppressed++;
+	rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_CHREQ_LOG_SUPPRESSED]);
+}
+
+static uint8_t rach_load_wait_ind(struct gsm_bts *bts)
+{
+	unsigned int wait_ind, load;
+
+	if (bts->T3122)
+		wait_ind = bts->T3122;
+	else if (bts->network->T3122)
+		wait_ind = bts->network->T3122 & 0xff;
+	else
+		wait_ind = GSM_T3122_DEFAULT;
+
+	if (!bts->rach_load.storm || !bts->rach_load.dynamic_t3122)
+		return wait_ind;
+
+	/* stretch the wait indication by how far we are above the threshold */
+	load = OSMO_MAX(bts->rach_load.rate, bts->rach_load.window_rqd);
+	load = wait_ind * load / bts->rach_load.threshold;
+	if (load > RACH_DYN_T3122_MAX)
+		load = RACH_DYN_T3122_MAX;
+	return OSMO_MAX(wait_ind, load);
+}
+
+static void rach_load_reject(struct gsm_bts *bts, struct gsm48_req_ref *rqd_ref)
+{
+	uint8_t wait_ind = rach_load_wait_ind(bts);
+	unsigned int idx;
+
+	bts->rach_load.window_rej++;
+
+	if (!bts->rach_load.storm) {
+		rsl_send_imm_ass_rej(bts, 1, rqd_ref, &wait_ind);
+		return;
+	}
+
+	idx = bts->rach_load.rej_count++;
+	memcpy(&bts->rach_load.rej_ref[idx], rqd_ref, sizeof(*rqd_ref));
+	bts->rach_load.rej_wait_ind[idx] = wait_ind;
+
+	if (bts->rach_load.rej_count == ARRAY_SIZE(bts->rach_load.rej_ref)) {
+		rach_load_rej_flush(bts);
+		return;
+	}
+
+	if (!osmo_timer_pending(&bts->rach_load.rej_timer)) {
+		osmo_timer_setup(&bts->rach_load.rej_timer,
+				 rach_load_rej_timer_cb, bts);
+		osmo_timer_schedule(&bts->rach_load.rej_timer, 0,
+				    RACH_REJ_FLUSH_USEC);
+	}
+}
+
 /* Handle packet channel rach requests */
 static int rsl_rx_pchan_rqd(struct msgb *msg, struct gsm_bts *bts)
 {
@@ -1832,6 +2005,8 @@ static int rsl_rx_chan_rqd(struct msgb *msg)
 	struct gsm_lchan *lchan;
 	uint8_t rqd_ta;
 	int is_lu;
+	uint32_t alloc_bit;
+	bool storm;
 
 	uint16_t arfcn;
 	uint8_t subch;
@@ -1847,12 +2022,16 @@ static int rsl_rx_chan_rqd(struct msgb *msg)
 		return -EINVAL;
 	rqd_ta = rqd_hdr->data[sizeof(struct gsm48_req_ref)+2];
 
+	storm = rach_load_account(bts);
+
 	/* Determine channel request cause code */
 	chreq_reason = get_reason_by_chreq(rqd_ref->ra, bts->network->neci);
-	LOGP(DRSL, LOGL_NOTICE, "(bts=%d) CHAN RQD: reason: %s (ra=0x%02x, neci=0x%02x, chreq_reason=0x%02x)\n",
-	     msg->lchan->ts->trx->bts->nr,
-	     get_value_string(gsm_chreq_descs, chreq_reason),
-	     rqd_ref->ra, bts->network->neci, chreq_reason);
+	if (storm)
+		rach_load_log_suppressed(bts);
+	else
+		LOGP(DRSL, LOGL_NOTICE, "(bts=%d) CHAN RQD: reason: %s (ra=0x%02x, neci=0x%02x, chreq_reason=0x%02x)\n",
+		     bts->nr, get_value_string(gsm_chreq_descs, chreq_reason),
+		     rqd_ref->ra, bts->network->neci, chreq_reason);
 
 	/* Handle PDCH related rach requests (in case of BSC-co-located-PCU */
 	if (chreq_reason == GSM_CHREQ_REASON_PDCH)
@@ -1870,21 +2049,22 @@ static int rsl_rx_chan_rqd(struct msgb *msg)
 	 */
 	is_lu = !!(chreq_reason == GSM_CHREQ_REASON_LOCATION_UPD);
 
-	/* check availability / allocate channel */
-	lchan = lchan_alloc(bts, lctype, is_lu);
+	/* check availability / allocate channel, during a RACH storm
+	 * don't search again for what was exhausted a moment ago */
+	alloc_bit = 1 << (lctype * 2 + is_lu);
+	if (storm && (bts->rach_load.alloc_failed & alloc_bit))
+		lchan = NULL;
+	else
+		lchan = lchan_alloc(bts, lctype, is_lu);
 	if (!lchan) {
-		uint8_t wait_ind;
-		LOGP(DRSL, LOGL_NOTICE, "(bts=%d) CHAN RQD: no resources for %s 0x%x\n",
-		     msg->lchan->ts->trx->bts->nr, gsm_lchant_name(lctype), rqd_ref->ra);
-		rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_CHREQ_NO_CHANNEL]);
-		if (bts->T3122)
-			wait_ind = bts->T3122;
-		else if (bts->network->T3122)
-			wait_ind = bts->network->T3122 & 0xff;
+		bts->rach_load.alloc_failed |= alloc_bit;
+		if (storm)
+			rach_load_log_suppressed(bts);
 		else
-			wait_ind = GSM_T3122_DEFAULT;
-		/* The BTS will gather multiple CHAN RQD and reject up to 4 MS at the same time. */
-		rsl_send_imm_ass_rej(bts, rqd_ref, wait_ind);
+			LOGP(DRSL, LOGL_NOTICE, "(bts=%d) CHAN RQD: no resources for %s 0x%x\n",
+			     bts->nr, gsm_lchant_name(lctype), rqd_ref->ra);
+		rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_CHREQ_NO_CHANNEL]);
+		rach_load_reject(bts, rqd_ref);
 		return 0;
 	}
 
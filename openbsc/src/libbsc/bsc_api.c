@@ -274,10 +274,8 @@ void bsc_subscr_con_free(struct gsm_subscriber_connection *conn)
 		return;
 
 
-	if (conn->subscr) {
-		subscr_put(conn->subscr);
-		conn->subscr = NULL;
-	}
+	if (conn->subscr)
+		subscr_put(subscr_con_detach(conn));
 
 
 	if (conn->ho_lchan) {
@@ -19,6 +19,7 @@
  *
  */
 #include <errno.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include <osmocom/ctrl/control_cmd.h>
@@ -215,8 +216,61 @@ oom:
 CTRL_CMD_DEFINE_WO(net_mcc_mnc_apply, "mcc-mnc-apply");
 
 /* BTS related commands below */
-CTRL_CMD_DEFINE_RANGE(bts_lac, "location-area-code", struct gsm_bts, location_area_code, 0, 65535);
-CTRL_CMD_DEFINE_RANGE(bts_ci, "cell-identity", struct gsm_bts, cell_identity, 0, 65535);
+CTRL_CMD_DEFINE(bts_lac, "location-area-code");
+static int get_bts_lac(struct ctrl_cmd *cmd, void *data)
+{
+	struct gsm_bts *bts = cmd->node;
+	cmd->reply = talloc_asprintf(cmd, "%u", bts->location_area_code);
+	if (!cmd->reply) {
+		cmd->reply = "OOM";
+		return CTRL_CMD_ERROR;
+	}
+	return CTRL_CMD_REPLY;
+}
+static int set_bts_lac(struct ctrl_cmd *cmd, void *data)
+{
+	struct gsm_bts *bts = cmd->node;
+	bts->location_area_code = atoi(cmd->value);
+	gsm_net_cell_tbl_invalidate(bts->network);
+	return get_bts_lac(cmd, data);
+}
+static int verify_bts_lac(struct ctrl_cmd *cmd, const char *value, void *data)
+{
+	int lac = atoi(value);
+	if (lac < 0 || lac > 65535) {
+		cmd->reply = "Input not within the range";
+		return -1;
+	}
+	return 0;
+}
+
+CTRL_CMD_DEFINE(bts_ci, "cell-identity");
+static int get_bts_ci(struct ctrl_cmd *cmd, void *data)
+{
+	struct gsm_bts *bts = cmd->node;
+	cmd->reply = talloc_asprintf(cmd, "%u", bts->cell_identity);
+	if (!cmd->reply) {
+		cmd->reply = "OOM";
+		return CTRL_CMD_ERROR;
+	}
+	return CTRL_CMD_REPLY;
+}
+static int set_bts_ci(struct ctrl_cmd *cmd, void *data)
+{
+	struct gsm_bts *bts = cmd->node;
+	bts->cell_identity = atoi(cmd->value);
+	gsm_net_cell_tbl_invalidate(bts->network);
+	return get_bts_ci(cmd, data);
+}
+static int verify_bts_ci(struct ctrl_cmd *cmd, const char *value, void *data)
+{
+	int ci = atoi(value);
+	if (ci < 0 || ci > 65535) {
+		cmd->reply = "Input not within the range";
+		return -1;
+	}
+	return 0;
+}
 
 static int set_bts_apply_config(struct ctrl_cmd *cmd, void *data)
 {
@@ -472,7 +526,17 @@ static int verify_trx_max_power(struct ctrl_cmd *cmd, const char *value, void *_
 
 	return 0;
 }
-CTRL_CMD_DEFINE_RANGE(trx_arfcn, "arfcn", struct gsm_bts_trx, arfcn, 0, 1023);
+
+CTRL_HELPER_GET_INT(trx_arfcn, struct gsm_bts_trx, arfcn);
+static int set_trx_arfcn(struct ctrl_cmd *cmd, void *_data)
+{
+	struct gsm_bts_trx *trx = cmd->node;
+	trx->arfcn = atoi(cmd->value);
+	gsm_net_neigh_tbl_invalidate(trx->bts->network);
+	return get_trx_arfcn(cmd, _data);
+}
+CTRL_HELPER_VERIFY_RANGE(trx_arfcn, 0, 1023);
+CTRL_CMD_DEFINE(trx_arfcn, "arfcn");
 
 static int set_trx_max_power(struct ctrl_cmd *cmd, void *_data)
 {
@@ -552,6 +552,9 @@ int bsc_network_configure(const char *config_file)
 		return rc;
 	}
 
+	/* the config might have set up log targets */
+	bsc_log_level_cache_invalidate();
+
 	/* start telnet after reading config for vty_get_bind_addr() */
 	rc = telnet_init_dynif(tall_bsc_ctx, bsc_gsmnet, vty_get_bind_addr(),
 			       OSMO_VTY_PORT_NITB_BSC);
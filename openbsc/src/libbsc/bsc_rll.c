@@ -47,8 +47,6 @@ struct bsc_rll_req {
 /* we only compare C1, C2 and SAPI */
 #define LINKID_MASK	0xC7
 
-static LLIST_HEAD(bsc_rll_reqs);
-
 static void complete_rllr(struct bsc_rll_req *rllr, enum bsc_rllr_ind type)
 {
 	llist_del(&rllr->list);
@@ -87,7 +85,7 @@ int rll_establish(struct gsm_lchan *lchan, uint8_t sapi,
 	rllr->cb = cb;
 	rllr->data = data;
 
-	llist_add(&rllr->list, &bsc_rll_reqs);
+	llist_add(&rllr->list, &lchan->rll_reqs);
 
 	osmo_timer_setup(&rllr->timer, timer_cb, rllr);
 	osmo_timer_schedule(&rllr->timer, 7, 0);
@@ -102,9 +100,8 @@ void rll_indication(struct gsm_lchan *lchan, uint8_t link_id, uint8_t type)
 {
 	struct bsc_rll_req *rllr, *rllr2;
 
-	llist_for_each_entry_safe(rllr, rllr2, &bsc_rll_reqs, list) {
-		if (rllr->lchan == lchan &&
-		    (rllr->link_id & LINKID_MASK) == (link_id & LINKID_MASK)) {
+	llist_for_each_entry_safe(rllr, rllr2, &lchan->rll_reqs, list) {
+		if ((rllr->link_id & LINKID_MASK) == (link_id & LINKID_MASK)) {
 			osmo_timer_del(&rllr->timer);
 			complete_rllr(rllr, type);
 			return;
@@ -123,11 +120,9 @@ static int rll_lchan_signal(unsigned int subsys, unsigned int signal,
 
 	challoc = (struct challoc_signal_data *) signal_data;
 
-	llist_for_each_entry_safe(rllr, rllr2, &bsc_rll_reqs, list) {
-		if (rllr->lchan == challoc->lchan) {
-			osmo_timer_del(&rllr->timer);
-			complete_rllr(rllr, BSC_RLLR_IND_ERR_IND);
-		}
+	llist_for_each_entry_safe(rllr, rllr2, &challoc->lchan->rll_reqs, list) {
+		osmo_timer_del(&rllr->timer);
+		complete_rllr(rllr, BSC_RLLR_IND_ERR_IND);
 	}
 
 	return 0;
@@ -32,6 +32,180 @@
 #include <openbsc/bsc_subscriber.h>
 #include <openbsc/debug.h>
 
+/*
+ * Every subscriber list has its own IMSI and TMSI hash table, the list
+ * head is the first member of struct bsc_subscr_list. Subscribers
+ * without an IMSI or with a reserved TMSI are not indexed, they can't
+ * be looked up by it anyway. New entries go to the head of their chain.
+ */
+#define BSUB_HASH_MIN_SIZE	256
+
+struct bsub_hash {
+	struct bsc_subscr **buckets;
+	unsigned int size;
+	unsigned int count;
+};
+
+struct bsc_subscr_list {
+	struct llist_head list;
+	struct bsub_hash imsi_hash;
+	struct bsub_hash tmsi_hash;
+};
+
+enum bsub_key {
+	BSUB_KEY_IMSI,
+	BSUB_KEY_TMSI,
+};
+
+/*! Allocate an empty list of BSC subscribers.
+ *  \param[in] ctx talloc context of the list
+ *  \returns the list head or NULL
+ */
+struct llist_head *bsc_subscr_list_alloc(void *ctx)
+{
+	struct bsc_subscr_list *bsubs;
+
+	bsubs = talloc_zero(ctx, struct bsc_subscr_list);
+	if (!bsubs)
+		return NULL;
+
+	INIT_LLIST_HEAD(&bsubs->list);
+	return &bsubs->list;
+}
+
+static struct bsub_hash *bsub_hash_get(struct llist_head *list,
+				       enum bsub_key key)
+{
+	struct bsc_subscr_list *bsubs;
+
+	bsubs = container_of(list, struct bsc_subscr_list, list);
+	if (key == BSUB_KEY_IMSI)
+		return &bsubs->imsi_hash;
+	return &bsubs->tmsi_hash;
+}
+
+/* 0 is a valid TMSI, only the reserved one means there is none */
+static int tmsi_valid(uint32_t tmsi)
+{
+	return tmsi != GSM_RESERVED_TMSI;
+}
+
+static uint32_t imsi_hash_key(const char *imsi)
+{
+	uint32_t h = 2166136261u;
+
+	while (*imsi) {
+		h ^= (uint8_t) *imsi++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static uint32_t tmsi_hash_key(uint32_t tmsi)
+{
+	uint32_t h = tmsi * 0x85ebca6b;
+
+	return h ^ (h >> 16);
+}
+
+static int bsub_indexed(enum bsub_key key, struct bsc_subscr *bsub)
+{
+	if (key == BSUB_KEY_IMSI)
+		return bsub->imsi[0] != '\0';
+	return tmsi_valid(bsub->tmsi);
+}
+
+static uint32_t bsub_hash_key(enum bsub_key key, struct bsc_subscr *bsub)
+{
+	if (key == BSUB_KEY_IMSI)
+		return imsi_hash_key(bsub->imsi);
+	return tmsi_hash_key(bsub->tmsi);
+}
+
+static struct bsc_subscr **bsub_hash_next(enum bsub_key key,
+					  struct bsc_subscr *bsub)
+{
+	if (key == BSUB_KEY_IMSI)
+		return &bsub->imsi_next;
+	return &bsub->tmsi_next;
+}
+
+static void bsub_hash_insert(enum bsub_key key,
+			     struct bsc_subscr **buckets, unsigned int size,
+			     struct bsc_subscr *bsub)
+{
+	struct bsc_subscr **pos;
+
+	pos = &buckets[bsub_hash_key(key, bsub) & (size - 1)];
+	*bsub_hash_next(key, bsub) = *pos;
+	*pos = bsub;
+}
+
+static void bsub_hash_grow(struct bsub_hash *hash, enum bsub_key key,
+			   void *ctx)
+{
+	struct bsc_subscr **buckets;
+	unsigned int size, i;
+
+	size = hash->size ? hash->size * 2 : BSUB_HASH_MIN_SIZE;
+	buckets = talloc_zero_array(ctx, struct bsc_subscr *, size);
+	/* on failure keep using the old table, the chains just get longer */
+	if (!buckets)
+		return;
+
+	for (i = 0; i < hash->size; i++) {
+		struct bsc_subscr *bsub = hash->buckets[i];
+
+		while (bsub) {
+			struct bsc_subscr *next = *bsub_hash_next(key, bsub);
+			bsub_hash_insert(key, buckets, size, bsub);
+			bsub = next;
+		}
+	}
+
+	talloc_free(hash->buckets);
+	hash->buckets = buckets;
+	hash->size = size;
+}
+
+static void bsub_hash_add(enum bsub_key key, struct bsc_subscr *bsub)
+{
+	struct bsub_hash *hash = bsub_hash_get(bsub->list, key);
+
+	if (!bsub_indexed(key, bsub))
+		return;
+
+	if (hash->count >= hash->size)
+		bsub_hash_grow(hash, key, bsub->list);
+	if (!hash->buckets) {
+		/* no table at all, the subscriber can't be looked up */
+		return;
+	}
+
+	bsub_hash_insert(key, hash->buckets, hash->size, bsub);
+	hash->count += 1;
+}
+
+static void bsub_hash_del(enum bsub_key key, struct bsc_subscr *bsub)
+{
+	struct bsub_hash *hash = bsub_hash_get(bsub->list, key);
+	struct bsc_subscr **pos;
+
+	if (!hash->buckets || !bsub_indexed(key, bsub))
+		return;
+
+	pos = &hash->buckets[bsub_hash_key(key, bsub) & (hash->size - 1)];
+	while (*pos) {
+		if (*pos == bsub) {
+			*pos = *bsub_hash_next(key, bsub);
+			*bsub_hash_next(key, bsub) = NULL;
+			hash->count -= 1;
+			return;
+		}
+		pos = bsub_hash_next(key, *pos);
+	}
+}
+
 static struct bsc_subscr *bsc_subscr_alloc(struct llist_head *list)
 {
 	struct bsc_subscr *bsub;
@@ -41,7 +215,10 @@ static struct bsc_subscr *bsc_subscr_alloc(struct llist_head *list)
 		return NULL;
 
 	llist_add_tail(&bsub->entry, list);
+	INIT_LLIST_HEAD(&bsub->paging_requests);
 	bsub->use_count = 1;
+	bsub->tmsi = GSM_RESERVED_TMSI;
+	bsub->list = list;
 
 	return bsub;
 }
@@ -49,12 +226,17 @@ static struct bsc_subscr *bsc_subscr_alloc(struct llist_head *list)
 struct bsc_subscr *bsc_subscr_find_by_imsi(struct llist_head *list,
 					   const char *imsi)
 {
+	struct bsub_hash *hash = bsub_hash_get(list, BSUB_KEY_IMSI);
 	struct bsc_subscr *bsub;
 
 	if (!imsi || !*imsi)
 		return NULL;
 
-	llist_for_each_entry(bsub, list, entry) {
+	if (!hash->buckets)
+		return NULL;
+
+	bsub = hash->buckets[imsi_hash_key(imsi) & (hash->size - 1)];
+	for (; bsub; bsub = bsub->imsi_next) {
 		if (!strcmp(bsub->imsi, imsi))
 			return bsc_subscr_get(bsub);
 	}
@@ -64,12 +246,17 @@ struct bsc_subscr *bsc_subscr_find_by_imsi(struct llist_head *list,
 struct bsc_subscr *bsc_subscr_find_by_tmsi(struct llist_head *list,
 					   uint32_t tmsi)
 {
+	struct bsub_hash *hash = bsub_hash_get(list, BSUB_KEY_TMSI);
 	struct bsc_subscr *bsub;
 
-	if (tmsi == GSM_RESERVED_TMSI)
+	if (!tmsi_valid(tmsi))
+		return NULL;
+
+	if (!hash->buckets)
 		return NULL;
 
-	llist_for_each_entry(bsub, list, entry) {
+	bsub = hash->buckets[tmsi_hash_key(tmsi) & (hash->size - 1)];
+	for (; bsub; bsub = bsub->tmsi_next) {
 		if (bsub->tmsi == tmsi)
 			return bsc_subscr_get(bsub);
 	}
@@ -80,7 +267,20 @@ void bsc_subscr_set_imsi(struct bsc_subscr *bsub, const char *imsi)
 {
 	if (!bsub)
 		return;
+	bsub_hash_del(BSUB_KEY_IMSI, bsub);
 	osmo_strlcpy(bsub->imsi, imsi, sizeof(bsub->imsi));
+	bsub_hash_add(BSUB_KEY_IMSI, bsub);
+}
+
+void bsc_subscr_set_tmsi(struct bsc_subscr *bsub, uint32_t tmsi)
+{
+	if (!bsub)
+		return;
+	if (bsub->tmsi == tmsi)
+		return;
+	bsub_hash_del(BSUB_KEY_TMSI, bsub);
+	bsub->tmsi = tmsi;
+	bsub_hash_add(BSUB_KEY_TMSI, bsub);
 }
 
 struct bsc_subscr *bsc_subscr_find_or_create_by_imsi(struct llist_head *list,
@@ -107,7 +307,7 @@ struct bsc_subscr *bsc_subscr_find_or_create_by_tmsi(struct llist_head *list,
 	bsub = bsc_subscr_alloc(list);
 	if (!bsub)
 		return NULL;
-	bsub->tmsi = tmsi;
+	bsc_subscr_set_tmsi(bsub, tmsi);
 	return bsub;
 }
 
@@ -125,6 +325,8 @@ const char *bsc_subscr_name(struct bsc_subscr *bsub)
 
 static void bsc_subscr_free(struct bsc_subscr *bsub)
 {
+	bsub_hash_del(BSUB_KEY_IMSI, bsub);
+	bsub_hash_del(BSUB_KEY_TMSI, bsub);
 	llist_del(&bsub->entry);
 	talloc_free(bsub);
 }
@@ -169,4 +371,6 @@ void log_set_filter_bsc_subscr(struct log_target *target,
 		*fsub = bsc_subscr_get(bsc_subscr);
 	} else
 		target->filter_map &= ~(1 << LOG_FLT_BSC_SUBSCR);
+
+	bsc_log_level_cache_invalidate();
 }
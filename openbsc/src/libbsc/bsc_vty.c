@@ -279,6 +279,8 @@ static void bts_dump_vty(struct vty *vty, struct gsm_bts *bts)
 		VTY_NEWLINE);
 	if (bts->si_common.rach_control.cell_bar)
 		vty_out(vty, "  CELL IS BARRED%s", VTY_NEWLINE);
+	vty_out(vty, "RACH load: %u CHAN RQD/s%s%s", bts->rach_load.rate,
+		bts->rach_load.storm ? ", storm" : "", VTY_NEWLINE);
 	if (bts->dtxu != GSM48_DTX_SHALL_NOT_BE_USED)
 		vty_out(vty, "Uplink DTX: %s%s",
 			(bts->dtxu != GSM48_DTX_SHALL_BE_USED) ?
@@ -663,6 +665,11 @@ static void config_write_bts_single(struct vty *vty, struct gsm_bts *bts)
 	if (bts->rach_ldavg_slots != -1)
 		vty_out(vty, "  rach nm load average %u%s",
 			bts->rach_ldavg_slots, VTY_NEWLINE);
+	if (bts->rach_load.threshold != GSM_RACH_STORM_THRESHOLD_DEFAULT)
+		vty_out(vty, "  rach storm threshold %u%s",
+			bts->rach_load.threshold, VTY_NEWLINE);
+	if (bts->rach_load.dynamic_t3122)
+		vty_out(vty, "  rach storm dynamic-t3122 1%s", VTY_NEWLINE);
 	if (bts->si_common.rach_control.cell_bar)
 		vty_out(vty, "  cell barred 1%s", VTY_NEWLINE);
 	if ((bts->si_common.rach_control.t2 & 0x4) == 0)
@@ -1772,6 +1779,7 @@ DEFUN(cfg_bts_ci,
 		return CMD_WARNING;
 	}
 	bts->cell_identity = ci;
+	gsm_net_cell_tbl_invalidate(bts->network);
 
 	return CMD_SUCCESS;
 }
@@ -1797,6 +1805,7 @@ DEFUN(cfg_bts_lac,
 	}
 
 	bts->location_area_code = lac;
+	gsm_net_cell_tbl_invalidate(bts->network);
 
 	return CMD_SUCCESS;
 }
@@ -1826,6 +1835,7 @@ DEFUN(cfg_bts_bsic,
 		return CMD_WARNING;
 	}
 	bts->bsic = bsic;
+	gsm_net_neigh_tbl_invalidate(bts->network);
 
 	return CMD_SUCCESS;
 }
@@ -1849,6 +1859,7 @@ DEFUN(cfg_bts_unit_id,
 
 	bts->ip_access.site_id = site_id;
 	bts->ip_access.bts_id = bts_id;
+	gsm_net_unitid_tbl_invalidate(bts->network);
 
 	return CMD_SUCCESS;
 }
@@ -2117,6 +2128,33 @@ DEFUN(cfg_bts_rach_nm_ldavg,
 	return CMD_SUCCESS;
 }
 
+#define STORM_STR "Protection against bursts of channel requests\n"
+
+DEFUN(cfg_bts_rach_storm_thresh,
+      cfg_bts_rach_storm_thresh_cmd,
+      "rach storm threshold <0-65535>",
+	RACH_STR STORM_STR
+      "Set the CHAN RQD rate considered a burst\n"
+      "CHAN RQD per second, 0 to disable\n")
+{
+	struct gsm_bts *bts = vty->index;
+	bts->rach_load.threshold = atoi(argv[0]);
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_rach_storm_dyn_t3122,
+      cfg_bts_rach_storm_dyn_t3122_cmd,
+      "rach storm dynamic-t3122 (0|1)",
+	RACH_STR STORM_STR
+      "Scale the IMMEDIATE ASSIGNMENT REJECT wait indication with the CHAN RQD rate\n"
+      "Use the configured T3122\n"
+      "Scale T3122 during a burst\n")
+{
+	struct gsm_bts *bts = vty->index;
+	bts->rach_load.dynamic_t3122 = atoi(argv[0]);
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_bts_cell_barred, cfg_bts_cell_barred_cmd,
       "cell barred (0|1)",
       "Should this cell be barred from access?\n"
@@ -3597,6 +3635,7 @@ DEFUN(cfg_trx_arfcn,
 	/* FIXME: check if this ARFCN is supported by this TRX */
 
 	trx->arfcn = arfcn;
+	gsm_net_neigh_tbl_invalidate(trx->bts->network);
 
 	/* FIXME: patch ARFCN into SYSTEM INFORMATION */
 	/* FIXME: use OML layer to update the ARFCN */
@@ -3888,14 +3927,23 @@ void openbsc_vty_print_statistics(struct vty *vty, struct gsm_network *net)
 		net->bsc_ctrs->ctr[BSC_CTR_CHREQ_TOTAL].current,
 		net->bsc_ctrs->ctr[BSC_CTR_CHREQ_NO_CHANNEL].current,
 		VTY_NEWLINE);
+	vty_out(vty, "Channel Request Bursts  : %"PRIu64" detected, %"PRIu64" IMM ASS REJ sent, %"PRIu64" log messages suppressed%s",
+		net->bsc_ctrs->ctr[BSC_CTR_CHREQ_STORM].current,
+		net->bsc_ctrs->ctr[BSC_CTR_CHREQ_REJ_MSGS].current,
+		net->bsc_ctrs->ctr[BSC_CTR_CHREQ_LOG_SUPPRESSED].current,
+		VTY_NEWLINE);
 	vty_out(vty, "Channel Failures        : %"PRIu64" rf_failures, %"PRIu64" rll failures%s",
 		net->bsc_ctrs->ctr[BSC_CTR_CHAN_RF_FAIL].current,
 		net->bsc_ctrs->ctr[BSC_CTR_CHAN_RLL_ERR].current,
 		VTY_NEWLINE);
-	vty_out(vty, "Paging                  : %"PRIu64" attempted, %"PRIu64" complete, %"PRIu64" expired%s",
+	vty_out(vty, "Paging                  : %"PRIu64" attempted, %"PRIu64" complete, %"PRIu64" expired, %"PRIu64" refreshed%s",
 		net->bsc_ctrs->ctr[BSC_CTR_PAGING_ATTEMPTED].current,
 		net->bsc_ctrs->ctr[BSC_CTR_PAGING_COMPLETED].current,
 		net->bsc_ctrs->ctr[BSC_CTR_PAGING_EXPIRED].current,
+		net->bsc_ctrs->ctr[BSC_CTR_PAGING_REFRESHED].current,
+		VTY_NEWLINE);
+	vty_out(vty, "Paging BTS              : %"PRIu64" paged%s",
+		net->bsc_ctrs->ctr[BSC_CTR_PAGING_BTS_PAGED].current,
 		VTY_NEWLINE);
 	vty_out(vty, "BTS failures            : %"PRIu64" OML, %"PRIu64" RSL%s",
 		net->bsc_ctrs->ctr[BSC_CTR_BTS_OML_FAIL].current,
@@ -4391,6 +4439,8 @@ int bsc_vty_init(struct gsm_network *network)
 	install_element(BTS_NODE, &cfg_bts_chan_desc_bs_ag_blks_res_cmd);
 	install_element(BTS_NODE, &cfg_bts_rach_nm_b_thresh_cmd);
 	install_element(BTS_NODE, &cfg_bts_rach_nm_ldavg_cmd);
+	install_element(BTS_NODE, &cfg_bts_rach_storm_thresh_cmd);
+	install_element(BTS_NODE, &cfg_bts_rach_storm_dyn_t3122_cmd);
 	install_element(BTS_NODE, &cfg_bts_cell_barred_cmd);
 	install_element(BTS_NODE, &cfg_bts_rach_ec_allowed_cmd);
 	install_element(BTS_NODE, &cfg_bts_rach_ac_class_cmd);
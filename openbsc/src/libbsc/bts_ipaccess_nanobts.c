@@ -329,22 +329,6 @@ int bts_model_nanobts_init(void)
 #define OML_UP         0x0001
 #define RSL_UP         0x0002
 
-static struct gsm_bts *
-find_bts_by_unitid(struct gsm_network *net, uint16_t site_id, uint16_t bts_id)
-{
-	struct gsm_bts *bts;
-
-	llist_for_each_entry(bts, &net->bts_list, list) {
-		if (!is_ipaccess_bts(bts))
-			continue;
-
-		if (bts->ip_access.site_id == site_id &&
-		    bts->ip_access.bts_id == bts_id)
-			return bts;
-	}
-	return NULL;
-}
-
 /* These are exported because they are used by the VTY interface. */
 void ipaccess_drop_rsl(struct gsm_bts_trx *trx)
 {
@@ -426,7 +410,7 @@ ipaccess_sign_link_up(void *unit_data, struct e1inp_line *line,
 	struct timespec tp;
 	int rc;
 
-	bts = find_bts_by_unitid(bsc_gsmnet, dev->site_id, dev->bts_id);
+	bts = gsm_bts_by_unitid(bsc_gsmnet, dev->site_id, dev->bts_id);
 	if (!bts) {
 		LOGP(DLINP, LOGL_ERROR, "Unable to find BTS configuration for "
 			" %u/%u/%u, disconnecting\n", dev->site_id,
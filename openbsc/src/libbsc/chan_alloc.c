@@ -382,6 +382,9 @@ void lchan_free(struct gsm_lchan *lchan)
 	sig.type = lchan->type;
 	lchan->type = GSM_LCHAN_NONE;
 
+	/* let the RACH load controller try lchan_alloc() again */
+	lchan->ts->trx->bts->rach_load.alloc_failed = 0;
+
 
 	if (lchan->conn) {
 		struct lchan_signal_data sig;
@@ -70,23 +70,50 @@ static int rxlev_for_cell_in_rep(struct gsm_meas_rep *mr,
 	return -ENODEV;
 }
 
+/* store a new rxlev sample in the ring and update the running sums */
+static void neigh_meas_push(struct neigh_meas_proc *nmp, uint8_t rxlev)
+{
+	unsigned int n = ARRAY_SIZE(nmp->rxlev);
+	unsigned int idx = nmp->rxlev_cnt % n;
+
+	/* the sample leaving a window of the full ring size is the one we
+	 * are about to overwrite */
+	nmp->rxlev_sum_max -= nmp->rxlev[idx];
+	nmp->rxlev_sum_max += rxlev;
+	if (nmp->rxlev_sum_win_len) {
+		nmp->rxlev_sum_win -= nmp->rxlev[(idx + n - nmp->rxlev_sum_win_len) % n];
+		nmp->rxlev_sum_win += rxlev;
+	}
+
+	nmp->rxlev[idx] = rxlev;
+	nmp->rxlev_cnt++;
+}
+
 /* obtain averaged rxlev for given neighbor */
 static int neigh_meas_avg(struct neigh_meas_proc *nmp, int window)
 {
 	unsigned int i, idx;
-	int avg = 0;
 
+	if (window == ARRAY_SIZE(nmp->rxlev))
+		return nmp->rxlev_sum_max / window;
+
+	if (nmp->rxlev_sum_win_len == window)
+		return nmp->rxlev_sum_win / window;
+
+	/* the window size changed, sum it up once */
 	idx = calc_initial_idx(ARRAY_SIZE(nmp->rxlev),
 				nmp->rxlev_cnt % ARRAY_SIZE(nmp->rxlev),
 				window);
 
+	nmp->rxlev_sum_win = 0;
 	for (i = 0; i < window; i++) {
 		int j = (idx+i) % ARRAY_SIZE(nmp->rxlev);
 
-		avg += nmp->rxlev[j];
+		nmp->rxlev_sum_win += nmp->rxlev[j];
 	}
+	nmp->rxlev_sum_win_len = window;
 
-	return avg / window;
+	return nmp->rxlev_sum_win / window;
 }
 
 /* find empty or evict bad neighbor */
@@ -118,12 +145,11 @@ static struct neigh_meas_proc *find_evict_neigh(struct gsm_lchan *lchan)
 /* process neighbor cell measurement reports */
 static void process_meas_neigh(struct gsm_meas_rep *mr)
 {
-	int i, j, idx;
+	int i, j;
 
 	/* for each reported cell, try to update global state */
 	for (j = 0; j < ARRAY_SIZE(mr->lchan->neigh_meas); j++) {
 		struct neigh_meas_proc *nmp = &mr->lchan->neigh_meas[j];
-		unsigned int idx;
 		int rxlev;
 
 		/* skip unused entries */
@@ -131,13 +157,11 @@ static void process_meas_neigh(struct gsm_meas_rep *mr)
 			continue;
 
 		rxlev = rxlev_for_cell_in_rep(mr, nmp->arfcn, nmp->bsic);
-		idx = nmp->rxlev_cnt % ARRAY_SIZE(nmp->rxlev);
 		if (rxlev >= 0) {
-			nmp->rxlev[idx] = rxlev;
+			neigh_meas_push(nmp, rxlev);
 			nmp->last_seen_nr = mr->nr;
 		} else
-			nmp->rxlev[idx] = 0;
-		nmp->rxlev_cnt++;
+			neigh_meas_push(nmp, 0);
 	}
 
 	/* iterate over list of reported cells, check if we did not
@@ -154,9 +178,7 @@ static void process_meas_neigh(struct gsm_meas_rep *mr)
 		nmp->arfcn = mrc->arfcn;
 		nmp->bsic = mrc->bsic;
 
-		idx = nmp->rxlev_cnt % ARRAY_SIZE(nmp->rxlev);
-		nmp->rxlev[idx] = mrc->rxlev;
-		nmp->rxlev_cnt++;
+		neigh_meas_push(nmp, mrc->rxlev);
 		nmp->last_seen_nr = mr->nr;
 
 		mrc->flags |= MRC_F_PROCESSED;
@@ -41,9 +41,8 @@
 #include <openbsc/transaction.h>
 #include <openbsc/trau_mux.h>
 
+/* hung off both lchans as ho_from and ho_to while it is pending */
 struct bsc_handover {
-	struct llist_head list;
-
 	struct gsm_lchan *old_lchan;
 	struct gsm_lchan *new_lchan;
 
@@ -52,37 +51,26 @@ struct bsc_handover {
 	uint8_t ho_ref;
 };
 
-static LLIST_HEAD(bsc_handovers);
-
 static void handover_free(struct bsc_handover *ho)
 {
 	osmo_timer_del(&ho->T3103);
-	llist_del(&ho->list);
+	if (ho->old_lchan->ho_from == ho)
+		ho->old_lchan->ho_from = NULL;
+	if (ho->new_lchan->ho_to == ho)
+		ho->new_lchan->ho_to = NULL;
 	talloc_free(ho);
 }
 
 static struct bsc_handover *bsc_ho_by_new_lchan(struct gsm_lchan *new_lchan)
 {
-	struct bsc_handover *ho;
-
-	llist_for_each_entry(ho, &bsc_handovers, list) {
-		if (ho->new_lchan == new_lchan)
-			return ho;
-	}
-
-	return NULL;
+	if (!new_lchan)
+		return NULL;
+	return new_lchan->ho_to;
 }
 
 static struct bsc_handover *bsc_ho_by_old_lchan(struct gsm_lchan *old_lchan)
 {
-	struct bsc_handover *ho;
-
-	llist_for_each_entry(ho, &bsc_handovers, list) {
-		if (ho->old_lchan == old_lchan)
-			return ho;
-	}
-
-	return NULL;
+	return old_lchan->ho_from;
 }
 
 /*! \brief Hand over the specified logical channel to the specified new BTS.
@@ -151,7 +139,8 @@ int bsc_handover_start(struct gsm_lchan *old_lchan, struct gsm_bts *bts)
 	}
 
 	rsl_lchan_set_state(new_lchan, LCHAN_S_ACT_REQ);
-	llist_add(&ho->list, &bsc_handovers);
+	old_lchan->ho_from = ho;
+	new_lchan->ho_to = ho;
 	/* we continue in the SS_LCHAN handler / ho_chan_activ_ack */
 
 	return 0;
@@ -61,8 +61,9 @@ void *tall_paging_ctx;
 static void paging_remove_request(struct gsm_bts_paging_state *paging_bts,
 				  struct gsm_paging_request *to_be_deleted)
 {
-	osmo_timer_del(&to_be_deleted->T3113);
+	wheel_timer_del(&to_be_deleted->T3113);
 	llist_del(&to_be_deleted->entry);
+	llist_del(&to_be_deleted->bsub_entry);
 	bsc_subscr_put(to_be_deleted->bsub);
 	talloc_free(to_be_deleted);
 }
@@ -237,17 +238,19 @@ static void paging_init_if_needed(struct gsm_bts *bts)
 	bts->paging.available_slots = 20;
 }
 
-static int paging_pending_request(struct gsm_bts_paging_state *bts,
-				  struct bsc_subscr *bsub)
+static struct gsm_paging_request *paging_find_request(struct gsm_bts *bts,
+						      struct bsc_subscr *bsub)
 {
 	struct gsm_paging_request *req;
 
-	llist_for_each_entry(req, &bts->pending_requests, entry) {
-		if (bsub == req->bsub)
-			return 1;
+	/* a subscriber is paged on a handful of BTS at most, walk its
+	 * own requests instead of everything pending at the BTS */
+	llist_for_each_entry(req, &bsub->paging_requests, bsub_entry) {
+		if (req->bts == bts)
+			return req;
 	}
 
-	return 0;	
+	return NULL;
 }
 
 static void paging_T3113_expired(void *data)
@@ -285,7 +288,7 @@ static int _paging_request(struct gsm_bts *bts, struct bsc_subscr *bsub,
 	struct gsm_bts_paging_state *bts_entry = &bts->paging;
 	struct gsm_paging_request *req;
 
-	if (paging_pending_request(bts_entry, bsub)) {
+	if (paging_find_request(bts, bsub)) {
 		LOGP(DPAG, LOGL_INFO, "Paging request already pending for %s\n",
 		     bsc_subscr_name(bsub));
 		return -EEXIST;
@@ -299,9 +302,11 @@ static int _paging_request(struct gsm_bts *bts, struct bsc_subscr *bsub,
 	req->chan_type = type;
 	req->cbfn = cbfn;
 	req->cbfn_param = data;
-	osmo_timer_setup(&req->T3113, paging_T3113_expired, req);
-	osmo_timer_schedule(&req->T3113, bts->network->T3113, 0);
+	wheel_timer_setup(&req->T3113, timer_wheel_default(),
+			  paging_T3113_expired, req);
+	wheel_timer_schedule(&req->T3113, bts->network->T3113, 0);
 	llist_add_tail(&req->entry, &bts_entry->pending_requests);
+	llist_add_tail(&req->bsub_entry, &bsub->paging_requests);
 	paging_schedule_if_needed(bts_entry);
 
 	return 0;
@@ -323,6 +328,7 @@ int paging_request_bts(struct gsm_bts *bts, struct bsc_subscr *bsub,
 	rc = _paging_request(bts, bsub, type, cbfn, data);
 	if (rc < 0)
 		return rc;
+	rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_PAGING_BTS_PAGED]);
 	return 1;
 }
 
@@ -332,18 +338,30 @@ int paging_request_bts(struct gsm_bts *bts, struct bsc_subscr *bsub,
 int paging_request(struct gsm_network *network, struct bsc_subscr *bsub,
 		   int type, gsm_cbfn *cbfn, void *data)
 {
+	const struct gsm_bts_cell_entry *cells = NULL;
 	struct gsm_bts *bts = NULL;
+	int i, num_cells = -1;
 	int num_pages = 0;
 
 	rate_ctr_inc(&network->bsc_ctrs->ctr[BSC_CTR_PAGING_ATTEMPTED]);
 
+	/* use the cell index unless we page everything anyway */
+	if (bsub->lac != GSM_LAC_RESERVED_ALL_BTS)
+		num_cells = gsm_bts_by_lac_ci(network, bsub->lac, -1, &cells);
+
 	/* start paging subscriber on all BTS within Location Area */
-	do {
+	for (i = 0; ; i++) {
 		int rc;
 
-		bts = gsm_bts_by_lac(network, bsub->lac, bts);
-		if (!bts)
-			break;
+		if (num_cells >= 0) {
+			if (i == num_cells)
+				break;
+			bts = cells[i].bts;
+		} else {
+			bts = gsm_bts_by_lac(network, bsub->lac, bts);
+			if (!bts)
+				break;
+		}
 
 		rc = paging_request_bts(bts, bsub, type, cbfn, data);
 		if (rc >= 0)
@@ -352,7 +370,7 @@ int paging_request(struct gsm_network *network, struct bsc_subscr *bsub,
 			num_pages += 1;
 		else
 			return rc;
-	} while (1);
+	}
 
 	if (num_pages == 0)
 		rate_ctr_inc(&network->bsc_ctrs->ctr[BSC_CTR_PAGING_DETACHED]);
@@ -360,36 +378,54 @@ int paging_request(struct gsm_network *network, struct bsc_subscr *bsub,
 	return num_pages;
 }
 
+/*! Restart T3113 of all paging requests pending for a subscriber
+ *  \returns Amount of BTS the subscriber is being paged on
+ */
+int paging_request_refresh(struct bsc_subscr *bsub)
+{
+	struct gsm_paging_request *req;
+	int num_pages = 0;
+
+	llist_for_each_entry(req, &bsub->paging_requests, bsub_entry) {
+		wheel_timer_schedule(&req->T3113, req->bts->network->T3113, 0);
+		num_pages += 1;
+	}
+
+	if (num_pages > 0)
+		LOGP(DPAG, LOGL_DEBUG, "Refreshed paging of subscriber %s on %d bts.\n",
+		     bsc_subscr_name(bsub), num_pages);
+
+	return num_pages;
+}
 
 /* we consciously ignore the type of the request here */
 static void _paging_request_stop(struct gsm_bts *bts, struct bsc_subscr *bsub,
 				 struct gsm_subscriber_connection *conn,
 				 struct msgb *msg)
 {
-	struct gsm_bts_paging_state *bts_entry = &bts->paging;
-	struct gsm_paging_request *req, *req2;
+	struct gsm_paging_request *req;
+	gsm_cbfn *cbfn;
+	void *param;
 
 	paging_init_if_needed(bts);
 
-	llist_for_each_entry_safe(req, req2, &bts_entry->pending_requests,
-				  entry) {
-		if (req->bsub == bsub) {
-			gsm_cbfn *cbfn = req->cbfn;
-			void *param = req->cbfn_param;
-
-			/* now give up the data structure */
-			paging_remove_request(&bts->paging, req);
-			req = NULL;
-
-			if (conn && cbfn) {
-				LOGP(DPAG, LOGL_DEBUG, "Stop paging %s on bts %d, calling cbfn.\n", bsub->imsi, bts->nr);
-				cbfn(GSM_HOOK_RR_PAGING, GSM_PAGING_SUCCEEDED,
-				     msg, conn, param);
-			} else
-				LOGP(DPAG, LOGL_DEBUG, "Stop paging %s on bts %d silently.\n", bsub->imsi, bts->nr);
-			break;
-		}
-	}
+	req = paging_find_request(bts, bsub);
+	if (!req)
+		return;
+
+	cbfn = req->cbfn;
+	param = req->cbfn_param;
+
+	/* now give up the data structure */
+	paging_remove_request(&bts->paging, req);
+	req = NULL;
+
+	if (conn && cbfn) {
+		LOGP(DPAG, LOGL_DEBUG, "Stop paging %s on bts %d, calling cbfn.\n", bsub->imsi, bts->nr);
+		cbfn(GSM_HOOK_RR_PAGING, GSM_PAGING_SUCCEEDED,
+		     msg, conn, param);
+	} else
+		LOGP(DPAG, LOGL_DEBUG, "Stop paging %s on bts %d silently.\n", bsub->imsi, bts->nr);
 }
 
 /* Stop paging on all other bts' */
@@ -444,9 +480,9 @@ void *paging_get_data(struct gsm_bts *bts, struct bsc_subscr *bsub)
 {
 	struct gsm_paging_request *req;
 
-	llist_for_each_entry(req, &bts->paging.pending_requests, entry)
-		if (req->bsub == bsub)
-			return req->cbfn_param;
+	req = paging_find_request(bts, bsub);
+	if (!req)
+		return NULL;
 
-	return NULL;
+	return req->cbfn_param;
 }
@@ -21,6 +21,7 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -33,6 +34,7 @@
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/select.h>
 #include <osmocom/core/socket.h>
+#include <osmocom/core/timer.h>
 #include <osmocom/core/logging.h>
 #include <osmocom/gsm/l1sap.h>
 #include <osmocom/gsm/gsm0502.h>
@@ -44,6 +46,11 @@
 #include <openbsc/debug.h>
 #include <openbsc/abis_rsl.h>
 
+/* primitives read or written with one system call */
+#define PCU_SOCK_BATCH		16
+/* seconds between two logs of a full queue */
+#define PCU_SOCK_DROP_LOG_INTERVAL	10
+
 static int pcu_sock_send(struct gsm_bts *bts, struct msgb *msg);
 uint32_t trx_get_hlayer1(struct gsm_bts_trx *trx);
 int pcu_direct = 1;
@@ -462,6 +469,23 @@ static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
  * PCU socket interface
  */
 
+/* a PCU that stopped reading would flood the log, summarize the drops */
+static void pcu_sock_log_drop(struct pcu_sock_state *state)
+{
+	struct timespec now;
+
+	state->drops += 1;
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	if (state->drop_log_time
+	    && now.tv_sec - state->drop_log_time < PCU_SOCK_DROP_LOG_INTERVAL)
+		return;
+
+	LOGP(DPCU, LOGL_NOTICE, "PCU socket queue full, dropped %u "
+		"message(s)\n", state->drops);
+	state->drops = 0;
+	state->drop_log_time = now.tv_sec;
+}
+
 static int pcu_sock_send(struct gsm_bts *bts, struct msgb *msg)
 {
 	struct pcu_sock_state *state = bts->pcu_state;
@@ -483,7 +507,14 @@ static int pcu_sock_send(struct gsm_bts *bts, struct msgb *msg)
 		msgb_free(msg);
 		return -EIO;
 	}
+	if (state->upqueue_len >= PCU_SOCK_QUEUE_MAX) {
+		pcu_sock_log_drop(state);
+		rate_ctr_inc(&bts->network->bsc_ctrs->ctr[BSC_CTR_PCU_DROPPED]);
+		msgb_free(msg);
+		return -ENOBUFS;
+	}
 	msgb_enqueue(&state->upqueue, msg);
+	state->upqueue_len += 1;
 	conn_bfd->when |= BSC_FD_WRITE;
 
 	return 0;
@@ -534,69 +565,107 @@ static void pcu_sock_close(struct pcu_sock_state *state)
 		struct msgb *msg = msgb_dequeue(&state->upqueue);
 		msgb_free(msg);
 	}
+	state->upqueue_len = 0;
 }
 
 static int pcu_sock_read(struct osmo_fd *bfd)
 {
 	struct pcu_sock_state *state = (struct pcu_sock_state *)bfd->data;
-	struct gsm_pcu_if *pcu_prim;
-	struct msgb *msg;
-	int rc;
-
-	msg = msgb_alloc(sizeof(*pcu_prim), "pcu_sock_rx");
-	if (!msg)
-		return -ENOMEM;
-
-	pcu_prim = (struct gsm_pcu_if *) msg->tail;
+	struct mmsghdr msgs[PCU_SOCK_BATCH];
+	struct iovec iov[PCU_SOCK_BATCH];
+	int i, num, rc = 0;
+
+	/* the socket keeps the boundaries, each one gets its own buffer */
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < PCU_SOCK_BATCH; i++) {
+		iov[i].iov_base = &state->rx_buf[i];
+		iov[i].iov_len = sizeof(state->rx_buf[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
 
-	rc = recv(bfd->fd, msg->tail, msgb_tailroom(msg), 0);
-	if (rc == 0)
+	num = recvmmsg(bfd->fd, msgs, PCU_SOCK_BATCH, MSG_DONTWAIT, NULL);
+	if (num == 0)
 		goto close;
 
-	if (rc < 0) {
+	if (num < 0) {
 		if (errno == EAGAIN)
 			return 0;
 		goto close;
 	}
 
-	rc = pcu_rx(state->net, pcu_prim->msg_type, pcu_prim);
-
 	/* as we always synchronously process the message in pcu_rx() and
-	 * its callbacks, we can free the message here. */
-	msgb_free(msg);
+	 * its callbacks, the buffer can be used again right away. */
+	for (i = 0; i < num; i++) {
+		struct gsm_pcu_if *pcu_prim = &state->rx_buf[i];
+
+		/* an empty read is the end of the connection */
+		if (msgs[i].msg_len == 0)
+			goto close;
+
+		rc = pcu_rx(state->net, pcu_prim->msg_type, pcu_prim);
+	}
 
 	return rc;
 
 close:
-	msgb_free(msg);
 	pcu_sock_close(state);
 	return -1;
 }
 
+static void pcu_sock_dequeue(struct pcu_sock_state *state)
+{
+	struct msgb *msg = msgb_dequeue(&state->upqueue);
+
+	state->upqueue_len -= 1;
+	msgb_free(msg);
+}
+
 static int pcu_sock_write(struct osmo_fd *bfd)
 {
 	struct pcu_sock_state *state = bfd->data;
-	int rc;
+	struct mmsghdr msgs[PCU_SOCK_BATCH];
+	struct iovec iov[PCU_SOCK_BATCH];
+	int rc, i;
+
+	bfd->when &= ~BSC_FD_WRITE;
 
 	while (!llist_empty(&state->upqueue)) {
-		struct msgb *msg, *msg2;
-		struct gsm_pcu_if *pcu_prim;
+		struct msgb *msg;
+		int num = 0;
 
-		/* peek at the beginning of the queue */
-		msg = llist_entry(state->upqueue.next, struct msgb, list);
-		pcu_prim = (struct gsm_pcu_if *)msg->data;
+		/* collect the beginning of the queue */
+		memset(msgs, 0, sizeof(msgs));
+		llist_for_each_entry(msg, &state->upqueue, list) {
+			if (num == PCU_SOCK_BATCH)
+				break;
 
-		bfd->when &= ~BSC_FD_WRITE;
+			iov[num].iov_base = msgb_data(msg);
+			iov[num].iov_len = msgb_length(msg);
+			msgs[num].msg_hdr.msg_iov = &iov[num];
+			msgs[num].msg_hdr.msg_iovlen = 1;
+			num += 1;
+		}
 
 		/* bug hunter 8-): maybe someone forgot msgb_put(...) ? */
-		if (!msgb_length(msg)) {
+		if (!iov[0].iov_len) {
+			struct gsm_pcu_if *pcu_prim;
+
+			msg = llist_entry(state->upqueue.next, struct msgb, list);
+			pcu_prim = (struct gsm_pcu_if *)msg->data;
 			LOGP(DPCU, LOGL_ERROR, "message type (%d) with ZERO "
 				"bytes!\n", pcu_prim->msg_type);
-			goto dontsend;
+			pcu_sock_dequeue(state);
+			continue;
 		}
 
-		/* try to send it over the socket */
-		rc = write(bfd->fd, msgb_data(msg), msgb_length(msg));
+		/* send up to the first empty message */
+		for (i = 1; i < num; i++)
+			if (!iov[i].iov_len)
+				break;
+
+		/* try to send them over the socket */
+		rc = sendmmsg(bfd->fd, msgs, i, MSG_DONTWAIT);
 		if (rc == 0)
 			goto close;
 		if (rc < 0) {
@@ -607,11 +676,9 @@ static int pcu_sock_write(struct osmo_fd *bfd)
 			goto close;
 		}
 
-dontsend:
-		/* _after_ we send it, we can deueue */
-		msg2 = msgb_dequeue(&state->upqueue);
-		assert(msg == msg2);
-		msgb_free(msg);
+		/* _after_ we send them, we can dequeue */
+		for (i = 0; i < rc; i++)
+			pcu_sock_dequeue(state);
 	}
 	return 0;
 
@@ -694,6 +761,12 @@ int pcu_sock_init(const char *path, struct gsm_bts *bts)
 	state->net = bts->network;
 	state->conn_bfd.fd = -1;
 
+	state->rx_buf = talloc_array(state, struct gsm_pcu_if, PCU_SOCK_BATCH);
+	if (!state->rx_buf) {
+		talloc_free(state);
+		return -ENOMEM;
+	}
+
 	bfd = &state->listen_bfd;
 
 	bfd->fd = osmo_sock_unix_init(SOCK_SEQPACKET, 0, path,
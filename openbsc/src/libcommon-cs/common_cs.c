@@ -27,6 +27,7 @@
 #include <openbsc/common_cs.h>
 #include <openbsc/gsm_data.h>
 #include <openbsc/gsm_subscriber.h>
+#include <openbsc/bsc_subscriber.h>
 #include <openbsc/gsm_data.h>
 #include <openbsc/gsm_04_11.h>
 
@@ -72,8 +73,7 @@ struct gsm_network *gsm_network_init(void *ctx,
 	INIT_LLIST_HEAD(&net->upqueue);
 	INIT_LLIST_HEAD(&net->subscr_conns);
 
-	net->bsc_subscribers = talloc_zero(net, struct llist_head);
-	INIT_LLIST_HEAD(net->bsc_subscribers);
+	net->bsc_subscribers = bsc_subscr_list_alloc(net);
 
 	/* init statistics */
 	net->msc_ctrs = rate_ctr_group_alloc(net, &msc_ctrg_desc, 0);
@@ -30,7 +30,9 @@
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/core/logging.h>
+#include <osmocom/core/signal.h>
 #include <osmocom/gprs/gprs_msgb.h>
+#include <osmocom/vty/vty.h>
 #include <openbsc/gsm_data.h>
 #include <openbsc/gsm_subscriber.h>
 #include <openbsc/debug.h>
@@ -216,6 +218,75 @@ const struct log_info log_info = {
 	.num_cat = ARRAY_SIZE(default_categories),
 };
 
+uint8_t bsc_log_level_cache[BSC_LOG_CACHE_SIZE];
+int bsc_log_level_cache_valid;
+
+/* every command on the VTY might have changed the logging */
+static int log_vty_signal(unsigned int subsys, unsigned int signal,
+			  void *handler_data, void *signal_data)
+{
+	if (subsys == SS_L_VTY && signal == S_VTY_EVENT)
+		bsc_log_level_cache_invalidate();
+	return 0;
+}
+
+static uint8_t lowest_log_level(int subsys)
+{
+	struct log_target *tar;
+	unsigned int idx;
+	uint8_t lowest = LOGL_FATAL + 1;
+
+	idx = subsys < 0 ? osmo_log_info->num_cat_user - 1 - subsys : subsys;
+	if (idx >= osmo_log_info->num_cat)
+		return 0;
+
+	llist_for_each_entry(tar, &osmo_log_target_list, entry) {
+		struct log_category *cat = &tar->categories[idx];
+		uint8_t level;
+
+		if (!cat->enabled)
+			continue;
+
+		/* without any filter our filter_fn drops everything */
+		if (tar->filter_map == 0 && osmo_log_info->filter_fn == filter_fn)
+			continue;
+
+		level = tar->loglevel != 0 ? tar->loglevel : cat->loglevel;
+		if (level < lowest)
+			lowest = level;
+	}
+
+	return lowest;
+}
+
+/*! Rebuild the per category levels from the current log targets. */
+void bsc_log_level_cache_update(void)
+{
+	static int signal_registered;
+	int i;
+
+	if (!signal_registered) {
+		osmo_signal_register_handler(SS_L_VTY, log_vty_signal, NULL);
+		signal_registered = 1;
+	}
+
+	for (i = 0; i < BSC_LOG_CACHE_SIZE; ++i) {
+		int subsys = i < Debug_LastEntry ? i : Debug_LastEntry - 1 - i;
+
+		bsc_log_level_cache[i] = osmo_log_info ? lowest_log_level(subsys) : 0;
+	}
+	bsc_log_level_cache_valid = 1;
+}
+
+/*! Make the next message rebuild the per category levels.
+ *  This needs to be called after changing log targets outside of
+ *  the VTY, e.g. after reading the config file.
+ */
+void bsc_log_level_cache_invalidate(void)
+{
+	bsc_log_level_cache_valid = 0;
+}
+
 void log_set_filter_vlr_subscr(struct log_target *target,
 			       struct gsm_subscriber *vlr_subscr)
 {
@@ -232,4 +303,6 @@ void log_set_filter_vlr_subscr(struct log_target *target,
 		*fsub = subscr_get(vlr_subscr);
 	} else
 		target->filter_map &= ~(1 << LOG_FLT_VLR_SUBSCR);
+
+	bsc_log_level_cache_invalidate();
 }
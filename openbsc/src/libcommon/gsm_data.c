@@ -71,17 +71,76 @@ int gsm_bts_model_register(struct gsm_bts_model *model)
 	return 0;
 }
 
+#define NEIGH_KEY(arfcn, bsic)	(((uint32_t)(arfcn) << 8) | (bsic))
+
+/* Build the (ARFCN, BSIC) table of the network. It is kept sorted by key
+ * and, for equal keys, in the order of the BTS list. */
+static int neigh_tbl_build(struct gsm_network *net)
+{
+	struct gsm_bts_neigh_entry *tbl;
+	struct gsm_bts *bts;
+	unsigned int i, j, n = 0;
+
+	tbl = talloc_array(net, struct gsm_bts_neigh_entry,
+			   OSMO_MAX(net->num_bts, 1));
+	if (!tbl)
+		return -ENOMEM;
+
+	llist_for_each_entry(bts, &net->bts_list, list) {
+		if (n == net->num_bts)
+			break;
+		tbl[n].key = NEIGH_KEY(bts->c0->arfcn, bts->bsic);
+		tbl[n].bts = bts;
+		n++;
+	}
+
+	/* insertion sort, it is stable and the table is rebuilt rarely */
+	for (i = 1; i < n; i++) {
+		struct gsm_bts_neigh_entry tmp = tbl[i];
+
+		for (j = i; j > 0 && tbl[j - 1].key > tmp.key; j--)
+			tbl[j] = tbl[j - 1];
+		tbl[j] = tmp;
+	}
+
+	net->neigh_tbl = tbl;
+	net->neigh_tbl_len = n;
+	return 0;
+}
+
 /* Get reference to a neighbor cell on a given BCCH ARFCN */
 struct gsm_bts *gsm_bts_neighbor(const struct gsm_bts *bts,
 				 uint16_t arfcn, uint8_t bsic)
 {
+	struct gsm_network *net = bts->network;
 	struct gsm_bts *neigh;
+	uint32_t key = NEIGH_KEY(arfcn, bsic);
+	unsigned int lo, hi;
 	/* FIXME: use some better heuristics here to determine which cell
 	 * using this ARFCN really is closest to the target cell.  For
 	 * now we simply assume that each ARFCN will only be used by one
 	 * cell */
 
-	llist_for_each_entry(neigh, &bts->network->bts_list, list) {
+	if (!net->neigh_tbl && neigh_tbl_build(net) != 0)
+		goto slow;
+
+	/* find the first entry with the key */
+	lo = 0;
+	hi = net->neigh_tbl_len;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (net->neigh_tbl[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < net->neigh_tbl_len && net->neigh_tbl[lo].key == key)
+		return net->neigh_tbl[lo].bts;
+	return NULL;
+
+slow:
+	llist_for_each_entry(neigh, &net->bts_list, list) {
 		if (neigh->c0->arfcn == arfcn &&
 		    neigh->bsic == bsic)
 			return neigh;
@@ -90,6 +149,14 @@ struct gsm_bts *gsm_bts_neighbor(const struct gsm_bts *bts,
 	return NULL;
 }
 
+/* Call when a BTS was added or its ARFCN or BSIC has changed */
+void gsm_net_neigh_tbl_invalidate(struct gsm_network *net)
+{
+	talloc_free(net->neigh_tbl);
+	net->neigh_tbl = NULL;
+	net->neigh_tbl_len = 0;
+}
+
 const struct value_string bts_type_descs[_NUM_GSM_BTS_TYPE+1] = {
 	{ GSM_BTS_TYPE_UNKNOWN,		"Unknown BTS Type" },
 	{ GSM_BTS_TYPE_BS11,		"Siemens BTS (BS-11 or compatible)" },
@@ -116,28 +183,207 @@ struct gsm_bts_trx *gsm_bts_trx_by_nr(struct gsm_bts *bts, int nr)
 struct gsm_bts *gsm_bts_by_lac(struct gsm_network *net, unsigned int lac,
 				struct gsm_bts *start_bts)
 {
-	int i;
+	struct llist_head *pos;
+
+	/* the list is in the order of the BTS numbers */
+	pos = start_bts ? start_bts->list.next : net->bts_list.next;
+	for (; pos != &net->bts_list; pos = pos->next) {
+		struct gsm_bts *bts = llist_entry(pos, struct gsm_bts, list);
+
+		if (lac == GSM_LAC_RESERVED_ALL_BTS || bts->location_area_code == lac)
+			return bts;
+	}
+	return NULL;
+}
+
+#define CELL_KEY(lac, ci)	(((uint32_t)(lac) << 16) | (ci))
+
+/* Build the (LAC, CI) table of the network. It is kept sorted by key
+ * and, for equal keys, in the order of the BTS list. */
+static int cell_tbl_build(struct gsm_network *net)
+{
+	struct gsm_bts_cell_entry *tbl;
+	struct gsm_bts *bts;
+	unsigned int i, j, n = 0;
+
+	tbl = talloc_array(net, struct gsm_bts_cell_entry,
+			   OSMO_MAX(net->num_bts, 1));
+	if (!tbl)
+		return -ENOMEM;
+
+	llist_for_each_entry(bts, &net->bts_list, list) {
+		if (n == net->num_bts)
+			break;
+		tbl[n].key = CELL_KEY(bts->location_area_code, bts->cell_identity);
+		tbl[n].bts = bts;
+		n++;
+	}
+
+	/* insertion sort, it is stable and the table is rebuilt rarely */
+	for (i = 1; i < n; i++) {
+		struct gsm_bts_cell_entry tmp = tbl[i];
+
+		for (j = i; j > 0 && tbl[j - 1].key > tmp.key; j--)
+			tbl[j] = tbl[j - 1];
+		tbl[j] = tmp;
+	}
+
+	net->cell_tbl = tbl;
+	net->cell_tbl_len = n;
+	return 0;
+}
+
+/*! Find the BTS of a Location Area, or of a single cell in it.
+ *  The matches are consecutive entries of the network's cell table,
+ *  which stays valid until the next LAC or CI change.
+ *  \param[in] lac Location Area Code
+ *  \param[in] ci Cell Identity, or -1 for all cells of the LAC
+ *  \param[out] first the first matching entry
+ *  \returns number of matching entries, negative on error
+ */
+int gsm_bts_by_lac_ci(struct gsm_network *net, uint16_t lac, int ci,
+		      const struct gsm_bts_cell_entry **first)
+{
+	uint32_t key_lo, key_hi;
+	unsigned int lo, hi, i;
+
+	if (!net->cell_tbl) {
+		int rc = cell_tbl_build(net);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (ci < 0) {
+		key_lo = CELL_KEY(lac, 0);
+		key_hi = CELL_KEY(lac, 0xffff);
+	} else
+		key_lo = key_hi = CELL_KEY(lac, ci);
+
+	/* find the first entry not below key_lo */
+	lo = 0;
+	hi = net->cell_tbl_len;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (net->cell_tbl[mid].key < key_lo)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = lo; i < net->cell_tbl_len; i++) {
+		if (net->cell_tbl[i].key > key_hi)
+			break;
+	}
+
+	*first = &net->cell_tbl[lo];
+	return i - lo;
+}
+
+/* Call when a BTS was added or its LAC or CI has changed */
+void gsm_net_cell_tbl_invalidate(struct gsm_network *net)
+{
+	talloc_free(net->cell_tbl);
+	net->cell_tbl = NULL;
+	net->cell_tbl_len = 0;
+}
+
+#define UNITID_KEY(site_id, bts_id)	(((uint32_t)(site_id) << 16) | (bts_id))
+#define UNITID_HASH(key)		((key) * 2654435761u)
+
+/* Build the unit ID hash of the network with open addressing. It is at
+ * most half full and the first BTS of the list wins for a unit ID. */
+static int unitid_tbl_build(struct gsm_network *net)
+{
+	struct gsm_bts_unitid_entry *tbl;
 	struct gsm_bts *bts;
-	int skip = 0;
+	unsigned int size = 16;
 
-	if (start_bts)
-		skip = 1;
+	while (size < 2 * net->num_bts)
+		size *= 2;
 
-	for (i = 0; i < net->num_bts; i++) {
-		bts = gsm_bts_num(net, i);
+	tbl = talloc_zero_array(net, struct gsm_bts_unitid_entry, size);
+	if (!tbl)
+		return -ENOMEM;
 
-		if (skip) {
-			if (start_bts == bts)
-				skip = 0;
+	llist_for_each_entry(bts, &net->bts_list, list) {
+		uint32_t key, i;
+
+		if (!is_ipaccess_bts(bts))
 			continue;
+
+		key = UNITID_KEY(bts->ip_access.site_id, bts->ip_access.bts_id);
+		for (i = UNITID_HASH(key) & (size - 1); tbl[i].bts;
+		     i = (i + 1) & (size - 1)) {
+			if (tbl[i].key == key)
+				break;
 		}
+		if (tbl[i].bts)
+			continue;
 
-		if (lac == GSM_LAC_RESERVED_ALL_BTS || bts->location_area_code == lac)
-			return bts;
+		tbl[i].key = key;
+		tbl[i].bts = bts;
+	}
+
+	net->unitid_tbl = tbl;
+	net->unitid_tbl_mask = size - 1;
+	return 0;
+}
+
+/*! Find the IPA BTS with a given unit ID.
+ *  \param[in] site_id the site part of the unit ID
+ *  \param[in] bts_id the BTS part of the unit ID
+ *  \returns the BTS or NULL if no IPA BTS has the unit ID
+ */
+struct gsm_bts *gsm_bts_by_unitid(struct gsm_network *net, uint16_t site_id,
+				  uint16_t bts_id)
+{
+	uint32_t key = UNITID_KEY(site_id, bts_id);
+	uint32_t i;
+
+	if (!net->unitid_tbl && unitid_tbl_build(net) != 0)
+		return NULL;
+
+	for (i = UNITID_HASH(key) & net->unitid_tbl_mask; net->unitid_tbl[i].bts;
+	     i = (i + 1) & net->unitid_tbl_mask) {
+		if (net->unitid_tbl[i].key == key)
+			return net->unitid_tbl[i].bts;
 	}
 	return NULL;
 }
 
+/* Call when a BTS was added or its type or unit ID has changed */
+void gsm_net_unitid_tbl_invalidate(struct gsm_network *net)
+{
+	talloc_free(net->unitid_tbl);
+	net->unitid_tbl = NULL;
+	net->unitid_tbl_mask = 0;
+}
+
+/* Make the BTS reachable by its number */
+static void bts_by_nr_add(struct gsm_network *net, struct gsm_bts *bts)
+{
+	if (bts->nr >= net->bts_by_nr_size) {
+		unsigned int size = OSMO_MAX(2 * net->bts_by_nr_size, 16);
+		struct gsm_bts **tbl;
+
+		while (size <= bts->nr)
+			size *= 2;
+
+		/* gsm_bts_num() walks the list without it */
+		tbl = talloc_realloc(net, net->bts_by_nr, struct gsm_bts *, size);
+		if (!tbl)
+			return;
+		memset(&tbl[net->bts_by_nr_size], 0,
+		       (size - net->bts_by_nr_size) * sizeof(*tbl));
+		net->bts_by_nr = tbl;
+		net->bts_by_nr_size = size;
+	}
+
+	/* like the list walk, the first BTS of a number wins */
+	if (!net->bts_by_nr[bts->nr])
+		net->bts_by_nr[bts->nr] = bts;
+}
+
 static const struct value_string auth_policy_names[] = {
 	{ GSM_AUTH_POLICY_CLOSED,	"closed" },
 	{ GSM_AUTH_POLICY_ACCEPT_ALL,	"accept-all" },
@@ -245,6 +491,7 @@ int gsm_set_bts_type(struct gsm_bts *bts, enum gsm_bts_type type)
 
 	bts->type = type;
 	bts->model = model;
+	gsm_net_unitid_tbl_invalidate(bts->network);
 
 	if (model->start && !model->started) {
 		int ret = model->start(bts->network);
@@ -328,6 +575,10 @@ struct gsm_bts *gsm_bts_alloc_register(struct gsm_network *net, enum gsm_bts_typ
 	gsm_bts_set_radio_link_timeout(bts, 32); /* Use RADIO LINK TIMEOUT of 32 */
 
 	llist_add_tail(&bts->list, &net->bts_list);
+	bts_by_nr_add(net, bts);
+	gsm_net_neigh_tbl_invalidate(net);
+	gsm_net_cell_tbl_invalidate(net);
+	gsm_net_unitid_tbl_invalidate(net);
 
 	INIT_LLIST_HEAD(&bts->abis_queue);
 
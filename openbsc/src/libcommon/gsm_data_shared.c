@@ -38,6 +38,7 @@
 static const struct osmo_stat_item_desc bts_stat_desc[] = {
 	{ "chanloadavg", "Channel load average.", "%", 16, 0 },
 	{ "T3122", "T3122 IMMEDIATE ASSIGNMENT REJECT wait indicator.", "s", 16, GSM_T3122_DEFAULT },
+	{ "rach_load", "CHAN RQD received in the last second.", "", 16, 0 },
 };
 
 static const struct osmo_stat_item_group_desc bts_statg_desc = {
@@ -227,9 +228,12 @@ struct gsm_bts *gsm_bts_num(struct gsm_network *net, int num)
 {
 	struct gsm_bts *bts;
 
-	if (num >= net->num_bts)
+	if (num < 0 || num >= net->num_bts)
 		return NULL;
 
+	if (num < net->bts_by_nr_size && net->bts_by_nr[num])
+		return net->bts_by_nr[num];
+
 	llist_for_each_entry(bts, &net->bts_list, list) {
 		if (bts->nr == num)
 			return bts;
@@ -285,7 +289,9 @@ struct gsm_bts_trx *gsm_bts_trx_alloc(struct gsm_bts *bts)
 
 			name = gsm_lchan_name_compute(lchan);
 			lchan->name = talloc_strdup(trx, name);
-#ifndef ROLE_BSC
+#ifdef ROLE_BSC
+			INIT_LLIST_HEAD(&lchan->rll_reqs);
+#else
 			INIT_LLIST_HEAD(&lchan->sapi_cmds);
 #endif
 		}
@@ -382,6 +388,7 @@ struct gsm_bts *gsm_bts_alloc(void *ctx, uint8_t bts_num)
 	bts->bcch_change_mark = 1;
 
 	bts->chan_load_avg = 0;
+	bts->rach_load.threshold = GSM_RACH_STORM_THRESHOLD_DEFAULT;
 
 	/* timer overrides */
 	bts->T3122 = 0; /* not overriden by default */
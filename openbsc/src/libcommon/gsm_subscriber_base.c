@@ -26,15 +26,183 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
 #include <openbsc/gsm_subscriber.h>
+#include <openbsc/chan_alloc.h>
 #include <openbsc/debug.h>
 
 LLIST_HEAD(active_subscribers);
 void *tall_subscr_ctx;
 
+/*
+ * Index of the subscribers in RAM by extension. Extensions that are
+ * not known to the HLR either are remembered for a while so that
+ * routing SMS to off-net numbers doesn't hit the DB every time.
+ */
+#define SUBSCR_EXT_BUCKETS	1024
+#define SUBSCR_EXT_ABSENT_MAX	4096
+#define SUBSCR_EXT_ABSENT_TTL	60
+
+struct subscr_ext_entry {
+	struct subscr_ext_entry *next;
+	/* NULL if the extension is unknown */
+	struct gsm_subscriber *subscr;
+	/* for unknown extensions only */
+	struct llist_head absent;
+	time_t expire;
+	char extension[GSM_EXTENSION_LENGTH];
+};
+
+static struct subscr_ext_entry *ext_buckets[SUBSCR_EXT_BUCKETS];
+static LLIST_HEAD(ext_absent_list);
+static unsigned int ext_absent_count;
+
+static struct subscr_ext_entry **ext_find(const char *ext)
+{
+	struct subscr_ext_entry **pos;
+	const char *c;
+	uint32_t h = 2166136261u;
+
+	for (c = ext; *c; c++) {
+		h ^= (uint8_t) *c;
+		h *= 16777619;
+	}
+
+	pos = &ext_buckets[h & (SUBSCR_EXT_BUCKETS - 1)];
+	while (*pos && strcmp((*pos)->extension, ext) != 0)
+		pos = &(*pos)->next;
+	return pos;
+}
+
+static void ext_unlink(struct subscr_ext_entry **pos)
+{
+	struct subscr_ext_entry *e = *pos;
+
+	*pos = e->next;
+	if (e->subscr)
+		e->subscr->ext_entry = NULL;
+	else {
+		llist_del(&e->absent);
+		ext_absent_count -= 1;
+	}
+	talloc_free(e);
+}
+
+static void ext_del(const char *ext)
+{
+	struct subscr_ext_entry **pos = ext_find(ext);
+
+	if (*pos)
+		ext_unlink(pos);
+}
+
+/*! Look up a subscriber in RAM by extension.
+ *  \param[in] ext the extension to look for
+ *  \param[out] absent set if the extension is known not to exist
+ *  \returns the subscriber without taking a reference, NULL if the
+ *  extension is not in the index
+ */
+struct gsm_subscriber *subscr_ext_lookup(const char *ext, bool *absent)
+{
+	struct subscr_ext_entry **pos = ext_find(ext);
+	struct subscr_ext_entry *e = *pos;
+
+	*absent = false;
+	if (!e)
+		return NULL;
+
+	if (e->subscr) {
+		if (strcmp(e->subscr->extension, ext) == 0)
+			return e->subscr;
+	} else if (e->expire > time(NULL)) {
+		*absent = true;
+		return NULL;
+	}
+
+	/* stale, the extension was changed or the entry timed out */
+	ext_unlink(pos);
+	return NULL;
+}
+
+/*! Add a subscriber in RAM to the extension index. */
+void subscr_ext_add(struct gsm_subscriber *subscr)
+{
+	struct subscr_ext_entry **pos, *e;
+
+	if (subscr->ext_entry || subscr->extension[0] == '\0')
+		return;
+
+	pos = ext_find(subscr->extension);
+	if (*pos)
+		ext_unlink(pos);
+
+	e = talloc_zero(tall_subscr_ctx, struct subscr_ext_entry);
+	if (!e)
+		return;
+	osmo_strlcpy(e->extension, subscr->extension, sizeof(e->extension));
+	e->subscr = subscr;
+	subscr->ext_entry = e;
+	e->next = *pos;
+	*pos = e;
+}
+
+/*! Remember that no subscriber has the given extension. */
+void subscr_ext_add_absent(const char *ext)
+{
+	struct subscr_ext_entry **pos, *e;
+
+	if (ext[0] == '\0' || strlen(ext) >= GSM_EXTENSION_LENGTH)
+		return;
+
+	if (ext_absent_count >= SUBSCR_EXT_ABSENT_MAX) {
+		e = llist_entry(ext_absent_list.next,
+				struct subscr_ext_entry, absent);
+		ext_del(e->extension);
+	}
+
+	pos = ext_find(ext);
+	if (*pos)
+		return;
+
+	e = talloc_zero(tall_subscr_ctx, struct subscr_ext_entry);
+	if (!e)
+		return;
+	osmo_strlcpy(e->extension, ext, sizeof(e->extension));
+	e->expire = time(NULL) + SUBSCR_EXT_ABSENT_TTL;
+	llist_add_tail(&e->absent, &ext_absent_list);
+	ext_absent_count += 1;
+	e->next = *pos;
+	*pos = e;
+}
+
+/*! Bring the index up to date after an extension was read from the DB
+ *  or assigned to the subscriber. Nothing happens if it is the one the
+ *  index knows, otherwise the subscriber is indexed under the new one. */
+void subscr_ext_update(struct gsm_subscriber *subscr)
+{
+	if (subscr->ext_entry) {
+		if (strcmp(subscr->ext_entry->extension, subscr->extension) == 0)
+			return;
+		ext_del(subscr->ext_entry->extension);
+	}
+
+	/* replaces an entry saying the extension doesn't exist */
+	subscr_ext_add(subscr);
+}
+
+/*! Drop what the index knows about the subscriber's extension, e.g.
+ *  when the subscriber is deleted. */
+void subscr_ext_invalidate(struct gsm_subscriber *subscr)
+{
+	if (subscr->ext_entry)
+		ext_del(subscr->ext_entry->extension);
+	if (subscr->extension[0] != '\0')
+		ext_del(subscr->extension);
+}
+
 /* for the gsm_subscriber.c */
 struct llist_head *subscr_bsc_active_subscribers(void)
 {
@@ -70,8 +238,28 @@ struct gsm_subscriber *subscr_alloc(void)
 	return s;
 }
 
+/*
+ * Stale links between subscribers and connections abort debug builds,
+ * other builds log them and go on.
+ */
+#ifdef NDEBUG
+#define SUBSCR_CONN_CHECK(cond)						\
+	do {								\
+		if (!(cond))						\
+			LOGP(DREF, LOGL_ERROR, "Stale subscriber link: "	\
+			     "%s failed at %s:%d\n", #cond,		\
+			     __FILE__, __LINE__);			\
+	} while (0)
+#else
+#define SUBSCR_CONN_CHECK(cond)	OSMO_ASSERT(cond)
+#endif
+
 static void subscr_free(struct gsm_subscriber *subscr)
 {
+	/* a connection still holds a reference then */
+	SUBSCR_CONN_CHECK(!subscr->conn && subscr->num_conns == 0);
+	if (subscr->ext_entry)
+		ext_del(subscr->ext_entry->extension);
 	llist_del(&subscr->entry);
 	talloc_free(subscr);
 }
@@ -90,6 +278,64 @@ struct gsm_subscriber *subscr_get(struct gsm_subscriber *subscr)
 	return subscr;
 }
 
+/*! Hand the caller's reference to the subscriber over to the connection.
+ *  \param[in] conn connection without a subscriber
+ *  \param[in] subscr subscriber to attach, may be NULL
+ */
+void subscr_con_attach(struct gsm_subscriber_connection *conn,
+		       struct gsm_subscriber *subscr)
+{
+	SUBSCR_CONN_CHECK(!conn->subscr);
+	if (conn->subscr)
+		subscr_put(subscr_con_detach(conn));
+
+	conn->subscr = subscr;
+	if (!subscr)
+		return;
+
+	subscr->num_conns += 1;
+	if (!subscr->conn)
+		subscr->conn = conn;
+}
+
+/*! Unlink the subscriber from the connection.
+ *  \param[in] conn connection to detach the subscriber from
+ *  \returns the subscriber, the caller has to put the reference
+ */
+struct gsm_subscriber *subscr_con_detach(struct gsm_subscriber_connection *conn)
+{
+	struct gsm_subscriber *subscr = conn->subscr;
+	struct gsm_subscriber_connection *other;
+
+	if (!subscr)
+		return NULL;
+
+	SUBSCR_CONN_CHECK(subscr->num_conns > 0);
+	conn->subscr = NULL;
+	if (subscr->num_conns > 0)
+		subscr->num_conns -= 1;
+	if (subscr->conn != conn)
+		return subscr;
+
+	/* only in odd cases there is a second connection to look for */
+	subscr->conn = NULL;
+	if (subscr->num_conns == 0)
+		return subscr;
+	llist_for_each_entry(other, &conn->network->subscr_conns, entry) {
+		if (other->subscr == subscr) {
+			subscr->conn = other;
+			break;
+		}
+	}
+	return subscr;
+}
+
+struct gsm_subscriber_connection *connection_for_subscr(struct gsm_subscriber *subscr)
+{
+	SUBSCR_CONN_CHECK(!subscr->conn || subscr->conn->subscr == subscr);
+	return subscr->conn;
+}
+
 struct gsm_subscriber *subscr_put(struct gsm_subscriber *subscr)
 {
 	subscr->use_count--;
@@ -134,6 +380,19 @@ struct gsm_subscriber *subscr_active_by_tmsi(struct gsm_subscriber_group *sgrp,
 	return NULL;
 }
 
+struct gsm_subscriber *subscr_active_by_id(struct gsm_subscriber_group *sgrp,
+					   unsigned long long id)
+{
+	struct gsm_subscriber *subscr;
+
+	llist_for_each_entry(subscr, subscr_bsc_active_subscribers(), entry) {
+		if (subscr->id == id && subscr->group == sgrp)
+			return subscr_get(subscr);
+	}
+
+	return NULL;
+}
+
 struct gsm_subscriber *subscr_active_by_imsi(struct gsm_subscriber_group *sgrp,
 					     const char *imsi)
 {
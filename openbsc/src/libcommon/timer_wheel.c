@@ -0,0 +1,284 @@
+/* Hierarchical timer wheel for coarse timeouts */
+
+/*
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <openbsc/timer_wheel.h>
+
+/*
+ * Level n of the wheel holds the timers that expire in less than
+ * 64^(n+1) ticks and indexes them by bits 6n..6n+5 of their expiry.
+ * Whenever the lower bits of the current tick wrap around, the slot
+ * of the next level is emptied into the levels below it. The range
+ * of the wheel is 2^24 ticks, longer timeouts are cut to that.
+ */
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE	(1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+static struct timer_wheel default_wheel;
+static int default_wheel_init;
+
+static void timer_wheel_tick(void *data);
+
+static void wheel_insert(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+	uint32_t delta = timer->expires - wheel->now;
+	int level;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; ++level)
+		if (delta < 1u << (TIMER_WHEEL_BITS * (level + 1)))
+			break;
+
+	llist_add_tail(&timer->entry, &wheel->slots[level][
+		(timer->expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK]);
+}
+
+static void wheel_cascade(struct timer_wheel *wheel, int level)
+{
+	struct llist_head *slot;
+	struct llist_head list;
+
+	slot = &wheel->slots[level][
+		(wheel->now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	if (llist_empty(slot))
+		return;
+
+	/* the timers are all closer than one round of the level below */
+	INIT_LLIST_HEAD(&list);
+	llist_splice_init(slot, &list);
+	while (!llist_empty(&list)) {
+		struct wheel_timer *timer;
+
+		timer = llist_entry(list.next, struct wheel_timer, entry);
+		llist_del(&timer->entry);
+		wheel_insert(wheel, timer);
+	}
+}
+
+/*! Initialize a timer wheel.
+ *  \param[in] wheel the wheel to initialize
+ *  \param[in] tick_ms the granularity of the wheel in milliseconds
+ */
+void timer_wheel_init(struct timer_wheel *wheel, unsigned int tick_ms)
+{
+	int level, slot;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+		for (slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot)
+			INIT_LLIST_HEAD(&wheel->slots[level][slot]);
+
+	wheel->tick_ms = tick_ms;
+	wheel->now = 0;
+	wheel->until = 0;
+	wheel->pending = 0;
+	wheel->last.tv_sec = 0;
+	wheel->last.tv_nsec = 0;
+	osmo_timer_setup(&wheel->timer, timer_wheel_tick, wheel);
+}
+
+/*! The wheel shared by the users that are fine with the default tick. */
+struct timer_wheel *timer_wheel_default(void)
+{
+	if (!default_wheel_init) {
+		timer_wheel_init(&default_wheel, TIMER_WHEEL_TICK_MS);
+		default_wheel_init = 1;
+	}
+	return &default_wheel;
+}
+
+/* move the wheel forward and fire the timers that expire */
+static void timer_wheel_advance(struct timer_wheel *wheel, uint32_t ticks)
+{
+	struct llist_head list;
+
+	INIT_LLIST_HEAD(&list);
+	wheel->until = wheel->now + ticks;
+	while (ticks > 0) {
+		struct llist_head *slot;
+		int level;
+
+		/* nothing is waiting for the ticks */
+		if (wheel->pending == 0) {
+			wheel->now += ticks;
+			break;
+		}
+
+		ticks -= 1;
+		wheel->now += 1;
+
+		for (level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+			if (wheel->now & ((1u << (TIMER_WHEEL_BITS * level)) - 1))
+				break;
+			wheel_cascade(wheel, level);
+		}
+
+		/*
+		 * The callbacks might arm and cancel timers of this slot,
+		 * take one after another from a private list.
+		 */
+		slot = &wheel->slots[0][wheel->now & TIMER_WHEEL_MASK];
+		llist_splice_init(slot, &list);
+		while (!llist_empty(&list)) {
+			struct wheel_timer *timer;
+
+			timer = llist_entry(list.next, struct wheel_timer, entry);
+			llist_del(&timer->entry);
+			timer->active = 0;
+			wheel->pending -= 1;
+			timer->cb(timer->data);
+		}
+	}
+}
+
+static void timer_wheel_arm(struct timer_wheel *wheel, unsigned int ms)
+{
+	osmo_timer_schedule(&wheel->timer, ms / 1000, (ms % 1000) * 1000);
+}
+
+/* milliseconds since the current tick, a clock going back counts as 0 */
+static unsigned long long wheel_elapsed_ms(struct timer_wheel *wheel)
+{
+	struct timespec now;
+	long long ns;
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (long long) (now.tv_sec - wheel->last.tv_sec) * 1000000000
+		+ now.tv_nsec - wheel->last.tv_nsec;
+	if (ns < 0)
+		return 0;
+	return ns / 1000000;
+}
+
+static void timer_wheel_tick(void *data)
+{
+	struct timer_wheel *wheel = data;
+	unsigned long long elapsed, ms;
+	uint32_t ticks;
+
+	elapsed = wheel_elapsed_ms(wheel);
+	if (elapsed / wheel->tick_ms >= TIMER_WHEEL_RANGE)
+		ticks = TIMER_WHEEL_RANGE - 1;
+	else
+		ticks = elapsed / wheel->tick_ms;
+
+	/* the time of the tick the wheel is about to reach */
+	ms = (unsigned long long) ticks * wheel->tick_ms;
+	wheel->last.tv_sec += ms / 1000;
+	wheel->last.tv_nsec += (ms % 1000) * 1000000;
+	if (wheel->last.tv_nsec >= 1000000000) {
+		wheel->last.tv_sec += 1;
+		wheel->last.tv_nsec -= 1000000000;
+	}
+
+	timer_wheel_advance(wheel, ticks);
+
+	/* timers armed by the callbacks have taken care of it already */
+	if (wheel->pending > 0 && !osmo_timer_pending(&wheel->timer))
+		timer_wheel_arm(wheel, wheel->tick_ms - elapsed % wheel->tick_ms);
+}
+
+/*! Set up a timer of a wheel.
+ *  \param[in] timer the timer to set up
+ *  \param[in] wheel the wheel the timer will be armed on
+ *  \param[in] cb the function to call on expiry
+ *  \param[in] data the argument of cb
+ */
+void wheel_timer_setup(struct wheel_timer *timer, struct timer_wheel *wheel,
+		       void (*cb)(void *data), void *data)
+{
+	INIT_LLIST_HEAD(&timer->entry);
+	timer->wheel = wheel;
+	timer->active = 0;
+	timer->cb = cb;
+	timer->data = data;
+}
+
+/*! Arm a timer, it will not expire before the timeout has passed.
+ *  A timer that is already armed is moved to the new timeout.
+ *  \param[in] timer the timer to arm
+ *  \param[in] seconds the seconds of the timeout
+ *  \param[in] microseconds the microseconds of the timeout
+ */
+void wheel_timer_schedule(struct wheel_timer *timer, int seconds,
+			  int microseconds)
+{
+	struct timer_wheel *wheel = timer->wheel;
+	int idle = wheel->pending == 0;
+	unsigned long long ms;
+	uint32_t ticks, behind;
+
+	ms = (unsigned long long) seconds * 1000 + (microseconds + 999) / 1000;
+
+	/*
+	 * The wheel has moved on since the time of its current tick. This
+	 * is also the case for timers armed by the callbacks of a tick,
+	 * even though the osmo timer is not pending then.
+	 */
+	if (!idle)
+		ms += wheel_elapsed_ms(wheel);
+
+	/*
+	 * The time of the wheel is that of the tick it is advancing to.
+	 * When a late tick catches up, the callbacks run while now is
+	 * still behind it, count from there and not from now.
+	 */
+	behind = wheel->until - wheel->now;
+	ticks = (ms + wheel->tick_ms - 1) / wheel->tick_ms;
+	if (ticks == 0)
+		ticks = 1;
+	if (ticks >= TIMER_WHEEL_RANGE - behind)
+		ticks = TIMER_WHEEL_RANGE - behind - 1;
+
+	if (timer->active)
+		llist_del(&timer->entry);
+	else
+		wheel->pending += 1;
+
+	timer->active = 1;
+	timer->expires = wheel->until + ticks;
+	wheel_insert(wheel, timer);
+
+	/* an idle wheel starts ticking now, a busy one keeps its time */
+	if (idle) {
+		osmo_clock_gettime(CLOCK_MONOTONIC, &wheel->last);
+		timer_wheel_arm(wheel, wheel->tick_ms);
+	}
+}
+
+/*! Cancel a timer, nothing happens if it is not armed. */
+void wheel_timer_del(struct wheel_timer *timer)
+{
+	if (!timer->active)
+		return;
+
+	llist_del(&timer->entry);
+	INIT_LLIST_HEAD(&timer->entry);
+	timer->active = 0;
+	timer->wheel->pending -= 1;
+
+	if (timer->wheel->pending == 0)
+		osmo_timer_del(&timer->wheel->timer);
+}
+
+/*! Check if a timer is armed. */
+int wheel_timer_pending(const struct wheel_timer *timer)
+{
+	return timer->active;
+}
@@ -115,6 +115,17 @@ static const struct mgcp_request mgcp_requests [] = {
 	MGCP_REQUEST("RSIP", handle_rsip, "ReSetInProgress")
 };
 
+/* the verb is the first four characters of a command */
+static const struct mgcp_request *mgcp_find_request(const char *verb)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mgcp_requests); ++i)
+		if (memcmp(mgcp_requests[i].name, verb, 4) == 0)
+			return &mgcp_requests[i];
+	return NULL;
+}
+
 static struct msgb *mgcp_msgb_alloc(void)
 {
 	struct msgb *msg;
@@ -125,14 +136,14 @@ static struct msgb *mgcp_msgb_alloc(void)
 	return msg;
 }
 
-static struct msgb *do_retransmission(const struct mgcp_endpoint *endp)
+static struct msgb *do_retransmission(const char *resp, size_t len)
 {
 	struct msgb *msg = mgcp_msgb_alloc();
 	if (!msg)
 		return NULL;
 
-	msg->l2h = msgb_put(msg, strlen(endp->last_response));
-	memcpy(msg->l2h, endp->last_response, msgb_l2len(msg));
+	msg->l2h = msgb_put(msg, len);
+	memcpy(msg->l2h, resp, len);
 	return msg;
 }
 
@@ -160,17 +171,12 @@ static struct msgb *create_resp(struct mgcp_endpoint *endp, int code,
 	LOGP(DMGCP, LOGL_DEBUG, "Generated response: code: %d for '%s'\n", code, res->l2h);
 
 	/*
-	 * Remember the last transmission per endpoint.
+	 * Remember the transmission for answering retransmissions.
 	 */
-	if (endp) {
-		struct mgcp_trunk_config *tcfg = endp->tcfg;
-		talloc_free(endp->last_response);
-		talloc_free(endp->last_trans);
-		endp->last_trans = talloc_strdup(tcfg->endpoints, trans);
-		endp->last_response = talloc_strndup(tcfg->endpoints,
-						(const char *) res->l2h,
-						msgb_l2len(res));
-	}
+	if (endp)
+		mgcp_trans_cache_store(endp->cfg, endp, trans,
+				       (const char *) res->l2h,
+				       msgb_l2len(res));
 
 	return res;
 }
@@ -317,8 +323,7 @@ static void send_dummy(struct mgcp_endpoint *endp)
 struct msgb *mgcp_handle_message(struct mgcp_config *cfg, struct msgb *msg)
 {
 	struct mgcp_parse_data pdata;
-	int i, code, handled = 0;
-	struct msgb *resp = NULL;
+	const struct mgcp_request *request;
 	char *data;
 	unsigned char *tail = msg->l2h + msgb_l2len(msg); /* char after l2 data */
 
@@ -341,14 +346,19 @@ struct msgb *mgcp_handle_message(struct mgcp_config *cfg, struct msgb *msg)
 		return NULL;
 	}
 
-        /* attempt to treat it as a response */
-        if (sscanf((const char *)&msg->l2h[0], "%3d %*s", &code) == 1) {
-		LOGP(DMGCP, LOGL_DEBUG, "Response: Code: %d\n", code);
+	/* attempt to treat it as a response */
+	if (isdigit(msg->l2h[0]) && isdigit(msg->l2h[1]) && isdigit(msg->l2h[2])) {
+		LOGP(DMGCP, LOGL_DEBUG, "Response: Code: %.3s\n", msg->l2h);
 		return NULL;
 	}
 
-	msg->l3h = &msg->l2h[4];
+	request = mgcp_find_request((const char *) msg->l2h);
+	if (!request) {
+		LOGP(DMGCP, LOGL_NOTICE, "MSG with type: '%.4s' not handled\n", &msg->l2h[0]);
+		return NULL;
+	}
 
+	msg->l3h = &msg->l2h[4];
 
 	/*
 	 * Check for a duplicate message and respond.
@@ -357,24 +367,19 @@ struct msgb *mgcp_handle_message(struct mgcp_config *cfg, struct msgb *msg)
 	pdata.cfg = cfg;
 	data = strline_r((char *) msg->l3h, &pdata.save);
 	pdata.found = mgcp_analyze_header(&pdata, data);
-	if (pdata.endp && pdata.trans
-			&& pdata.endp->last_trans
-			&& strcmp(pdata.endp->last_trans, pdata.trans) == 0) {
-		return do_retransmission(pdata.endp);
-	}
-
-	for (i = 0; i < ARRAY_SIZE(mgcp_requests); ++i) {
-		if (strncmp(mgcp_requests[i].name, (const char *) &msg->l2h[0], 4) == 0) {
-			handled = 1;
-			resp = mgcp_requests[i].handle_request(&pdata);
-			break;
+	if (pdata.endp && pdata.trans) {
+		const char *cached;
+		size_t len;
+
+		cached = mgcp_trans_cache_lookup(cfg, pdata.endp, pdata.trans, &len);
+		if (cached) {
+			LOGP(DMGCP, LOGL_DEBUG, "Retransmission of %s on 0x%x\n",
+			     pdata.trans, ENDPOINT_NUMBER(pdata.endp));
+			return do_retransmission(cached, len);
 		}
 	}
 
-	if (!handled)
-		LOGP(DMGCP, LOGL_NOTICE, "MSG with type: '%.4s' not handled\n", &msg->l2h[0]);
-
-	return resp;
+	return request->handle_request(&pdata);
 }
 
 /**
@@ -440,6 +445,24 @@ static struct mgcp_endpoint *find_endpoint(struct mgcp_config *cfg, const char *
 	return NULL;
 }
 
+/* split the next space separated word off the status line in place */
+static char *header_word(char **pos)
+{
+	char *start = *pos, *end;
+
+	while (*start == ' ')
+		++start;
+	if (*start == '\0')
+		return NULL;
+
+	for (end = start; *end != ' ' && *end != '\0'; ++end)
+		;
+	if (*end == ' ')
+		*end++ = '\0';
+	*pos = end;
+	return start;
+}
+
 /**
  * @returns 0 when the status line was complete and transaction_id and
  * endp out parameters are set.
@@ -447,13 +470,12 @@ static struct mgcp_endpoint *find_endpoint(struct mgcp_config *cfg, const char *
 static int mgcp_analyze_header(struct mgcp_parse_data *pdata, char *data)
 {
 	int i = 0;
-	char *elem, *save = NULL;
+	char *elem;
 
 	OSMO_ASSERT(data);
 	pdata->trans = "000000";
 
-	for (elem = strtok_r(data, " ", &save); elem;
-	     elem = strtok_r(NULL, " ", &save)) {
+	while ((elem = header_word(&data))) {
 		switch (i) {
 		case 0:
 			pdata->trans = elem;
@@ -832,8 +854,8 @@ mgcp_header_done:
 	endp->bts_jitter_delay_min = endp->cfg->bts_jitter_delay_min;
 	endp->bts_jitter_delay_max = endp->cfg->bts_jitter_delay_max;
 
-
 	endp->allocated = 1;
+	endp->trans_gen += 1;
 
 	/* set up RTP media parameters */
 	mgcp_set_audio_info(p->cfg, &endp->bts_end.codec, tcfg->audio_payload, tcfg->audio_name);
@@ -1359,6 +1381,7 @@ void mgcp_release_endp(struct mgcp_endpoint *endp)
 	endp->bts_jb = NULL;
 	endp->ci = CI_UNUSED;
 	endp->allocated = 0;
+	endp->trans_gen += 1;
 
 	talloc_free(endp->callid);
 	endp->callid = NULL;
@@ -0,0 +1,203 @@
+/* A Media Gateway Control Protocol Media Gateway: RFC 3435 */
+/* Responses remembered for answering retransmitted commands */
+
+/*
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <openbsc/mgcp.h>
+#include <openbsc/mgcp_internal.h>
+
+#include <osmocom/core/talloc.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * RFC 3435 wants a response to be repeated for as long as the call
+ * agent may retransmit the command. We keep the last responses of all
+ * endpoints in a ring and index them by endpoint and transaction id.
+ * The endpoint generation is part of the key so that a transaction id
+ * reused for a new call on the endpoint is handled again.
+ */
+#define MGCP_TRANS_CACHE_SIZE	1024
+#define MGCP_TRANS_ID_LEN	32
+
+struct mgcp_trans_entry {
+	const struct mgcp_endpoint *endp;
+	uint32_t gen;
+	uint32_t hash;
+	int next;
+
+	char trans[MGCP_TRANS_ID_LEN];
+	char *resp;
+	size_t resp_len;
+};
+
+struct mgcp_trans_cache {
+	struct mgcp_trans_entry entries[MGCP_TRANS_CACHE_SIZE];
+	int buckets[MGCP_TRANS_CACHE_SIZE];
+
+	/* ring position that is replaced next and number of used entries */
+	int oldest;
+	int used;
+
+	unsigned int hits;
+};
+
+static uint32_t trans_hash(const struct mgcp_endpoint *endp, const char *trans)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*trans) {
+		hash ^= (uint8_t) *trans++;
+		hash *= 16777619u;
+	}
+
+	hash ^= (uintptr_t) endp >> 4;
+	hash *= 16777619u;
+	hash ^= endp->trans_gen;
+	hash *= 16777619u;
+	return hash;
+}
+
+static struct mgcp_trans_cache *trans_cache_alloc(struct mgcp_config *cfg)
+{
+	struct mgcp_trans_cache *cache;
+	int i;
+
+	cache = talloc_zero(cfg, struct mgcp_trans_cache);
+	if (!cache)
+		return NULL;
+
+	for (i = 0; i < MGCP_TRANS_CACHE_SIZE; ++i)
+		cache->buckets[i] = -1;
+	cfg->trans_cache = cache;
+	return cache;
+}
+
+static void trans_cache_unlink(struct mgcp_trans_cache *cache, int idx)
+{
+	struct mgcp_trans_entry *entry = &cache->entries[idx];
+	int *link = &cache->buckets[entry->hash % MGCP_TRANS_CACHE_SIZE];
+
+	while (*link != idx)
+		link = &cache->entries[*link].next;
+	*link = entry->next;
+
+	talloc_free(entry->resp);
+	entry->resp = NULL;
+}
+
+/*! Look up the response to an already handled transaction.
+ *  \param[in] cfg the MGCP configuration
+ *  \param[in] endp the endpoint the command was sent to
+ *  \param[in] trans the transaction id of the command
+ *  \param[out] len the length of the response
+ *  \returns the response or NULL if the transaction is not known
+ */
+const char *mgcp_trans_cache_lookup(struct mgcp_config *cfg,
+				    const struct mgcp_endpoint *endp,
+				    const char *trans, size_t *len)
+{
+	struct mgcp_trans_cache *cache = cfg->trans_cache;
+	uint32_t hash;
+	int idx;
+
+	if (!cache)
+		return NULL;
+
+	hash = trans_hash(endp, trans);
+	for (idx = cache->buckets[hash % MGCP_TRANS_CACHE_SIZE]; idx >= 0;
+	     idx = cache->entries[idx].next) {
+		struct mgcp_trans_entry *entry = &cache->entries[idx];
+
+		if (entry->hash != hash || entry->endp != endp
+		    || entry->gen != endp->trans_gen
+		    || strcmp(entry->trans, trans) != 0)
+			continue;
+
+		cache->hits += 1;
+		*len = entry->resp_len;
+		return entry->resp;
+	}
+
+	return NULL;
+}
+
+/*! Remember the response to a transaction.
+ *  The oldest response is forgotten once the cache is full.
+ *  \param[in] cfg the MGCP configuration
+ *  \param[in] endp the endpoint the command was sent to
+ *  \param[in] trans the transaction id of the command
+ *  \param[in] resp the response that was generated
+ *  \param[in] len the length of the response
+ */
+void mgcp_trans_cache_store(struct mgcp_config *cfg,
+			    const struct mgcp_endpoint *endp,
+			    const char *trans, const char *resp, size_t len)
+{
+	struct mgcp_trans_cache *cache = cfg->trans_cache;
+	struct mgcp_trans_entry *entry;
+	size_t trans_len = strlen(trans);
+	int idx, bucket;
+
+	if (trans_len >= MGCP_TRANS_ID_LEN) {
+		LOGP(DMGCP, LOGL_NOTICE,
+		     "Transaction id too long to remember on 0x%x\n",
+		     ENDPOINT_NUMBER(endp));
+		return;
+	}
+
+	if (!cache)
+		cache = trans_cache_alloc(cfg);
+	if (!cache)
+		return;
+
+	idx = cache->oldest;
+	if (cache->used == MGCP_TRANS_CACHE_SIZE)
+		trans_cache_unlink(cache, idx);
+	else
+		cache->used += 1;
+	cache->oldest = (idx + 1) % MGCP_TRANS_CACHE_SIZE;
+
+	entry = &cache->entries[idx];
+	entry->resp = talloc_strndup(cache, resp, len);
+	if (!entry->resp) {
+		/* keep the slot unlinked and reuse it next time */
+		cache->used -= 1;
+		cache->oldest = idx;
+		return;
+	}
+	entry->resp_len = len;
+	entry->endp = endp;
+	entry->gen = endp->trans_gen;
+	entry->hash = trans_hash(endp, trans);
+	memcpy(entry->trans, trans, trans_len + 1);
+
+	bucket = entry->hash % MGCP_TRANS_CACHE_SIZE;
+	entry->next = cache->buckets[bucket];
+	cache->buckets[bucket] = idx;
+}
+
+/*! Number of commands answered from the cache. */
+unsigned int mgcp_trans_cache_hits(const struct mgcp_config *cfg)
+{
+	return cfg->trans_cache ? cfg->trans_cache->hits : 0;
+}
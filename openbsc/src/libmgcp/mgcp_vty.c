@@ -1595,6 +1595,8 @@ int mgcp_parse_config(const char *config_file, struct mgcp_config *cfg,
 		return rc;
 	}
 
+	/* the config might have set up log targets */
+	bsc_log_level_cache_invalidate();
 
 	if (!g_cfg->bts_ip)
 		fprintf(stderr, "No BTS ip address specified. This will allow everyone to connect.\n");
@@ -0,0 +1,153 @@
+/* Capture all counters at once for storing them elsewhere */
+
+/*
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/statistics.h>
+#include <osmocom/core/rate_ctr.h>
+
+#include <openbsc/ctr_snapshot.h>
+
+struct snapshot_state {
+	void *ctx;
+	struct ctr_snapshot *snap;
+	unsigned int num_counters;
+	unsigned int num_rate_ctrs;
+};
+
+/* the arrays are kept between snapshots and only ever grow */
+static struct ctr_sample *next_sample(void *ctx, struct ctr_sample **samples,
+				      unsigned int *num, unsigned int *size)
+{
+	struct ctr_sample *grown;
+	unsigned int new_size;
+
+	if (*num == *size) {
+		new_size = *size ? *size * 2 : 64;
+		grown = talloc_realloc(ctx, *samples, struct ctr_sample,
+				       new_size);
+		if (!grown)
+			return NULL;
+		*samples = grown;
+		*size = new_size;
+	}
+
+	return &(*samples)[(*num)++];
+}
+
+static int take_counter(struct osmo_counter *ctr, void *data)
+{
+	struct snapshot_state *state = data;
+	struct ctr_snapshot *snap = state->snap;
+	struct ctr_sample *sample;
+
+	sample = next_sample(state->ctx, &snap->counters, &snap->num_counters,
+			     &state->num_counters);
+	if (!sample)
+		return -ENOMEM;
+
+	sample->prefix = NULL;
+	sample->name = ctr->name;
+	sample->idx = 0;
+	sample->value = ctr->value;
+	return 0;
+}
+
+static int take_rate_ctr_group(struct rate_ctr_group *ctrg, void *data)
+{
+	struct snapshot_state *state = data;
+	struct ctr_snapshot *snap = state->snap;
+	struct ctr_sample *sample;
+	unsigned int i;
+
+	for (i = 0; i < ctrg->desc->num_ctr; i++) {
+		sample = next_sample(state->ctx, &snap->rate_ctrs,
+				     &snap->num_rate_ctrs,
+				     &state->num_rate_ctrs);
+		if (!sample)
+			return -ENOMEM;
+
+		sample->prefix = ctrg->desc->group_name_prefix;
+		sample->name = ctrg->desc->ctr_desc[i].name;
+		sample->idx = ctrg->idx;
+		sample->value = ctrg->ctr[i].current;
+	}
+	return 0;
+}
+
+/*! Copy the current value of every counter and rate counter.
+ *  The arrays of a previous snapshot are reused.
+ *  \param[in] ctx talloc context for the arrays
+ *  \param[in,out] snap the snapshot, zero it before the first use
+ *  \returns 0 on success, negative on error
+ */
+int ctr_snapshot_take(void *ctx, struct ctr_snapshot *snap)
+{
+	struct snapshot_state state = {
+		.ctx = ctx,
+		.snap = snap,
+		.num_counters = snap->counters ?
+			talloc_array_length(snap->counters) : 0,
+		.num_rate_ctrs = snap->rate_ctrs ?
+			talloc_array_length(snap->rate_ctrs) : 0,
+	};
+	int rc;
+
+	snap->time = time(NULL);
+	snap->num_counters = 0;
+	snap->num_rate_ctrs = 0;
+
+	rc = osmo_counters_for_each(take_counter, &state);
+	if (rc < 0)
+		return rc;
+	return rate_ctr_for_each_group(take_rate_ctr_group, &state);
+}
+
+/*! Append a snapshot as "time,name,index,value" lines to a file.
+ *  \param[in] snap the snapshot
+ *  \param[in] file the file to write to, it is flushed once at the end
+ *  \returns 0 on success, negative on error
+ */
+int ctr_snapshot_write_csv(const struct ctr_snapshot *snap, FILE *file)
+{
+	const struct ctr_sample *sample;
+	unsigned int i;
+
+	for (i = 0; i < snap->num_counters; i++) {
+		sample = &snap->counters[i];
+		fprintf(file, "%ld,%s,%u,%"PRIu64"\n", (long) snap->time,
+			sample->name, sample->idx, sample->value);
+	}
+
+	for (i = 0; i < snap->num_rate_ctrs; i++) {
+		sample = &snap->rate_ctrs[i];
+		fprintf(file, "%ld,%s.%s,%u,%"PRIu64"\n", (long) snap->time,
+			sample->prefix, sample->name, sample->idx,
+			sample->value);
+	}
+
+	if (fflush(file) != 0 || ferror(file))
+		return -EIO;
+	return 0;
+}
@@ -103,6 +103,7 @@ static int set_subscriber_modify(struct ctrl_cmd *cmd, void *data)
 
 	subscr->authorized = 1;
 	osmo_strlcpy(subscr->extension, msisdn, sizeof(subscr->extension));
+	subscr_ext_update(subscr);
 
 	/* put it back to the db */
 	rc = db_sync_subscriber(subscr);
@@ -209,6 +210,23 @@ static int get_subscriber_list(struct ctrl_cmd *cmd, void *d)
 }
 CTRL_CMD_DEFINE_RO(subscriber_list, "subscriber-list-active-v1");
 
+static int get_subscriber_expire(struct ctrl_cmd *cmd, void *d)
+{
+	struct gsm_network *net = cmd->node;
+	struct rate_ctr *ctr = &net->msc_ctrs->ctr[MSC_CTR_SUBSCR_EXPIRED];
+
+	cmd->reply = talloc_asprintf(cmd, "%u,%lu,%lu",
+				     net->subscr_expire_backlog,
+				     ctr->current,
+				     ctr->intv[RATE_CTR_INTV_SEC].rate);
+	if (!cmd->reply) {
+		cmd->reply = "OOM";
+		return CTRL_CMD_ERROR;
+	}
+	return CTRL_CMD_REPLY;
+}
+CTRL_CMD_DEFINE_RO(subscriber_expire, "subscriber-expire-v1");
+
 int msc_ctrl_cmds_install(void)
 {
 	int rc = 0;
@@ -216,5 +234,6 @@ int msc_ctrl_cmds_install(void)
 	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_subscriber_modify);
 	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_subscriber_delete);
 	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_subscriber_list);
+	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_subscriber_expire);
 	return rc;
 }
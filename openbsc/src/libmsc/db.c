@@ -20,6 +20,7 @@
  */
 
 #include <stdint.h>
+#include <stdarg.h>
 #include <inttypes.h>
 #include <libgen.h>
 #include <stdio.h>
@@ -34,6 +35,8 @@
 #include <openbsc/gsm_04_11.h>
 #include <openbsc/db.h>
 #include <openbsc/debug.h>
+#include <openbsc/tmsi_set.h>
+#include <openbsc/ctr_snapshot.h>
 
 #include <osmocom/gsm/protocol/gsm_23_003.h>
 #include <osmocom/core/talloc.h>
@@ -48,6 +51,41 @@ static char *db_basename = NULL;
 static char *db_dirname = NULL;
 static dbi_conn conn;
 
+/* every query goes through db_conn_query(), see db_query_count() */
+static unsigned long long num_queries;
+
+static dbi_result db_conn_query(dbi_conn c, const char *query)
+{
+	num_queries++;
+	return dbi_conn_query(c, query);
+}
+
+static dbi_result db_conn_queryf(dbi_conn c, const char *fmt, ...)
+{
+	dbi_result result;
+	va_list ap;
+	char *query;
+
+	va_start(ap, fmt);
+	query = talloc_vasprintf(NULL, fmt, ap);
+	va_end(ap);
+	if (!query)
+		return NULL;
+
+	result = db_conn_query(c, query);
+	talloc_free(query);
+	return result;
+}
+
+/*
+ * The TMSIs of the Subscriber table, to allocate new ones without a
+ * query. TMSIs that are given up stay in the set until it is loaded
+ * again, which only costs another draw if one of them comes up.
+ */
+static struct tmsi_set tmsi_set;
+static bool tmsi_set_valid;
+static unsigned int tmsi_set_loaded;
+
 #define SCHEMA_REVISION "5"
 
 enum {
@@ -181,6 +219,15 @@ static const char *create_stmts[] = {
 		")",
 };
 
+static const char *create_index_stmts[] = {
+	"CREATE INDEX IF NOT EXISTS SubscriberExpireLu "
+		"ON Subscriber (expire_lu)",
+	"CREATE INDEX IF NOT EXISTS CountersTimestamp "
+		"ON Counters (timestamp)",
+	"CREATE INDEX IF NOT EXISTS RateCountersTimestamp "
+		"ON RateCounters (timestamp)",
+};
+
 static inline int next_row(dbi_result result)
 {
 	if (!dbi_result_has_next_row(result))
@@ -200,7 +247,7 @@ static int update_db_revision_2(void)
 {
 	dbi_result result;
 
-	result = dbi_conn_query(conn,
+	result = db_conn_query(conn,
 				"ALTER TABLE Subscriber "
 				"ADD COLUMN expire_lu "
 				"TIMESTAMP DEFAULT NULL");
@@ -211,7 +258,7 @@ static int update_db_revision_2(void)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_query(conn,
+	result = db_conn_query(conn,
 				"UPDATE Meta "
 				"SET value = '3' "
 				"WHERE key = 'revision'");
@@ -282,7 +329,7 @@ static int update_db_revision_3(void)
 
 	LOGP(DDB, LOGL_NOTICE, "Going to migrate from revision 3\n");
 
-	result = dbi_conn_query(conn, "BEGIN EXCLUSIVE TRANSACTION");
+	result = db_conn_query(conn, "BEGIN EXCLUSIVE TRANSACTION");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 			"Failed to begin transaction (upgrade from rev 3)\n");
@@ -291,7 +338,7 @@ static int update_db_revision_3(void)
 	dbi_result_free(result);
 
 	/* Rename old SMS table to be able create a new one */
-	result = dbi_conn_query(conn, "ALTER TABLE SMS RENAME TO SMS_3");
+	result = db_conn_query(conn, "ALTER TABLE SMS RENAME TO SMS_3");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed to rename the old SMS table (upgrade from rev 3).\n");
@@ -300,7 +347,7 @@ static int update_db_revision_3(void)
 	dbi_result_free(result);
 
 	/* Create new SMS table with all the bells and whistles! */
-	result = dbi_conn_query(conn, create_stmts[SCHEMA_SMS]);
+	result = db_conn_query(conn, create_stmts[SCHEMA_SMS]);
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed to create a new SMS table (upgrade from rev 3).\n");
@@ -309,7 +356,7 @@ static int update_db_revision_3(void)
 	dbi_result_free(result);
 
 	/* Cycle through old messages and convert them to the new format */
-	result = dbi_conn_query(conn, "SELECT * FROM SMS_3");
+	result = db_conn_query(conn, "SELECT * FROM SMS_3");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed fetch messages from the old SMS table (upgrade from rev 3).\n");
@@ -328,7 +375,7 @@ static int update_db_revision_3(void)
 	dbi_result_free(result);
 
 	/* Remove the temporary table */
-	result = dbi_conn_query(conn, "DROP TABLE SMS_3");
+	result = db_conn_query(conn, "DROP TABLE SMS_3");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed to drop the old SMS table (upgrade from rev 3).\n");
@@ -337,7 +384,7 @@ static int update_db_revision_3(void)
 	dbi_result_free(result);
 
 	/* We're done. Bump DB Meta revision to 4 */
-	result = dbi_conn_query(conn,
+	result = db_conn_query(conn,
 				"UPDATE Meta "
 				"SET value = '4' "
 				"WHERE key = 'revision'");
@@ -348,7 +395,7 @@ static int update_db_revision_3(void)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_query(conn, "COMMIT TRANSACTION");
+	result = db_conn_query(conn, "COMMIT TRANSACTION");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 			"Failed to commit the transaction (upgrade from rev 3)\n");
@@ -358,7 +405,7 @@ static int update_db_revision_3(void)
 	}
 
 	/* Shrink DB file size by actually wiping out SMS_3 table data */
-	result = dbi_conn_query(conn, "VACUUM");
+	result = db_conn_query(conn, "VACUUM");
 	if (!result)
 		LOGP(DDB, LOGL_ERROR,
 			"VACUUM failed. Ignoring it (upgrade from rev 3).\n");
@@ -368,7 +415,7 @@ static int update_db_revision_3(void)
 	return 0;
 
 rollback:
-	result = dbi_conn_query(conn, "ROLLBACK TRANSACTION");
+	result = db_conn_query(conn, "ROLLBACK TRANSACTION");
 	if (!result)
 		LOGP(DDB, LOGL_ERROR,
 			"Rollback failed (upgrade from rev 3).\n");
@@ -428,7 +475,7 @@ static int update_db_revision_4(void)
 
 	LOGP(DDB, LOGL_NOTICE, "Going to migrate from revision 4\n");
 
-	result = dbi_conn_query(conn, "BEGIN EXCLUSIVE TRANSACTION");
+	result = db_conn_query(conn, "BEGIN EXCLUSIVE TRANSACTION");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 			"Failed to begin transaction (upgrade from rev 4)\n");
@@ -437,7 +484,7 @@ static int update_db_revision_4(void)
 	dbi_result_free(result);
 
 	/* Rename old SMS table to be able create a new one */
-	result = dbi_conn_query(conn, "ALTER TABLE SMS RENAME TO SMS_4");
+	result = db_conn_query(conn, "ALTER TABLE SMS RENAME TO SMS_4");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed to rename the old SMS table (upgrade from rev 4).\n");
@@ -446,7 +493,7 @@ static int update_db_revision_4(void)
 	dbi_result_free(result);
 
 	/* Create new SMS table with all the bells and whistles! */
-	result = dbi_conn_query(conn, create_stmts[SCHEMA_SMS]);
+	result = db_conn_query(conn, create_stmts[SCHEMA_SMS]);
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed to create a new SMS table (upgrade from rev 4).\n");
@@ -455,7 +502,7 @@ static int update_db_revision_4(void)
 	dbi_result_free(result);
 
 	/* Cycle through old messages and convert them to the new format */
-	result = dbi_conn_query(conn, "SELECT * FROM SMS_4");
+	result = db_conn_query(conn, "SELECT * FROM SMS_4");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed fetch messages from the old SMS table (upgrade from rev 4).\n");
@@ -474,7 +521,7 @@ static int update_db_revision_4(void)
 	dbi_result_free(result);
 
 	/* Remove the temporary table */
-	result = dbi_conn_query(conn, "DROP TABLE SMS_4");
+	result = db_conn_query(conn, "DROP TABLE SMS_4");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 		     "Failed to drop the old SMS table (upgrade from rev 4).\n");
@@ -483,7 +530,7 @@ static int update_db_revision_4(void)
 	dbi_result_free(result);
 
 	/* We're done. Bump DB Meta revision to 4 */
-	result = dbi_conn_query(conn,
+	result = db_conn_query(conn,
 				"UPDATE Meta "
 				"SET value = '5' "
 				"WHERE key = 'revision'");
@@ -494,7 +541,7 @@ static int update_db_revision_4(void)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_query(conn, "COMMIT TRANSACTION");
+	result = db_conn_query(conn, "COMMIT TRANSACTION");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR,
 			"Failed to commit the transaction (upgrade from rev 4)\n");
@@ -504,7 +551,7 @@ static int update_db_revision_4(void)
 	}
 
 	/* Shrink DB file size by actually wiping out SMS_4 table data */
-	result = dbi_conn_query(conn, "VACUUM");
+	result = db_conn_query(conn, "VACUUM");
 	if (!result)
 		LOGP(DDB, LOGL_ERROR,
 			"VACUUM failed. Ignoring it (upgrade from rev 4).\n");
@@ -514,7 +561,7 @@ static int update_db_revision_4(void)
 	return 0;
 
 rollback:
-	result = dbi_conn_query(conn, "ROLLBACK TRANSACTION");
+	result = db_conn_query(conn, "ROLLBACK TRANSACTION");
 	if (!result)
 		LOGP(DDB, LOGL_ERROR,
 			"Rollback failed (upgrade from rev 4).\n");
@@ -530,7 +577,7 @@ static int check_db_revision(void)
 	int db_rev = 0;
 
 	/* Make a query */
-	result = dbi_conn_query(conn,
+	result = db_conn_query(conn,
 		"SELECT value FROM Meta "
 		"WHERE key = 'revision'");
 
@@ -590,7 +637,7 @@ static int db_configure(void)
 {
 	dbi_result result;
 
-	result = dbi_conn_query(conn,
+	result = db_conn_query(conn,
 				"PRAGMA synchronous = FULL");
 	if (!result)
 		return -EINVAL;
@@ -638,13 +685,46 @@ out_err:
 }
 
 
+static int tmsi_set_load(void)
+{
+	dbi_result result;
+	const char *string;
+
+	tmsi_set_clear(&tmsi_set);
+	tmsi_set_valid = false;
+
+	result = db_conn_query(conn,
+			"SELECT tmsi FROM Subscriber WHERE tmsi IS NOT NULL");
+	if (!result) {
+		LOGP(DDB, LOGL_ERROR, "Failed to load the TMSIs.\n");
+		return -EIO;
+	}
+
+	while (next_row(result)) {
+		string = dbi_result_get_string(result, "tmsi");
+		if (!string)
+			continue;
+		if (tmsi_set_add(&tmsi_set, tmsi_from_string(string)) < 0) {
+			LOGP(DDB, LOGL_ERROR, "Failed to load the TMSIs.\n");
+			dbi_result_free(result);
+			tmsi_set_clear(&tmsi_set);
+			return -ENOMEM;
+		}
+	}
+	dbi_result_free(result);
+
+	tmsi_set_valid = true;
+	tmsi_set_loaded = tmsi_set.count;
+	return 0;
+}
+
 int db_prepare(void)
 {
 	dbi_result result;
 	int i;
 
 	for (i = 0; i < ARRAY_SIZE(create_stmts); i++) {
-		result = dbi_conn_query(conn, create_stmts[i]);
+		result = db_conn_query(conn, create_stmts[i]);
 		if (!result) {
 			LOGP(DDB, LOGL_ERROR,
 			     "Failed to create some table.\n");
@@ -659,7 +739,19 @@ int db_prepare(void)
                 return -1;
 	}
 
+	/* the columns only exist after the migration */
+	for (i = 0; i < ARRAY_SIZE(create_index_stmts); i++) {
+		result = db_conn_query(conn, create_index_stmts[i]);
+		if (!result) {
+			LOGP(DDB, LOGL_ERROR,
+			     "Failed to create some index.\n");
+			return 1;
+		}
+		dbi_result_free(result);
+	}
+
 	db_configure();
+	tmsi_set_load();
 
 	return 0;
 }
@@ -669,6 +761,9 @@ int db_fini(void)
 	dbi_conn_close(conn);
 	dbi_shutdown();
 
+	tmsi_set_clear(&tmsi_set);
+	tmsi_set_valid = false;
+
 	free(db_dirname);
 	free(db_basename);
 	return 0;
@@ -691,7 +786,7 @@ struct gsm_subscriber *db_create_subscriber(const char *imsi, uint64_t smin,
 	if (!subscr)
 		return NULL;
 	subscr->flags |= GSM_SUBSCRIBER_FIRST_CONTACT;
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT INTO Subscriber "
 		"(imsi, created, updated) "
 		"VALUES "
@@ -714,29 +809,13 @@ struct gsm_subscriber *db_create_subscriber(const char *imsi, uint64_t smin,
 
 osmo_static_assert(sizeof(unsigned char) == sizeof(struct gsm48_classmark1), classmark1_size);
 
-static int get_equipment_by_subscr(struct gsm_subscriber *subscr)
+/* all but the id, which is ambiguous in joined queries */
+static void db_set_equipment_from_query(struct gsm_equipment *equip,
+					dbi_result result)
 {
-	dbi_result result;
 	const char *string;
 	unsigned char cm1;
 	const unsigned char *cm2, *cm3;
-	struct gsm_equipment *equip = &subscr->equipment;
-
-	result = dbi_conn_queryf(conn,
-		"SELECT Equipment.* "
-			"FROM Equipment JOIN EquipmentWatch ON "
-				"EquipmentWatch.equipment_id=Equipment.id "
-			"WHERE EquipmentWatch.subscriber_id = %llu "
-			"ORDER BY EquipmentWatch.updated DESC", subscr->id);
-	if (!result)
-		return -EIO;
-
-	if (!next_row(result)) {
-		dbi_result_free(result);
-		return -ENOENT;
-	}
-
-	equip->id = dbi_result_get_ulonglong(result, "id");
 
 	string = dbi_result_get_string(result, "imei");
 	if (string)
@@ -761,7 +840,29 @@ static int get_equipment_by_subscr(struct gsm_subscriber *subscr)
 		equip->classmark3_len = sizeof(equip->classmark3);
 	if (cm3)
 		memcpy(equip->classmark3, cm3, equip->classmark3_len);
+}
+
+static int get_equipment_by_subscr(struct gsm_subscriber *subscr)
+{
+	dbi_result result;
+	struct gsm_equipment *equip = &subscr->equipment;
 
+	result = db_conn_queryf(conn,
+		"SELECT Equipment.* "
+			"FROM Equipment JOIN EquipmentWatch ON "
+				"EquipmentWatch.equipment_id=Equipment.id "
+			"WHERE EquipmentWatch.subscriber_id = %llu "
+			"ORDER BY EquipmentWatch.updated DESC", subscr->id);
+	if (!result)
+		return -EIO;
+
+	if (!next_row(result)) {
+		dbi_result_free(result);
+		return -ENOENT;
+	}
+
+	equip->id = dbi_result_get_ulonglong(result, "id");
+	db_set_equipment_from_query(equip, result);
 	dbi_result_free(result);
 
 	return 0;
@@ -773,7 +874,7 @@ int db_get_authinfo_for_subscr(struct gsm_auth_info *ainfo,
 	dbi_result result;
 	const unsigned char *a3a8_ki;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"SELECT * FROM AuthKeys WHERE subscriber_id=%llu",
 			 subscr->id);
 	if (!result)
@@ -806,7 +907,7 @@ int db_sync_authinfo_for_subscr(struct gsm_auth_info *ainfo,
 
 	/* Deletion ? */
 	if (ainfo == NULL) {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"DELETE FROM AuthKeys WHERE subscriber_id=%llu",
 			subscr->id);
 
@@ -829,13 +930,13 @@ int db_sync_authinfo_for_subscr(struct gsm_auth_info *ainfo,
 		ainfo->a3a8_ki, ainfo->a3a8_ki_len, &ki_str);
 
 	if (!upd) {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 				"INSERT INTO AuthKeys "
 				"(subscriber_id, algorithm_id, a3a8_ki) "
 				"VALUES (%llu, %u, %s)",
 				subscr->id, ainfo->auth_algo, ki_str);
 	} else {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 				"UPDATE AuthKeys "
 				"SET algorithm_id=%u, a3a8_ki=%s "
 				"WHERE subscriber_id=%llu",
@@ -859,7 +960,7 @@ int db_get_lastauthtuple_for_subscr(struct gsm_auth_tuple *atuple,
 	int len;
 	const unsigned char *blob;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"SELECT * FROM AuthLastTuples WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result)
@@ -915,7 +1016,7 @@ int db_sync_lastauthtuple_for_subscr(struct gsm_auth_tuple *atuple,
 
 	/* Deletion ? */
 	if (atuple == NULL) {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"DELETE FROM AuthLastTuples WHERE subscriber_id=%llu",
 			subscr->id);
 
@@ -942,7 +1043,7 @@ int db_sync_lastauthtuple_for_subscr(struct gsm_auth_tuple *atuple,
 		atuple->vec.kc, sizeof(atuple->vec.kc), &kc_str);
 
 	if (!upd) {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 				"INSERT INTO AuthLastTuples "
 				"(subscriber_id, issued, use_count, "
 				 "key_seq, rand, sres, kc) "
@@ -953,7 +1054,7 @@ int db_sync_lastauthtuple_for_subscr(struct gsm_auth_tuple *atuple,
 	} else {
 		char *issued = atuple->key_seq == atuple_old.key_seq ?
 					"issued" : "datetime('now')";
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 				"UPDATE AuthLastTuples "
 				"SET issued=%s, use_count=%u, "
 				 "key_seq=%u, rand=%s, sres=%s, kc=%s "
@@ -1002,6 +1103,7 @@ static void db_set_from_query(struct gsm_subscriber *subscr, dbi_conn result)
 
 	subscr->authorized = dbi_result_get_ulonglong(result, "authorized");
 
+	subscr_ext_update(subscr);
 }
 
 #define BASE_QUERY "SELECT * FROM Subscriber "
@@ -1015,7 +1117,7 @@ struct gsm_subscriber *db_get_subscriber(enum gsm_subscriber_field field,
 	switch (field) {
 	case GSM_SUBSCRIBER_IMSI:
 		dbi_conn_quote_string_copy(conn, id, &quoted);
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			BASE_QUERY
 			"WHERE imsi = %s ",
 			quoted
@@ -1024,7 +1126,7 @@ struct gsm_subscriber *db_get_subscriber(enum gsm_subscriber_field field,
 		break;
 	case GSM_SUBSCRIBER_TMSI:
 		dbi_conn_quote_string_copy(conn, id, &quoted);
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			BASE_QUERY
 			"WHERE tmsi = %s ",
 			quoted
@@ -1033,7 +1135,7 @@ struct gsm_subscriber *db_get_subscriber(enum gsm_subscriber_field field,
 		break;
 	case GSM_SUBSCRIBER_EXTENSION:
 		dbi_conn_quote_string_copy(conn, id, &quoted);
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			BASE_QUERY
 			"WHERE extension = %s ",
 			quoted
@@ -1042,7 +1144,7 @@ struct gsm_subscriber *db_get_subscriber(enum gsm_subscriber_field field,
 		break;
 	case GSM_SUBSCRIBER_ID:
 		dbi_conn_quote_string_copy(conn, id, &quoted);
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			BASE_QUERY
 			"WHERE id = %s ", quoted);
 		free(quoted);
@@ -1083,7 +1185,7 @@ int db_subscriber_update(struct gsm_subscriber *subscr)
 
 	/* Copy the id to a string as queryf with %llu is failing */
 	sprintf(buf, "%llu", subscr->id);
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			BASE_QUERY
 			"WHERE id = %s", buf);
 
@@ -1128,7 +1230,7 @@ int db_sync_subscriber(struct gsm_subscriber *subscriber)
 		q_tmsi = strdup("NULL");
 
 	if (subscriber->expire_lu == GSM_SUBSCRIBER_NO_EXPIRATION) {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"UPDATE Subscriber "
 			"SET updated = datetime('now'), "
 			"name = %s, "
@@ -1145,7 +1247,7 @@ int db_sync_subscriber(struct gsm_subscriber *subscriber)
 			subscriber->lac,
 			subscriber->imsi);
 	} else {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"UPDATE Subscriber "
 			"SET updated = datetime('now'), "
 			"name = %s, "
@@ -1168,13 +1270,21 @@ int db_sync_subscriber(struct gsm_subscriber *subscriber)
 	free(q_name);
 	free(q_extension);
 
+	subscr_ext_update(subscriber);
+
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR, "Failed to update Subscriber (by IMSI).\n");
+		/* maybe someone else took the TMSI, better load them again */
+		tmsi_set_valid = false;
 		return 1;
 	}
 
 	dbi_result_free(result);
 
+	if (tmsi_set_valid && subscriber->tmsi != GSM_RESERVED_TMSI
+	    && tmsi_set_add(&tmsi_set, subscriber->tmsi) < 0)
+		tmsi_set_valid = false;
+
 	return 0;
 }
 
@@ -1182,7 +1292,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 {
 	dbi_result result;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM AuthKeys WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1192,7 +1302,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM AuthLastTuples WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1202,7 +1312,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM AuthToken WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1212,7 +1322,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM EquipmentWatch WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1223,8 +1333,8 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 	dbi_result_free(result);
 
 	if (subscr->extension[0] != '\0') {
-		result = dbi_conn_queryf(conn,
-			    "DELETE FROM SMS WHERE src_addr=%s OR dest_addr=%s",
+		result = db_conn_queryf(conn,
+			   "DELETE FROM SMS WHERE src_addr=%s OR dest_addr=%s",
 					 subscr->extension, subscr->extension);
 		if (!result) {
 			LOGP(DDB, LOGL_ERROR,
@@ -1234,7 +1344,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 		dbi_result_free(result);
 	}
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM VLR WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1244,7 +1354,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM ApduBlobs WHERE subscriber_id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1254,7 +1364,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 	}
 	dbi_result_free(result);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 			"DELETE FROM Subscriber WHERE id=%llu",
 			subscr->id);
 	if (!result) {
@@ -1263,6 +1373,7 @@ int db_subscriber_delete(struct gsm_subscriber *subscr)
 		return -1;
 	}
 	dbi_result_free(result);
+	subscr_ext_invalidate(subscr);
 
 	return 0;
 }
@@ -1277,8 +1388,8 @@ int db_subscriber_list_active(void (*cb)(struct gsm_subscriber*,void*), void *cl
 {
 	dbi_result result;
 
-	result = dbi_conn_query(conn,
-		       "SELECT * from Subscriber WHERE LAC != 0 AND authorized = 1");
+	result = db_conn_query(conn,
+		      "SELECT * from Subscriber WHERE LAC != 0 AND authorized = 1");
 	if (!result) {
 		LOGP(DDB, LOGL_ERROR, "Failed to list active subscribers\n");
 		return -1;
@@ -1324,7 +1435,7 @@ int db_sync_equipment(struct gsm_equipment *equip)
 				   equip->classmark3_len, &cm3);
 	dbi_conn_quote_string_copy(conn, equip->imei, &q_imei);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"UPDATE Equipment SET "
 			"updated = datetime('now'), "
 			"classmark1 = %u, "
@@ -1346,71 +1457,117 @@ int db_sync_equipment(struct gsm_equipment *equip)
 	return 0;
 }
 
-int db_subscriber_expire(void *priv, void (*callback)(void *priv, long long unsigned int id))
+#define EXPIRED_QUERY \
+			"FROM Subscriber " \
+			"WHERE lac != 0 AND " \
+				"( expire_lu is NOT NULL " \
+				"AND expire_lu < datetime('now') ) "
+
+/*! Count the subscribers waiting to be expired.
+ *  \returns the number of subscribers or negative on error
+ */
+int db_subscriber_expire_backlog(void)
 {
 	dbi_result result;
+	int count;
 
-	result = dbi_conn_query(conn,
-			"SELECT id "
-			"FROM Subscriber "
-			"WHERE lac != 0 AND "
-				"( expire_lu is NOT NULL "
-				"AND expire_lu < datetime('now') ) "
-			"LIMIT 1");
+	result = db_conn_query(conn, "SELECT COUNT(*) AS n " EXPIRED_QUERY);
 	if (!result) {
-		LOGP(DDB, LOGL_ERROR, "Failed to get expired subscribers\n");
+		LOGP(DDB, LOGL_ERROR, "Failed to count expired subscribers\n");
 		return -EIO;
 	}
 
-	while (next_row(result))
-		callback(priv, dbi_result_get_ulonglong(result, "id"));
-
+	count = next_row(result) ? dbi_result_get_ulonglong(result, "n") : 0;
 	dbi_result_free(result);
-	return 0;
+	return count;
 }
 
-int db_subscriber_alloc_tmsi(struct gsm_subscriber *subscriber)
+/*! Detach up to max subscribers whose location update expired, in a
+ *  single transaction and the oldest first.
+ *  \param[in] priv passed to the callback
+ *  \param[in] callback called for each subscriber before it is detached,
+ *  a non-zero return keeps the subscriber attached
+ *  \param[in] max the most subscribers to look at
+ *  \returns the number of detached subscribers or negative on error
+ */
+int db_subscriber_expire(void *priv,
+			 int (*callback)(void *priv, long long unsigned int id),
+			 unsigned int max)
 {
-	dbi_result result = NULL;
-	char tmsi[14];
-	char *tmsi_quoted;
+	dbi_result result, update;
+	long long unsigned int id;
+	int expired = 0;
 
-	for (;;) {
-		int rc = osmo_get_rand_id((uint8_t *) &subscriber->tmsi, sizeof(subscriber->tmsi));
-		if (rc < 0) {
-			LOGP(DDB, LOGL_ERROR, "osmo_get_rand_id() failed: %s\n", strerror(-rc));
-			return 1;
-		}
-		if (subscriber->tmsi == GSM_RESERVED_TMSI)
-			continue;
-
-		sprintf(tmsi, "%u", subscriber->tmsi);
-		dbi_conn_quote_string_copy(conn, tmsi, &tmsi_quoted);
-		result = dbi_conn_queryf(conn,
-			"SELECT * FROM Subscriber "
-			"WHERE tmsi = %s ",
-			tmsi_quoted);
+	update = db_conn_query(conn, "BEGIN TRANSACTION");
+	if (!update) {
+		LOGP(DDB, LOGL_ERROR, "Failed to begin the expiry\n");
+		return -EIO;
+	}
+	dbi_result_free(update);
 
-		free(tmsi_quoted);
+	result = db_conn_queryf(conn,
+			"SELECT id " EXPIRED_QUERY
+			"ORDER BY expire_lu LIMIT %u", max);
+	if (!result) {
+		LOGP(DDB, LOGL_ERROR, "Failed to get expired subscribers\n");
+		goto rollback;
+	}
 
-		if (!result) {
-			LOGP(DDB, LOGL_ERROR, "Failed to query Subscriber "
-				"while allocating new TMSI.\n");
-			return 1;
-		}
-		if (dbi_result_get_numrows(result)) {
-			dbi_result_free(result);
+	while (next_row(result)) {
+		id = dbi_result_get_ulonglong(result, "id");
+		if (callback(priv, id))
 			continue;
-		}
-		if (!next_row(result)) {
+
+		update = db_conn_queryf(conn,
+				"UPDATE Subscriber "
+				"SET updated = datetime('now'), lac = 0 "
+				"WHERE id = %llu", id);
+		if (!update) {
+			LOGP(DDB, LOGL_ERROR,
+			     "Failed to expire Subscriber %llu\n", id);
 			dbi_result_free(result);
-			DEBUGP(DDB, "Allocated TMSI %u for IMSI %s.\n",
-				subscriber->tmsi, subscriber->imsi);
-			return db_sync_subscriber(subscriber);
+			goto rollback;
 		}
-		dbi_result_free(result);
+		dbi_result_free(update);
+		expired += 1;
 	}
-	return 0;
+	dbi_result_free(result);
+
+	update = db_conn_query(conn, "COMMIT TRANSACTION");
+	if (!update) {
+		LOGP(DDB, LOGL_ERROR, "Failed to commit the expiry\n");
+		goto rollback;
+	}
+	dbi_result_free(update);
+	return expired;
+
+rollback:
+	update = db_conn_query(conn, "ROLLBACK TRANSACTION");
+	if (update)
+		dbi_result_free(update);
+	return -EIO;
+}
+
+int db_subscriber_alloc_tmsi(struct gsm_subscriber *subscriber)
+{
+	int rc;
+
+	/* start over once the given up TMSIs outnumber the ones in use */
+	if (!tmsi_set_valid || tmsi_set.count > 2 * tmsi_set_loaded + 1024) {
+		if (tmsi_set_load() < 0)
+			return 1;
+	}
+
+	rc = tmsi_set_alloc(&tmsi_set, &subscriber->tmsi);
+	if (rc < 0) {
+		LOGP(DDB, LOGL_ERROR, "Failed to allocate a TMSI: %s\n",
+		     strerror(-rc));
+		return 1;
+	}
+
+	DEBUGP(DDB, "Allocated TMSI %u for IMSI %s.\n",
+		subscriber->tmsi, subscriber->imsi);
+	return db_sync_subscriber(subscriber);
 }
 
 int db_subscriber_alloc_exten(struct gsm_subscriber *subscriber, uint64_t smin,
@@ -1421,7 +1578,7 @@ int db_subscriber_alloc_exten(struct gsm_subscriber *subscriber, uint64_t smin,
 
 	for (;;) {
 		try = (rand() % (smax - smin + 1) + smin);
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"SELECT * FROM Subscriber "
 			"WHERE extension = %"PRIu64,
 			try
@@ -1464,7 +1621,7 @@ int db_subscriber_alloc_token(struct gsm_subscriber *subscriber, uint32_t *token
 		}
 		if (!try) /* 0 is an invalid token */
 			continue;
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"SELECT * FROM AuthToken "
 			"WHERE subscriber_id = %llu OR token = \"%08X\" ",
 			subscriber->id, try);
@@ -1483,7 +1640,7 @@ int db_subscriber_alloc_token(struct gsm_subscriber *subscriber, uint32_t *token
 		}
 		dbi_result_free(result);
 	}
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT INTO AuthToken "
 		"(subscriber_id, created, token) "
 		"VALUES "
@@ -1508,7 +1665,7 @@ int db_subscriber_assoc_imei(struct gsm_subscriber *subscriber, char imei[GSM230
 
 	osmo_strlcpy(subscriber->equipment.imei, imei, sizeof(subscriber->equipment.imei));
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT OR IGNORE INTO Equipment "
 		"(imei, created, updated) "
 		"VALUES "
@@ -1528,7 +1685,7 @@ int db_subscriber_assoc_imei(struct gsm_subscriber *subscriber, char imei[GSM230
 	if (equipment_id)
 		DEBUGP(DDB, "New Equipment: ID %llu, IMEI %s\n", equipment_id, imei);
 	else {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"SELECT id FROM Equipment "
 			"WHERE imei = %s ",
 			imei
@@ -1546,7 +1703,7 @@ int db_subscriber_assoc_imei(struct gsm_subscriber *subscriber, char imei[GSM230
 		dbi_result_free(result);
 	}
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT OR IGNORE INTO EquipmentWatch "
 		"(subscriber_id, equipment_id, created, updated) "
 		"VALUES "
@@ -1566,7 +1723,7 @@ int db_subscriber_assoc_imei(struct gsm_subscriber *subscriber, char imei[GSM230
 		DEBUGP(DDB, "New EquipmentWatch: ID %llu, IMSI %s, IMEI %s\n",
 			equipment_id, subscriber->imsi, imei);
 	else {
-		result = dbi_conn_queryf(conn,
+		result = db_conn_queryf(conn,
 			"UPDATE EquipmentWatch "
 			"SET updated = datetime('now') "
 			"WHERE subscriber_id = %llu AND equipment_id = %llu ",
@@ -1600,7 +1757,7 @@ int db_sms_store(struct gsm_sms *sms)
 				   &q_udata);
 
 	/* FIXME: correct validity period */
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT INTO SMS "
 		"(created, valid_until, "
 		 "reply_path_req, status_rep_req, is_report, "
@@ -1635,7 +1792,8 @@ int db_sms_store(struct gsm_sms *sms)
 	return 0;
 }
 
-static struct gsm_sms *sms_from_result(struct gsm_network *net, dbi_result result)
+static struct gsm_sms *sms_from_result(struct gsm_network *net, dbi_result result,
+				       struct gsm_subscriber *receiver)
 {
 	struct gsm_sms *sms = sms_alloc();
 	const char *text, *daddr, *saddr;
@@ -1663,7 +1821,11 @@ static struct gsm_sms *sms_from_result(struct gsm_network *net, dbi_result resul
 	daddr = dbi_result_get_string(result, "dest_addr");
 	if (daddr)
 		osmo_strlcpy(sms->dst.addr, daddr, sizeof(sms->dst.addr));
-	sms->receiver = subscr_get_by_extension(net->subscr_group, sms->dst.addr);
+	if (receiver)
+		sms->receiver = subscr_get(receiver);
+	else
+		sms->receiver = subscr_get_by_extension(net->subscr_group,
+							sms->dst.addr);
 
 	sms->src.npi = dbi_result_get_ulonglong(result, "src_npi");
 	sms->src.ton = dbi_result_get_ulonglong(result, "src_ton");
@@ -1688,7 +1850,7 @@ struct gsm_sms *db_sms_get(struct gsm_network *net, unsigned long long id)
 	dbi_result result;
 	struct gsm_sms *sms;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"SELECT * FROM SMS WHERE SMS.id = %llu", id);
 	if (!result)
 		return NULL;
@@ -1698,7 +1860,7 @@ struct gsm_sms *db_sms_get(struct gsm_network *net, unsigned long long id)
 		return NULL;
 	}
 
-	sms = sms_from_result(net, result);
+	sms = sms_from_result(net, result, NULL);
 
 	dbi_result_free(result);
 
@@ -1711,7 +1873,7 @@ struct gsm_sms *db_sms_get_unsent(struct gsm_network *net, unsigned long long mi
 	dbi_result result;
 	struct gsm_sms *sms;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"SELECT SMS.* "
 			"FROM SMS JOIN Subscriber ON "
 				"SMS.dest_addr = Subscriber.extension "
@@ -1727,7 +1889,7 @@ struct gsm_sms *db_sms_get_unsent(struct gsm_network *net, unsigned long long mi
 		return NULL;
 	}
 
-	sms = sms_from_result(net, result);
+	sms = sms_from_result(net, result, NULL);
 
 	dbi_result_free(result);
 
@@ -1741,7 +1903,7 @@ struct gsm_sms *db_sms_get_unsent_by_subscr(struct gsm_network *net,
 	dbi_result result;
 	struct gsm_sms *sms;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"SELECT SMS.* "
 			"FROM SMS JOIN Subscriber ON "
 				"SMS.dest_addr = Subscriber.extension "
@@ -1757,20 +1919,123 @@ struct gsm_sms *db_sms_get_unsent_by_subscr(struct gsm_network *net,
 		return NULL;
 	}
 
-	sms = sms_from_result(net, result);
+	sms = sms_from_result(net, result, NULL);
 
 	dbi_result_free(result);
 
 	return sms;
 }
 
+/*
+ * The receiver of a row of db_sms_get_unsent_batch. A subscriber that
+ * is in RAM already wins over the DB, everyone else is set up from the
+ * columns that came along.
+ */
+static struct gsm_subscriber *receiver_from_result(struct gsm_network *net,
+						   dbi_result result)
+{
+	struct gsm_subscriber *subscr;
+	long long unsigned int id;
+	bool absent;
+
+	id = dbi_result_get_ulonglong(result, "subscr_id");
+
+	/* every subscriber in RAM is indexed under its extension */
+	subscr = subscr_ext_lookup(dbi_result_get_string(result, "extension"),
+				   &absent);
+	if (subscr && subscr->id == id)
+		return subscr_get(subscr);
+
+	/* not indexed under its extension (yet), but it might still be
+	 * in RAM and there must not be a second one */
+	subscr = subscr_active_by_id(net->subscr_group, id);
+	if (subscr)
+		return subscr;
+
+	subscr = subscr_alloc();
+	if (!subscr)
+		return NULL;
+	subscr->id = id;
+	subscr->group = net->subscr_group;
+	db_set_from_query(subscr, result);
+	if (!dbi_result_field_is_null(result, "equipment_id")) {
+		subscr->equipment.id = dbi_result_get_ulonglong(result,
+								"equipment_id");
+		db_set_equipment_from_query(&subscr->equipment, result);
+	}
+	return subscr;
+}
+
+/*! Retrieve the oldest unsent SMS of up to max subscribers, in the
+ *  order of the subscriber id. The receivers come from the same query.
+ *  \param[in] net the network
+ *  \param[in] min_subscr_id first subscriber id to look at
+ *  \param[in] failed skip SMS with this many delivery attempts
+ *  \param[out] sms the SMS, the caller has to free them
+ *  \param[in] max size of the sms array
+ *  \returns the number of SMS or negative on error
+ */
+int db_sms_get_unsent_batch(struct gsm_network *net,
+			    unsigned long long min_subscr_id,
+			    unsigned int failed,
+			    struct gsm_sms **sms, unsigned int max)
+{
+	struct gsm_subscriber *receiver;
+	dbi_result result;
+	unsigned int num = 0;
+
+	/* SQLite takes the other columns from the row picking MIN(SMS.id) */
+	result = db_conn_queryf(conn,
+		"SELECT SMS.*, MIN(SMS.id), "
+			"Subscriber.id AS subscr_id, Subscriber.imsi, "
+			"Subscriber.tmsi, Subscriber.name, "
+			"Subscriber.extension, Subscriber.authorized, "
+			"Subscriber.lac, Subscriber.expire_lu, "
+			"Equipment.id AS equipment_id, Equipment.imei, "
+			"Equipment.classmark1, Equipment.classmark2, "
+			"Equipment.classmark3 "
+			"FROM SMS JOIN Subscriber ON "
+				"SMS.dest_addr = Subscriber.extension "
+			"LEFT JOIN Equipment ON Equipment.id = "
+				"(SELECT equipment_id FROM EquipmentWatch "
+				"WHERE subscriber_id = Subscriber.id "
+				"ORDER BY updated DESC LIMIT 1) "
+			"WHERE Subscriber.id >= %llu AND SMS.sent IS NULL "
+				"AND Subscriber.lac > 0 AND SMS.deliver_attempts < %u "
+			"GROUP BY Subscriber.id "
+			"ORDER BY Subscriber.id LIMIT %u",
+		min_subscr_id, failed, max);
+	if (!result)
+		return -EIO;
+
+	while (num < max && next_row(result)) {
+		receiver = receiver_from_result(net, result);
+		if (!receiver)
+			break;
+		sms[num] = sms_from_result(net, result, receiver);
+		subscr_put(receiver);
+		if (!sms[num])
+			break;
+		num += 1;
+	}
+
+	dbi_result_free(result);
+	return num;
+}
+
+/*! \returns the number of queries issued so far */
+unsigned long long db_query_count(void)
+{
+	return num_queries;
+}
+
 /* retrieve the next unsent SMS for a given subscriber */
 struct gsm_sms *db_sms_get_unsent_for_subscr(struct gsm_subscriber *subscr)
 {
 	dbi_result result;
 	struct gsm_sms *sms;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"SELECT SMS.* "
 			"FROM SMS JOIN Subscriber ON "
 				"SMS.dest_addr = Subscriber.extension "
@@ -1786,7 +2051,7 @@ struct gsm_sms *db_sms_get_unsent_for_subscr(struct gsm_subscriber *subscr)
 		return NULL;
 	}
 
-	sms = sms_from_result(subscr->group->net, result);
+	sms = sms_from_result(subscr->group->net, result, NULL);
 
 	dbi_result_free(result);
 
@@ -1798,7 +2063,7 @@ int db_sms_mark_delivered(struct gsm_sms *sms)
 {
 	dbi_result result;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"UPDATE SMS "
 		"SET sent = datetime('now') "
 		"WHERE id = %llu", sms->id);
@@ -1816,7 +2081,7 @@ int db_sms_inc_deliver_attempts(struct gsm_sms *sms)
 {
 	dbi_result result;
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"UPDATE SMS "
 		"SET deliver_attempts = deliver_attempts + 1 "
 		"WHERE id = %llu", sms->id);
@@ -1839,7 +2104,7 @@ int db_apdu_blob_store(struct gsm_subscriber *subscr,
 
 	dbi_conn_quote_binary_copy(conn, apdu, len, &q_apdu);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT INTO ApduBlobs "
 		"(created,subscriber_id,apdu_id_flags,apdu) VALUES "
 		"(datetime('now'),%llu,%u,%s)",
@@ -1861,7 +2126,7 @@ int db_store_counter(struct osmo_counter *ctr)
 
 	dbi_conn_quote_string_copy(conn, ctr->name, &q_name);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"INSERT INTO Counters "
 		"(timestamp,name,value) VALUES "
 		"(datetime('now'),%s,%lu)", q_name, ctr->value);
@@ -1884,7 +2149,7 @@ static int db_store_rate_ctr(struct rate_ctr_group *ctrg, unsigned int num,
 	dbi_conn_quote_string_copy(conn, ctrg->desc->ctr_desc[num].name,
 				   &q_name);
 
-	result = dbi_conn_queryf(conn,
+	result = db_conn_queryf(conn,
 		"Insert INTO RateCounters "
 		"(timestamp,name,idx,value) VALUES "
 		"(datetime('now'),%s.%s,%u,%"PRIu64")",
@@ -1913,3 +2178,171 @@ int db_store_rate_ctr_group(struct rate_ctr_group *ctrg)
 
 	return 0;
 }
+
+/* the Counters table has no idx, it is always zero for those */
+static int db_store_sample(bool rate_ctr, time_t time,
+			   const struct ctr_sample *sample)
+{
+	dbi_result result;
+	char name[128];
+	char *q_name;
+
+	if (sample->prefix)
+		snprintf(name, sizeof(name), "%s.%s", sample->prefix,
+			 sample->name);
+	else
+		osmo_strlcpy(name, sample->name, sizeof(name));
+	dbi_conn_quote_string_copy(conn, name, &q_name);
+
+	if (rate_ctr)
+		result = db_conn_queryf(conn,
+			"INSERT INTO RateCounters "
+			"(timestamp,name,idx,value) VALUES "
+			"(datetime(%ld, 'unixepoch'),%s,%u,%"PRIu64")",
+			(long) time, q_name, sample->idx, sample->value);
+	else
+		result = db_conn_queryf(conn,
+			"INSERT INTO Counters "
+			"(timestamp,name,value) VALUES "
+			"(datetime(%ld, 'unixepoch'),%s,%"PRIu64")",
+			(long) time, q_name, sample->value);
+
+	free(q_name);
+
+	if (!result)
+		return -EIO;
+
+	dbi_result_free(result);
+	return 0;
+}
+
+/*! Store all values of a counter snapshot in a single transaction.
+ *  \param[in] snap the snapshot
+ *  \returns 0 on success, negative on error
+ */
+int db_store_ctr_snapshot(const struct ctr_snapshot *snap)
+{
+	dbi_result result;
+	unsigned int i;
+
+	result = db_conn_query(conn, "BEGIN TRANSACTION");
+	if (!result) {
+		LOGP(DDB, LOGL_ERROR, "Failed to begin the counter snapshot\n");
+		return -EIO;
+	}
+	dbi_result_free(result);
+
+	for (i = 0; i < snap->num_counters; i++) {
+		if (db_store_sample(false, snap->time, &snap->counters[i]) < 0)
+			goto rollback;
+	}
+
+	for (i = 0; i < snap->num_rate_ctrs; i++) {
+		if (db_store_sample(true, snap->time, &snap->rate_ctrs[i]) < 0)
+			goto rollback;
+	}
+
+	result = db_conn_query(conn, "COMMIT TRANSACTION");
+	if (!result)
+		goto rollback;
+	dbi_result_free(result);
+	return 0;
+
+rollback:
+	LOGP(DDB, LOGL_ERROR, "Failed to store the counter snapshot\n");
+	result = db_conn_query(conn, "ROLLBACK TRANSACTION");
+	if (result)
+		dbi_result_free(result);
+	return -EIO;
+}
+
+/* drop rows older than expire and keep only the last value of each counter
+ * per hour before rollup, they only ever grow. At most limit rows go per
+ * call so a large backlog doesn't stall the main loop. */
+static int db_trim_table(const char *table, const char *group_by,
+			 time_t rollup, time_t expire, unsigned int limit)
+{
+	dbi_result result;
+	int removed = 0;
+
+	if (expire) {
+		result = db_conn_queryf(conn,
+			"DELETE FROM %s WHERE id IN (SELECT id FROM %s "
+				"WHERE timestamp < datetime(%ld, 'unixepoch') "
+				"ORDER BY id LIMIT %u)",
+			table, table, (long) expire, limit);
+		if (!result)
+			return -EIO;
+		removed = dbi_result_get_numrows_affected(result);
+		dbi_result_free(result);
+	}
+
+	if (rollup && (unsigned int) removed < limit) {
+		result = db_conn_queryf(conn,
+			"DELETE FROM %s WHERE id IN (SELECT id FROM %s "
+				"WHERE timestamp < datetime(%ld, 'unixepoch') "
+				"AND id NOT IN (SELECT MAX(id) FROM %s "
+					"WHERE timestamp < datetime(%ld, 'unixepoch') "
+					"GROUP BY %s, strftime('%%Y-%%m-%%d %%H', timestamp)) "
+				"ORDER BY id LIMIT %u)",
+			table, table, (long) rollup, table, (long) rollup,
+			group_by, limit - removed);
+		if (!result)
+			return -EIO;
+		removed += dbi_result_get_numrows_affected(result);
+		dbi_result_free(result);
+	}
+
+	return removed;
+}
+
+/*! Thin out the stored counters.
+ *  \param[in] now the current time
+ *  \param[in] rollup_age keep only one value per hour of older rows, zero
+ *  keeps all of them
+ *  \param[in] max_age remove older rows completely, zero keeps them
+ *  \param[in] limit the maximum number of rows to remove from each table
+ *  \returns the number of rows removed or negative on error
+ */
+int db_trim_counters(time_t now, unsigned int rollup_age,
+		     unsigned int max_age, unsigned int limit)
+{
+	dbi_result result;
+	time_t rollup = rollup_age ? now - rollup_age : 0;
+	time_t expire = max_age ? now - max_age : 0;
+	int rc, removed;
+
+	if (!rollup && !expire)
+		return 0;
+
+	result = db_conn_query(conn, "BEGIN TRANSACTION");
+	if (!result) {
+		LOGP(DDB, LOGL_ERROR, "Failed to begin trimming the counters\n");
+		return -EIO;
+	}
+	dbi_result_free(result);
+
+	rc = db_trim_table("Counters", "name", rollup, expire, limit);
+	if (rc < 0)
+		goto rollback;
+	removed = rc;
+
+	rc = db_trim_table("RateCounters", "name, idx", rollup, expire,
+			   limit);
+	if (rc < 0)
+		goto rollback;
+	removed += rc;
+
+	result = db_conn_query(conn, "COMMIT TRANSACTION");
+	if (!result)
+		goto rollback;
+	dbi_result_free(result);
+	return removed;
+
+rollback:
+	LOGP(DDB, LOGL_ERROR, "Failed to trim the counters\n");
+	result = db_conn_query(conn, "ROLLBACK TRANSACTION");
+	if (result)
+		dbi_result_free(result);
+	return -EIO;
+}
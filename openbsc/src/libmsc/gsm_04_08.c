@@ -559,6 +559,7 @@ static int mm_rx_id_resp(struct gsm_subscriber_connection *conn, struct msgb *ms
 {
 	struct gsm48_hdr *gh = msgb_l3(msg);
 	struct gsm_network *net = conn->network;
+	struct gsm_subscriber *subscr;
 	uint8_t mi_type = gh->data[1] & GSM_MI_TYPE_MASK;
 	char mi_string[GSM48_MI_SIZE];
 
@@ -572,10 +573,11 @@ static int mm_rx_id_resp(struct gsm_subscriber_connection *conn, struct msgb *ms
 	case GSM_MI_TYPE_IMSI:
 		/* look up subscriber based on IMSI, create if not found */
 		if (!conn->subscr) {
-			conn->subscr = subscr_get_by_imsi(net->subscr_group,
-							  mi_string);
-			if (!conn->subscr)
-				conn->subscr = subscr_create(net, mi_string);
+			subscr = subscr_get_by_imsi(net->subscr_group,
+						    mi_string);
+			if (!subscr)
+				subscr = subscr_create(net, mi_string);
+			subscr_con_attach(conn, subscr);
 		}
 		if (!conn->subscr && conn->loc_operation) {
 			gsm0408_loc_upd_rej(conn, net->reject_cause);
@@ -722,7 +724,18 @@ static int mm_rx_loc_upd_req(struct gsm_subscriber_connection *conn, struct msgb
 		return -EINVAL;
 	}
 
-	conn->subscr = subscr;
+	if (!conn->subscr) {
+		subscr_con_attach(conn, subscr);
+	} else if (conn->subscr != subscr) {
+		LOGP(DMM, LOGL_ERROR, "<- Channel already owned by someone else?\n");
+		subscr_put(subscr);
+		gsm0408_loc_upd_rej(conn, GSM48_REJECT_PROTOCOL_ERROR);
+		loc_updating_failure(conn, 0);
+		return 0;
+	} else {
+		/* the connection has a reference already */
+		subscr_put(subscr);
+	}
 	conn->subscr->equipment.classmark1 = lu->classmark1;
 
 	/* check if we can let the subscriber into our network immediately
@@ -1074,7 +1087,7 @@ static int gsm48_rx_mm_serv_req(struct gsm_subscriber_connection *conn, struct m
 					    GSM48_REJECT_IMSI_UNKNOWN_IN_VLR);
 
 	if (!conn->subscr)
-		conn->subscr = subscr;
+		subscr_con_attach(conn, subscr);
 	else if (conn->subscr == subscr)
 		subscr_put(subscr); /* lchan already has a ref, don't need another one */
 	else {
@@ -1496,7 +1509,7 @@ static int gsm48_rx_rr_pag_resp(struct gsm_subscriber_connection *conn, struct m
 	}
 
 	if (!conn->subscr) {
-		conn->subscr = subscr;
+		subscr_con_attach(conn, subscr);
 	} else if (conn->subscr != subscr) {
 		LOGP(DRR, LOGL_ERROR, "<- Channel already owned by someone else?\n");
 		subscr_put(subscr);
@@ -1520,7 +1533,7 @@ static int gsm48_rx_rr_pag_resp(struct gsm_subscriber_connection *conn, struct m
 	 * BSC instead. */
 	bsub = bsc_subscr_find_or_create_by_imsi(conn->network->bsc_subscribers,
 						 subscr->imsi);
-	bsub->tmsi = subscr->tmsi;
+	bsc_subscr_set_tmsi(bsub, subscr->tmsi);
 	bsub->lac = subscr->lac;
 
 	/* We received a paging */
@@ -3997,10 +4010,8 @@ void msc_subscr_con_free(struct gsm_subscriber_connection *conn)
 	if (!conn)
 		return;
 
-	if (conn->subscr) {
-		subscr_put(conn->subscr);
-		conn->subscr = NULL;
-	}
+	if (conn->subscr)
+		subscr_put(subscr_con_detach(conn));
 
 	llist_del(&conn->entry);
 	talloc_free(conn);
@@ -29,6 +29,7 @@
 #include <stdbool.h>
 
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
 
 #include <osmocom/vty/vty.h>
 
@@ -100,7 +101,7 @@ static int subscr_paging_dispatch(unsigned int hooknum, unsigned int event,
 	 * BSC instead. */
 	bsub = bsc_subscr_find_or_create_by_imsi(net->bsc_subscribers,
 						 subscr->imsi);
-	bsub->tmsi = subscr->tmsi;
+	bsc_subscr_set_tmsi(bsub, subscr->tmsi);
 	bsub->lac = subscr->lac;
 	paging_request_stop(&net->bts_list, NULL, bsub, NULL, NULL);
 	bsc_subscr_put(bsub);
@@ -193,7 +194,7 @@ struct subscr_request *subscr_request_channel(struct gsm_subscriber *subscr,
 		 * a message to the BSC instead. */
 		bsub = bsc_subscr_find_or_create_by_imsi(net->bsc_subscribers,
 							 subscr->imsi);
-		bsub->tmsi = subscr->tmsi;
+		bsc_subscr_set_tmsi(bsub, subscr->tmsi);
 		bsub->lac = subscr->lac;
 		rc = paging_request(net, bsub, channel_type, subscr_paging_cb,
 				    subscr);
@@ -270,13 +271,27 @@ struct gsm_subscriber *subscr_get_by_extension(struct gsm_subscriber_group *sgrp
 					       const char *ext)
 {
 	struct gsm_subscriber *subscr;
+	bool absent;
+
+	subscr = subscr_ext_lookup(ext, &absent);
+	if (subscr)
+		return subscr_get(subscr);
+	if (absent)
+		return NULL;
 
 	llist_for_each_entry(subscr, subscr_bsc_active_subscribers(), entry) {
-		if (strcmp(subscr->extension, ext) == 0)
+		if (strcmp(subscr->extension, ext) == 0) {
+			subscr_ext_add(subscr);
 			return subscr_get(subscr);
+		}
 	}
 
-	return get_subscriber(sgrp, GSM_SUBSCRIBER_EXTENSION, ext);
+	subscr = get_subscriber(sgrp, GSM_SUBSCRIBER_EXTENSION, ext);
+	if (subscr)
+		subscr_ext_add(subscr);
+	else
+		subscr_ext_add_absent(ext);
+	return subscr;
 }
 
 struct gsm_subscriber *subscr_get_by_id(struct gsm_subscriber_group *sgrp,
@@ -372,11 +387,21 @@ void subscr_update_from_db(struct gsm_subscriber *sub)
 	db_subscriber_update(sub);
 }
 
-static void subscr_expire_callback(void *data, long long unsigned int id)
+static int subscr_expire_callback(void *data, long long unsigned int id)
 {
-	struct gsm_network *net = data;
-	struct gsm_subscriber *s = subscr_get_by_id(net->subscr_group, id);
-	struct gsm_subscriber_connection *conn = connection_for_subscr(s);
+	struct gsm_subscriber_connection *conn;
+	struct gsm_subscriber *s;
+
+	/* only subscribers in RAM need more than the DB update */
+	llist_for_each_entry(s, subscr_bsc_active_subscribers(), entry) {
+		if (s->id == id)
+			break;
+	}
+	if (&s->entry == subscr_bsc_active_subscribers()) {
+		LOGP(DMM, LOGL_INFO, "Expiring inactive subscriber ID %llu\n",
+		     id);
+		return 0;
+	}
 
 	/*
 	 * The subscriber is active and the phone stopped the timer. As
@@ -385,38 +410,42 @@ static void subscr_expire_callback(void *data, long long unsigned int id)
 	 * for expiration. This way on the next around another subscriber
 	 * will be selected.
 	 */
+	conn = connection_for_subscr(s);
 	if (conn && conn->expire_timer_stopped) {
 		LOGP(DMM, LOGL_DEBUG, "Not expiring subscriber %s (ID %llu)\n",
 			subscr_name(s), id);
 		subscr_update_expire_lu(s, conn->bts);
-		subscr_put(s);
-		return;
+		return 1;
 	}
 
-
 	LOGP(DMM, LOGL_NOTICE, "Expiring inactive subscriber %s (ID %llu)\n",
 			subscr_name(s), id);
 	s->lac = GSM_LAC_RESERVED_DETACHED;
-	db_sync_subscriber(s);
-
-	subscr_put(s);
+	return 0;
 }
 
-void subscr_expire(struct gsm_subscriber_group *sgrp)
+/*! Detach a batch of subscribers whose location update expired.
+ *  \returns the number of subscribers still waiting to be expired
+ */
+int subscr_expire(struct gsm_subscriber_group *sgrp)
 {
-	db_subscriber_expire(sgrp->net, subscr_expire_callback);
-}
+	struct gsm_network *net = sgrp->net;
+	int backlog, expired;
 
-struct gsm_subscriber_connection *connection_for_subscr(struct gsm_subscriber *subscr)
-{
-	/* FIXME: replace this with a backpointer in gsm_subscriber? */
-	struct gsm_network *net = subscr->group->net;
-	struct gsm_subscriber_connection *conn;
+	backlog = db_subscriber_expire_backlog();
+	if (backlog <= 0) {
+		net->subscr_expire_backlog = 0;
+		return 0;
+	}
 
-	llist_for_each_entry(conn, &net->subscr_conns, entry) {
-		if (conn->subscr == subscr)
-			return conn;
+	expired = db_subscriber_expire(net, subscr_expire_callback,
+				       SUBSCR_EXPIRE_BATCH);
+	if (expired > 0) {
+		rate_ctr_add(&net->msc_ctrs->ctr[MSC_CTR_SUBSCR_EXPIRED], expired);
+		backlog -= expired;
 	}
 
-	return NULL;
+	net->subscr_expire_backlog = OSMO_MAX(backlog, 0);
+	return net->subscr_expire_backlog;
 }
+
@@ -1,14 +1,20 @@
 /* UDP-Feed of measurement reports */
 
 #include <unistd.h>
+#include <errno.h>
 
 #include <sys/socket.h>
+#include <arpa/inet.h>
 
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/bits.h>
 #include <osmocom/core/socket.h>
 #include <osmocom/core/write_queue.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/stats.h>
+#include <osmocom/core/timer.h>
 
 #include <osmocom/vty/command.h>
 #include <osmocom/vty/vty.h>
@@ -21,27 +27,242 @@
 
 #include "meas_feed.h"
 
+/* stay below the usual MTU */
+#define MEAS_FEED_DGRAM_SIZE	1400
+/* datagrams that may wait for the socket before we start dropping */
+#define MEAS_FEED_RING_SIZE	8
+
+enum {
+	MEAS_FEED_CTR_RECORDS,
+	MEAS_FEED_CTR_DATAGRAMS,
+	MEAS_FEED_CTR_DROPPED,
+	MEAS_FEED_CTR_SAMPLED_OUT,
+};
+
+static const struct rate_ctr_desc meas_feed_ctr_desc[] = {
+	[MEAS_FEED_CTR_RECORDS] =	{ "records", "Measurement reports exported." },
+	[MEAS_FEED_CTR_DATAGRAMS] =	{ "datagrams", "Datagrams sent." },
+	[MEAS_FEED_CTR_DROPPED] =	{ "dropped", "Measurement reports dropped due to a full queue or send errors." },
+	[MEAS_FEED_CTR_SAMPLED_OUT] =	{ "sampled_out", "Measurement reports skipped by sampling." },
+};
+
+static const struct rate_ctr_group_desc meas_feed_ctrg_desc = {
+	"meas_feed",
+	"measurement report feed",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(meas_feed_ctr_desc),
+	meas_feed_ctr_desc,
+};
+
+/* one datagram of the version 2 feed */
+struct meas_feed_buf {
+	uint8_t data[MEAS_FEED_DGRAM_SIZE];
+	unsigned int len;
+	unsigned int num_rec;
+};
+
 struct meas_feed_state {
 	struct osmo_wqueue wqueue;
 	char scenario[31+1];
 	char *dst_host;
 	uint16_t dst_port;
+
+	int version;
+	struct rate_ctr_group *ctrg;
+
+	/* export 1 in N subscribers, 1 in N reports of a BTS */
+	unsigned int sample_subscr;
+	uint16_t sample_bts[256];
+	uint16_t sample_bts_cnt[256];
+
+	/* version 2: ring[head] is being filled, the ones from tail on
+	 * are complete and wait to be sent */
+	struct meas_feed_buf ring[MEAS_FEED_RING_SIZE];
+	unsigned int head;
+	unsigned int tail;
+	unsigned int pending;
+	uint32_t seq;
+	unsigned int flush_ms;
+	struct osmo_timer_list flush_timer;
+};
+
+
+static struct meas_feed_state g_mfs = {
+	.version = MEAS_FEED_VERSION,
+	.sample_subscr = 1,
+	.flush_ms = MEAS_FEED_FLUSH_MS_DEFAULT,
 };
 
+static uint64_t imsi_to_num(const char *imsi)
+{
+	uint64_t num = 0;
+
+	for (; *imsi >= '0' && *imsi <= '9'; imsi++)
+		num = num * 10 + (*imsi - '0');
+	return num;
+}
 
-static struct meas_feed_state g_mfs;
+/* decide if the report should be exported */
+static int sample_meas_rep(struct gsm_meas_rep *mr, uint64_t imsi)
+{
+	uint8_t bts_nr = mr->lchan->ts->trx->bts->nr;
+	unsigned int n;
+
+	if (g_mfs.sample_subscr > 1 && imsi % g_mfs.sample_subscr != 0)
+		return 0;
+
+	n = g_mfs.sample_bts[bts_nr];
+	if (n > 1) {
+		if (++g_mfs.sample_bts_cnt[bts_nr] < n)
+			return 0;
+		g_mfs.sample_bts_cnt[bts_nr] = 0;
+	}
+
+	return 1;
+}
+
+static void batch_send(void)
+{
+	struct meas_feed_buf *buf;
+	int rc;
+
+	while (g_mfs.pending) {
+		buf = &g_mfs.ring[g_mfs.tail];
+		rc = send(g_mfs.wqueue.bfd.fd, buf->data, buf->len, MSG_DONTWAIT);
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+			       || errno == ENOBUFS))
+			break;
+
+		if (rc < 0)
+			rate_ctr_add(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_DROPPED], buf->num_rec);
+		else
+			rate_ctr_inc(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_DATAGRAMS]);
+
+		g_mfs.tail = (g_mfs.tail + 1) % MEAS_FEED_RING_SIZE;
+		g_mfs.pending--;
+	}
+
+	/* try again later */
+	if (g_mfs.pending && !osmo_timer_pending(&g_mfs.flush_timer))
+		osmo_timer_schedule(&g_mfs.flush_timer, 0, g_mfs.flush_ms * 1000);
+}
+
+/* finish the datagram being filled and queue it */
+static void batch_close(void)
+{
+	struct meas_feed_buf *buf = &g_mfs.ring[g_mfs.head];
+	struct meas_feed_batch *batch = (struct meas_feed_batch *) buf->data;
+
+	if (!buf->num_rec)
+		return;
+
+	batch->seq = htonl(g_mfs.seq++);
+	batch->num_rec = htons(buf->num_rec);
+
+	g_mfs.head = (g_mfs.head + 1) % MEAS_FEED_RING_SIZE;
+	g_mfs.pending++;
+
+	/* all buffers are waiting for the socket, drop the oldest */
+	if (g_mfs.pending == MEAS_FEED_RING_SIZE) {
+		rate_ctr_add(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_DROPPED],
+			     g_mfs.ring[g_mfs.tail].num_rec);
+		g_mfs.tail = (g_mfs.tail + 1) % MEAS_FEED_RING_SIZE;
+		g_mfs.pending--;
+	}
+
+	g_mfs.ring[g_mfs.head].len = 0;
+	g_mfs.ring[g_mfs.head].num_rec = 0;
+}
+
+static void flush_timer_cb(void *data)
+{
+	batch_close();
+	batch_send();
+}
+
+static void batch_add(struct gsm_meas_rep *mr, uint64_t imsi)
+{
+	struct meas_feed_buf *buf = &g_mfs.ring[g_mfs.head];
+	struct meas_feed_rec *rec;
+	int i;
+
+	if (!buf->len) {
+		struct meas_feed_batch *batch = (struct meas_feed_batch *) buf->data;
+
+		memset(batch, 0, sizeof(*batch));
+		batch->hdr.msg_type = MEAS_FEED_MEAS_BATCH;
+		batch->hdr.version = MEAS_FEED_VERSION_BATCH;
+		batch->rec_len = htons(sizeof(*rec));
+		osmo_strlcpy(batch->scenario, g_mfs.scenario, sizeof(batch->scenario));
+		buf->len = sizeof(*batch);
+	}
+
+	rec = (struct meas_feed_rec *) &buf->data[buf->len];
+	memset(rec, 0, sizeof(*rec));
+	osmo_store64be(imsi, &rec->imsi);
+	rec->bts_nr = mr->lchan->ts->trx->bts->nr;
+	rec->trx_nr = mr->lchan->ts->trx->nr;
+	rec->ts_nr = mr->lchan->ts->nr;
+	rec->ss_nr = mr->lchan->nr;
+	rec->lchan_type = mr->lchan->type;
+	rec->pchan_type = mr->lchan->ts->pchan;
+	rec->nr = mr->nr;
+	rec->flags = mr->flags;
+	rec->ul_full_rx_lev = mr->ul.full.rx_lev;
+	rec->ul_full_rx_qual = mr->ul.full.rx_qual;
+	rec->ul_sub_rx_lev = mr->ul.sub.rx_lev;
+	rec->ul_sub_rx_qual = mr->ul.sub.rx_qual;
+	rec->dl_full_rx_lev = mr->dl.full.rx_lev;
+	rec->dl_full_rx_qual = mr->dl.full.rx_qual;
+	rec->dl_sub_rx_lev = mr->dl.sub.rx_lev;
+	rec->dl_sub_rx_qual = mr->dl.sub.rx_qual;
+	rec->bs_power = mr->bs_power;
+	rec->ms_pwr = mr->ms_l1.pwr;
+	rec->ms_ta = mr->ms_l1.ta;
+	rec->ms_timing_offset = htons(mr->ms_timing_offset);
+	rec->num_cell = OSMO_MIN(mr->num_cell, ARRAY_SIZE(rec->cell));
+	for (i = 0; i < rec->num_cell; i++) {
+		rec->cell[i].arfcn = htons(mr->cell[i].arfcn);
+		rec->cell[i].bsic = mr->cell[i].bsic;
+		rec->cell[i].rxlev = mr->cell[i].rxlev;
+	}
+
+	buf->len += sizeof(*rec);
+	buf->num_rec++;
+	rate_ctr_inc(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_RECORDS]);
+
+	/* flush on size or after the flush interval */
+	if (buf->len + sizeof(*rec) > sizeof(buf->data)) {
+		osmo_timer_del(&g_mfs.flush_timer);
+		batch_close();
+		batch_send();
+	} else if (!osmo_timer_pending(&g_mfs.flush_timer))
+		osmo_timer_schedule(&g_mfs.flush_timer, 0, g_mfs.flush_ms * 1000);
+}
 
 static int process_meas_rep(struct gsm_meas_rep *mr)
 {
 	struct msgb *msg;
 	struct meas_feed_meas *mfm;
 	struct gsm_subscriber *subscr;
+	uint64_t imsi;
 
 	/* ignore measurements as long as we don't know who it is */
 	if (!mr->lchan || !mr->lchan->conn || !mr->lchan->conn->subscr)
 		return 0;
 
 	subscr = mr->lchan->conn->subscr;
+	imsi = imsi_to_num(subscr->imsi);
+
+	if (!sample_meas_rep(mr, imsi)) {
+		rate_ctr_inc(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_SAMPLED_OUT]);
+		return 0;
+	}
+
+	if (g_mfs.version == MEAS_FEED_VERSION_BATCH) {
+		batch_add(mr, imsi);
+		return 0;
+	}
 
 	msg = msgb_alloc(sizeof(struct meas_feed_meas), "Meas. Feed");
 	if (!msg)
@@ -70,8 +291,11 @@ static int process_meas_rep(struct gsm_meas_rep *mr)
 	mfm->ss_nr = mr->lchan->nr;
 
 	/* and send it to the socket */
-	if (osmo_wqueue_enqueue(&g_mfs.wqueue, msg) != 0)
+	if (osmo_wqueue_enqueue(&g_mfs.wqueue, msg) != 0) {
+		rate_ctr_inc(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_DROPPED]);
 		msgb_free(msg);
+	} else
+		rate_ctr_inc(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_RECORDS]);
 
 	return 0;
 }
@@ -92,6 +316,7 @@ static int meas_feed_sig_cb(unsigned int subsys, unsigned int signal,
 
 static int feed_write_cb(struct osmo_fd *ofd, struct msgb *msg)
 {
+	rate_ctr_inc(&g_mfs.ctrg->ctr[MEAS_FEED_CTR_DATAGRAMS]);
 	return write(ofd->fd, msgb_data(msg), msgb_length(msg));
 }
 
@@ -121,9 +346,13 @@ int meas_feed_cfg_set(const char *dst_host, uint16_t dst_port)
 		return 0;
 
 	if (!already_initialized) {
+		g_mfs.ctrg = rate_ctr_group_alloc(NULL, &meas_feed_ctrg_desc, 0);
+		if (!g_mfs.ctrg)
+			return -ENOMEM;
 		osmo_wqueue_init(&g_mfs.wqueue, 10);
 		g_mfs.wqueue.write_cb = feed_write_cb;
 		g_mfs.wqueue.read_cb = feed_read_cb;
+		osmo_timer_setup(&g_mfs.flush_timer, flush_timer_cb, NULL);
 		osmo_signal_register_handler(SS_LCHAN, meas_feed_sig_cb, NULL);
 	}
 
@@ -165,3 +394,58 @@ const char *meas_feed_scenario_get(void)
 {
 	return g_mfs.scenario;
 }
+
+void meas_feed_version_set(int version)
+{
+	if (g_mfs.version == version)
+		return;
+
+	/* don't leave a partial batch behind */
+	if (g_mfs.version == MEAS_FEED_VERSION_BATCH && g_mfs.ctrg) {
+		osmo_timer_del(&g_mfs.flush_timer);
+		batch_close();
+		batch_send();
+	}
+	g_mfs.version = version;
+}
+
+int meas_feed_version_get(void)
+{
+	return g_mfs.version;
+}
+
+void meas_feed_flush_interval_set(unsigned int ms)
+{
+	g_mfs.flush_ms = ms;
+}
+
+unsigned int meas_feed_flush_interval_get(void)
+{
+	return g_mfs.flush_ms;
+}
+
+void meas_feed_sample_subscr_set(unsigned int n)
+{
+	g_mfs.sample_subscr = n;
+}
+
+unsigned int meas_feed_sample_subscr_get(void)
+{
+	return g_mfs.sample_subscr;
+}
+
+void meas_feed_sample_bts_set(uint8_t bts_nr, unsigned int n)
+{
+	g_mfs.sample_bts[bts_nr] = n;
+	g_mfs.sample_bts_cnt[bts_nr] = 0;
+}
+
+unsigned int meas_feed_sample_bts_get(uint8_t bts_nr)
+{
+	return g_mfs.sample_bts[bts_nr] ? g_mfs.sample_bts[bts_nr] : 1;
+}
+
+struct rate_ctr_group *meas_feed_ctrg_get(void)
+{
+	return g_mfs.ctrg;
+}
@@ -3,10 +3,27 @@
 
 #include <stdint.h>
 
+#define MEAS_FEED_FLUSH_MS_DEFAULT	100
+
+struct rate_ctr_group;
+
 int meas_feed_cfg_set(const char *dst_host, uint16_t dst_port);
 void meas_feed_cfg_get(char **host, uint16_t *port);
 
 void meas_feed_scenario_set(const char *name);
 const char *meas_feed_scenario_get(void);
 
+void meas_feed_version_set(int version);
+int meas_feed_version_get(void);
+
+void meas_feed_flush_interval_set(unsigned int ms);
+unsigned int meas_feed_flush_interval_get(void);
+
+void meas_feed_sample_subscr_set(unsigned int n);
+unsigned int meas_feed_sample_subscr_get(void);
+void meas_feed_sample_bts_set(uint8_t bts_nr, unsigned int n);
+unsigned int meas_feed_sample_bts_get(uint8_t bts_nr);
+
+struct rate_ctr_group *meas_feed_ctrg_get(void);
+
 #endif  /* _INT_MEAS_FEED_H */
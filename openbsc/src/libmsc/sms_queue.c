@@ -38,6 +38,7 @@
 #include <openbsc/signal.h>
 
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
 
 #include <osmocom/vty/vty.h>
 
@@ -53,6 +54,9 @@ struct gsm_sms_pending {
 	int resend;
 };
 
+/* the most SMS to fetch from the DB at once */
+#define SMSQ_BATCH	32
+
 struct gsm_sms_queue {
 	struct osmo_timer_list resend_pending;
 	struct osmo_timer_list push_queue;
@@ -63,6 +67,15 @@ struct gsm_sms_queue {
 
 	struct llist_head pending_sms;
 	unsigned long long last_subscr_id;
+
+	/* fetched but not looked at yet, only during sms_submit_pending */
+	struct gsm_sms *batch[SMSQ_BATCH];
+	int batch_len;
+	int batch_pos;
+
+	/* DB queries to fetch SMS and the SMS delivered */
+	unsigned long long queries;
+	unsigned long long delivered;
 };
 
 static int sms_subscr_cb(unsigned int, unsigned int, void *, void *);
@@ -166,13 +179,16 @@ static void sms_resend_pending(void *_data)
 {
 	struct gsm_sms_pending *pending, *tmp;
 	struct gsm_sms_queue *smsq = _data;
+	unsigned long long queries;
 
 	llist_for_each_entry_safe(pending, tmp, &smsq->pending_sms, entry) {
 		struct gsm_sms *sms;
 		if (!pending->resend)
 			continue;
 
+		queries = db_query_count();
 		sms = db_sms_get(smsq->network, pending->sms_id);
+		smsq->queries += db_query_count() - queries;
 
 		/* the sms is gone? Move to the next */
 		if (!sms) {
@@ -186,25 +202,50 @@ static void sms_resend_pending(void *_data)
 	}
 }
 
-static struct gsm_sms *take_next_sms(struct gsm_sms_queue *smsq)
+static int fetch_sms(struct gsm_sms_queue *smsq, int max)
+{
+	unsigned long long queries = db_query_count();
+	int rc;
+
+	rc = db_sms_get_unsent_batch(smsq->network, smsq->last_subscr_id, 10,
+				     smsq->batch, max);
+	smsq->queries += db_query_count() - queries;
+	return rc;
+}
+
+static struct gsm_sms *take_next_sms(struct gsm_sms_queue *smsq, int max)
 {
 	struct gsm_sms *sms;
+	int rc;
+
+	if (smsq->batch_pos == smsq->batch_len) {
+		max = OSMO_MIN(OSMO_MAX(max, 1), SMSQ_BATCH);
+		smsq->batch_pos = smsq->batch_len = 0;
 
-	sms = db_sms_get_unsent_by_subscr(smsq->network, smsq->last_subscr_id, 10);
-	if (sms) {
-		smsq->last_subscr_id = sms->receiver->id + 1;
-		return sms;
+		rc = fetch_sms(smsq, max);
+		if (rc <= 0) {
+			/* need to wrap around */
+			smsq->last_subscr_id = 0;
+			rc = fetch_sms(smsq, max);
+		}
+		if (rc <= 0)
+			return NULL;
+		smsq->batch_len = rc;
 	}
 
-	/* need to wrap around */
-	smsq->last_subscr_id = 0;
-	sms = db_sms_get_unsent_by_subscr(smsq->network,
-					  smsq->last_subscr_id, 10);
-	if (sms)
-		smsq->last_subscr_id = sms->receiver->id + 1;
+	sms = smsq->batch[smsq->batch_pos++];
+	smsq->last_subscr_id = sms->receiver->id + 1;
 	return sms;
 }
 
+/* drop what the last round didn't need, it might be stale next time */
+static void drop_fetched_sms(struct gsm_sms_queue *smsq)
+{
+	while (smsq->batch_pos < smsq->batch_len)
+		sms_free(smsq->batch[smsq->batch_pos++]);
+	smsq->batch_pos = smsq->batch_len = 0;
+}
+
 /**
  * I will submit up to max_pending - pending SMS to the
  * subsystem.
@@ -224,7 +265,7 @@ static void sms_submit_pending(void *_data)
 		struct gsm_sms *sms;
 
 
-		sms = take_next_sms(smsq);
+		sms = take_next_sms(smsq, attempts - attempted);
 		if (!sms) {
 			LOGP(DLSMS, LOGL_DEBUG, "Sending SMS done (%d attempted)\n",
 			     attempted);
@@ -283,6 +324,7 @@ static void sms_submit_pending(void *_data)
 		gsm411_send_sms_subscr(sms->receiver, sms);
 	} while (attempted < attempts && rounds < 1000);
 
+	drop_fetched_sms(smsq);
 	LOGP(DLSMS, LOGL_DEBUG, "SMSqueue added %d messages in %d rounds\n", attempted, rounds);
 }
 
@@ -294,12 +336,15 @@ static void sms_send_next(struct gsm_subscriber *subscr)
 	struct gsm_sms_queue *smsq = subscr->group->net->sms_queue;
 	struct gsm_sms_pending *pending;
 	struct gsm_sms *sms;
+	unsigned long long queries;
 
 	/* the subscriber should not be in the queue */
 	OSMO_ASSERT(!sms_subscriber_is_pending(smsq, subscr));
 
 	/* check for more messages for this subscriber */
+	queries = db_query_count();
 	sms = db_sms_get_unsent_for_subscr(subscr);
+	smsq->queries += db_query_count() - queries;
 	if (!sms)
 		goto no_pending_sms;
 
@@ -447,6 +492,7 @@ static int sms_sms_cb(unsigned int subsys, unsigned int signal,
 	case S_SMS_DELIVERED:
 		/* Remember the subscriber and clear the pending entry */
 		network->sms_queue->pending -= 1;
+		network->sms_queue->delivered += 1;
 		subscr = subscr_get(pending->subscr);
 		sms_pending_free(pending);
 		/* Attempt to send another SMS to this subscriber */
@@ -505,6 +551,10 @@ int sms_queue_stats(struct gsm_sms_queue *smsq, struct vty *vty)
 
 	vty_out(vty, "SMSqueue with max_pending: %d pending: %d%s",
 		smsq->max_pending, smsq->pending, VTY_NEWLINE);
+	vty_out(vty, "SMSqueue delivered: %llu fetch queries: %llu (%.2f per SMS)%s",
+		smsq->delivered, smsq->queries,
+		smsq->delivered ? (double) smsq->queries / smsq->delivered : 0.0,
+		VTY_NEWLINE);
 
 	llist_for_each_entry(pending, &smsq->pending_sms, entry)
 		vty_out(vty, " SMS Pending for Subscriber: %llu SMS: %llu Failed: %d.%s",
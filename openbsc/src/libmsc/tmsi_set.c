@@ -0,0 +1,138 @@
+/* Set of the TMSIs in use for collision free allocation */
+
+/*
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/protocol/gsm_23_003.h>
+
+#include <openbsc/tmsi_set.h>
+
+#define TMSI_SET_MIN_SIZE	1024
+
+/* TMSIs are random already, but not the ones configured by hand */
+static unsigned int tmsi_slot(const struct tmsi_set *set, uint32_t tmsi)
+{
+	return (tmsi * 0x9e3779b1) & (set->size - 1);
+}
+
+static void tmsi_set_insert(struct tmsi_set *set, uint32_t tmsi)
+{
+	unsigned int i = tmsi_slot(set, tmsi);
+
+	while (set->slots[i] != GSM_RESERVED_TMSI)
+		i = (i + 1) & (set->size - 1);
+	set->slots[i] = tmsi;
+}
+
+static int tmsi_set_grow(struct tmsi_set *set)
+{
+	struct tmsi_set new;
+	unsigned int i;
+
+	new.size = set->size ? set->size * 2 : TMSI_SET_MIN_SIZE;
+	new.count = set->count;
+	new.slots = talloc_array(NULL, uint32_t, new.size);
+	if (!new.slots)
+		return -ENOMEM;
+	memset(new.slots, 0xff, new.size * sizeof(uint32_t));
+
+	for (i = 0; i < set->size; i++) {
+		if (set->slots[i] != GSM_RESERVED_TMSI)
+			tmsi_set_insert(&new, set->slots[i]);
+	}
+
+	talloc_free(set->slots);
+	*set = new;
+	return 0;
+}
+
+/*! Remove all TMSIs and free the memory of the set. */
+void tmsi_set_clear(struct tmsi_set *set)
+{
+	talloc_free(set->slots);
+	memset(set, 0, sizeof(*set));
+}
+
+/*! Add a TMSI to the set.
+ *  \returns 0 if it was added, 1 if it was there already, negative on error
+ */
+int tmsi_set_add(struct tmsi_set *set, uint32_t tmsi)
+{
+	int rc;
+
+	if (tmsi == GSM_RESERVED_TMSI)
+		return -EINVAL;
+	if (tmsi_set_contains(set, tmsi))
+		return 1;
+
+	/* keep at least half of the slots free for short probe runs */
+	if (2 * (set->count + 1) > set->size) {
+		rc = tmsi_set_grow(set);
+		if (rc < 0)
+			return rc;
+	}
+
+	tmsi_set_insert(set, tmsi);
+	set->count += 1;
+	return 0;
+}
+
+bool tmsi_set_contains(const struct tmsi_set *set, uint32_t tmsi)
+{
+	unsigned int i;
+
+	if (!set->size)
+		return false;
+
+	for (i = tmsi_slot(set, tmsi); set->slots[i] != GSM_RESERVED_TMSI;
+	     i = (i + 1) & (set->size - 1)) {
+		if (set->slots[i] == tmsi)
+			return true;
+	}
+	return false;
+}
+
+/*! Pick a random TMSI that is not in the set yet and add it.
+ *  \param[out] tmsi the new TMSI
+ *  \returns 0 on success, negative on error
+ */
+int tmsi_set_alloc(struct tmsi_set *set, uint32_t *tmsi)
+{
+	uint32_t try;
+	int rc;
+
+	do {
+		rc = osmo_get_rand_id((uint8_t *) &try, sizeof(try));
+		if (rc < 0)
+			return rc;
+	} while (try == GSM_RESERVED_TMSI || tmsi_set_contains(set, try));
+
+	rc = tmsi_set_add(set, try);
+	if (rc < 0)
+		return rc;
+
+	*tmsi = try;
+	return 0;
+}
@@ -52,8 +52,10 @@
 #include <openbsc/sms_queue.h>
 #include <openbsc/mncc_int.h>
 #include <openbsc/handover.h>
+#include <openbsc/meas_feed.h>
 
 #include <osmocom/vty/logging.h>
+#include <osmocom/vty/misc.h>
 
 #include "meas_feed.h"
 
@@ -717,6 +719,7 @@ DEFUN(ena_subscr_extension,
 	}
 
 	osmo_strlcpy(subscr->extension, ext, sizeof(subscr->extension));
+	subscr_ext_update(subscr);
 	db_sync_subscriber(subscr);
 
 	subscr_put(subscr);
@@ -931,6 +934,11 @@ DEFUN(show_stats,
 		net->msc_ctrs->ctr[MSC_CTR_LOC_UPDATE_COMPLETED].current,
 		net->msc_ctrs->ctr[MSC_CTR_LOC_UPDATE_FAILED].current,
 		VTY_NEWLINE);
+	vty_out(vty, "Location Update Expiry  : %u pending, %lu expired, %lu/s%s",
+		net->subscr_expire_backlog,
+		net->msc_ctrs->ctr[MSC_CTR_SUBSCR_EXPIRED].current,
+		net->msc_ctrs->ctr[MSC_CTR_SUBSCR_EXPIRED].intv[RATE_CTR_INTV_SEC].rate,
+		VTY_NEWLINE);
 	vty_out(vty, "Handover                : %lu attempted, %lu no_channel, %lu timeout, "
 		"%lu completed, %lu failed%s",
 		net->bsc_ctrs->ctr[BSC_CTR_HANDOVER_ATTEMPTED].current,
@@ -1047,6 +1055,7 @@ static int config_write_mncc_int(struct vty *vty)
 	uint16_t meas_port;
 	char *meas_host;
 	const char *meas_scenario;
+	int i;
 
 	meas_feed_cfg_get(&meas_host, &meas_port);
 	meas_scenario = meas_feed_scenario_get();
@@ -1064,6 +1073,20 @@ static int config_write_mncc_int(struct vty *vty)
 	if (strlen(meas_scenario) > 0)
 		vty_out(vty, " meas-feed scenario %s%s",
 			meas_scenario, VTY_NEWLINE);
+	if (meas_feed_version_get() != MEAS_FEED_VERSION)
+		vty_out(vty, " meas-feed version %d%s",
+			meas_feed_version_get(), VTY_NEWLINE);
+	if (meas_feed_flush_interval_get() != MEAS_FEED_FLUSH_MS_DEFAULT)
+		vty_out(vty, " meas-feed flush-interval %u%s",
+			meas_feed_flush_interval_get(), VTY_NEWLINE);
+	if (meas_feed_sample_subscr_get() > 1)
+		vty_out(vty, " meas-feed sampling subscriber %u%s",
+			meas_feed_sample_subscr_get(), VTY_NEWLINE);
+	for (i = 0; i < 256; i++) {
+		if (meas_feed_sample_bts_get(i) > 1)
+			vty_out(vty, " meas-feed sampling bts %d %u%s",
+				i, meas_feed_sample_bts_get(i), VTY_NEWLINE);
+	}
 
 
 	return CMD_SUCCESS;
@@ -1128,6 +1151,74 @@ DEFUN(meas_feed_scenario, meas_feed_scenario_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(mnccint_meas_feed_version, mnccint_meas_feed_version_cmd,
+	"meas-feed version (1|2)",
+	MEAS_STR "Format of the feed\n"
+	"One datagram per measurement report\n"
+	"Compact records batched into datagrams\n")
+{
+	meas_feed_version_set(atoi(argv[0]));
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(mnccint_meas_feed_flush, mnccint_meas_feed_flush_cmd,
+	"meas-feed flush-interval <10-10000>",
+	MEAS_STR "Maximum time a record of the version 2 feed is held back\n"
+	"Milliseconds\n")
+{
+	meas_feed_flush_interval_set(atoi(argv[0]));
+
+	return CMD_SUCCESS;
+}
+
+#define SAMPLING_STR "Only export a subset of the measurement reports\n"
+DEFUN(mnccint_meas_feed_sample_subscr, mnccint_meas_feed_sample_subscr_cmd,
+	"meas-feed sampling subscriber <1-65535>",
+	MEAS_STR SAMPLING_STR "Select subscribers by their IMSI\n"
+	"Export the reports of one in N subscribers\n")
+{
+	meas_feed_sample_subscr_set(atoi(argv[0]));
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(mnccint_meas_feed_sample_bts, mnccint_meas_feed_sample_bts_cmd,
+	"meas-feed sampling bts <0-255> <1-65535>",
+	MEAS_STR SAMPLING_STR "Select reports of a BTS\n" "BTS number\n"
+	"Export one in N reports of this BTS\n")
+{
+	meas_feed_sample_bts_set(atoi(argv[0]), atoi(argv[1]));
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(mnccint_no_meas_feed_sample_bts, mnccint_no_meas_feed_sample_bts_cmd,
+	"no meas-feed sampling bts <0-255>",
+	NO_STR MEAS_STR SAMPLING_STR "Select reports of a BTS\n" "BTS number\n")
+{
+	meas_feed_sample_bts_set(atoi(argv[0]), 1);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_meas_feed, show_meas_feed_cmd,
+	"show meas-feed",
+	SHOW_STR "Display the state of the measurement report feed\n")
+{
+	struct rate_ctr_group *ctrg = meas_feed_ctrg_get();
+
+	if (!ctrg) {
+		vty_out(vty, "Measurement feed is not configured%s", VTY_NEWLINE);
+		return CMD_SUCCESS;
+	}
+
+	vty_out(vty, "Measurement feed version %d%s", meas_feed_version_get(),
+		VTY_NEWLINE);
+	vty_out_rate_ctr_group(vty, " ", ctrg);
+	return CMD_SUCCESS;
+}
+
 
 DEFUN(logging_fltr_imsi,
       logging_fltr_imsi_cmd,
@@ -1271,6 +1362,7 @@ int bsc_vty_init_extra(void)
 	install_element_ve(&subscriber_update_cmd);
 	install_element_ve(&show_stats_cmd);
 	install_element_ve(&show_smsqueue_cmd);
+	install_element_ve(&show_meas_feed_cmd);
 	install_element_ve(&logging_fltr_imsi_cmd);
 
 	install_element(ENABLE_NODE, &ena_subscr_delete_cmd);
@@ -1294,6 +1386,11 @@ int bsc_vty_init_extra(void)
 	install_element(MNCC_INT_NODE, &mnccint_def_codec_h_cmd);
 	install_element(MNCC_INT_NODE, &mnccint_meas_feed_cmd);
 	install_element(MNCC_INT_NODE, &meas_feed_scenario_cmd);
+	install_element(MNCC_INT_NODE, &mnccint_meas_feed_version_cmd);
+	install_element(MNCC_INT_NODE, &mnccint_meas_feed_flush_cmd);
+	install_element(MNCC_INT_NODE, &mnccint_meas_feed_sample_subscr_cmd);
+	install_element(MNCC_INT_NODE, &mnccint_meas_feed_sample_bts_cmd);
+	install_element(MNCC_INT_NODE, &mnccint_no_meas_feed_sample_bts_cmd);
 
 	install_element(CFG_LOG_NODE, &log_level_sms_cmd);
 	install_element(CFG_LOG_NODE, &logging_fltr_imsi_cmd);
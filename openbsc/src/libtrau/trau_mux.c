@@ -112,10 +112,93 @@ static LLIST_HEAD(ss_upqueue);
 
 void *tall_map_ctx, *tall_upq_ctx;
 
+/*
+ * A frame arrives on every subslot of a call every 20ms, so the entries
+ * of both lists are indexed by the subslot they are looked up with. The
+ * index covers the 16k subslots the demuxer delivers, entries of other
+ * subslots are only found by walking the lists.
+ */
+#define SS_INDEX_TS	32
+#define SS_INDEX_SS	4
+
+struct ss_index_entry {
+	struct map_entry *me;
+	struct upqueue_entry *ue;
+};
+
+/* one array of SS_INDEX_TS * SS_INDEX_SS entries per E1 line */
+static struct ss_index_entry *ss_index[256];
+
+static int ss_indexed(const struct gsm_e1_subslot *ss)
+{
+	return ss->e1_ts < SS_INDEX_TS && ss->e1_ts_ss < SS_INDEX_SS;
+}
+
+static struct ss_index_entry *ss_index_get(const struct gsm_e1_subslot *ss)
+{
+	struct ss_index_entry **line;
+
+	if (!ss_indexed(ss))
+		return NULL;
+
+	line = &ss_index[ss->e1_nr];
+	if (!*line) {
+		*line = talloc_zero_array(tall_map_ctx, struct ss_index_entry,
+					  SS_INDEX_TS * SS_INDEX_SS);
+		if (!*line)
+			return NULL;
+	}
+
+	return &(*line)[ss->e1_ts * SS_INDEX_SS + ss->e1_ts_ss];
+}
+
+/* the most recent receiver of a subslot */
+static struct upqueue_entry *
+scan_trau_upqueue(const struct gsm_e1_subslot *src)
+{
+	struct upqueue_entry *ue;
+
+	llist_for_each_entry(ue, &ss_upqueue, list) {
+		if (!memcmp(&ue->src, src, sizeof(*src)))
+			return ue;
+	}
+	return NULL;
+}
+
+static void map_entry_free(struct map_entry *me)
+{
+	struct ss_index_entry *idx;
+
+	idx = ss_index_get(&me->src);
+	if (idx && idx->me == me)
+		idx->me = NULL;
+	idx = ss_index_get(&me->dst);
+	if (idx && idx->me == me)
+		idx->me = NULL;
+
+	llist_del(&me->list);
+	talloc_free(me);
+}
+
+static void upqueue_entry_free(struct upqueue_entry *ue)
+{
+	struct ss_index_entry *idx;
+
+	llist_del(&ue->list);
+
+	/* an older receiver of the subslot takes over */
+	idx = ss_index_get(&ue->src);
+	if (idx && idx->ue == ue)
+		idx->ue = scan_trau_upqueue(&ue->src);
+
+	talloc_free(ue);
+}
+
 /* map one particular subslot to another subslot */
 int trau_mux_map(const struct gsm_e1_subslot *src,
 		 const struct gsm_e1_subslot *dst)
 {
+	struct ss_index_entry *src_idx, *dst_idx;
 	struct map_entry *me;
 
 	me = talloc(tall_map_ctx, struct map_entry);
@@ -133,9 +216,21 @@ int trau_mux_map(const struct gsm_e1_subslot *src,
 	trau_mux_unmap(src, 0);
 	trau_mux_unmap(dst, 0);
 
+	src_idx = ss_index_get(src);
+	dst_idx = ss_index_get(dst);
+	if ((!src_idx && ss_indexed(src)) || (!dst_idx && ss_indexed(dst))) {
+		LOGP(DLMIB, LOGL_FATAL, "Out of memory\n");
+		talloc_free(me);
+		return -ENOMEM;
+	}
+
 	memcpy(&me->src, src, sizeof(me->src));
 	memcpy(&me->dst, dst, sizeof(me->dst));
 	llist_add(&me->list, &ss_map);
+	if (src_idx)
+		src_idx->me = me;
+	if (dst_idx)
+		dst_idx->me = me;
 
 	return 0;
 }
@@ -162,17 +257,17 @@ int trau_mux_unmap(const struct gsm_e1_subslot *ss, uint32_t callref)
 		llist_for_each_entry_safe(me, me2, &ss_map, list) {
 			if (!memcmp(&me->src, ss, sizeof(*ss)) ||
 			    !memcmp(&me->dst, ss, sizeof(*ss))) {
-				llist_del(&me->list);
+				map_entry_free(me);
 				return 0;
 			}
 		}
 	llist_for_each_entry_safe(ue, ue2, &ss_upqueue, list) {
 		if (ue->callref == callref) {
-			llist_del(&ue->list);
+			upqueue_entry_free(ue);
 			return 0;
 		}
 		if (ss && !memcmp(&ue->src, ss, sizeof(*ss))) {
-			llist_del(&ue->list);
+			upqueue_entry_free(ue);
 			return 0;
 		}
 	}
@@ -183,8 +278,18 @@ int trau_mux_unmap(const struct gsm_e1_subslot *ss, uint32_t callref)
 static struct gsm_e1_subslot *
 lookup_trau_mux_map(const struct gsm_e1_subslot *src)
 {
+	struct ss_index_entry *idx = ss_index_get(src);
 	struct map_entry *me;
 
+	if (idx) {
+		me = idx->me;
+		if (!me)
+			return NULL;
+		if (!memcmp(&me->src, src, sizeof(*src)))
+			return &me->dst;
+		return &me->src;
+	}
+
 	llist_for_each_entry(me, &ss_map, list) {
 		if (!memcmp(&me->src, src, sizeof(*src)))
 			return &me->dst;
@@ -198,17 +303,59 @@ lookup_trau_mux_map(const struct gsm_e1_subslot *src)
 struct upqueue_entry *
 lookup_trau_upqueue(const struct gsm_e1_subslot *src)
 {
-	struct upqueue_entry *ue;
+	struct ss_index_entry *idx = ss_index_get(src);
 
-	llist_for_each_entry(ue, &ss_upqueue, list) {
-		if (!memcmp(&ue->src, src, sizeof(*src)))
-			return ue;
-	}
-	return NULL;
+	if (idx)
+		return idx->ue;
+	return scan_trau_upqueue(src);
 }
 
 static const uint8_t c_bits_check_fr[] = { 0, 0, 0, 1, 0 };
 static const uint8_t c_bits_check_efr[] = { 1, 1, 0, 1, 0 };
+static const uint8_t c_bits_check_idle[] = { 1, 0, 0, 0, 0 };
+
+static const uint8_t c_bits_fr_down[] = { 1, 1, 1, 0, 0 };
+static const uint8_t c_bits_idle_down[] = { 0, 1, 1, 1, 0 };
+
+/*
+ * Turn an uplink FR, EFR or idle speech TRAU frame into a downlink one,
+ * with the same result as decode_trau_frame(), trau_frame_up2down() and
+ * encode_trau_frame(). Only the sync pattern and the control bits that
+ * differ between the directions are rewritten, the data bits are copied
+ * as they are (TS 08.60, 3.1.1). Other frame types return -EINVAL.
+ */
+int trau_up2down_bits(uint8_t *out, const uint8_t *in)
+{
+	const uint8_t *c_bits;
+	int i;
+
+	if (!memcmp(in + 17, c_bits_check_fr, 5))
+		c_bits = c_bits_fr_down;
+	else if (!memcmp(in + 17, c_bits_check_idle, 5))
+		c_bits = c_bits_idle_down;
+	else if (!memcmp(in + 17, c_bits_check_efr, 5))
+		c_bits = c_bits_check_efr;
+	else
+		return -EINVAL;
+
+	memcpy(out, in, TRAU_FRAME_BITS);
+
+	/* 16 zero bits followed by a one at the start of every word */
+	memset(out, 0, 16);
+	for (i = 16; i < TRAU_FRAME_BITS; i += 16)
+		out[i] = 1;
+
+	/* C1..C5 frame type, C6..C11 time alignment */
+	memcpy(out + 17, c_bits, 5);
+	memset(out + 22, 0, 6);
+	/* C12 is kept, C13..C21 are spare */
+	memset(out + 29, 1, 3);
+	memset(out + 310, 1, 6);
+	/* T1..T4 */
+	memset(out + 316, 1, 4);
+
+	return 0;
+}
 
 struct msgb *trau_decode_fr(uint32_t callref,
 	const struct decoded_trau_frame *tf)
@@ -334,48 +481,54 @@ int trau_mux_input(struct gsm_e1_subslot *src_e1_ss,
 	struct gsm_e1_subslot *dst_e1_ss = lookup_trau_mux_map(src_e1_ss);
 	struct subch_mux *mx;
 	struct upqueue_entry *ue;
+	struct msgb *msg = NULL;
 	int rc;
 
-	/* decode TRAU, change it to downlink, re-encode */
-	rc = decode_trau_frame(&tf, trau_bits);
-	if (rc)
-		return rc;
+	if (dst_e1_ss) {
+		/* speech frames only need their control bits changed */
+		if (trau_up2down_bits(trau_bits_out, trau_bits) < 0) {
+			/* decode TRAU, change it to downlink, re-encode */
+			rc = decode_trau_frame(&tf, trau_bits);
+			if (rc)
+				return rc;
+			trau_frame_up2down(&tf);
+			encode_trau_frame(trau_bits_out, &tf);
+		}
 
-	if (!dst_e1_ss) {
-		struct msgb *msg = NULL;
-		/* frame shall be sent to upqueue */
-		if (!(ue = lookup_trau_upqueue(src_e1_ss)))
-			return -EINVAL;
-		if (!ue->callref)
-			return -EINVAL;
-		if (!memcmp(tf.c_bits, c_bits_check_fr, 5))
-			msg = trau_decode_fr(ue->callref, &tf);
-		else if (!memcmp(tf.c_bits, c_bits_check_efr, 5))
-			msg = trau_decode_efr(ue->callref, &tf);
-		else {
-			DEBUGPC(DLMUX, "illegal trau (C1-C5) %s\n",
-				osmo_hexdump(tf.c_bits, 5));
-			DEBUGPC(DLMUX, "test trau (C1-C5) %s\n",
-				osmo_hexdump(c_bits_check_efr, 5));
+		mx = e1inp_get_mux(dst_e1_ss->e1_nr, dst_e1_ss->e1_ts);
+		if (!mx)
 			return -EINVAL;
-		}
-		if (!msg)
-			return -ENOMEM;
-		trau_tx_to_mncc(ue->net, msg);
 
-		return 0;
+		/* and send it to the muxer */
+		return subchan_mux_enqueue(mx, dst_e1_ss->e1_ts_ss,
+					   trau_bits_out, TRAU_FRAME_BITS);
 	}
 
-	mx = e1inp_get_mux(dst_e1_ss->e1_nr, dst_e1_ss->e1_ts);
-	if (!mx)
-		return -EINVAL;
+	rc = decode_trau_frame(&tf, trau_bits);
+	if (rc)
+		return rc;
 
-	trau_frame_up2down(&tf);
-	encode_trau_frame(trau_bits_out, &tf);
+	/* frame shall be sent to upqueue */
+	if (!(ue = lookup_trau_upqueue(src_e1_ss)))
+		return -EINVAL;
+	if (!ue->callref)
+		return -EINVAL;
+	if (!memcmp(tf.c_bits, c_bits_check_fr, 5))
+		msg = trau_decode_fr(ue->callref, &tf);
+	else if (!memcmp(tf.c_bits, c_bits_check_efr, 5))
+		msg = trau_decode_efr(ue->callref, &tf);
+	else {
+		DEBUGPC(DLMUX, "illegal trau (C1-C5) %s\n",
+			osmo_hexdump(tf.c_bits, 5));
+		DEBUGPC(DLMUX, "test trau (C1-C5) %s\n",
+			osmo_hexdump(c_bits_check_efr, 5));
+		return -EINVAL;
+	}
+	if (!msg)
+		return -ENOMEM;
+	trau_tx_to_mncc(ue->net, msg);
 
-	/* and send it to the muxer */
-	return subchan_mux_enqueue(mx, dst_e1_ss->e1_ts_ss, trau_bits_out,
-				   TRAU_FRAME_BITS);
+	return 0;
 }
 
 /* callback when a TRAU frame was received */
@@ -396,6 +549,7 @@ int subch_cb(struct subch_demux *dmx, int ch, uint8_t *data, int len,
 int trau_recv_lchan(struct gsm_lchan *lchan, uint32_t callref)
 {
 	struct gsm_e1_subslot *src_ss;
+	struct ss_index_entry *idx;
 	struct upqueue_entry *ue;
 
 	ue = talloc(tall_upq_ctx, struct upqueue_entry);
@@ -403,6 +557,11 @@ int trau_recv_lchan(struct gsm_lchan *lchan, uint32_t callref)
 		return -ENOMEM;
 
 	src_ss = &lchan->ts->e1_link;
+	idx = ss_index_get(src_ss);
+	if (!idx && ss_indexed(src_ss)) {
+		talloc_free(ue);
+		return -ENOMEM;
+	}
 
 	DEBUGP(DCC, "Setting up TRAU receiver (e1=%u,ts=%u,ss=%u) "
 		"and (callref 0x%x)\n",
@@ -416,6 +575,8 @@ int trau_recv_lchan(struct gsm_lchan *lchan, uint32_t callref)
 	ue->net = lchan->ts->trx->bts->network;
 	ue->callref = callref;
 	llist_add(&ue->list, &ss_upqueue);
+	if (idx)
+		idx->ue = ue;
 
 	return 0;
 }
@@ -29,6 +29,7 @@
 
 #include <osmocom/gsm/protocol/gsm_08_08.h>
 #include <osmocom/gsm/gsm0808.h>
+#include <osmocom/gsm/gsm48.h>
 #include <osmocom/sccp/sccp.h>
 
 /*
@@ -97,7 +98,7 @@ static int bssmap_handle_reset_ack(struct bsc_msc_data *msc,
 	return 0;
 }
 
-static int bssmap_send_reset_ack(struct bsc_msc_data *msc)
+int bssmap_send_reset_ack(struct bsc_msc_data *msc)
 {
 	struct msgb *resp;
 	int rc;
@@ -118,12 +119,176 @@ static int bssmap_handle_reset(struct bsc_msc_data *msc,
 	LOGP(DMSC, LOGL_NOTICE, "Rx RESET from MSC\n");
 
 	/* Instruct the BSC to close all open SCCP connections and to close all
-	 * active radio channels on the BTS side as well */
-	bsc_notify_and_close_conns(msc->msc_con);
+	 * active radio channels on the BTS side as well. The MSC is informed
+	 * with a RESET ACK once the last of them is gone, which can take a
+	 * few main loop iterations. */
+	msc->reset_ack_pending = 1;
+	bsc_notify_and_close_conns(msc);
+	return 0;
+}
+
+/* the BTS a BSSMAP PAGING is sent on, each of them at most once */
+struct paging_targets {
+	unsigned int num;
+	struct gsm_bts *bts[256];
+	uint8_t seen[256 / 8];
+};
+
+static void paging_targets_add_bts(struct paging_targets *targets,
+				   struct gsm_bts *bts)
+{
+	if (targets->seen[bts->nr / 8] & (1 << (bts->nr % 8)))
+		return;
+	targets->seen[bts->nr / 8] |= 1 << (bts->nr % 8);
+	targets->bts[targets->num++] = bts;
+}
+
+/* leave out the BTS the subscriber is being paged on already */
+static void paging_targets_drop_pending(struct paging_targets *targets,
+					struct bsc_subscr *subscr)
+{
+	struct gsm_paging_request *req;
+	uint8_t pending[256 / 8];
+	unsigned int i, num = 0;
+
+	memset(pending, 0, sizeof(pending));
+	llist_for_each_entry(req, &subscr->paging_requests, bsub_entry)
+		pending[req->bts->nr / 8] |= 1 << (req->bts->nr % 8);
+
+	for (i = 0; i < targets->num; i++) {
+		struct gsm_bts *bts = targets->bts[i];
+
+		if (!(pending[bts->nr / 8] & (1 << (bts->nr % 8))))
+			targets->bts[num++] = bts;
+	}
+	targets->num = num;
+}
+
+/* add all cells of a LAC, or a single cell when ci >= 0 */
+static int paging_targets_add(struct paging_targets *targets,
+			      struct bsc_msc_data *msc, uint16_t lac, int ci)
+{
+	const struct gsm_bts_cell_entry *cells;
+	struct gsm_bts *bts;
+	int i, num_cells;
+
+	/* the MSC knows the whole BSS by one LAC, we need to page everything */
+	if (msc->core_lac != -1) {
+		llist_for_each_entry(bts, &msc->network->bts_list, list)
+			paging_targets_add_bts(targets, bts);
+		return 0;
+	}
+
+	/* the same is true for a patched CI within the LAC */
+	if (msc->core_ci != -1)
+		ci = -1;
+
+	num_cells = gsm_bts_by_lac_ci(msc->network, lac, ci, &cells);
+	if (num_cells < 0)
+		return num_cells;
+
+	for (i = 0; i < num_cells; i++)
+		paging_targets_add_bts(targets, cells[i].bts);
+	return 0;
+}
+
+/* is the PLMN of a CGI or LAI the one the MSC knows us by */
+static int paging_plmn_match(struct bsc_msc_data *msc, const uint8_t *data)
+{
+	struct osmo_location_area_id lai;
+	struct osmo_plmn_id plmn = msc->network->plmn;
+
+	gsm48_decode_lai2((const struct gsm48_loc_area_id *) data, &lai);
+
+	if (msc->core_plmn.mcc != GSM_MCC_MNC_INVALID)
+		plmn.mcc = msc->core_plmn.mcc;
+	if (msc->core_plmn.mnc != GSM_MCC_MNC_INVALID) {
+		plmn.mnc = msc->core_plmn.mnc;
+		plmn.mnc_3_digits = msc->core_plmn.mnc_3_digits;
+	}
+
+	return osmo_plmn_cmp(&lai.plmn, &plmn) == 0;
+}
+
+/*
+ * Collect the BTS for a Cell Identifier List (GSM 08.08 § 3.2.2.27).
+ * Lists of CGI, LAC+CI, LAI and LAC and the whole BSS are understood.
+ * *lac is set to the first LAC of the list.
+ */
+static int paging_targets_parse(struct paging_targets *targets,
+				struct bsc_msc_data *msc,
+				const uint8_t *data, uint8_t data_length,
+				unsigned int *lac)
+{
+	struct gsm_bts *bts;
+	unsigned int entry_len, i;
+	int rc = 0;
 
-	/* Inform the MSC that we have received the reset request and
-	 * that we acted accordingly */
-	return bssmap_send_reset_ack(msc);
+	if (data_length < 1)
+		return -1;
+
+	switch (data[0] & 0x0f) {
+	case CELL_IDENT_BSS:
+		if (data_length != 1)
+			return -1;
+		*lac = GSM_LAC_RESERVED_ALL_BTS;
+		llist_for_each_entry(bts, &msc->network->bts_list, list)
+			paging_targets_add_bts(targets, bts);
+		return 0;
+	case CELL_IDENT_WHOLE_GLOBAL:
+		entry_len = 7;
+		break;
+	case CELL_IDENT_LAC_AND_CI:
+		entry_len = 4;
+		break;
+	case CELL_IDENT_LAI_AND_LAC:
+		entry_len = 5;
+		break;
+	case CELL_IDENT_LAC:
+		entry_len = 2;
+		break;
+	default:
+		return -1;
+	}
+
+	if (data_length == 1 || (data_length - 1) % entry_len != 0)
+		return -1;
+
+	for (i = 1; i < data_length && rc == 0; i += entry_len) {
+		const uint8_t *entry = &data[i];
+		uint16_t entry_lac;
+
+		switch (data[0] & 0x0f) {
+		case CELL_IDENT_WHOLE_GLOBAL:
+			if (!paging_plmn_match(msc, entry))
+				continue;
+			entry_lac = osmo_load16be(&entry[3]);
+			rc = paging_targets_add(targets, msc, entry_lac,
+						osmo_load16be(&entry[5]));
+			break;
+		case CELL_IDENT_LAC_AND_CI:
+			entry_lac = osmo_load16be(&entry[0]);
+			rc = paging_targets_add(targets, msc, entry_lac,
+						osmo_load16be(&entry[2]));
+			break;
+		case CELL_IDENT_LAI_AND_LAC:
+			if (!paging_plmn_match(msc, entry))
+				continue;
+			entry_lac = osmo_load16be(&entry[3]);
+			rc = paging_targets_add(targets, msc, entry_lac, -1);
+			break;
+		case CELL_IDENT_LAC:
+		default:
+			entry_lac = osmo_load16be(&entry[0]);
+			rc = paging_targets_add(targets, msc, entry_lac, -1);
+			break;
+		}
+
+		if (*lac == GSM_LAC_RESERVED_ALL_BTS)
+			*lac = entry_lac;
+	}
+
+	return rc;
 }
 
 /* GSM 08.08 § 3.2.1.19 */
@@ -131,6 +296,7 @@ static int bssmap_handle_paging(struct bsc_msc_data *msc,
 				struct msgb *msg, unsigned int payload_length)
 {
 	struct bsc_subscr *subscr;
+	struct paging_targets targets;
 	struct tlv_parsed tp;
 	char mi_string[GSM48_MI_SIZE];
 	uint32_t tmsi = GSM_RESERVED_TMSI;
@@ -138,7 +304,7 @@ static int bssmap_handle_paging(struct bsc_msc_data *msc,
 	uint8_t data_length;
 	const uint8_t *data;
 	uint8_t chan_needed = RSL_CHANNEED_ANY;
-	int rc;
+	int rc, refreshed = 0;
 
 	tlv_parse(&tp, gsm0808_att_tlvdef(), msg->l4h + 1, payload_length - 1, 0, 0);
 
@@ -173,11 +339,11 @@ static int bssmap_handle_paging(struct bsc_msc_data *msc,
 	data = TLVP_VAL(&tp, GSM0808_IE_CELL_IDENTIFIER_LIST);
 
 	/*
-	 * Support paging to all network or one BTS at one LAC
+	 * Collect every BTS to page on in one go
 	 */
-	if (data_length == 3 && data[0] == CELL_IDENT_LAC) {
-		lac = osmo_load16be(&data[1]);
-	} else if (data_length > 1 || (data[0] & 0x0f) != CELL_IDENT_BSS) {
+	targets.num = 0;
+	memset(targets.seen, 0, sizeof(targets.seen));
+	if (paging_targets_parse(&targets, msc, data, data_length, &lac) != 0) {
 		LOGP(DMSC, LOGL_ERROR, "Unsupported Cell Identifier List: %s\n", osmo_hexdump(data, data_length));
 		return -1;
 	}
@@ -196,12 +362,44 @@ static int bssmap_handle_paging(struct bsc_msc_data *msc,
 		return -1;
 	}
 
+	/*
+	 * The MSC repeats the PAGING as long as the MS doesn't answer.
+	 * Keep the requests we already have running, only cells we are
+	 * not paging on yet get a new one.
+	 */
+	if (!llist_empty(&subscr->paging_requests)) {
+		refreshed = paging_request_refresh(subscr);
+		paging_targets_drop_pending(&targets, subscr);
+	}
+
 	subscr->lac = lac;
-	subscr->tmsi = tmsi;
+	bsc_subscr_set_tmsi(subscr, tmsi);
+
+	if (refreshed > 0 && targets.num == 0) {
+		rate_ctr_inc(&msc->network->bsc_ctrs->ctr[BSC_CTR_PAGING_REFRESHED]);
+		LOGP(DMSC, LOGL_DEBUG, "Paging for IMSI: '%s' already pending on %d BTS\n",
+		     mi_string, refreshed);
+		bsc_subscr_put(subscr);
+		return 0;
+	}
 
-	LOGP(DMSC, LOGL_INFO, "Paging request from MSC IMSI: '%s' TMSI: '0x%x/%u' LAC: 0x%x\n", mi_string, tmsi, tmsi, lac);
+	LOGP(DMSC, LOGL_INFO, "Paging request from MSC IMSI: '%s' TMSI: '0x%x/%u' LAC: 0x%x on %u BTS\n",
+	     mi_string, tmsi, tmsi, lac, targets.num);
 	rc = bsc_grace_paging_request(msc->network->bsc_data->rf_ctrl->policy,
-				 subscr, chan_needed, msc);
+				 subscr, chan_needed, msc, targets.bts, targets.num);
+
+	if (rc <= 0 && refreshed > 0) {
+		rate_ctr_inc(&msc->network->bsc_ctrs->ctr[BSC_CTR_PAGING_REFRESHED]);
+		LOGP(DMSC, LOGL_DEBUG, "Paging for IMSI: '%s' already pending on %d BTS\n",
+		     mi_string, refreshed);
+		bsc_subscr_put(subscr);
+		return 0;
+	}
+
+	rate_ctr_inc(&msc->network->bsc_ctrs->ctr[BSC_CTR_PAGING_ATTEMPTED]);
+	if (targets.num == 0)
+		rate_ctr_inc(&msc->network->bsc_ctrs->ctr[BSC_CTR_PAGING_DETACHED]);
+
 	if (rc <= 0) {
 		LOGP(DMSC, LOGL_ERROR, "Paging request failed (%d): IMSI: '%s' TMSI: '0x%x/%u' LAC: 0x%x\n",
 			rc, mi_string, tmsi, tmsi, lac);
@@ -351,7 +549,7 @@ static int bssmap_handle_assignm_req(struct osmo_bsc_sccp_con *conn,
 		goto reject;
 	}
 
-	conn->cic = osmo_load16be(TLVP_VAL(&tp, GSM0808_IE_CIRCUIT_IDENTITY_CODE));
+	bsc_sccp_con_set_cic(conn, osmo_load16be(TLVP_VAL(&tp, GSM0808_IE_CIRCUIT_IDENTITY_CODE)));
 	timeslot = conn->cic & 0x1f;
 	multiplex = (conn->cic & ~0x1f) >> 5;
 
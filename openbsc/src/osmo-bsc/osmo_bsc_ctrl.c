@@ -528,7 +528,7 @@ CTRL_CMD_DEFINE_WO(net_ussd_notify, "ussd-notify-v1");
 static int set_net_ussd_notify(struct ctrl_cmd *cmd, void *data)
 {
 	struct gsm_subscriber_connection *conn;
-	struct gsm_network *net;
+	struct osmo_bsc_sccp_con *sccp;
 	char *saveptr = NULL;
 	char *cic_str, *alert_str, *text_str;
 	int cic, alert;
@@ -548,28 +548,22 @@ static int set_net_ussd_notify(struct ctrl_cmd *cmd, void *data)
 	cic = atoi(cic_str);
 	alert = atoi(alert_str);
 
-	net = cmd->node;
-	llist_for_each_entry(conn, &net->subscr_conns, entry) {
-		if (!conn->sccp_con)
-			continue;
-
-		if (conn->sccp_con->cic != cic)
-			continue;
-
-		/*
-		 * This is a hack. My E71 does not like to immediately
-		 * receive a release complete on a TCH. So schedule a
-		 * release complete to clear any previous attempt. The
-		 * right thing would be to track invokeId and only send
-		 * the release complete when we get a returnResultLast
-		 * for this invoke id.
-		 */
-		bsc_send_ussd_release_complete(conn);
-		bsc_send_ussd_notify(conn, alert, text_str);
-		cmd->reply = "Found a connection";
-		break;
-	}
+	sccp = bsc_sccp_con_find_by_cic(cic);
+	if (!sccp)
+		return CTRL_CMD_REPLY;
 
+	/*
+	 * This is a hack. My E71 does not like to immediately
+	 * receive a release complete on a TCH. So schedule a
+	 * release complete to clear any previous attempt. The
+	 * right thing would be to track invokeId and only send
+	 * the release complete when we get a returnResultLast
+	 * for this invoke id.
+	 */
+	conn = sccp->conn;
+	bsc_send_ussd_release_complete(conn);
+	bsc_send_ussd_notify(conn, alert, text_str);
+	cmd->reply = "Found a connection";
 	return CTRL_CMD_REPLY;
 }
 
@@ -35,50 +35,39 @@ int bsc_grace_allow_new_connection(struct gsm_network *network, struct gsm_bts *
 
 
 static int normal_paging(struct bsc_subscr *subscr, int chan_needed,
-			 struct bsc_msc_data *msc)
+			 struct bsc_msc_data *msc,
+			 struct gsm_bts **bts, unsigned int num_bts)
 {
 	int rc, num_pages = 0;
-	/* we can't page by lac.. we need to page everything */
-	if (msc->core_lac != -1) {
-		struct gsm_bts *bts;
-
-		llist_for_each_entry(bts, &msc->network->bts_list, list) {
-			rc = paging_request_bts(bts, subscr, chan_needed, NULL, msc);
-			if (rc > 0)
-				num_pages += rc;
-		}
+	unsigned int i;
 
-		return num_pages;
+	for (i = 0; i < num_bts; i++) {
+		rc = paging_request_bts(bts[i], subscr, chan_needed, NULL, msc);
+		if (rc > 0)
+			num_pages += rc;
 	}
 
-	return paging_request(msc->network, subscr, chan_needed, NULL, msc);
+	return num_pages;
 }
 
 static int locked_paging(struct bsc_subscr *subscr, int chan_needed,
-			 struct bsc_msc_data *msc)
+			 struct bsc_msc_data *msc,
+			 struct gsm_bts **bts, unsigned int num_bts)
 {
-	struct gsm_bts *bts = NULL;
 	int rc, num_pages = 0;
+	unsigned int i;
 
-	/*
-	 * Check if there is any BTS that is on for the given lac. Start
-	 * with NULL and iterate through all bts.
-	 */
-	llist_for_each_entry(bts, &msc->network->bts_list, list) {
+	for (i = 0; i < num_bts; i++) {
 		/*
 		 * continue if the BTS is not excluded from the lock
 		 */
-		if (!bts->excl_from_rf_lock)
-			continue;
-
-		/* in case of no lac patching is in place, check the BTS */
-		if (msc->core_lac == -1 && subscr->lac != bts->location_area_code)
+		if (!bts[i]->excl_from_rf_lock)
 			continue;
 
 		/*
 		 * now page on this bts
 		 */
-		rc = paging_request_bts(bts, subscr, chan_needed, NULL, msc);
+		rc = paging_request_bts(bts[i], subscr, chan_needed, NULL, msc);
 		if (rc > 0)
 			num_pages += rc;
 	};
@@ -93,11 +82,12 @@ static int locked_paging(struct bsc_subscr *subscr, int chan_needed,
 int bsc_grace_paging_request(enum signal_rf rf_policy,
 			     struct bsc_subscr *subscr,
 			     int chan_needed,
-			     struct bsc_msc_data *msc)
+			     struct bsc_msc_data *msc,
+			     struct gsm_bts **bts, unsigned int num_bts)
 {
 	if (rf_policy == S_RF_ON)
-		return normal_paging(subscr, chan_needed, msc);
-	return locked_paging(subscr, chan_needed, msc);
+		return normal_paging(subscr, chan_needed, msc, bts, num_bts);
+	return locked_paging(subscr, chan_needed, msc, bts, num_bts);
 }
 
 static int handle_sub(struct gsm_lchan *lchan, const char *text)
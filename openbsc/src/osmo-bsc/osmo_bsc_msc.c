@@ -559,6 +559,9 @@ struct bsc_msc_data *osmo_msc_data_alloc(struct gsm_network *net, int nr)
 	msc_data->network = net;
 
 	INIT_LLIST_HEAD(&msc_data->dests);
+	INIT_LLIST_HEAD(&msc_data->sccp_cons);
+	INIT_LLIST_HEAD(&msc_data->sccp_closing);
+	osmo_timer_setup(&msc_data->sccp_close_timer, bsc_close_conns_cb, msc_data);
 	msc_data->ping_timeout = 20;
 	msc_data->pong_timeout = 5;
 	msc_data->core_plmn = (struct osmo_plmn_id){
@@ -37,7 +37,12 @@
 /* SCCP helper */
 #define SCCP_IT_TIMER 60
 
-static LLIST_HEAD(active_connections);
+/* connections cleared per main loop iteration once the MSC is lost */
+#define SCCP_CLOSE_BATCH 32
+
+/* connections with an assigned CIC, hashed by the CIC */
+#define CIC_HASH_SIZE 256
+static struct llist_head cic_hash[CIC_HASH_SIZE];
 
 static void free_queued(struct osmo_bsc_sccp_con *conn)
 {
@@ -236,11 +241,12 @@ enum bsc_con bsc_create_new_connection(struct gsm_subscriber_connection *conn,
 	osmo_timer_setup(&bsc_con->sccp_cc_timeout, sccp_cc_timeout, bsc_con);
 
 	INIT_LLIST_HEAD(&bsc_con->sccp_queue);
+	INIT_LLIST_HEAD(&bsc_con->cic_entry);
 
 	bsc_con->sccp = sccp;
 	bsc_con->msc = msc;
 	bsc_con->conn = conn;
-	llist_add_tail(&bsc_con->entry, &active_connections);
+	llist_add_tail(&bsc_con->entry, &msc->sccp_cons);
 	conn->sccp_con = bsc_con;
 	return BSC_CON_SUCCESS;
 }
@@ -262,12 +268,33 @@ int bsc_delete_connection(struct osmo_bsc_sccp_con *sccp)
 		LOGP(DMSC, LOGL_ERROR, "Should have been cleared.\n");
 
 	llist_del(&sccp->entry);
+	llist_del(&sccp->cic_entry);
 	osmo_timer_del(&sccp->sccp_it_timeout);
 	osmo_timer_del(&sccp->sccp_cc_timeout);
 	talloc_free(sccp);
 	return 0;
 }
 
+void bsc_sccp_con_set_cic(struct osmo_bsc_sccp_con *sccp, uint16_t cic)
+{
+	llist_del(&sccp->cic_entry);
+	sccp->cic = cic;
+	llist_add_tail(&sccp->cic_entry, &cic_hash[cic % CIC_HASH_SIZE]);
+}
+
+/*! \brief Find the oldest connection with a subscriber on the CIC */
+struct osmo_bsc_sccp_con *bsc_sccp_con_find_by_cic(uint16_t cic)
+{
+	struct osmo_bsc_sccp_con *sccp;
+
+	llist_for_each_entry(sccp, &cic_hash[cic % CIC_HASH_SIZE], cic_entry) {
+		if (sccp->cic == cic && sccp->conn)
+			return sccp;
+	}
+
+	return NULL;
+}
+
 static void bsc_notify_msc_lost(struct osmo_bsc_sccp_con *con)
 {
 	struct gsm_subscriber_connection *conn = con->conn;
@@ -287,17 +314,41 @@ static void bsc_notify_msc_lost(struct osmo_bsc_sccp_con *con)
 	bsc_send_ussd_release_complete(conn);
 }
 
-void bsc_notify_and_close_conns(struct bsc_msc_connection *msc_con)
+void bsc_close_conns_cb(void *_msc)
 {
-	struct osmo_bsc_sccp_con *con, *tmp;
-
-	llist_for_each_entry_safe(con, tmp, &active_connections, entry) {
-		if (con->msc->msc_con != msc_con)
-			continue;
-
+	struct bsc_msc_data *msc = _msc;
+	struct osmo_bsc_sccp_con *con;
+	int i;
+
+	/* freeing a connection might free others, always take the first */
+	for (i = 0; i < SCCP_CLOSE_BATCH && !llist_empty(&msc->sccp_closing); ++i) {
+		con = llist_entry(msc->sccp_closing.next,
+				  struct osmo_bsc_sccp_con, entry);
 		bsc_notify_msc_lost(con);
 		bsc_sccp_force_free(con);
 	}
+
+	/* continue after RSL and the other sockets had their turn */
+	if (!llist_empty(&msc->sccp_closing)) {
+		osmo_timer_schedule(&msc->sccp_close_timer, 0, 0);
+		return;
+	}
+
+	/* all connections are gone now, acknowledge the RESET */
+	if (msc->reset_ack_pending) {
+		msc->reset_ack_pending = 0;
+		bssmap_send_reset_ack(msc);
+	}
+}
+
+/*! \brief Clear all connections of the MSC.
+ *  The connections are taken off the MSC right away so that new ones
+ *  are not affected. They are cleared a few per main loop iteration.
+ */
+void bsc_notify_and_close_conns(struct bsc_msc_data *msc)
+{
+	llist_splice_init(&msc->sccp_cons, &msc->sccp_closing);
+	bsc_close_conns_cb(msc);
 }
 
 static int handle_msc_signal(unsigned int subsys, unsigned int signal,
@@ -309,14 +360,22 @@ static int handle_msc_signal(unsigned int subsys, unsigned int signal,
 		return 0;
 
 	msc = signal_data;
-	if (signal == S_MSC_LOST)
-		bsc_notify_and_close_conns(msc->data->msc_con);
+	if (signal == S_MSC_LOST) {
+		/* there is no one to acknowledge a RESET to anymore */
+		msc->data->reset_ack_pending = 0;
+		bsc_notify_and_close_conns(msc->data);
+	}
 
 	return 0;
 }
 
 int osmo_bsc_sccp_init(struct gsm_network *gsmnet)
 {
+	int i;
+
+	for (i = 0; i < CIC_HASH_SIZE; ++i)
+		INIT_LLIST_HEAD(&cic_hash[i]);
+
 	sccp_set_log_area(DSCCP);
 	sccp_system_init(msc_sccp_write_ipa, gsmnet);
 	sccp_connection_set_incoming(&sccp_ssn_bssap, msc_sccp_accept, NULL);
@@ -30,6 +30,8 @@
 
 #include <osmocom/sccp/sccp.h>
 
+#include <stddef.h>
+
 /*
  * The idea is to have a simple struct describing a IPA packet with
  * SCCP SSN and the GSM 08.08 payload and decide. We will both have
@@ -137,6 +139,88 @@ int bsc_nat_parse(struct msgb *msg, struct bsc_nat_parsed *parsed)
 	return 0;
 }
 
+ /*! Locate the references of an established connection message.
+  *  Only DT1, RLSD and RLC are understood and nothing but the fixed
+  *  part of the SCCP header is looked at. The msgb is not modified
+  *  besides setting l2h. Everything else has to go through the full
+  *  \ref bsc_nat_parse.
+  *  \param[in] msg the IPA message to parse
+  *  \param[out] parsed the structure to fill with parsed values
+  *  \returns 0 on success, negative if the slow path is needed
+  */
+int bsc_nat_parse_fast(struct msgb *msg, struct bsc_nat_parsed *parsed)
+{
+	struct ipaccess_head *hh;
+	uint8_t *data;
+	int len;
+
+	if (msg->len < sizeof(*hh) + 1)
+		return -1;
+
+	hh = (struct ipaccess_head *) msg->data;
+	if (hh->proto != IPAC_PROTO_SCCP)
+		return -1;
+
+	msg->l2h = &hh->data[0];
+	len = msgb_l2len(msg);
+	if (ntohs(hh->len) != len)
+		return -1;
+
+	parsed->ipa_proto = hh->proto;
+	parsed->called_ssn = parsed->calling_ssn = -1;
+	parsed->bssap = parsed->gsm_type = -1;
+	parsed->sccp_type = msg->l2h[0];
+	parsed->src_local_ref = NULL;
+	parsed->dest_local_ref = NULL;
+
+	switch (parsed->sccp_type) {
+	case SCCP_MSG_TYPE_DT1: {
+		struct sccp_data_form1 *dt1;
+
+		if (len < sizeof(*dt1) + 1)
+			return -1;
+		dt1 = (struct sccp_data_form1 *) msg->l2h;
+
+		/* the user data must fill the rest of the message */
+		data = &dt1->variable_start + dt1->variable_start;
+		if (data >= msg->tail || data + 1 + data[0] != msg->tail)
+			return -1;
+		if (data[0] < 3)
+			return -1;
+
+		parsed->dest_local_ref = &dt1->destination_local_reference;
+		parsed->bssap = data[1];
+		parsed->gsm_type = data[3];
+		break;
+	}
+	case SCCP_MSG_TYPE_RLSD: {
+		struct sccp_connection_released *rlsd;
+
+		if (len < offsetof(struct sccp_connection_released, variable_optional))
+			return -1;
+		rlsd = (struct sccp_connection_released *) msg->l2h;
+		parsed->dest_local_ref = &rlsd->destination_local_reference;
+		parsed->src_local_ref = &rlsd->source_local_reference;
+		break;
+	}
+	case SCCP_MSG_TYPE_RLC: {
+		struct sccp_connection_release_complete *rlc;
+
+		if (len < sizeof(*rlc))
+			return -1;
+		rlc = (struct sccp_connection_release_complete *) msg->l2h;
+		parsed->dest_local_ref = &rlc->destination_local_reference;
+		parsed->src_local_ref = &rlc->source_local_reference;
+		break;
+	}
+	default:
+		return -1;
+	}
+
+	parsed->original_dest_ref = *parsed->dest_local_ref;
+	return 0;
+}
+
 /* Returns 0 if message is whitelisted (has to beforwarded by bsc-nat), 1 if
 /* it's blacklisted (not to be forwarded) */
 int bsc_nat_filter_ipa(int dir, struct msgb *msg, struct bsc_nat_parsed *parsed)
@@ -57,13 +57,19 @@
 #include <osmocom/sccp/sccp.h>
 
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
 #include <osmocom/gsm/gsm0808.h>
 #include <osmocom/gsm/protocol/gsm_08_08.h>
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <strings.h>
 #include <unistd.h>
 
 static void send_direct(struct bsc_nat *nat, struct msgb *output)
@@ -92,9 +98,15 @@ int bsc_mgcp_nr_multiplexes(int max_endpoints)
 	return div;
 }
 
+/* the bits at and above n, shifting by 32 is undefined */
+static uint32_t bits_from(int n)
+{
+	return n >= 32 ? 0 : ~0u << n;
+}
+
 static int bsc_init_endps_if_needed(struct bsc_connection *con)
 {
-	int multiplexes;
+	int multiplexes, endpoint, multiplex, timeslot;
 
 	/* we have done that */
 	if (con->_endpoint_status)
@@ -108,56 +120,97 @@ static int bsc_init_endps_if_needed(struct bsc_connection *con)
 	con->number_multiplexes = multiplexes;
 	con->max_endpoints = con->cfg->max_endpoints;
 	con->_endpoint_status = talloc_zero_array(con, char, 32 * multiplexes + 1);
-	return con->_endpoint_status == NULL;
+	con->_endpoint_free = talloc_zero_array(con, uint32_t, multiplexes);
+	if (!con->_endpoint_status || !con->_endpoint_free) {
+		TALLOC_FREE(con->_endpoint_status);
+		TALLOC_FREE(con->_endpoint_free);
+		return 1;
+	}
+
+	/* timeslot 0 and 31 are never used */
+	con->_multiplex_free = 0;
+	for (endpoint = 1; endpoint < con->max_endpoints; ++endpoint) {
+		mgcp_endpoint_to_timeslot(endpoint, &multiplex, &timeslot);
+		if (timeslot == 0 || timeslot == 0x1f)
+			continue;
+		con->_endpoint_free[multiplex] |= 1u << timeslot;
+		con->_multiplex_free |= 1u << multiplex;
+	}
+	return 0;
 }
 
-static int bsc_assign_endpoint(struct bsc_connection *bsc, struct nat_sccp_connection *con)
+static void bsc_endp_set_used(struct bsc_connection *bsc, int endpoint)
 {
-	int multiplex;
-	int timeslot;
-	const int number_endpoints = bsc->max_endpoints;
-	int i;
-
-	mgcp_endpoint_to_timeslot(bsc->last_endpoint, &multiplex, &timeslot);
-	timeslot += 1;
-
-	for (i = 0; i < number_endpoints; ++i) {
-		int endpoint;
-
-		/* Wrap around timeslots */
-		if (timeslot == 0)
-			timeslot = 1;
-
-		if (timeslot == 0x1f) {
-			timeslot = 1;
-			multiplex += 1;
-		}
+	int multiplex, timeslot;
 
-		/* Wrap around the multiplex */
-		if (multiplex >= bsc->number_multiplexes)
-			multiplex = 0;
+	mgcp_endpoint_to_timeslot(endpoint, &multiplex, &timeslot);
+	bsc->_endpoint_status[endpoint] = 1;
+	bsc->_endpoint_free[multiplex] &= ~(1u << timeslot);
+	if (!bsc->_endpoint_free[multiplex])
+		bsc->_multiplex_free &= ~(1u << multiplex);
+}
 
-		endpoint = mgcp_timeslot_to_endpoint(multiplex, timeslot);
+static void bsc_endp_set_free(struct bsc_connection *bsc, int endpoint)
+{
+	int multiplex, timeslot;
 
-		/* Now check if we are allowed to assign this one */
-		if (endpoint >= bsc->max_endpoints) {
-			multiplex = 0;
-			timeslot = 1;
-			endpoint = mgcp_timeslot_to_endpoint(multiplex, timeslot);
-		}
+	mgcp_endpoint_to_timeslot(endpoint, &multiplex, &timeslot);
+	bsc->_endpoint_status[endpoint] = 0;
+	bsc->_endpoint_free[multiplex] |= 1u << timeslot;
+	bsc->_multiplex_free |= 1u << multiplex;
+}
 
+/*
+ * Take the next free endpoint after the last one, round robin. The
+ * max-endpoints limit of 1024 means there are at most 32 multiplexes
+ * so a single word tells which multiplex has a free timeslot.
+ */
+static int bsc_assign_endpoint(struct bsc_connection *bsc, struct nat_sccp_connection *con)
+{
+	int multiplex;
+	int timeslot;
+	int endpoint;
+	uint32_t free, multiplexes;
+
+	mgcp_endpoint_to_timeslot(OSMO_MAX(bsc->last_endpoint, 0),
+				  &multiplex, &timeslot);
+
+	/* Wrap around the multiplex */
+	if (multiplex >= bsc->number_multiplexes)
+		multiplex = 0;
+
+	free = bsc->_endpoint_free[multiplex] & bits_from(timeslot + 1);
+	if (!free) {
+		/* the next multiplex, wrapping around to the current one */
+		multiplexes = bsc->_multiplex_free & bits_from(multiplex + 1);
+		if (!multiplexes)
+			multiplexes = bsc->_multiplex_free;
+		if (!multiplexes)
+			return -1;
+
+		multiplex = ffs(multiplexes) - 1;
+		free = bsc->_endpoint_free[multiplex];
+	}
 
-		if (bsc->_endpoint_status[endpoint] == 0) {
-			bsc->_endpoint_status[endpoint] = 1;
-			con->bsc_endp = endpoint;
-			bsc->last_endpoint = endpoint;
-			return 0;
-		}
+	timeslot = ffs(free) - 1;
+	endpoint = mgcp_timeslot_to_endpoint(multiplex, timeslot);
+	bsc_endp_set_used(bsc, endpoint);
+	con->bsc_endp = endpoint;
+	bsc->last_endpoint = endpoint;
+	return 0;
+}
 
-		timeslot += 1;
-	}
+/* drop the connection from the endpoint index */
+static void bsc_mgcp_unlink_con(struct nat_sccp_connection *con)
+{
+	struct bsc_nat *nat = con->bsc->nat;
 
-	return -1;
+	if (con->msc_endp < 0 || !nat->bsc_endpoints)
+		return;
+	if (con->msc_endp >= talloc_array_length(nat->bsc_endpoints))
+		return;
+	if (nat->bsc_endpoints[con->msc_endp].con == con)
+		nat->bsc_endpoints[con->msc_endp].con = NULL;
 }
 
 static uint16_t create_cic(int endpoint)
@@ -170,6 +223,7 @@ static uint16_t create_cic(int endpoint)
 
 int bsc_mgcp_assign_patch(struct nat_sccp_connection *con, struct msgb *msg)
 {
+	struct bsc_nat *nat = con->bsc->nat;
 	struct nat_sccp_connection *mcon;
 	struct tlv_parsed tp;
 	uint16_t cic;
@@ -200,26 +254,28 @@ int bsc_mgcp_assign_patch(struct nat_sccp_connection *con, struct msgb *msg)
 
 	endp = mgcp_timeslot_to_endpoint(multiplex, timeslot);
 
-	if (endp >= con->bsc->nat->mgcp_cfg->trunk.number_endpoints) {
+	if (endp >= nat->mgcp_cfg->trunk.number_endpoints) {
 		LOGP(DNAT, LOGL_ERROR,
 			"MSC attempted to assign bad endpoint 0x%x\n",
 			endp);
 		return -1;
 	}
 
-	/* find stale connections using that endpoint */
-	llist_for_each_entry(mcon, &con->bsc->nat->sccp_connections, list_entry) {
-		if (mcon->msc_endp == endp) {
-			LOGP(DNAT, LOGL_ERROR,
-			     "Endpoint 0x%x was assigned to 0x%x and now 0x%x\n",
-			     endp,
-			     sccp_src_ref_to_int(&mcon->patched_ref),
-			     sccp_src_ref_to_int(&con->patched_ref));
-			bsc_mgcp_dlcx(mcon);
-		}
+	/* find a stale connection using that endpoint */
+	mcon = nat->bsc_endpoints[endp].con;
+	if (mcon) {
+		LOGP(DNAT, LOGL_ERROR,
+		     "Endpoint 0x%x was assigned to 0x%x and now 0x%x\n",
+		     endp,
+		     sccp_src_ref_to_int(&mcon->patched_ref),
+		     sccp_src_ref_to_int(&con->patched_ref));
+		bsc_mgcp_dlcx(mcon);
 	}
 
+	/* a re-assignment moves the connection to the new endpoint */
+	bsc_mgcp_unlink_con(con);
 	con->msc_endp = endp;
+	nat->bsc_endpoints[endp].con = con;
 	if (bsc_init_endps_if_needed(con->bsc) != 0)
 		return -1;
 	if (bsc_assign_endpoint(con->bsc, con) != 0)
@@ -378,11 +434,12 @@ void bsc_mgcp_dlcx(struct nat_sccp_connection *con)
 		if (con->bsc->_endpoint_status[con->bsc_endp] != 1)
 			LOGP(DNAT, LOGL_ERROR, "Endpoint 0x%x was not in use\n", con->bsc_endp);
 		remember_pending_dlcx(con, con->bsc->next_transaction);
-		con->bsc->_endpoint_status[con->bsc_endp] = 0;
+		bsc_endp_set_free(con->bsc, con->bsc_endp);
 		bsc_mgcp_send_dlcx(con->bsc, con->bsc_endp, con->bsc->next_transaction++);
 		bsc_mgcp_free_endpoint(con->bsc->nat, con->msc_endp);
 	}
 
+	bsc_mgcp_unlink_con(con);
 	bsc_mgcp_init(con);
 
 }
@@ -480,16 +537,10 @@ free_stat:
 struct nat_sccp_connection *bsc_mgcp_find_con(struct bsc_nat *nat, int endpoint)
 {
 	struct nat_sccp_connection *con = NULL;
-	struct nat_sccp_connection *sccp;
 
-	llist_for_each_entry(sccp, &nat->sccp_connections, list_entry) {
-		if (sccp->msc_endp == -1)
-			continue;
-		if (sccp->msc_endp != endpoint)
-			continue;
-
-		con = sccp;
-	}
+	if (nat->bsc_endpoints && endpoint >= 0
+	    && endpoint < talloc_array_length(nat->bsc_endpoints))
+		con = nat->bsc_endpoints[endpoint].con;
 
 	if (con)
 		return con;
@@ -876,23 +927,101 @@ uint32_t bsc_mgcp_extract_ci(const char *str)
 	return ci;
 }
 
+/* append to the rewritten message, false if it does not fit */
+static bool mgcp_put(struct msgb *output, const char *data, int len)
+{
+	if (msgb_tailroom(output) < len)
+		return false;
+	memcpy(msgb_put(output, len), data, len);
+	return true;
+}
+
+/* vsnprintf to the end of the message, keeping at most limit bytes */
+static bool mgcp_printf(struct msgb *output, int limit, const char *fmt, ...)
+{
+	int room = msgb_tailroom(output);
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf((char *) output->tail, room, fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return false;
+	len = OSMO_MIN(len, limit);
+	if (len >= room)
+		return false;
+	msgb_put(output, len);
+	return true;
+}
+
+static bool line_starts(const char *line, int len, const char *str, int str_len)
+{
+	return len >= str_len && memcmp(line, str, str_len) == 0;
+}
+
+static const char *skip_space(const char *pos, const char *end)
+{
+	while (pos < end && isspace((unsigned char) *pos))
+		pos++;
+	return pos;
+}
+
+static const char *skip_word(const char *pos, const char *end)
+{
+	while (pos < end && !isspace((unsigned char) *pos))
+		pos++;
+	return pos;
+}
+
+/* like %d of scanf on a line that isn't terminated */
+static const char *parse_int(const char *pos, const char *end, int *val)
+{
+	const char *digits;
+	int sign = 1;
+	long res = 0;
+
+	pos = skip_space(pos, end);
+	if (pos < end && (*pos == '-' || *pos == '+')) {
+		sign = *pos == '-' ? -1 : 1;
+		pos++;
+	}
+
+	for (digits = pos; pos < end && isdigit((unsigned char) *pos); pos++) {
+		if (res < INT_MAX)
+			res = res * 10 + (*pos - '0');
+	}
+	if (pos == digits)
+		return NULL;
+
+	*val = sign * (int) OSMO_MIN(res, (long) INT_MAX);
+	return pos;
+}
+
 /**
- * Create a new MGCPCommand based on the input and endpoint from a message
+ * Create a new MGCPCommand based on the input and endpoint from a message.
+ * The transaction id is the second word of the line, a line without one
+ * is dropped.
  */
-static void patch_mgcp(struct msgb *output, const char *op, const char *tok,
-		       int endp, int len, int cr, int osmux_cid)
+static bool patch_mgcp(struct msgb *output, const char *op,
+		       const char *line, const char *end,
+		       int endp, int cr, int osmux_cid)
 {
-	int slen;
-	int ret;
-	char buf[40];
+	const char *trans, *trans_end;
 	char osmux_extension[strlen("\nX-Osmux: 255") + 1];
 
-	buf[0] = buf[39] = '\0';
-	ret = sscanf(tok, "%*s %s", buf);
-	if (ret != 1) {
+	trans = skip_space(skip_word(line, end), end);
+	trans_end = skip_word(trans, end);
+	if (trans == trans_end) {
 		LOGP(DMGCP, LOGL_ERROR,
-			"Failed to find Endpoint in: %s\n", tok);
-		return;
+			"Failed to find Endpoint in: %.*s\n", (int) (end - line), line);
+		return true;
+	}
+	if (trans_end - trans > 39) {
+		LOGP(DMGCP, LOGL_ERROR,
+			"Transaction too long in: %.*s\n", (int) (end - line), line);
+		return false;
 	}
 
 	if (osmux_cid >= 0)
@@ -900,13 +1029,40 @@ static void patch_mgcp(struct msgb *output, const char *op, const char *tok,
 	else
 		osmux_extension[0] = '\0';
 
-	slen = sprintf((char *) output->l3h, "%s %s %x@mgw MGCP 1.0%s%s",
-			op, buf, endp, osmux_extension, cr ? "\r\n" : "\n");
-	output->l3h = msgb_put(output, slen);
+	return mgcp_printf(output, INT_MAX, "%s %.*s %x@mgw MGCP 1.0%s%s",
+			   op, (int) (trans_end - trans), trans, endp,
+			   osmux_extension, cr ? "\r\n" : "\n");
+}
+
+/* "m=audio %*d RTP/AVP %n%d", the rest of the line follows the new port */
+static bool patch_audio(struct msgb *output, const char *line,
+			const char *end, int port, int *payload)
+{
+	static const char avp_str[] = "RTP/AVP";
+	const char *pos, *rest;
+	int val;
+
+	pos = parse_int(line + strlen("m=audio "), end, &val);
+	if (!pos)
+		return false;
+	pos = skip_space(pos, end);
+	if (!line_starts(pos, end - pos, avp_str, sizeof(avp_str) - 1))
+		return false;
+	rest = skip_space(pos + sizeof(avp_str) - 1, end);
+	if (!parse_int(rest, end, payload))
+		return false;
+
+	/* this used to go through a 128 byte buffer */
+	return mgcp_printf(output, 126, "m=audio %d RTP/AVP %.*s\n",
+			   port, (int) (end - rest), rest);
 }
 
-/* we need to replace some strings... */
-struct msgb *bsc_mgcp_rewrite(char *input, int length, int endpoint,
+/*
+ * We need to replace some strings. This is done in one pass over the
+ * input, copying the lines that stay the same. Only lines that end with
+ * a newline are looked at. The input is not modified.
+ */
+struct msgb *bsc_mgcp_rewrite(const char *input, int length, int endpoint,
 			      const char *ip, int port, int osmux_cid,
 			      int *first_payload_type, int ensure_mode_set)
 {
@@ -918,9 +1074,10 @@ struct msgb *bsc_mgcp_rewrite(char *input, int length, int endpoint,
 	static const char aud_str[] = "m=audio ";
 	static const char fmt_str[] = "a=fmtp:";
 
-	char buf[128];
-	char *running, *token;
+	const char *line, *end, *next, *input_end;
 	struct msgb *output;
+	bool ok = true;
+	int len;
 
 	/* keep state to add the a=fmtp line */
 	int found_fmtp = 0;
@@ -937,69 +1094,53 @@ struct msgb *bsc_mgcp_rewrite(char *input, int length, int endpoint,
 		LOGP(DMGCP, LOGL_ERROR, "Failed to allocate new MGCP msg.\n");
 		return NULL;
 	}
-
-	running = input;
 	output->l2h = output->data;
-	output->l3h = output->l2h;
-	for (token = strsep(&running, "\n"); running; token = strsep(&running, "\n")) {
-		int len = strlen(token);
-		cr = len > 0 && token[len - 1] == '\r';
-
-		if (strncmp(crcx_str, token, (sizeof crcx_str) - 1) == 0) {
-			patch_mgcp(output, "CRCX", token, endpoint, len, cr, osmux_cid);
-		} else if (strncmp(dlcx_str, token, (sizeof dlcx_str) - 1) == 0) {
-			patch_mgcp(output, "DLCX", token, endpoint, len, cr, -1);
-		} else if (strncmp(mdcx_str, token, (sizeof mdcx_str) - 1) == 0) {
-			patch_mgcp(output, "MDCX", token, endpoint, len, cr, -1);
-		} else if (strncmp(ip_str, token, (sizeof ip_str) - 1) == 0) {
-			output->l3h = msgb_put(output, strlen(ip_str));
-			memcpy(output->l3h, ip_str, strlen(ip_str));
-			output->l3h = msgb_put(output, strlen(ip));
-			memcpy(output->l3h, ip, strlen(ip));
-
-			if (cr) {
-				output->l3h = msgb_put(output, 2);
-				output->l3h[0] = '\r';
-				output->l3h[1] = '\n';
-			} else {
-				output->l3h = msgb_put(output, 1);
-				output->l3h[0] = '\n';
-			}
-		} else if (strncmp(aud_str, token, (sizeof aud_str) - 1) == 0) {
-			int offset;
-			if (sscanf(token, "m=audio %*d RTP/AVP %n%d", &offset, &payload) != 1) {
+
+	/* the input used to be handled as a string */
+	input_end = memchr(input, '\0', length);
+	if (!input_end)
+		input_end = input + length;
+
+	for (line = input; ok && line < input_end; line = next + 1) {
+		next = memchr(line, '\n', input_end - line);
+		if (!next)
+			break;
+		end = next;
+		len = end - line;
+		cr = len > 0 && line[len - 1] == '\r';
+
+		if (line_starts(line, len, crcx_str, sizeof(crcx_str) - 1)) {
+			ok = patch_mgcp(output, "CRCX", line, end, endpoint, cr, osmux_cid);
+		} else if (line_starts(line, len, dlcx_str, sizeof(dlcx_str) - 1)) {
+			ok = patch_mgcp(output, "DLCX", line, end, endpoint, cr, -1);
+		} else if (line_starts(line, len, mdcx_str, sizeof(mdcx_str) - 1)) {
+			ok = patch_mgcp(output, "MDCX", line, end, endpoint, cr, -1);
+		} else if (line_starts(line, len, ip_str, sizeof(ip_str) - 1)) {
+			ok = mgcp_put(output, ip_str, sizeof(ip_str) - 1)
+				&& mgcp_put(output, ip, strlen(ip))
+				&& mgcp_put(output, cr ? "\r\n" : "\n", cr ? 2 : 1);
+		} else if (line_starts(line, len, aud_str, sizeof(aud_str) - 1)) {
+			if (!patch_audio(output, line, end, port, &payload)) {
 				LOGP(DMGCP, LOGL_ERROR, "Could not parsed audio line.\n");
 				msgb_free(output);
 				return NULL;
 			}
-
-			snprintf(buf, sizeof(buf)-1, "m=audio %d RTP/AVP %s\n",
-				 port, &token[offset]);
-			buf[sizeof(buf)-1] = '\0';
-
-			output->l3h = msgb_put(output, strlen(buf));
-			memcpy(output->l3h, buf, strlen(buf));
-		} else if (strncmp(fmt_str, token, (sizeof fmt_str) - 1) == 0) {
-			found_fmtp = 1;
-			goto copy;
 		} else {
-copy:
-			output->l3h = msgb_put(output, len + 1);
-			memcpy(output->l3h, token, len);
-			output->l3h[len] = '\n';
+			if (line_starts(line, len, fmt_str, sizeof(fmt_str) - 1))
+				found_fmtp = 1;
+			ok = mgcp_put(output, line, len + 1);
 		}
 	}
 
-	/*
-	 * the above code made sure that we have 128 bytes lefts. So we can
-	 * safely append another line.
-	 */
-	if (ensure_mode_set && !found_fmtp && payload != -1) {
-		snprintf(buf, sizeof(buf) - 1, "a=fmtp:%d mode-set=2 octet-align=1%s",
-			payload, cr ? "\r\n" : "\n");
-		buf[sizeof(buf) - 1] = '\0';
-		output->l3h = msgb_put(output, strlen(buf));
-		memcpy(output->l3h, buf, strlen(buf));
+	if (ok && ensure_mode_set && !found_fmtp && payload != -1)
+		ok = mgcp_printf(output, INT_MAX,
+				 "a=fmtp:%d mode-set=2 octet-align=1%s",
+				 payload, cr ? "\r\n" : "\n");
+
+	if (!ok) {
+		LOGP(DMGCP, LOGL_ERROR, "Failed to rewrite the MGCP msg.\n");
+		msgb_free(output);
+		return NULL;
 	}
 
 	if (payload != -1 && first_payload_type)
@@ -692,6 +692,27 @@ static void update_con_authorize(struct nat_sccp_connection *con,
 	}
 }
 
+/*
+ * Established connections without anything to filter or patch only
+ * need the SCCP reference to be changed. Do it in place and hand the
+ * received msgb to the BSC. Returns 0 if the msgb was consumed.
+ */
+static int forward_sccp_fast_to_bts(struct msgb *msg)
+{
+	struct nat_sccp_connection *con;
+	struct bsc_nat_parsed parsed;
+
+	con = bsc_nat_fast_path_to_bsc(nat, msg, &parsed);
+	if (!con) {
+		osmo_counter_inc(nat->stats.fwd.slow);
+		return -1;
+	}
+
+	osmo_counter_inc(nat->stats.fwd.fast);
+	bsc_write_msg(&con->bsc->write_queue, msg);
+	return 0;
+}
+
 static int forward_sccp_to_bts(struct bsc_msc_connection *msc_con, struct msgb *msg)
 {
 	struct nat_sccp_connection *con = NULL;
@@ -806,6 +827,8 @@ static void msc_connection_was_lost(struct bsc_msc_connection *con)
 	llist_for_each_entry_safe(bsc, tmp, &nat->bsc_connections, list_entry)
 		bsc_close_connection(bsc);
 
+	bsc_nat_link_reset(&nat->msc_link);
+
 	bsc_mgcp_free_endpoints(nat);
 	bsc_msc_schedule_connect(con);
 }
@@ -840,16 +863,45 @@ static void msc_send_reset(struct bsc_msc_connection *msc_con)
 	LOGP(DMSC, LOGL_NOTICE, "Scheduled GSM0808 reset msg for the MSC.\n");
 }
 
+static void ipaccess_msc_handle_msg(struct bsc_msc_connection *msc_con,
+				    struct osmo_fd *bfd, struct msgb *msg)
+{
+	struct ipaccess_head *hh;
+
+	LOGP(DNAT, LOGL_DEBUG,
+		"MSG from MSC(%s): %s proto: %d\n", msc_con->name,
+		osmo_hexdump(msg->data, msg->len), msg->l2h[0]);
+
+	/* handle base message handling */
+	hh = (struct ipaccess_head *) msg->data;
+
+	/* initialize the networking. This includes sending a GSM08.08 message */
+	if (hh->proto == IPAC_PROTO_IPACCESS) {
+		ipa_ccm_rcvmsg_base(msg, bfd);
+		if (msg->l2h[0] == IPAC_MSGT_ID_ACK)
+			initialize_msc_if_needed(msc_con);
+		else if (msg->l2h[0] == IPAC_MSGT_ID_GET)
+			send_id_get_response(msc_con);
+	} else if (hh->proto == IPAC_PROTO_SCCP) {
+		if (forward_sccp_fast_to_bts(msg) == 0)
+			return;
+		forward_sccp_to_bts(msc_con, msg);
+	} else if (hh->proto == IPAC_PROTO_MGCP_OLD) {
+		bsc_nat_handle_mgcp(nat, msg);
+	}
+
+	msgb_free(msg);
+}
+
 static int ipaccess_msc_read_cb(struct osmo_fd *bfd)
 {
 	struct bsc_msc_connection *msc_con;
-	struct msgb *msg = NULL;
-	struct ipaccess_head *hh;
+	struct msgb *msg;
 	int ret;
 
 	msc_con = (struct bsc_msc_connection *) bfd->data;
 
-	ret = ipa_msg_recv_buffered(bfd->fd, &msg, &msc_con->pending_msg);
+	ret = bsc_nat_link_read(&nat->msc_link, bfd->fd);
 	if (ret <= 0) {
 		if (ret == -EAGAIN)
 			return 0;
@@ -859,43 +911,34 @@ static int ipaccess_msc_read_cb(struct osmo_fd *bfd)
 				msc_con->name);
 		else
 			LOGP(DNAT, LOGL_ERROR,
-				"Failed to parse ip access message on %s: %d\n",
+				"Failed to read from MSC(%s): %d\n",
 				msc_con->name, ret);
 
 		bsc_msc_lost(msc_con);
 		return -EBADF;
 	}
 
-	LOGP(DNAT, LOGL_DEBUG,
-		"MSG from MSC(%s): %s proto: %d\n", msc_con->name,
-		osmo_hexdump(msg->data, msg->len), msg->l2h[0]);
-
-	/* handle base message handling */
-	hh = (struct ipaccess_head *) msg->data;
+	/* handle every complete frame of this read */
+	while ((msg = bsc_nat_link_dequeue(&nat->msc_link, &ret)))
+		ipaccess_msc_handle_msg(msc_con, bfd, msg);
 
-	/* initialize the networking. This includes sending a GSM08.08 message */
-	if (hh->proto == IPAC_PROTO_IPACCESS) {
-		ipa_ccm_rcvmsg_base(msg, bfd);
-		if (msg->l2h[0] == IPAC_MSGT_ID_ACK)
-			initialize_msc_if_needed(msc_con);
-		else if (msg->l2h[0] == IPAC_MSGT_ID_GET)
-			send_id_get_response(msc_con);
-	} else if (hh->proto == IPAC_PROTO_SCCP) {
-		forward_sccp_to_bts(msc_con, msg);
-	} else if (hh->proto == IPAC_PROTO_MGCP_OLD) {
-		bsc_nat_handle_mgcp(nat, msg);
+	if (ret < 0) {
+		LOGP(DNAT, LOGL_ERROR,
+			"Failed to parse ip access message on %s: %d\n",
+			msc_con->name, ret);
+		bsc_msc_lost(msc_con);
+		return -EBADF;
 	}
 
-	msgb_free(msg);
 	return 0;
 }
 
 static int ipaccess_msc_write_cb(struct osmo_fd *bfd, struct msgb *msg)
 {
 	int rc;
-	rc = write(bfd->fd, msg->data, msg->len);
 
-	if (rc != msg->len) {
+	rc = bsc_nat_link_write(&nat->msc_link, bfd, msg, nat->write_batch);
+	if (rc < 0) {
 		LOGP(DNAT, LOGL_ERROR, "Failed to write MSG to MSC.\n");
 		return -1;
 	}
@@ -961,12 +1004,11 @@ void bsc_close_connection(struct bsc_connection *connection)
 	osmo_wqueue_clear(&connection->write_queue);
 	llist_del(&connection->list_entry);
 
-	if (connection->pending_msg) {
+	if (connection->link.rx_len != connection->link.rx_off
+	    || connection->link.rx_big)
 		LOGP(DNAT, LOGL_ERROR, "Dropping partial message on connection %d.\n",
 		     connection->cfg ? connection->cfg->nr : -1);
-		msgb_free(connection->pending_msg);
-		connection->pending_msg = NULL;
-	}
+	bsc_nat_link_free(&connection->link);
 
 	talloc_free(connection);
 }
@@ -1111,6 +1153,35 @@ static void handle_con_stats(struct nat_sccp_connection *con)
 	rate_ctr_inc(&ctrg->ctr[id]);
 }
 
+/*
+ * The fast path towards the MSC, see \ref forward_sccp_fast_to_bts. A
+ * RLC still needs to release the connection and maybe close the BSC.
+ * Returns 0 if the msgb was consumed.
+ */
+static int forward_sccp_fast_to_msc(struct bsc_connection *bsc, struct msgb *msg,
+				    bool *bsc_conn_closed)
+{
+	struct nat_sccp_connection *con;
+	struct bsc_msc_connection *con_msc;
+	struct bsc_nat_parsed parsed;
+
+	con = bsc_nat_fast_path_to_msc(bsc, msg, &parsed);
+	if (!con) {
+		osmo_counter_inc(nat->stats.fwd.slow);
+		return -1;
+	}
+
+	osmo_counter_inc(nat->stats.fwd.fast);
+	con_msc = con->msc_con;
+	if (parsed.sccp_type == SCCP_MSG_TYPE_RLC) {
+		sccp_connection_destroy(con);
+		*bsc_conn_closed = bsc_maybe_close(bsc);
+	}
+
+	queue_for_msc(con_msc, msg);
+	return 0;
+}
+
 /*!
  * Forward messages to msc and verify received authentication messages.
  * \param[in] bsc Pointer to bsc_connection structure from which the message was received.
@@ -1312,30 +1383,12 @@ exit2:
 	return -1;
 }
 
-static int ipaccess_bsc_read_cb(struct osmo_fd *bfd)
+/* Returns -EBADF if the BSC connection was closed */
+static int ipaccess_bsc_handle_msg(struct bsc_connection *bsc, struct msgb *msg)
 {
-	struct bsc_connection *bsc = bfd->data;
-	struct msgb *msg = NULL;
 	struct ipaccess_head *hh;
 	struct ipaccess_head_ext *hh_ext;
 	bool fd_closed = false;
-	int ret;
-
-	ret = ipa_msg_recv_buffered(bfd->fd, &msg, &bsc->pending_msg);
-	if (ret == -EAGAIN) {
-		return 0;
-	} else if (ret == 0) {
-		LOGP(DNAT, LOGL_ERROR,
-		     "The connection to the BSC Nr: %d was lost. Cleaning it\n",
-		     bsc->cfg ? bsc->cfg->nr : -1);
-		goto close_fd;
-	} else if (ret < 0) {
-		LOGP(DNAT, LOGL_ERROR,
-		     "Stream error on BSC Nr: %d. Failed to parse ip access message: %d (%s)\n",
-		     bsc->cfg ? bsc->cfg->nr : -1, ret, strerror(-ret));
-		 goto close_fd;
-	}
-
 
 	LOGP(DNAT, LOGL_DEBUG, "MSG from BSC: %s proto: %d\n", osmo_hexdump(msg->data, msg->len), msg->l2h[0]);
 
@@ -1365,15 +1418,68 @@ static int ipaccess_bsc_read_cb(struct osmo_fd *bfd)
 			return bsc_nat_handle_ctrlif_msg(bsc, msg);
 	}
 
+	if (hh->proto == IPAC_PROTO_SCCP &&
+	    forward_sccp_fast_to_msc(bsc, msg, &fd_closed) == 0)
+		return fd_closed ? -EBADF : 0;
+
 	/* FIXME: Currently no ID ACK is sent to the BSC */
 	forward_sccp_to_msc(bsc, msg, &fd_closed);
 	return fd_closed ? -EBADF : 0;
+}
+
+static int ipaccess_bsc_read_cb(struct osmo_fd *bfd)
+{
+	struct bsc_connection *bsc = bfd->data;
+	struct msgb *msg;
+	int ret;
+
+	ret = bsc_nat_link_read(&bsc->link, bfd->fd);
+	if (ret == -EAGAIN) {
+		return 0;
+	} else if (ret == 0) {
+		LOGP(DNAT, LOGL_ERROR,
+		     "The connection to the BSC Nr: %d was lost. Cleaning it\n",
+		     bsc->cfg ? bsc->cfg->nr : -1);
+		goto close_fd;
+	} else if (ret < 0) {
+		LOGP(DNAT, LOGL_ERROR,
+		     "Stream error on BSC Nr: %d. Failed to read: %d (%s)\n",
+		     bsc->cfg ? bsc->cfg->nr : -1, ret, strerror(-ret));
+		 goto close_fd;
+	}
+
+	/* handle every complete frame, stop once the BSC is gone */
+	while ((msg = bsc_nat_link_dequeue(&bsc->link, &ret))) {
+		if (ipaccess_bsc_handle_msg(bsc, msg) == -EBADF)
+			return -EBADF;
+	}
+
+	if (ret < 0) {
+		LOGP(DNAT, LOGL_ERROR,
+		     "Stream error on BSC Nr: %d. Failed to parse ip access message: %d (%s)\n",
+		     bsc->cfg ? bsc->cfg->nr : -1, ret, strerror(-ret));
+		goto close_fd;
+	}
+
+	return 0;
 
 close_fd:
 	bsc_close_connection(bsc);
 	return -EBADF;
 }
 
+static int ipaccess_bsc_write_cb(struct osmo_fd *bfd, struct msgb *msg)
+{
+	struct bsc_connection *bsc = bfd->data;
+	int rc;
+
+	rc = bsc_nat_link_write(&bsc->link, bfd, msg, nat->write_batch);
+	if (rc < 0)
+		LOGP(DNAT, LOGL_ERROR, "Failed to write message to the BSC.\n");
+
+	return rc;
+}
+
 static int ipaccess_listen_bsc_cb(struct osmo_fd *bfd, unsigned int what)
 {
 	struct bsc_connection *bsc;
@@ -1430,7 +1536,7 @@ static int ipaccess_listen_bsc_cb(struct osmo_fd *bfd, unsigned int what)
 	bsc->write_queue.bfd.data = bsc;
 	bsc->write_queue.bfd.fd = fd;
 	bsc->write_queue.read_cb = ipaccess_bsc_read_cb;
-	bsc->write_queue.write_cb = bsc_write_cb;
+	bsc->write_queue.write_cb = ipaccess_bsc_write_cb;
 	bsc->write_queue.bfd.when = BSC_FD_READ;
 	if (osmo_fd_register(&bsc->write_queue.bfd) < 0) {
 		LOGP(DNAT, LOGL_ERROR, "Failed to register BSC fd.\n");
@@ -40,10 +40,128 @@
 
 #include <osmocom/sccp/sccp.h>
 
+#include <ctype.h>
+#include <errno.h>
+
+/*
+ * The rules of a list are put into a digit trie by the literal start
+ * of their IMSI expression. A lookup walks the IMSI once and only looks
+ * at the rules hanging off the nodes on the way, merged back into the
+ * order of the file. The number expression is only run when the number
+ * starts with the literal part of it.
+ */
+#define NUM_REWR_DEPTH	(sizeof(((struct bsc_nat_num_rewr_entry *) 0)->imsi_prefix) - 1)
+
+struct bsc_nat_num_rewr_node {
+	struct bsc_nat_num_rewr_node *child[10];
+	struct bsc_nat_num_rewr_entry **rules;
+	unsigned int num_rules;
+};
+
+struct num_rewr_iter {
+	const char *imsi;
+
+	/* rules of the trie nodes matching the IMSI */
+	struct bsc_nat_num_rewr_entry **rules[NUM_REWR_DEPTH + 1];
+	unsigned int left[NUM_REWR_DEPTH + 1];
+	int num;
+
+	/* walking the list in case there is no index */
+	struct llist_head *head, *pos;
+};
+
+static int imsi_matches(const struct bsc_nat_num_rewr_entry *entry,
+			const char *imsi)
+{
+	if (strncmp(imsi, entry->imsi_prefix, strlen(entry->imsi_prefix)) != 0)
+		return 0;
+	if (entry->imsi_prefix_only)
+		return 1;
+	return regexec(&entry->msisdn_reg, imsi, 0, NULL, 0) == 0;
+}
+
+static int num_matches(const struct bsc_nat_num_rewr_entry *entry,
+		       const char *number, size_t nmatch, regmatch_t *matches)
+{
+	if (strncmp(number, entry->num_prefix, strlen(entry->num_prefix)) != 0)
+		return 0;
+	return regexec(&entry->num_reg, number, nmatch, matches, 0) == 0;
+}
+
+static struct bsc_nat_num_rewr_entry *num_rewr_next(struct num_rewr_iter *it)
+{
+	struct bsc_nat_num_rewr_entry *entry;
+	int i, best;
+
+	if (it->head) {
+		while ((it->pos = it->pos->next) != it->head) {
+			entry = llist_entry(it->pos, struct bsc_nat_num_rewr_entry, list);
+			if (imsi_matches(entry, it->imsi))
+				return entry;
+		}
+		return NULL;
+	}
+
+	while (1) {
+		best = -1;
+		for (i = 0; i < it->num; ++i) {
+			if (!it->left[i])
+				continue;
+			if (best < 0 || it->rules[i][0]->nr < it->rules[best][0]->nr)
+				best = i;
+		}
+
+		if (best < 0)
+			return NULL;
+
+		entry = it->rules[best][0];
+		it->rules[best] += 1;
+		it->left[best] -= 1;
+
+		if (imsi_matches(entry, it->imsi))
+			return entry;
+	}
+}
+
+static struct bsc_nat_num_rewr_entry *num_rewr_first(struct num_rewr_iter *it,
+						     struct bsc_nat_num_rewr *rewr,
+						     const char *imsi)
+{
+	struct bsc_nat_num_rewr_node *node = rewr->index;
+	const char *digit = imsi;
+
+	memset(it, 0, sizeof(*it));
+	it->imsi = imsi;
+
+	if (!node) {
+		it->head = it->pos = &rewr->entries;
+		return num_rewr_next(it);
+	}
+
+	while (node) {
+		if (node->num_rules) {
+			it->rules[it->num] = node->rules;
+			it->left[it->num] = node->num_rules;
+			it->num += 1;
+		}
+
+		if (!isdigit((unsigned char) *digit))
+			break;
+		node = node->child[*digit++ - '0'];
+	}
+
+	return num_rewr_next(it);
+}
+
+/* iterate over the rules of a list whose IMSI expression matches */
+#define num_rewr_for_each(entry, it, rewr, imsi)		\
+	for (entry = num_rewr_first(it, rewr, imsi); entry;	\
+	     entry = num_rewr_next(it))
+
 static char *trie_lookup(struct nat_rewrite *trie, const char *number,
 			regoff_t off, void *ctx)
 {
-	struct nat_rewrite_rule *rule;
+	const struct nat_rewrite_rule *rule;
 
 	if (!trie) {
 		LOGP(DCC, LOGL_ERROR,
@@ -62,22 +180,19 @@ static char *trie_lookup(struct nat_rewrite *trie, const char *number,
 }
 
 static char *match_and_rewrite_number(void *ctx, const char *number,
-				const char *imsi, struct llist_head *list,
+				const char *imsi, struct bsc_nat_num_rewr *list,
 				struct nat_rewrite *trie)
 {
 	struct bsc_nat_num_rewr_entry *entry;
+	struct num_rewr_iter it;
 	char *new_number = NULL;
 
 	/* need to find a replacement and then fix it */
-	llist_for_each_entry(entry, list, list) {
+	num_rewr_for_each(entry, &it, list, imsi) {
 		regmatch_t matches[2];
 
-		/* check the IMSI match */
-		if (regexec(&entry->msisdn_reg, imsi, 0, NULL, 0) != 0)
-			continue;
-
 		/* this regexp matches... */
-		if (regexec(&entry->num_reg, number, 2, matches, 0) == 0
+		if (num_matches(entry, number, 2, matches)
 			&& matches[1].rm_eo != -1) {
 			if (entry->is_prefix_lookup)
 				new_number = trie_lookup(trie, number,
@@ -95,14 +210,14 @@ static char *match_and_rewrite_number(void *ctx, const char *number,
 	return new_number;
 }
 
-static char *rewrite_isdn_number(struct bsc_nat *nat, struct llist_head *rewr_list,
+static char *rewrite_isdn_number(struct bsc_nat *nat, struct bsc_nat_num_rewr *rewr_list,
 				void *ctx, const char *imsi,
 				struct gsm_mncc_number *called)
 {
 	char int_number[sizeof(called->number) + 2];
 	char *number = called->number;
 
-	if (llist_empty(&nat->num_rewr)) {
+	if (llist_empty(&nat->num_rewr.entries)) {
 		LOGP(DCC, LOGL_DEBUG, "Rewrite rules empty.\n");
 		return NULL;
 	}
@@ -141,6 +256,117 @@ static void update_called_number(struct gsm_mncc_number *called,
 	}
 }
 
+/*
+ * Replace old_len bytes at pos of the DTAP with new_len bytes and fix
+ * up the DTAP, SCCP and IPA lengths. This needs the DTAP to be the end
+ * of the message and enough tailroom if it grows, -ENOSPC is returned
+ * if only the tailroom is missing.
+ */
+static int dtap_splice(struct msgb *msg, struct bsc_nat_parsed *parsed,
+		       uint8_t *pos, unsigned int old_len,
+		       const uint8_t *data, unsigned int new_len)
+{
+	struct ipaccess_head *hh = (struct ipaccess_head *) msg->data;
+	int delta = (int) new_len - (int) old_len;
+
+	if (msg->l3h[-1] != msgb_l3len(msg))
+		return -EINVAL;
+	if (msg->l3h[-1] + delta > 255 || msg->l3h[2] + delta > 255)
+		return -EINVAL;
+	if (delta > 0 && msgb_tailroom(msg) < delta)
+		return -ENOSPC;
+
+	memmove(pos + new_len, pos + old_len, msg->tail - (pos + old_len));
+	memcpy(pos, data, new_len);
+	if (delta > 0)
+		msgb_put(msg, delta);
+	else if (delta < 0)
+		msgb_trim(msg, msg->len + delta);
+
+	msg->l3h[-1] += delta;
+	msg->l3h[2] += delta;
+	hh->len = htons(msgb_l2len(msg));
+	parsed->gsm_type = msg->l3h[2];
+	return 0;
+}
+
+/*
+ * The frames of the BSC and MSC links point into the receive buffer
+ * and can not grow. Copy the message once with the room it needs.
+ */
+static struct msgb *dtap_copy_room(struct msgb *msg, unsigned int room)
+{
+	struct msgb *copy;
+
+	copy = msgb_alloc(msg->len + room, "changed-dtap");
+	if (!copy)
+		return NULL;
+
+	memcpy(msgb_put(copy, msg->len), msg->data, msg->len);
+	copy->l2h = copy->data + (msg->l2h - msg->data);
+	copy->l3h = copy->data + (msg->l3h - msg->data);
+	copy->l4h = copy->data + (msg->l4h - msg->data);
+	return copy;
+}
+
+/*
+ * Replace a part of the DTAP. This happens in place if possible, in a
+ * copy of the message if it lacks the room, otherwise the DTAP is
+ * copied and wrapped with DTAP, SCCP and IPA headers again. Returns the
+ * message to forward or NULL on failure.
+ */
+static struct msgb *dtap_replace(struct msgb *msg, struct bsc_nat_parsed *parsed,
+				 uint8_t *pos, unsigned int old_len,
+				 const uint8_t *data, unsigned int new_len)
+{
+	uint8_t link_id = msg->l3h[1];
+	uint8_t *dtap = msg->l4h;
+	unsigned int rest = dtap + msg->l3h[2] - (pos + old_len);
+	struct msgb *out, *sccp;
+	int rc;
+
+	rc = dtap_splice(msg, parsed, pos, old_len, data, new_len);
+	if (rc == 0)
+		return msg;
+
+	if (rc == -ENOSPC) {
+		out = dtap_copy_room(msg, new_len - old_len);
+		if (!out) {
+			LOGP(DNAT, LOGL_ERROR, "Failed to allocate.\n");
+			return NULL;
+		}
+
+		pos = out->data + (pos - msg->data);
+		OSMO_ASSERT(dtap_splice(out, parsed, pos, old_len,
+					data, new_len) == 0);
+		msgb_free(msg);
+		return out;
+	}
+
+	out = msgb_alloc_headroom(4096, 128, "changed-dtap");
+	if (!out) {
+		LOGP(DNAT, LOGL_ERROR, "Failed to allocate.\n");
+		return NULL;
+	}
+
+	memcpy(msgb_put(out, pos - dtap), dtap, pos - dtap);
+	memcpy(msgb_put(out, new_len), data, new_len);
+	memcpy(msgb_put(out, rest), pos + old_len, rest);
+
+	gsm0808_prepend_dtap_header(out, link_id);
+	sccp = sccp_create_dt1(parsed->dest_local_ref, out->data, out->len);
+	msgb_free(out);
+
+	if (!sccp) {
+		LOGP(DNAT, LOGL_ERROR, "Failed to allocate.\n");
+		return NULL;
+	}
+
+	ipa_prepend_header(sccp, IPAC_PROTO_SCCP);
+	msgb_free(msg);
+	return sccp;
+}
+
 /**
  * Rewrite non global numbers... according to rules based on the IMSI
  */
@@ -151,11 +377,9 @@ static struct msgb *rewrite_setup(struct bsc_nat *nat, struct msgb *msg,
 	struct tlv_parsed tp;
 	unsigned int payload_len;
 	struct gsm_mncc_number called;
-	struct msgb *out;
+	struct msgb *ie, *out;
 	char *new_number_pre = NULL, *new_number_post = NULL, *chosen_number;
-	uint8_t *outptr;
-	const uint8_t *msgptr;
-	int sec_len;
+	uint8_t *old_ie;
 
 	/* decode and rewrite the message */
 	payload_len = len - sizeof(*hdr48);
@@ -206,45 +430,27 @@ static struct msgb *rewrite_setup(struct bsc_nat *nat, struct msgb *msg,
 		return NULL;
 	}
 
-	/*
-	 * Need to create a new message now based on the old onew
-	 * with a new number. We can sadly not patch this in place
-	 * so we will need to regenerate it.
-	 */
-
-	out = msgb_alloc_headroom(4096, 128, "changed-setup");
-	if (!out) {
-		LOGP(DCC, LOGL_ERROR, "Failed to allocate.\n");
-		talloc_free(new_number_pre);
-		talloc_free(new_number_post);
-		return NULL;
-	}
-
-	/* copy the header */
-	outptr = msgb_put(out, sizeof(*hdr48));
-	memcpy(outptr, hdr48, sizeof(*hdr48));
-
-	/* copy everything up to the number */
-	sec_len = TLVP_VAL(&tp, GSM48_IE_CALLED_BCD) - 2 - &hdr48->data[0];
-	outptr = msgb_put(out, sec_len);
-	memcpy(outptr, &hdr48->data[0], sec_len);
-
 	/* create the new number */
 	update_called_number(&called, chosen_number);
+	talloc_free(new_number_pre);
+	talloc_free(new_number_post);
 	LOGP(DCC, LOGL_DEBUG,
 		"Chosen number for IMSI(%s) is Plan(%d) Type(%d) Number(%s)\n",
 		imsi, called.plan, called.type, called.number);
-	gsm48_encode_called(out, &called);
 
-	/* copy thre rest */
-	msgptr = TLVP_VAL(&tp, GSM48_IE_CALLED_BCD) +
-		 TLVP_LEN(&tp, GSM48_IE_CALLED_BCD);
-	sec_len = payload_len - (msgptr - &hdr48->data[0]);
-	outptr = msgb_put(out, sec_len);
-	memcpy(outptr, msgptr, sec_len);
+	ie = msgb_alloc(32, "called-bcd");
+	if (!ie) {
+		LOGP(DCC, LOGL_ERROR, "Failed to allocate.\n");
+		return NULL;
+	}
+	gsm48_encode_called(ie, &called);
 
-	talloc_free(new_number_pre);
-	talloc_free(new_number_post);
+	/* replace the called party IE including its tag and length */
+	old_ie = (uint8_t *) TLVP_VAL(&tp, GSM48_IE_CALLED_BCD) - 2;
+	out = dtap_replace(msg, parsed, old_ie,
+			   TLVP_LEN(&tp, GSM48_IE_CALLED_BCD) + 2,
+			   ie->data, ie->len);
+	msgb_free(ie);
 	return out;
 }
 
@@ -256,19 +462,16 @@ static char *find_new_smsc(struct bsc_nat *nat, void *ctx, const char *imsi,
 			   const char *smsc_addr, const char *dest_nr)
 {
 	struct bsc_nat_num_rewr_entry *entry;
+	struct num_rewr_iter it;
 	char *new_number = NULL;
-	uint8_t dest_match = llist_empty(&nat->tpdest_match);
+	uint8_t dest_match = llist_empty(&nat->tpdest_match.entries);
 
 	/* We will find a new number now */
-	llist_for_each_entry(entry, &nat->smsc_rewr, list) {
+	num_rewr_for_each(entry, &it, &nat->smsc_rewr, imsi) {
 		regmatch_t matches[2];
 
-		/* check the IMSI match */
-		if (regexec(&entry->msisdn_reg, imsi, 0, NULL, 0) != 0)
-			continue;
-
 		/* this regexp matches... */
-		if (regexec(&entry->num_reg, smsc_addr, 2, matches, 0) == 0 &&
+		if (num_matches(entry, smsc_addr, 2, matches) &&
 		    matches[1].rm_eo != -1)
 			new_number = talloc_asprintf(ctx, "%s%s",
 					entry->replace,
@@ -283,12 +486,8 @@ static char *find_new_smsc(struct bsc_nat *nat, void *ctx, const char *imsi,
 	/*
 	 * now match the number against another list
 	 */
-	llist_for_each_entry(entry, &nat->tpdest_match, list) {
-		/* check the IMSI match */
-		if (regexec(&entry->msisdn_reg, imsi, 0, NULL, 0) != 0)
-			continue;
-
-		if (regexec(&entry->num_reg, dest_nr, 0, NULL, 0) == 0) {
+	num_rewr_for_each(entry, &it, &nat->tpdest_match, imsi) {
+		if (num_matches(entry, dest_nr, 0, NULL)) {
 			dest_match = 1;
 			break;
 		}
@@ -309,13 +508,11 @@ static uint8_t sms_new_tpdu_hdr(struct bsc_nat *nat, const char *imsi,
 				const char *dest_nr, uint8_t hdr)
 {
 	struct bsc_nat_num_rewr_entry *entry;
+	struct num_rewr_iter it;
 
 	/* We will find a new number now */
-	llist_for_each_entry(entry, &nat->sms_clear_tp_srr, list) {
-		/* check the IMSI match */
-		if (regexec(&entry->msisdn_reg, imsi, 0, NULL, 0) != 0)
-			continue;
-		if (regexec(&entry->num_reg, dest_nr, 0, NULL, 0) != 0)
+	num_rewr_for_each(entry, &it, &nat->sms_clear_tp_srr, imsi) {
+		if (!num_matches(entry, dest_nr, 0, NULL))
 			continue;
 
 		/* matched phone number and imsi */
@@ -457,7 +654,7 @@ static struct msgb *rewrite_sms(struct bsc_nat *nat, struct msgb *msg,
 
 	char *new_number = NULL;
 	uint8_t tpdu_hdr;
-	struct msgb *out;
+	struct msgb *l3, *out;
 
 	payload_len = len - sizeof(*hdr48);
 	if (payload_len < 1) {
@@ -563,23 +760,41 @@ static struct msgb *rewrite_sms(struct bsc_nat *nat, struct msgb *msg,
 	if (tpdu_hdr == data_ptr[0] && !new_number && !new_dest_nr)
 		return NULL;
 
-	out = sms_create_new(GSM411_MT_RP_DATA_MO, ref, hdr48,
+	l3 = sms_create_new(GSM411_MT_RP_DATA_MO, ref, hdr48,
 			orig_addr_ptr, orig_addr_len,
 			new_number ? new_number : smsc_addr,
 			data_ptr, data_len, tpdu_hdr,
 			dest_len, new_dest_nr);
 	talloc_free(new_number);
 	talloc_free(new_dest_nr);
+	if (!l3)
+		return NULL;
+
+	out = dtap_replace(msg, parsed, (uint8_t *) hdr48, len,
+			   l3->data, l3->len);
+	msgb_free(l3);
 	return out;
 }
 
+/**
+ * Check if any of the lists used by \ref bsc_nat_rewrite_msg has
+ * an entry. Without them messages do not need to be looked at.
+ */
+int bsc_nat_rewrite_configured(struct bsc_nat *nat)
+{
+	return !llist_empty(&nat->num_rewr.entries)
+		|| !llist_empty(&nat->num_rewr_post.entries)
+		|| !llist_empty(&nat->smsc_rewr.entries)
+		|| !llist_empty(&nat->sms_clear_tp_srr.entries)
+		|| !llist_empty(&nat->sms_num_rewr.entries);
+}
+
 struct msgb *bsc_nat_rewrite_msg(struct bsc_nat *nat, struct msgb *msg, struct bsc_nat_parsed *parsed, const char *imsi)
 {
 	struct gsm48_hdr *hdr48;
 	uint32_t len;
 	uint8_t msg_type, proto;
-	struct msgb *new_msg = NULL, *sccp;
-	uint8_t link_id;
+	struct msgb *new_msg = NULL;
 
 	if (!imsi || strlen(imsi) < 5)
 		return msg;
@@ -594,7 +809,6 @@ struct msgb *bsc_nat_rewrite_msg(struct bsc_nat *nat, struct msgb *msg, struct b
 	if (!hdr48)
 		return msg;
 
-	link_id = msg->l3h[1];
 	proto = gsm48_hdr_pdisc(hdr48);
 	msg_type = gsm48_hdr_msg_type(hdr48);
 
@@ -603,44 +817,110 @@ struct msgb *bsc_nat_rewrite_msg(struct bsc_nat *nat, struct msgb *msg, struct b
 	else if (proto == GSM48_PDISC_SMS && msg_type == GSM411_MT_CP_DATA)
 		new_msg = rewrite_sms(nat, msg, parsed, imsi, hdr48, len);
 
-	if (!new_msg)
-		return msg;
+	/* the message is either patched in place or a new one */
+	return new_msg ? new_msg : msg;
+}
 
-	/* wrap with DTAP, SCCP, then IPA. TODO: Stop copying */
-	gsm0808_prepend_dtap_header(new_msg, link_id);
-	sccp = sccp_create_dt1(parsed->dest_local_ref, new_msg->data, new_msg->len);
-	talloc_free(new_msg);
+static void num_rewr_free_data(struct bsc_nat_num_rewr_entry *entry)
+{
+	regfree(&entry->msisdn_reg);
+	regfree(&entry->num_reg);
+	talloc_free(entry->replace);
+}
 
-	if (!sccp) {
-		LOGP(DNAT, LOGL_ERROR, "Failed to allocate.\n");
-		return msg;
+/*
+ * Copy the digits an anchored expression starts with. A digit followed
+ * by a quantifier is optional and not part of the prefix. Returns 1 if
+ * the expression is nothing but the prefix.
+ */
+static int literal_prefix(const char *regexp, char *prefix, size_t size)
+{
+	const char *p;
+	size_t len = 0;
+
+	prefix[0] = '\0';
+	if (regexp[0] != '^' || strchr(regexp, '|'))
+		return 0;
+
+	for (p = regexp + 1; isdigit((unsigned char) *p) && len + 1 < size; ++p)
+		prefix[len++] = *p;
+
+	if (len > 0 && *p != '\0' && strchr("*+?{\\", *p)) {
+		len -= 1;
+		p -= 1;
 	}
 
-	ipa_prepend_header(sccp, IPAC_PROTO_SCCP);
+	prefix[len] = '\0';
+	return *p == '\0';
+}
 
-	msgb_free(msg);
-	return sccp;
+static void num_rewr_index(void *ctx, struct bsc_nat_num_rewr *rewr)
+{
+	struct bsc_nat_num_rewr_entry *entry;
+
+	talloc_free(rewr->index);
+	rewr->index = NULL;
+
+	if (llist_empty(&rewr->entries))
+		return;
+
+	rewr->index = talloc_zero(ctx, struct bsc_nat_num_rewr_node);
+	if (!rewr->index)
+		goto error;
+
+	llist_for_each_entry(entry, &rewr->entries, list) {
+		struct bsc_nat_num_rewr_node *node = rewr->index;
+		const char *digit;
+
+		for (digit = entry->imsi_prefix; *digit; ++digit) {
+			struct bsc_nat_num_rewr_node **child;
+
+			child = &node->child[*digit - '0'];
+			if (!*child)
+				*child = talloc_zero(rewr->index,
+						     struct bsc_nat_num_rewr_node);
+			if (!*child)
+				goto error;
+			node = *child;
+		}
+
+		node->rules = talloc_realloc(rewr->index, node->rules,
+					     struct bsc_nat_num_rewr_entry *,
+					     node->num_rules + 1);
+		if (!node->rules)
+			goto error;
+		node->rules[node->num_rules++] = entry;
+	}
+	return;
+
+error:
+	/* the lookup will walk the list instead */
+	LOGP(DNAT, LOGL_ERROR, "Failed to index the rewrite rules.\n");
+	talloc_free(rewr->index);
+	rewr->index = NULL;
 }
 
-static void num_rewr_free_data(struct bsc_nat_num_rewr_entry *entry)
+void bsc_nat_num_rewr_init(struct bsc_nat_num_rewr *rewr)
 {
-	regfree(&entry->msisdn_reg);
-	regfree(&entry->num_reg);
-	talloc_free(entry->replace);
+	INIT_LLIST_HEAD(&rewr->entries);
+	rewr->index = NULL;
 }
 
-void bsc_nat_num_rewr_entry_adapt(void *ctx, struct llist_head *head,
+void bsc_nat_num_rewr_entry_adapt(void *ctx, struct bsc_nat_num_rewr *rewr,
 				  const struct osmo_config_list *list)
 {
 	struct bsc_nat_num_rewr_entry *entry, *tmp;
 	struct osmo_config_entry *cfg_entry;
+	unsigned int nr = 0;
 
 	/* free the old data */
-	llist_for_each_entry_safe(entry, tmp, head, list) {
+	llist_for_each_entry_safe(entry, tmp, &rewr->entries, list) {
 		num_rewr_free_data(entry);
 		llist_del(&entry->list);
 		talloc_free(entry);
 	}
+	talloc_free(rewr->index);
+	rewr->index = NULL;
 
 
 	if (!list)
@@ -697,6 +977,8 @@ void bsc_nat_num_rewr_entry_adapt(void *ctx, struct llist_head *head,
 			continue;
 		}
 
+		entry->imsi_prefix_only = literal_prefix(regexp, entry->imsi_prefix,
+						sizeof(entry->imsi_prefix));
 		talloc_free(regexp);
 		if (regcomp(&entry->num_reg, cfg_entry->option, REG_EXTENDED) != 0) {
 			LOGP(DNAT, LOGL_ERROR,
@@ -705,8 +987,13 @@ void bsc_nat_num_rewr_entry_adapt(void *ctx, struct llist_head *head,
 			talloc_free(entry);
 			continue;
 		}
+		literal_prefix(cfg_entry->option, entry->num_prefix,
+			       sizeof(entry->num_prefix));
 
 		/* we have copied the number */
-		llist_add_tail(&entry->list, head);
+		entry->nr = nr++;
+		llist_add_tail(&entry->list, &rewr->entries);
 	}
+
+	num_rewr_index(ctx, rewr);
 }
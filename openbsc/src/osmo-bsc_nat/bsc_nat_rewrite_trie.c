@@ -23,13 +23,22 @@
 #include <openbsc/debug.h>
 #include <openbsc/vty.h>
 
+#include <osmocom/core/select.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
 
+#include <sys/types.h>
+#include <sys/wait.h>
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 
 #define CHECK_IS_DIGIT_OR_FAIL(prefix, pos)						\
 	if (!isdigit(prefix[pos]) && prefix[pos] != '+') {				\
@@ -41,75 +50,93 @@
 #define TO_INT(c) \
 	((c) == '+' ? 10 : ((c - '0') % 10))
 
-static void insert_rewrite_node(struct nat_rewrite_rule *rule, struct nat_rewrite *root)
+/*
+ * The trie is kept in a single image. The header is followed by the
+ * nodes in breadth first order and the rules sorted by prefix. The
+ * image is built in one go and is never modified afterwards so that
+ * it can be handed from a child process to the main loop as it is.
+ */
+#define NAT_REWRITE_MAGIC	0x4e525431
+
+struct nat_rewrite_hdr {
+	uint32_t magic;
+	uint32_t nodes;
+	uint32_t prefixes;
+	uint32_t spare;
+};
+
+/* a rule while reading the file, the line keeps the first one of a prefix */
+struct rewrite_entry {
+	struct nat_rewrite_rule rule;
+	uint32_t line;
+};
+
+/* the rules below a node that is not placed yet */
+struct node_range {
+	uint32_t lo;
+	uint32_t hi;
+};
+
+struct nat_rewrite_loader {
+	struct osmo_fd bfd;
+	pid_t pid;
+
+	/* the image as it is being read from the child */
+	struct nat_rewrite_hdr hdr;
+	uint8_t *image;
+	size_t image_len;
+	size_t read;
+
+	void *ctx;
+	nat_rewrite_loaded_cb cb;
+	void *data;
+};
+
+static size_t image_size(uint32_t nodes, uint32_t prefixes)
 {
-	struct nat_rewrite_rule *new = &root->rule;
-
-	const int len = strlen(rule->prefix);
-	int i;
-
-	if (len <= 0) {
-		LOGP(DNAT, LOGL_ERROR, "An empty prefix does not make sense.\n");
-		goto fail;
-	}
+	return sizeof(struct nat_rewrite_hdr)
+		+ (size_t) nodes * sizeof(struct nat_rewrite_node)
+		+ (size_t) prefixes * sizeof(struct nat_rewrite_rule);
+}
 
-	for (i = 0; i < len - 1; ++i) {
-		int pos;
+static void *grow_array(void *ctx, void *array, size_t *size, size_t need,
+			size_t elem)
+{
+	size_t new_size;
 
-		/* check if the input is valid */
-		CHECK_IS_DIGIT_OR_FAIL(rule->prefix, i);
+	if (need <= *size)
+		return array;
 
-		/* check if the next node is already valid */
-		pos = TO_INT(rule->prefix[i]);
-		if (!new->rules[pos]) {
-			new->rules[pos] = talloc_zero(root, struct nat_rewrite_rule);
-			if (!new->rules[pos]) {
-				LOGP(DNAT, LOGL_ERROR,
-					"Failed to allocate memory.\n");
-				goto fail;
-			}
+	new_size = *size ? *size * 2 : 1024;
+	while (new_size < need)
+		new_size *= 2;
 
-			new->rules[pos]->empty = 1;
-		}
+	array = talloc_realloc_size(ctx, array, new_size * elem);
+	if (array)
+		*size = new_size;
+	return array;
+}
 
-		/* we continue here */
-		new = new->rules[pos];
-	}
+static int check_prefix(const char *prefix)
+{
+	int i;
 
-	/* new now points to the place where we want to add it */
-	int pos;
-
-	/* check if the input is valid */
-	CHECK_IS_DIGIT_OR_FAIL(rule->prefix, (len - 1));
-
-	/* check if the next node is already valid */
-	pos = TO_INT(rule->prefix[len - 1]);
-	if (!new->rules[pos])
-		new->rules[pos] = rule;
-	else if (new->rules[pos]->empty) {
-		/* copy over entries */
-		new->rules[pos]->empty = 0;
-		memcpy(new->rules[pos]->prefix, rule->prefix, sizeof(rule->prefix));
-		memcpy(new->rules[pos]->rewrite, rule->rewrite, sizeof(rule->rewrite));
-		talloc_free(rule);
-	} else {
-		LOGP(DNAT, LOGL_ERROR,
-			"Prefix(%s) is already installed\n", rule->prefix);
-		goto fail;
+	if (prefix[0] == '\0') {
+		LOGP(DNAT, LOGL_ERROR, "An empty prefix does not make sense.\n");
+		return -1;
 	}
 
-	root->prefixes += 1;
-	return;
+	for (i = 0; prefix[i]; ++i)
+		CHECK_IS_DIGIT_OR_FAIL(prefix, i);
+	return 0;
 
 fail:
-	talloc_free(rule);
-	return;
+	return -1;
 }
 
-static void handle_line(struct nat_rewrite *rewrite, char *line)
+static int handle_line(struct rewrite_entry *entry, char *line)
 {
 	char *split;
-	struct nat_rewrite_rule *rule;
 	size_t size_prefix, size_end, len;
 
 
@@ -118,14 +145,14 @@ static void handle_line(struct nat_rewrite *rewrite, char *line)
 	split = strstr(line, ",");
 	if (!split) {
 		LOGP(DNAT, LOGL_ERROR, "Line doesn't contain ','\n");
-		return;
+		return -1;
 	}
 
 	/* Check if there is space for the rewrite rule */
 	size_prefix = split - line;
 	if (len - size_prefix <= 2) {
 		LOGP(DNAT, LOGL_ERROR, "No rewrite available.\n");
-		return;
+		return -1;
 	}
 
 	/* Continue after the ',' to the end */
@@ -133,87 +160,426 @@ static void handle_line(struct nat_rewrite *rewrite, char *line)
 	size_end = strlen(split) - 1;
 
 	/* Check if both strings can fit into the static array */
-	if (size_prefix > sizeof(rule->prefix) - 1) {
+	if (size_prefix > sizeof(entry->rule.prefix) - 1) {
 		LOGP(DNAT, LOGL_ERROR,
 			"Prefix is too long with %zu\n", size_prefix);
-		return;
+		return -1;
 	}
 
-	if (size_end > sizeof(rule->rewrite) - 1) {
+	if (size_end > sizeof(entry->rule.rewrite) - 1) {
 		LOGP(DNAT, LOGL_ERROR,
 			"Rewrite is too long with %zu on %s\n",
 			size_end, &line[size_prefix + 1]);
-		return;
+		return -1;
+	}
+
+	memset(&entry->rule, 0, sizeof(entry->rule));
+	memcpy(entry->rule.prefix, line, size_prefix);
+	assert(size_prefix < sizeof(entry->rule.prefix));
+	entry->rule.prefix[size_prefix] = '\0';
+
+	memcpy(entry->rule.rewrite, split, size_end);
+	assert(size_end < sizeof(entry->rule.rewrite));
+	entry->rule.rewrite[size_end] = '\0';
+
+	return check_prefix(entry->rule.prefix);
+}
+
+/* sort by prefix with the digits before +, this is the order of a walk */
+static int entry_cmp(const void *_a, const void *_b)
+{
+	const struct rewrite_entry *a = _a, *b = _b;
+	const char *pa = a->rule.prefix, *pb = b->rule.prefix;
+
+	while (*pa && *pa == *pb)
+		++pa, ++pb;
+
+	if (*pa != *pb) {
+		if (!*pa)
+			return -1;
+		if (!*pb)
+			return 1;
+		return TO_INT(*pa) - TO_INT(*pb);
 	}
 
-	/* Now create the entry and insert it into the trie */
-	rule = talloc_zero(rewrite, struct nat_rewrite_rule);
-	if (!rule) {
+	return a->line < b->line ? -1 : a->line > b->line;
+}
+
+/*
+ * Read all rules, sort them and place the nodes level by level. The
+ * children of a node are the next free slots when the node itself is
+ * visited, so they end up next to each other.
+ */
+static void *build_image(void *ctx, FILE *file, size_t *image_len)
+{
+	struct rewrite_entry *entries = NULL;
+	struct nat_rewrite_node *nodes = NULL;
+	struct node_range *ranges = NULL;
+	struct nat_rewrite_hdr *hdr;
+	struct nat_rewrite_rule *rules;
+	size_t num = 0, entries_size = 0, nodes_size = 0, ranges_size = 0;
+	size_t i, out, nr, level_end, depth;
+	char *line = NULL;
+	size_t n = 0;
+	uint8_t *image = NULL;
+	uint32_t line_nr = 0;
+
+	while (getline(&line, &n, file) != -1) {
+		entries = grow_array(ctx, entries, &entries_size, num + 1,
+				     sizeof(*entries));
+		if (!entries) {
+			LOGP(DNAT, LOGL_ERROR, "Can not allocate memory\n");
+			goto out;
+		}
+
+		entries[num].line = line_nr++;
+		if (handle_line(&entries[num], line) == 0)
+			num += 1;
+	}
+
+	qsort(entries, num, sizeof(*entries), entry_cmp);
+
+	/* drop duplicates, the first one in the file wins */
+	for (i = 0, out = 0; i < num; ++i) {
+		if (out > 0 && strcmp(entries[out - 1].rule.prefix,
+				      entries[i].rule.prefix) == 0) {
+			LOGP(DNAT, LOGL_ERROR,
+				"Prefix(%s) is already installed\n",
+				entries[i].rule.prefix);
+			continue;
+		}
+		entries[out++] = entries[i];
+	}
+	num = out;
+
+	nodes = grow_array(ctx, nodes, &nodes_size, 1, sizeof(*nodes));
+	ranges = grow_array(ctx, ranges, &ranges_size, 1, sizeof(*ranges));
+	if (!nodes || !ranges) {
 		LOGP(DNAT, LOGL_ERROR, "Can not allocate memory\n");
-		return;
+		goto out;
 	}
 
-	memcpy(rule->prefix, line, size_prefix);
-	assert(size_prefix < sizeof(rule->prefix));
-	rule->prefix[size_prefix] = '\0';
+	memset(&nodes[0], 0, sizeof(nodes[0]));
+	ranges[0].lo = 0;
+	ranges[0].hi = num;
+	nr = 1;
+	level_end = 1;
+	depth = 0;
+
+	for (i = 0; i < nr; ++i) {
+		uint32_t lo = ranges[i].lo, hi = ranges[i].hi, j;
+
+		if (i == level_end) {
+			depth += 1;
+			level_end = nr;
+		}
+
+		/* the shortest prefix sorts first */
+		if (lo < hi && entries[lo].rule.prefix[depth] == '\0') {
+			nodes[i].rule = lo + 1;
+			lo += 1;
+		}
+
+		nodes[i].first_child = nr;
+		while (lo < hi) {
+			int pos = TO_INT(entries[lo].rule.prefix[depth]);
+
+			for (j = lo + 1; j < hi; ++j)
+				if (TO_INT(entries[j].rule.prefix[depth]) != pos)
+					break;
 
-	memcpy(rule->rewrite, split, size_end);
-	assert(size_end < sizeof(rule->rewrite));
-	rule->rewrite[size_end] = '\0';
+			nodes = grow_array(ctx, nodes, &nodes_size, nr + 1,
+					   sizeof(*nodes));
+			ranges = grow_array(ctx, ranges, &ranges_size, nr + 1,
+					    sizeof(*ranges));
+			if (!nodes || !ranges) {
+				LOGP(DNAT, LOGL_ERROR,
+					"Failed to allocate memory.\n");
+				goto out;
+			}
+
+			memset(&nodes[nr], 0, sizeof(nodes[nr]));
+			ranges[nr].lo = lo;
+			ranges[nr].hi = j;
+			nodes[i].children |= 1 << pos;
+			nr += 1;
+			lo = j;
+		}
+	}
+
+	*image_len = image_size(nr, num);
+	image = talloc_size(ctx, *image_len);
+	if (!image) {
+		LOGP(DNAT, LOGL_ERROR, "Can not allocate memory\n");
+		goto out;
+	}
+
+	hdr = (struct nat_rewrite_hdr *) image;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = NAT_REWRITE_MAGIC;
+	hdr->nodes = nr;
+	hdr->prefixes = num;
+	memcpy(hdr + 1, nodes, nr * sizeof(*nodes));
+
+	rules = (struct nat_rewrite_rule *)
+		(image + sizeof(*hdr) + nr * sizeof(*nodes));
+	for (i = 0; i < num; ++i)
+		rules[i] = entries[i].rule;
+
+out:
+	free(line);
+	talloc_free(entries);
+	talloc_free(nodes);
+	talloc_free(ranges);
+	return image;
+}
+
+/* take over the image and point into it */
+static struct nat_rewrite *rewrite_from_image(void *ctx, void *image,
+					      size_t len)
+{
+	const struct nat_rewrite_hdr *hdr = image;
+	struct nat_rewrite *res;
+
+	if (len < sizeof(*hdr) || hdr->magic != NAT_REWRITE_MAGIC
+	    || hdr->nodes == 0 || len != image_size(hdr->nodes, hdr->prefixes)) {
+		LOGP(DNAT, LOGL_ERROR, "The prefix image is not valid.\n");
+		talloc_free(image);
+		return NULL;
+	}
+
+	res = talloc_zero(ctx, struct nat_rewrite);
+	if (!res) {
+		talloc_free(image);
+		return NULL;
+	}
 
-	/* now insert and balance the tree */
-	insert_rewrite_node(rule, rewrite);
+	talloc_steal(res, image);
+	res->prefixes = hdr->prefixes;
+	res->nodes = hdr->nodes;
+	res->node = (const struct nat_rewrite_node *) (hdr + 1);
+	res->rules = (const struct nat_rewrite_rule *) (res->node + res->nodes);
+	res->image = image;
+	res->image_len = len;
+	return res;
 }
 
 struct nat_rewrite *nat_rewrite_parse(void *ctx, const char *filename)
 {
 	FILE *file;
-	char *line = NULL;
-	size_t n = 0;
-	struct nat_rewrite *res;
+	void *image;
+	size_t len;
 
 	file = fopen(filename, "r");
 	if (!file)
 		return NULL;
 
-	res = talloc_zero(ctx, struct nat_rewrite);
-	if (!res) {
-		fclose(file);
+	image = build_image(ctx, file, &len);
+	fclose(file);
+	if (!image)
 		return NULL;
+
+	return rewrite_from_image(ctx, image, len);
+}
+
+/* runs in the child and hands the image to the parent */
+static int write_image(const char *filename, int fd)
+{
+	FILE *file;
+	uint8_t *image;
+	size_t len, written = 0;
+
+	file = fopen(filename, "r");
+	if (!file)
+		return -1;
+
+	image = build_image(NULL, file, &len);
+	fclose(file);
+	if (!image)
+		return -1;
+
+	while (written < len) {
+		ssize_t rc = write(fd, image + written, len - written);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			return -1;
+		written += rc;
 	}
 
-	/* mark the root as empty */
-	res->rule.empty = 1;
+	return 0;
+}
 
-	while (getline(&line, &n, file) != -1) {
-		handle_line(res, line);
+static int loader_destroy(struct nat_rewrite_loader *loader)
+{
+	if (loader->bfd.fd >= 0) {
+		osmo_fd_unregister(&loader->bfd);
+		close(loader->bfd.fd);
 	}
 
-	free(line);
-	fclose(file);
-	return res;
+	if (loader->pid > 0) {
+		kill(loader->pid, SIGKILL);
+		waitpid(loader->pid, NULL, 0);
+	}
+
+	return 0;
+}
+
+static void loader_done(struct nat_rewrite_loader *loader,
+			struct nat_rewrite *rewr)
+{
+	nat_rewrite_loaded_cb cb = loader->cb;
+	void *data = loader->data;
+
+	talloc_free(loader);
+	cb(rewr, data);
+}
+
+static int loader_read_cb(struct osmo_fd *bfd, unsigned int what)
+{
+	struct nat_rewrite_loader *loader = bfd->data;
+	struct nat_rewrite *rewr;
+	uint8_t *dst, *image;
+	size_t want;
+	ssize_t rc;
+
+	if (loader->read < sizeof(loader->hdr)) {
+		dst = (uint8_t *) &loader->hdr + loader->read;
+		want = sizeof(loader->hdr) - loader->read;
+	} else {
+		dst = loader->image + loader->read;
+		want = loader->image_len - loader->read;
+	}
+
+	rc = read(bfd->fd, dst, want);
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (rc <= 0) {
+		LOGP(DNAT, LOGL_ERROR, "Building the prefix trie failed.\n");
+		loader_done(loader, NULL);
+		return 0;
+	}
+
+	loader->read += rc;
+	if (loader->read == sizeof(loader->hdr) && !loader->image) {
+		if (loader->hdr.magic != NAT_REWRITE_MAGIC) {
+			LOGP(DNAT, LOGL_ERROR, "The prefix image is not valid.\n");
+			loader_done(loader, NULL);
+			return 0;
+		}
+
+		loader->image_len = image_size(loader->hdr.nodes,
+					       loader->hdr.prefixes);
+		loader->image = talloc_size(loader, loader->image_len);
+		if (!loader->image) {
+			LOGP(DNAT, LOGL_ERROR, "Can not allocate memory\n");
+			loader_done(loader, NULL);
+			return 0;
+		}
+		memcpy(loader->image, &loader->hdr, sizeof(loader->hdr));
+	}
+
+	if (loader->image && loader->read == loader->image_len) {
+		image = loader->image;
+		loader->image = NULL;
+		rewr = rewrite_from_image(loader->ctx, image, loader->image_len);
+		loader_done(loader, rewr);
+	}
+
+	return 0;
+}
+
+/*! Build the trie in a child process and hand it over when done.
+ *  The main loop only reads the finished image from a pipe in small
+ *  chunks. The callback is invoked from the main loop with the new
+ *  trie or NULL on failure. Freeing the loader cancels the build.
+ *  \param[in] ctx the talloc context for the loader and the trie
+ *  \param[in] filename the CSV file to read
+ *  \param[in] cb called once the trie is ready
+ *  \param[in] data passed to the callback
+ *  \returns the loader or NULL if the build could not be started
+ */
+struct nat_rewrite_loader *nat_rewrite_parse_bg(void *ctx, const char *filename,
+						nat_rewrite_loaded_cb cb, void *data)
+{
+	struct nat_rewrite_loader *loader;
+	int fds[2];
+
+	loader = talloc_zero(ctx, struct nat_rewrite_loader);
+	if (!loader)
+		return NULL;
+
+	loader->bfd.fd = -1;
+	loader->ctx = ctx;
+	loader->cb = cb;
+	loader->data = data;
+	talloc_set_destructor(loader, loader_destroy);
+
+	if (pipe(fds) != 0) {
+		LOGP(DNAT, LOGL_ERROR, "Failed to create a pipe: %s\n",
+			strerror(errno));
+		talloc_free(loader);
+		return NULL;
+	}
+
+	loader->pid = fork();
+	if (loader->pid < 0) {
+		LOGP(DNAT, LOGL_ERROR, "Failed to fork: %s\n", strerror(errno));
+		loader->pid = 0;
+		close(fds[0]);
+		close(fds[1]);
+		talloc_free(loader);
+		return NULL;
+	}
+
+	if (loader->pid == 0) {
+		close(fds[0]);
+		_exit(write_image(filename, fds[1]) == 0 ? 0 : 1);
+	}
+
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	loader->bfd.fd = fds[0];
+	loader->bfd.when = BSC_FD_READ;
+	loader->bfd.cb = loader_read_cb;
+	loader->bfd.data = loader;
+	if (osmo_fd_register(&loader->bfd) != 0) {
+		LOGP(DNAT, LOGL_ERROR, "Failed to register the pipe.\n");
+		close(fds[0]);
+		loader->bfd.fd = -1;
+		talloc_free(loader);
+		return NULL;
+	}
+
+	return loader;
 }
 
 /**
  * Simple find that tries to do a longest match...
  */
-struct nat_rewrite_rule *nat_rewrite_lookup(struct nat_rewrite *rewrite,
-					const char *prefix)
+const struct nat_rewrite_rule *nat_rewrite_lookup(const struct nat_rewrite *rewrite,
+						  const char *prefix)
 {
-	struct nat_rewrite_rule *rule = &rewrite->rule;
-	struct nat_rewrite_rule *last = NULL;
-	const int len = OSMO_MIN(strlen(prefix), (sizeof(rule->prefix) - 1));
+	const struct nat_rewrite_node *node = &rewrite->node[0];
+	const struct nat_rewrite_rule *last = NULL;
+	const int len = OSMO_MIN(strlen(prefix), (sizeof(last->prefix) - 1));
 	int i;
 
-	for (i = 0; rule && i < len; ++i) {
+	for (i = 0; i < len; ++i) {
 		int pos;
 
 		CHECK_IS_DIGIT_OR_FAIL(prefix, i);
 		pos = TO_INT(prefix[i]);
 
-		rule = rule->rules[pos];
-		if (rule && !rule->empty)
-			last = rule;
+		if (!(node->children & (1 << pos)))
+			break;
+
+		/* the children before this one tell its place */
+		node = &rewrite->node[node->first_child
+			+ __builtin_popcount(node->children & ((1 << pos) - 1))];
+		if (node->rule)
+			last = &rewrite->rules[node->rule - 1];
 	}
 
 	return last;
@@ -222,38 +588,20 @@ fail:
 	return NULL;
 }
 
-static void nat_rewrite_dump_rec(struct nat_rewrite_rule *rule)
+void nat_rewrite_dump(const struct nat_rewrite *rewrite)
 {
-	int i;
-	if (!rule->empty)
-		printf("%s,%s\n", rule->prefix, rule->rewrite);
+	size_t i;
 
-	for (i = 0; i < ARRAY_SIZE(rule->rules); ++i) {
-		if (!rule->rules[i])
-			continue;
-		nat_rewrite_dump_rec(rule->rules[i]);
-	}
+	for (i = 0; i < rewrite->prefixes; ++i)
+		printf("%s,%s\n", rewrite->rules[i].prefix,
+			rewrite->rules[i].rewrite);
 }
 
-void nat_rewrite_dump(struct nat_rewrite *rewrite)
+void nat_rewrite_dump_vty(struct vty *vty, const struct nat_rewrite *rewrite)
 {
-	nat_rewrite_dump_rec(&rewrite->rule);
-}
+	size_t i;
 
-static void nat_rewrite_dump_rec_vty(struct vty *vty, struct nat_rewrite_rule *rule)
-{
-	int i;
-	if (!rule->empty)
-		vty_out(vty, "%s,%s%s", rule->prefix, rule->rewrite, VTY_NEWLINE);
-
-	for (i = 0; i < ARRAY_SIZE(rule->rules); ++i) {
-		if (!rule->rules[i])
-			continue;
-		nat_rewrite_dump_rec_vty(vty, rule->rules[i]);
-	}
-}
-
-void nat_rewrite_dump_vty(struct vty *vty, struct nat_rewrite *rewrite)
-{
-	nat_rewrite_dump_rec_vty(vty, &rewrite->rule);
+	for (i = 0; i < rewrite->prefixes; ++i)
+		vty_out(vty, "%s,%s%s", rewrite->rules[i].prefix,
+			rewrite->rules[i].rewrite, VTY_NEWLINE);
 }
@@ -33,6 +33,7 @@
 #include <osmocom/core/linuxlist.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/stats.h>
+#include <osmocom/core/utils.h>
 #include <osmocom/gsm/gsm0808.h>
 #include <osmocom/gsm/ipa.h>
 
@@ -41,9 +42,11 @@
 
 #include <osmocom/sccp/sccp.h>
 
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <errno.h>
 
 static const struct rate_ctr_desc bsc_cfg_ctr_description[] = {
 	[BCFG_CTR_SCCP_CONN]     = { "sccp:conn",      "SCCP Connections"	 },
@@ -69,6 +72,18 @@ static const struct rate_ctr_group_desc bsc_cfg_ctrg_desc = {
 	.class_id = OSMO_STATS_CLASS_PEER,
 };
 
+static void bsc_nat_free_counters(struct bsc_nat *nat)
+{
+	osmo_counter_free(nat->stats.sccp.conn);
+	osmo_counter_free(nat->stats.sccp.calls);
+	osmo_counter_free(nat->stats.bsc.reconn);
+	osmo_counter_free(nat->stats.bsc.auth_fail);
+	osmo_counter_free(nat->stats.msc.reconn);
+	osmo_counter_free(nat->stats.ussd.reconn);
+	osmo_counter_free(nat->stats.fwd.fast);
+	osmo_counter_free(nat->stats.fwd.slow);
+}
+
 struct bsc_nat *bsc_nat_alloc(void)
 {
 	struct bsc_nat *nat = talloc_zero(tall_bsc_ctx, struct bsc_nat);
@@ -87,12 +102,12 @@ struct bsc_nat *bsc_nat_alloc(void)
 	INIT_LLIST_HEAD(&nat->bsc_configs);
 	INIT_LLIST_HEAD(&nat->access_lists);
 	INIT_LLIST_HEAD(&nat->dests);
-	INIT_LLIST_HEAD(&nat->num_rewr);
-	INIT_LLIST_HEAD(&nat->num_rewr_post);
-	INIT_LLIST_HEAD(&nat->smsc_rewr);
-	INIT_LLIST_HEAD(&nat->tpdest_match);
-	INIT_LLIST_HEAD(&nat->sms_clear_tp_srr);
-	INIT_LLIST_HEAD(&nat->sms_num_rewr);
+	bsc_nat_num_rewr_init(&nat->num_rewr);
+	bsc_nat_num_rewr_init(&nat->num_rewr_post);
+	bsc_nat_num_rewr_init(&nat->smsc_rewr);
+	bsc_nat_num_rewr_init(&nat->tpdest_match);
+	bsc_nat_num_rewr_init(&nat->sms_clear_tp_srr);
+	bsc_nat_num_rewr_init(&nat->sms_num_rewr);
 
 	nat->stats.sccp.conn = osmo_counter_alloc("nat.sccp.conn");
 	nat->stats.sccp.calls = osmo_counter_alloc("nat.sccp.calls");
@@ -100,6 +115,15 @@ struct bsc_nat *bsc_nat_alloc(void)
 	nat->stats.bsc.auth_fail = osmo_counter_alloc("nat.bsc.auth_fail");
 	nat->stats.msc.reconn = osmo_counter_alloc("nat.msc.conn");
 	nat->stats.ussd.reconn = osmo_counter_alloc("nat.ussd.conn");
+	nat->stats.fwd.fast = osmo_counter_alloc("nat.fwd.fast");
+	nat->stats.fwd.slow = osmo_counter_alloc("nat.fwd.slow");
+	if (bsc_nat_link_init(nat, &nat->msc_link) != 0) {
+		bsc_nat_free_counters(nat);
+		talloc_free(nat);
+		return NULL;
+	}
+
+	nat->write_batch = NAT_LINK_BATCH_DEFAULT;
 	nat->auth_timeout = 2;
 	nat->ping_timeout = 20;
 	nat->pong_timeout = 5;
@@ -127,12 +151,8 @@ void bsc_nat_free(struct bsc_nat *nat)
 	bsc_nat_num_rewr_entry_adapt(nat, &nat->sms_num_rewr, NULL);
 	bsc_nat_num_rewr_entry_adapt(nat, &nat->tpdest_match, NULL);
 
-	osmo_counter_free(nat->stats.sccp.conn);
-	osmo_counter_free(nat->stats.sccp.calls);
-	osmo_counter_free(nat->stats.bsc.reconn);
-	osmo_counter_free(nat->stats.bsc.auth_fail);
-	osmo_counter_free(nat->stats.msc.reconn);
-	osmo_counter_free(nat->stats.ussd.reconn);
+	bsc_nat_free_counters(nat);
+	bsc_nat_link_free(&nat->msc_link);
 	talloc_free(nat->mgcp_cfg);
 	talloc_free(nat);
 }
@@ -148,6 +168,11 @@ struct bsc_connection *bsc_connection_alloc(struct bsc_nat *nat)
 	if (!con)
 		return NULL;
 
+	if (bsc_nat_link_init(con, &con->link) != 0) {
+		talloc_free(con);
+		return NULL;
+	}
+
 	con->nat = nat;
 	osmo_wqueue_init(&con->write_queue, 100);
 	INIT_LLIST_HEAD(&con->cmd_pending);
@@ -487,6 +512,290 @@ int bsc_write_cb(struct osmo_fd *bfd, struct msgb *msg)
 	return rc;
 }
 
+int bsc_nat_link_init(void *ctx, struct bsc_nat_link *link)
+{
+	memset(link, 0, sizeof(*link));
+	link->ctx = ctx;
+	link->rx_data = talloc_size(ctx, NAT_LINK_RX_SIZE);
+	if (!link->rx_data) {
+		LOGP(DNAT, LOGL_ERROR, "Failed to allocate the receive buffer.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The receive buffer lives on as long as a frame handed out uses it */
+void bsc_nat_link_free(struct bsc_nat_link *link)
+{
+	if (link->rx_big) {
+		msgb_free(link->rx_big);
+		link->rx_big = NULL;
+	}
+	talloc_unlink(link->ctx, link->rx_data);
+	link->rx_data = NULL;
+}
+
+/*
+ * Move the unparsed bytes to the start of the receive buffer. If
+ * frames that were handed out still point into it, a new buffer is
+ * used. On failure nothing changes and the stream stays intact.
+ */
+static int link_rebase(struct bsc_nat_link *link)
+{
+	unsigned int left = link->rx_len - link->rx_off;
+	uint8_t *data;
+
+	if (talloc_reference_count(link->rx_data) == 0) {
+		memmove(link->rx_data, &link->rx_data[link->rx_off], left);
+	} else {
+		data = talloc_size(link->ctx, NAT_LINK_RX_SIZE);
+		if (!data)
+			return -ENOMEM;
+		memcpy(data, &link->rx_data[link->rx_off], left);
+		talloc_unlink(link->ctx, link->rx_data);
+		link->rx_data = data;
+	}
+
+	link->rx_len = left;
+	link->rx_off = 0;
+	return 0;
+}
+
+/* Drop a partially received frame, e.g. after a reconnect */
+void bsc_nat_link_reset(struct bsc_nat_link *link)
+{
+	if (link->rx_len != link->rx_off)
+		LOGP(DNAT, LOGL_ERROR, "Dropping %u bytes of a partial message.\n",
+		     link->rx_len - link->rx_off);
+	link->rx_off = link->rx_len;
+	link_rebase(link);
+
+	if (link->rx_big) {
+		LOGP(DNAT, LOGL_ERROR, "Dropping %u bytes of a partial message.\n",
+		     link->rx_big->len);
+		msgb_free(link->rx_big);
+		link->rx_big = NULL;
+	}
+}
+
+/*! Read as much as the receive buffer can hold with one syscall.
+ *  A frame that does not fit into the buffer is read on its own.
+ *  \returns the number of bytes, 0 if the peer closed, negative errno
+ */
+int bsc_nat_link_read(struct bsc_nat_link *link, int fd)
+{
+	int rc;
+
+	if (link->rx_big) {
+		rc = read(fd, link->rx_big->tail, link->rx_big_len - link->rx_big->len);
+		if (rc < 0)
+			return -errno;
+
+		msgb_put(link->rx_big, rc);
+		link->rx_calls += 1;
+		link->rx_bytes += rc;
+		return rc;
+	}
+
+	/* a failed rebase might have left the buffer full */
+	if (link->rx_len == NAT_LINK_RX_SIZE && link_rebase(link) != 0)
+		return -ENOMEM;
+	if (link->rx_len == NAT_LINK_RX_SIZE)
+		return -ENOBUFS;
+
+	rc = read(fd, &link->rx_data[link->rx_len], NAT_LINK_RX_SIZE - link->rx_len);
+	if (rc < 0)
+		return -errno;
+
+	link->rx_calls += 1;
+	link->rx_bytes += rc;
+	link->rx_len += rc;
+	return rc;
+}
+
+/*
+ * Hand out a frame of the receive buffer without copying it. The msgb
+ * only points to the frame and holds a reference to the buffer, there
+ * is no room around the frame to grow it.
+ */
+static struct msgb *link_slice(struct bsc_nat_link *link, uint8_t *data,
+			       unsigned int len)
+{
+	struct msgb *msg;
+
+	msg = msgb_alloc(0, "IPA");
+	if (!msg)
+		return NULL;
+	if (!talloc_reference(msg, link->rx_data)) {
+		msgb_free(msg);
+		return NULL;
+	}
+
+	msg->head = msg->data = data;
+	msg->tail = data + len;
+	msg->data_len = msg->len = len;
+	msg->l2h = data + sizeof(struct ipaccess_head);
+	return msg;
+}
+
+/*! Take the next complete IPA frame out of the receive buffer.
+ *  \param[out] rc 0 or a negative errno if the stream can not be parsed
+ *  \returns a msgb with l2h pointing after the IPA header or NULL
+ */
+struct msgb *bsc_nat_link_dequeue(struct bsc_nat_link *link, int *rc)
+{
+	struct ipaccess_head *hh;
+	struct msgb *msg;
+	unsigned int len, left;
+
+	*rc = 0;
+	if (link->rx_big) {
+		if (link->rx_big->len < link->rx_big_len)
+			return NULL;
+
+		msg = link->rx_big;
+		link->rx_big = NULL;
+		msg->l2h = msg->data + sizeof(*hh);
+		link->rx_msgs += 1;
+		return msg;
+	}
+
+	left = link->rx_len - link->rx_off;
+	len = sizeof(*hh);
+	if (left < len)
+		goto rebase;
+
+	hh = (struct ipaccess_head *) &link->rx_data[link->rx_off];
+	len = sizeof(*hh) + ntohs(hh->len);
+	if (len > UINT16_MAX) {
+		/* a msgb can not hold it */
+		*rc = -EMSGSIZE;
+		return NULL;
+	}
+
+	if (len > NAT_LINK_RX_SIZE) {
+		/* continue with the frame in a msgb of its own */
+		msg = msgb_alloc(len, "IPA");
+		if (!msg) {
+			*rc = -ENOMEM;
+			return NULL;
+		}
+
+		memcpy(msgb_put(msg, left), hh, left);
+		link->rx_off = link->rx_len;
+		link->rx_big = msg;
+		link->rx_big_len = len;
+		link_rebase(link);
+		return NULL;
+	}
+
+	if (left < len)
+		goto rebase;
+
+	msg = link_slice(link, (uint8_t *) hh, len);
+	if (!msg) {
+		*rc = -ENOMEM;
+		return NULL;
+	}
+
+	link->rx_off += len;
+	link->rx_msgs += 1;
+	return msg;
+
+rebase:
+	/*
+	 * Keep the partial frame where it is while the buffer has room for
+	 * it and frames handed out still use the buffer.
+	 */
+	if (link->rx_off > 0
+	    && (talloc_reference_count(link->rx_data) == 0
+		|| link->rx_off + len > NAT_LINK_RX_SIZE
+		|| NAT_LINK_RX_SIZE - link->rx_len < NAT_LINK_RX_SIZE / 4))
+		link_rebase(link);
+	return NULL;
+}
+
+static void requeue_head(struct osmo_wqueue *queue, struct msgb *msg)
+{
+	llist_add(&msg->list, &queue->msg_queue);
+	queue->current_length += 1;
+}
+
+/*! Write the msgb and up to batch - 1 further queued ones with a single
+ *  writev(). The write queue frees the msgb it passed in, the others are
+ *  freed here. Whatever was not written is put back to the queue head.
+ *  \returns the number of bytes written or a negative errno, never
+ *  -EAGAIN as the unwritten data is queued again already
+ */
+int bsc_nat_link_write(struct bsc_nat_link *link, struct osmo_fd *bfd,
+		       struct msgb *msg, int batch)
+{
+	struct osmo_wqueue *queue = container_of(bfd, struct osmo_wqueue, bfd);
+	struct msgb *msgs[NAT_LINK_BATCH_MAX];
+	struct iovec iov[NAT_LINK_BATCH_MAX];
+	int i, cnt, rc, err, left;
+
+	batch = OSMO_MAX(1, OSMO_MIN(batch, NAT_LINK_BATCH_MAX));
+
+	msgs[0] = msg;
+	iov[0].iov_base = msg->data;
+	iov[0].iov_len = msg->len;
+	for (cnt = 1; cnt < batch && !llist_empty(&queue->msg_queue); ++cnt) {
+		msgs[cnt] = msgb_dequeue(&queue->msg_queue);
+		queue->current_length -= 1;
+		iov[cnt].iov_base = msgs[cnt]->data;
+		iov[cnt].iov_len = msgs[cnt]->len;
+	}
+
+	rc = writev(bfd->fd, iov, cnt);
+	err = rc < 0 ? errno : 0;
+	if (rc < 0 && err != EAGAIN)
+		LOGP(DNAT, LOGL_ERROR, "Failed to write to fd %d: %s\n",
+		     bfd->fd, strerror(err));
+
+	/* find the first msgb that was not written completely */
+	left = OSMO_MAX(rc, 0);
+	for (i = 0; i < cnt && left >= msgs[i]->len; ++i)
+		left -= msgs[i]->len;
+
+	if (rc > 0) {
+		link->tx_calls += 1;
+		link->tx_bytes += rc;
+		link->tx_msgs += i;
+	}
+
+	/* put the remainder back, last one first */
+	for (cnt = cnt - 1; cnt >= i && cnt > 0; --cnt) {
+		if (cnt == i)
+			msgb_pull(msgs[cnt], left);
+		requeue_head(queue, msgs[cnt]);
+	}
+
+	/*
+	 * The first msgb is freed by the caller, keep a copy of the rest.
+	 * It is queued already, so the caller must not see -EAGAIN.
+	 */
+	if (i == 0 && (rc >= 0 || err == EAGAIN)) {
+		struct msgb *rest = msgb_alloc(msg->len - left, "IPA rest");
+		if (rest) {
+			memcpy(msgb_put(rest, msg->len - left),
+			       msg->data + left, msg->len - left);
+			requeue_head(queue, rest);
+		}
+		if (rc < 0)
+			rc = err = 0;
+	}
+
+	for (cnt = 1; cnt < i; ++cnt)
+		msgb_free(msgs[cnt]);
+
+	if (!llist_empty(&queue->msg_queue))
+		bfd->when |= BSC_FD_WRITE;
+
+	return rc < 0 ? -err : rc;
+}
+
 static void extract_lac(const uint8_t *data, uint16_t *lac, uint16_t *ci)
 {
 	memcpy(lac, &data[0], sizeof(*lac));
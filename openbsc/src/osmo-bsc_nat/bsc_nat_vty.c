@@ -142,6 +142,7 @@ static int config_write_nat(struct vty *vty)
 	if (_nat->token)
 		vty_out(vty, " token %s%s", _nat->token, VTY_NEWLINE);
 	vty_out(vty, " ip-dscp %d%s", _nat->bsc_ip_dscp, VTY_NEWLINE);
+	vty_out(vty, " ipa-write-batch %d%s", _nat->write_batch, VTY_NEWLINE);
 	if (_nat->acc_lst_name)
 		vty_out(vty, " access-list-name %s%s", _nat->acc_lst_name, VTY_NEWLINE);
 	if (_nat->imsi_black_list_fn)
@@ -233,6 +234,26 @@ DEFUN(show_nat_bsc, show_nat_bsc_cmd, "show nat num-bscs-configured",
 	return CMD_SUCCESS;
 }
 
+static double per_call(uint64_t val, uint64_t calls)
+{
+	return calls ? (double) val / calls : 0.0;
+}
+
+static void dump_link_stats(struct vty *vty, const char *name,
+			    struct bsc_nat_link *link)
+{
+	vty_out(vty, " %s read: %"PRIu64" bytes, %"PRIu64" msgs, %"PRIu64
+		" syscalls (%.1f bytes/syscall, %.2f msgs/syscall)%s",
+		name, link->rx_bytes, link->rx_msgs, link->rx_calls,
+		per_call(link->rx_bytes, link->rx_calls),
+		per_call(link->rx_msgs, link->rx_calls), VTY_NEWLINE);
+	vty_out(vty, " %s write: %"PRIu64" bytes, %"PRIu64" msgs, %"PRIu64
+		" syscalls (%.1f bytes/syscall, %.2f msgs/syscall)%s",
+		name, link->tx_bytes, link->tx_msgs, link->tx_calls,
+		per_call(link->tx_bytes, link->tx_calls),
+		per_call(link->tx_msgs, link->tx_calls), VTY_NEWLINE);
+}
+
 DEFUN(show_bsc, show_bsc_cmd, "show bsc connections",
       SHOW_STR BSC_STR
       "All active connections\n")
@@ -248,6 +269,7 @@ DEFUN(show_bsc, show_bsc_cmd, "show bsc connections",
 			con->authenticated, con->write_queue.bfd.fd,
 			inet_ntoa(sock.sin_addr), con->pending_dlcx_count,
 			VTY_NEWLINE);
+		dump_link_stats(vty, "Link", &con->link);
 	}
 
 	return CMD_SUCCESS;
@@ -301,6 +323,10 @@ static void dump_stat_total(struct vty *vty, struct bsc_nat *nat)
 	vty_out(vty, " BSC Connections %lu total, %lu auth failed.%s",
 		osmo_counter_get(nat->stats.bsc.reconn),
 		osmo_counter_get(nat->stats.bsc.auth_fail), VTY_NEWLINE);
+	vty_out(vty, " SCCP forwarding %lu fast path, %lu slow path%s",
+		osmo_counter_get(nat->stats.fwd.fast),
+		osmo_counter_get(nat->stats.fwd.slow), VTY_NEWLINE);
+	dump_link_stats(vty, "MSC link", &nat->msc_link);
 }
 
 static void dump_bsc_status(struct vty *vty, struct bsc_config *conf)
@@ -509,6 +535,15 @@ DEFUN(cfg_nat_bsc_ip_dscp, cfg_nat_bsc_ip_dscp_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_nat_write_batch, cfg_nat_write_batch_cmd,
+      "ipa-write-batch <1-64>",
+      "Combine queued IPA messages into one write\n"
+      "Maximum number of messages per write\n")
+{
+	_nat->write_batch = atoi(argv[0]);
+	return CMD_SUCCESS;
+}
+
 ALIAS_DEPRECATED(cfg_nat_bsc_ip_dscp, cfg_nat_bsc_ip_tos_cmd,
       "ip-tos <0-255>",
       "Use ip-dscp in the future.\n" "Set the DSCP\n")
@@ -623,7 +658,7 @@ DEFUN(cfg_nat_no_imsi_black_list_fn,
 }
 
 static int replace_rules(struct bsc_nat *nat, char **name,
-			 struct llist_head *head, const char *file)
+			 struct bsc_nat_num_rewr *head, const char *file)
 {
 	struct osmo_config_list *rewr = NULL;
 
@@ -748,14 +783,30 @@ DEFUN(cfg_nat_no_sms_number_rewrite,
 	return CMD_SUCCESS;
 }
 
+static void prefix_trie_loaded(struct nat_rewrite *rewr, void *data)
+{
+	_nat->num_rewr_trie_loader = NULL;
+	if (!rewr) {
+		LOGP(DNAT, LOGL_ERROR,
+			"prefix-tree parsing has failed, keeping the old one.\n");
+		return;
+	}
+
+	/* replace it in one go, lookups never see a half loaded tree */
+	talloc_free(_nat->num_rewr_trie);
+	_nat->num_rewr_trie = rewr;
+	LOGP(DNAT, LOGL_NOTICE, "prefix-tree loaded %zu rules.\n",
+		rewr->prefixes);
+}
+
 DEFUN(cfg_nat_prefix_trie,
       cfg_nat_prefix_trie_cmd,
       "prefix-tree FILENAME",
       "Prefix tree for number rewriting\n" "File to load\n")
 {
-	/* give up the old data */
-	talloc_free(_nat->num_rewr_trie);
-	_nat->num_rewr_trie = NULL;
+	/* a load that is still running is for an old file */
+	talloc_free(_nat->num_rewr_trie_loader);
+	_nat->num_rewr_trie_loader = NULL;
 
 	/* replace the file name */
 	osmo_talloc_replace_string(_nat, &_nat->num_rewr_trie_name, argv[0]);
@@ -764,6 +815,30 @@ DEFUN(cfg_nat_prefix_trie,
 		return CMD_WARNING;
 	}
 
+	/*
+	 * Nothing is handled while the config file is read. Later the
+	 * tree is built in the background and the old one is used until
+	 * the new one is ready.
+	 */
+	if (vty->type != VTY_FILE) {
+		_nat->num_rewr_trie_loader = nat_rewrite_parse_bg(_nat,
+					_nat->num_rewr_trie_name,
+					prefix_trie_loaded, NULL);
+		if (!_nat->num_rewr_trie_loader) {
+			vty_out(vty, "%% prefix-tree loading could not be started.%s",
+				VTY_NEWLINE);
+			return CMD_WARNING;
+		}
+
+		vty_out(vty, "%% prefix-tree is loaded in the background.%s",
+			VTY_NEWLINE);
+		return CMD_SUCCESS;
+	}
+
+	/* give up the old data */
+	talloc_free(_nat->num_rewr_trie);
+	_nat->num_rewr_trie = NULL;
+
 	_nat->num_rewr_trie = nat_rewrite_parse(_nat, _nat->num_rewr_trie_name);
 	if (!_nat->num_rewr_trie) {
 		vty_out(vty, "%% prefix-tree parsing has failed.%s", VTY_NEWLINE);
@@ -779,6 +854,8 @@ DEFUN(cfg_nat_no_prefix_trie, cfg_nat_no_prefix_trie_cmd,
       "no prefix-tree",
       NO_STR "Prefix tree for number rewriting\n")
 {
+	talloc_free(_nat->num_rewr_trie_loader);
+	_nat->num_rewr_trie_loader = NULL;
 	talloc_free(_nat->num_rewr_trie);
 	_nat->num_rewr_trie = NULL;
 	talloc_free(_nat->num_rewr_trie_name);
@@ -1364,6 +1441,7 @@ int bsc_nat_vty_init(struct bsc_nat *nat)
 	install_element(NAT_NODE, &cfg_nat_token_cmd);
 	install_element(NAT_NODE, &cfg_nat_bsc_ip_dscp_cmd);
 	install_element(NAT_NODE, &cfg_nat_bsc_ip_tos_cmd);
+	install_element(NAT_NODE, &cfg_nat_write_batch_cmd);
 	install_element(NAT_NODE, &cfg_nat_acc_lst_name_cmd);
 	install_element(NAT_NODE, &cfg_nat_no_acc_lst_name_cmd);
 	install_element(NAT_NODE, &cfg_nat_include_cmd);
@@ -26,6 +26,7 @@
 #include <osmocom/sccp/sccp.h>
 
 #include <osmocom/core/talloc.h>
+#include <osmocom/gsm/protocol/gsm_08_08.h>
 
 #include <string.h>
 #include <time.h>
@@ -245,3 +246,111 @@ struct nat_sccp_connection *bsc_nat_find_con_by_bsc(struct bsc_nat *nat,
 
 	return NULL;
 }
+
+/*
+ * Fast path for established connections. Only the references of DT1,
+ * RLSD and RLC are looked at and patched inside the received msgb.
+ * Anything that still needs to be filtered, handed to USSD, rewritten
+ * or MGCP patched is left to the regular path and the msgb is not
+ * touched in that case.
+ */
+static int fast_path_to_msc_allowed(struct nat_sccp_connection *conn,
+				    struct bsc_nat_parsed *parsed)
+{
+	struct bsc_nat *nat = conn->bsc->nat;
+
+	if (conn->con_local != NAT_CON_END_MSC || !conn->msc_con)
+		return 0;
+
+	/* only DTAP is looked at by the filter, USSD and rewriting */
+	if (parsed->bssap != BSSAP_MSG_DTAP)
+		return 1;
+
+	if (!conn->filter_state.imsi_checked)
+		return 0;
+	if (conn->filter_state.con_type == FLT_CON_TYPE_SSA && nat->ussd_lst_name)
+		return 0;
+	if (bsc_nat_rewrite_configured(nat))
+		return 0;
+
+	return 1;
+}
+
+static int fast_path_to_bsc_allowed(struct nat_sccp_connection *conn,
+				    struct bsc_nat_parsed *parsed)
+{
+	if (conn->con_local != NAT_CON_END_MSC)
+		return 0;
+	if (!conn->bsc->authenticated)
+		return 0;
+
+	/* the authorization state is updated on the regular path */
+	if (!conn->authorized)
+		return 0;
+
+	if (parsed->bssap == BSSAP_MSG_BSS_MANAGEMENT &&
+	    parsed->gsm_type == BSS_MAP_MSG_ASSIGMENT_RQST)
+		return 0;
+
+	return 1;
+}
+
+struct nat_sccp_connection *bsc_nat_fast_path_to_msc(struct bsc_connection *bsc,
+						     struct msgb *msg,
+						     struct bsc_nat_parsed *parsed)
+{
+	struct nat_sccp_connection *conn;
+
+	if (!bsc->authenticated || !bsc->cfg)
+		return NULL;
+
+	if (bsc_nat_parse_fast(msg, parsed) != 0)
+		return NULL;
+
+	llist_for_each_entry(conn, &bsc->nat->sccp_connections, list_entry) {
+		if (conn->bsc != bsc)
+			continue;
+
+		if (parsed->src_local_ref) {
+			if (!equal(parsed->src_local_ref, &conn->real_ref))
+				continue;
+		} else if (!equal(parsed->dest_local_ref, &conn->remote_ref))
+			continue;
+
+		if (!fast_path_to_msc_allowed(conn, parsed))
+			return NULL;
+
+		if (parsed->src_local_ref)
+			*parsed->src_local_ref = conn->patched_ref;
+		return conn;
+	}
+
+	return NULL;
+}
+
+struct nat_sccp_connection *bsc_nat_fast_path_to_bsc(struct bsc_nat *nat,
+						     struct msgb *msg,
+						     struct bsc_nat_parsed *parsed)
+{
+	struct nat_sccp_connection *conn;
+
+	if (bsc_nat_parse_fast(msg, parsed) != 0)
+		return NULL;
+
+	/* the MSC is not supposed to send a RLC */
+	if (parsed->sccp_type == SCCP_MSG_TYPE_RLC)
+		return NULL;
+
+	llist_for_each_entry(conn, &nat->sccp_connections, list_entry) {
+		if (!equal(parsed->dest_local_ref, &conn->patched_ref))
+			continue;
+
+		if (!fast_path_to_bsc_allowed(conn, parsed))
+			return NULL;
+
+		*parsed->dest_local_ref = conn->real_ref;
+		return conn;
+	}
+
+	return NULL;
+}
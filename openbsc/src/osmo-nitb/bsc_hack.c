@@ -30,6 +30,7 @@
 #include <getopt.h>
 
 #include <openbsc/db.h>
+#include <openbsc/ctr_snapshot.h>
 #include <osmocom/core/application.h>
 #include <osmocom/core/select.h>
 #include <osmocom/core/stats.h>
@@ -65,10 +66,19 @@ extern const char *openbsc_copyright;
 static int daemonize = 0;
 static const char *mncc_sock_path = NULL;
 static int use_db_counter = 1;
+static const char *counter_csv_path = NULL;
+static FILE *counter_csv;
+static unsigned int counter_keep_days = 0;
+static unsigned int counter_rollup_days = 0;
 
 /* timer to store statistics */
 #define DB_SYNC_INTERVAL	60, 0
+/* old counters are trimmed once an hour, a bounded number of rows per go */
+#define DB_COUNTER_TRIM_INTERVAL	3600
+#define DB_COUNTER_TRIM_BATCH	1000
 #define EXPIRE_INTERVAL		10, 0
+/* keep going faster while there is a backlog */
+#define EXPIRE_BACKLOG_INTERVAL	1, 0
 
 static struct osmo_timer_list db_sync_timer;
 
@@ -106,6 +116,9 @@ static void print_help()
 	printf("  -M --mncc-sock-path PATH   Disable built-in MNCC handler and offer socket.\n");
 	printf("  -m --mncc-sock 	     Same as `-M /tmp/bsc_mncc' (deprecated).\n");
 	printf("  -C --no-dbcounter          Disable regular syncing of counters to database.\n");
+	printf("  -k --counter-keep DAYS     Remove counters older than DAYS from the database (0 keeps them).\n");
+	printf("  -R --counter-rollup DAYS   Keep only hourly counters older than DAYS in the database (0 keeps all).\n");
+	printf("  -S --counter-csv PATH      Append the counters to a CSV file as well.\n");
 	printf("  -r --rf-ctl PATH           A unix domain socket to listen for cmds.\n");
 	printf("  -p --pcap PATH             Write abis communication to pcap trace file.\n");
 }
@@ -129,11 +142,14 @@ static void handle_options(int argc, char **argv)
 			{"mncc-sock", 0, 0, 'm'},
 			{"mncc-sock-path", 1, 0, 'M'},
 			{"no-dbcounter", 0, 0, 'C'},
+			{"counter-keep", 1, 0, 'k'},
+			{"counter-rollup", 1, 0, 'R'},
+			{"counter-csv", 1, 0, 'S'},
 			{"rf-ctl", 1, 0, 'r'},
 			{0, 0, 0, 0}
 		};
 
-		c = getopt_long(argc, argv, "hd:Dsl:ar:p:TPVc:e:mCr:M:",
+		c = getopt_long(argc, argv, "hd:Dsl:ar:p:TPVc:e:mCk:R:S:r:M:",
 				long_options, &option_index);
 		if (c == -1)
 			break;
@@ -179,6 +195,15 @@ static void handle_options(int argc, char **argv)
 		case 'C':
 			use_db_counter = 0;
 			break;
+		case 'k':
+			counter_keep_days = atoi(optarg);
+			break;
+		case 'R':
+			counter_rollup_days = atoi(optarg);
+			break;
+		case 'S':
+			counter_csv_path = optarg;
+			break;
 		case 'V':
 			print_version(1);
 			exit(0);
@@ -225,22 +250,43 @@ static void signal_handler(int signal)
 }
 
 /* timer handling */
-static int _db_store_counter(struct osmo_counter *counter, void *data)
-{
-	return db_store_counter(counter);
-}
-
 static void db_sync_timer_cb(void *data)
 {
+	static struct ctr_snapshot snap;
+	static time_t last_trim;
+	int rc;
+
 	/* store counters to database and re-schedule */
-	osmo_counters_for_each(_db_store_counter, NULL);
+	if (ctr_snapshot_take(tall_bsc_ctx, &snap) == 0) {
+		if (use_db_counter)
+			db_store_ctr_snapshot(&snap);
+		if (counter_csv && ctr_snapshot_write_csv(&snap, counter_csv) < 0)
+			LOGP(DDB, LOGL_ERROR, "Failed to write the counters to %s\n",
+			     counter_csv_path);
+	}
+
+	/* nothing is removed unless asked for, a full batch means there is
+	 * more to do and we continue on the next sync instead of the hour */
+	if (use_db_counter && (counter_keep_days || counter_rollup_days)
+	    && snap.time - last_trim >= DB_COUNTER_TRIM_INTERVAL) {
+		rc = db_trim_counters(snap.time, counter_rollup_days * 24 * 3600,
+				      counter_keep_days * 24 * 3600,
+				      DB_COUNTER_TRIM_BATCH);
+		if (rc < DB_COUNTER_TRIM_BATCH)
+			last_trim = snap.time;
+	}
+
 	osmo_timer_schedule(&db_sync_timer, DB_SYNC_INTERVAL);
 }
 
 static void subscr_expire_cb(void *data)
 {
-	subscr_expire(bsc_gsmnet->subscr_group);
-	osmo_timer_schedule(&bsc_gsmnet->subscr_expire_timer, EXPIRE_INTERVAL);
+	if (subscr_expire(bsc_gsmnet->subscr_group) > 0)
+		osmo_timer_schedule(&bsc_gsmnet->subscr_expire_timer,
+				    EXPIRE_BACKLOG_INTERVAL);
+	else
+		osmo_timer_schedule(&bsc_gsmnet->subscr_expire_timer,
+				    EXPIRE_INTERVAL);
 }
 
 extern int bsc_vty_go_parent(struct vty *vty);
@@ -368,8 +414,16 @@ int main(int argc, char **argv)
 	printf("DB: Database prepared.\n");
 
 	/* setup the timer */
+	if (counter_csv_path) {
+		counter_csv = fopen(counter_csv_path, "a");
+		if (!counter_csv) {
+			perror("Failed to open the counter CSV file");
+			exit(1);
+		}
+	}
+
 	osmo_timer_setup(&db_sync_timer, db_sync_timer_cb, NULL);
-	if (use_db_counter)
+	if (use_db_counter || counter_csv)
 		osmo_timer_schedule(&db_sync_timer, DB_SYNC_INTERVAL);
 
 	osmo_timer_setup(&bsc_gsmnet->subscr_expire_timer, subscr_expire_cb,
@@ -0,0 +1,26 @@
+#ifndef _TESTS_BENCH_H
+#define _TESTS_BENCH_H
+
+#include <time.h>
+
+/*
+ * The benchmarks of the tests print their timings to stderr only, the
+ * testsuite compares stdout and the numbers differ from run to run.
+ */
+
+static inline void bench_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+/* wall clock time since bench_start() in microseconds */
+static inline double bench_elapsed_us(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000.0
+		+ (now.tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+#endif
@@ -26,7 +26,111 @@
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
 
+#include <osmocom/core/select.h>
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+struct bg_result {
+	int done;
+	struct nat_rewrite *trie;
+};
+
+static void bg_loaded(struct nat_rewrite *trie, void *data)
+{
+	struct bg_result *res = data;
+
+	res->done = 1;
+	res->trie = trie;
+}
+
+static void test_background_load(void)
+{
+	struct nat_rewrite_loader *loader;
+	struct bg_result res;
+
+	printf("Testing loading in the background\n");
+
+	memset(&res, 0, sizeof(res));
+	loader = nat_rewrite_parse_bg(NULL, "prefixes.csv", bg_loaded, &res);
+	OSMO_ASSERT(loader);
+	while (!res.done)
+		osmo_select_main(0);
+
+	OSMO_ASSERT(res.trie);
+	OSMO_ASSERT(res.trie->prefixes == 17);
+	nat_rewrite_dump(res.trie);
+	OSMO_ASSERT(strcmp(nat_rewrite_lookup(res.trie, "82345")->rewrite, "16") == 0);
+	OSMO_ASSERT(strcmp(nat_rewrite_lookup(res.trie, "+49123445")->rewrite, "17") == 0);
+	talloc_free(res.trie);
+
+	/* the file is missing */
+	memset(&res, 0, sizeof(res));
+	loader = nat_rewrite_parse_bg(NULL, "does_not_exist.csv", bg_loaded, &res);
+	OSMO_ASSERT(loader);
+	while (!res.done)
+		osmo_select_main(0);
+	OSMO_ASSERT(!res.trie);
+
+	/* cancel it before it is done */
+	memset(&res, 0, sizeof(res));
+	loader = nat_rewrite_parse_bg(NULL, "prefixes.csv", bg_loaded, &res);
+	OSMO_ASSERT(loader);
+	talloc_free(loader);
+	OSMO_ASSERT(!res.done);
+}
+
+#define MANY_PREFIXES	1000000
+#define LOOKUP_NUMBERS	4096
+
+static void test_many_prefixes(void)
+{
+	static char numbers[LOOKUP_NUMBERS][20];
+	static unsigned int expected[LOOKUP_NUMBERS];
+	struct nat_rewrite *trie;
+	FILE *file;
+	unsigned int i;
+
+	printf("Testing the trie with %d prefixes\n", MANY_PREFIXES);
+
+	/* ported numbers are spread over the whole range */
+	file = fopen("many_prefixes.csv", "w");
+	OSMO_ASSERT(file);
+	for (i = 0; i < MANY_PREFIXES; ++i)
+		fprintf(file, "491%08u,%u\n", (i * 37) % 100000000, i % 100000);
+	fclose(file);
+
+	trie = nat_rewrite_parse(NULL, "many_prefixes.csv");
+	unlink("many_prefixes.csv");
+
+	OSMO_ASSERT(trie);
+	OSMO_ASSERT(trie->prefixes == MANY_PREFIXES);
+	fprintf(stderr, "The trie has %zu nodes in %zu bytes\n",
+		trie->nodes, trie->image_len);
+	OSMO_ASSERT(trie->image_len < 64 * trie->prefixes);
+	printf("The trie uses less than 64 bytes per prefix\n");
+
+	for (i = 0; i < LOOKUP_NUMBERS; ++i) {
+		unsigned int rule = (i * 7919) % MANY_PREFIXES;
+
+		snprintf(numbers[i], sizeof(numbers[i]), "491%08u%04u",
+			 (rule * 37) % 100000000, i);
+		expected[i] = rule % 100000;
+	}
+
+	for (i = 0; i < LOOKUP_NUMBERS; ++i) {
+		const struct nat_rewrite_rule *rule;
+
+		rule = nat_rewrite_lookup(trie, numbers[i]);
+		OSMO_ASSERT(rule);
+		OSMO_ASSERT(atoi(rule->rewrite) == expected[i]);
+	}
+	printf("Found the rewrite of %d numbers\n", LOOKUP_NUMBERS);
+
+	talloc_free(trie);
+}
 
 int main(int argc, char **argv)
 {
@@ -82,6 +186,9 @@ int main(int argc, char **argv)
 	trie = nat_rewrite_parse(NULL, "does_not_exist.csv");
 	OSMO_ASSERT(!trie);
 
+	test_background_load();
+	test_many_prefixes();
+
 	printf("Done with the tests.\n");
 	return 0;
 }
@@ -25,6 +25,7 @@
 #include <openbsc/debug.h>
 #include <openbsc/gsm_data.h>
 #include <openbsc/bsc_nat.h>
+#include <openbsc/bsc_msc.h>
 #include <openbsc/bsc_nat_sccp.h>
 #include <openbsc/bsc_msg_filter.h>
 #include <openbsc/nat_rewrite_trie.h>
@@ -36,7 +37,12 @@
 #include <osmocom/sccp/sccp.h>
 #include <osmocom/gsm/protocol/gsm_08_08.h>
 
+#include <sys/socket.h>
+#include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
+
+#include "../bench.h"
 
 /* test messages for ipa */
 static uint8_t ipa_id[] = {
@@ -575,6 +581,23 @@ static void test_mgcp_ass_tracking(void)
 }
 
 /* test the code to find a given connection */
+/* assign the MSC endpoint of the CIC, the NAT picks the one of the BSC */
+static int assign_endp(struct nat_sccp_connection *con, int msc_endp)
+{
+	struct bsc_nat_parsed parsed;
+	struct msgb *msg;
+	uint16_t cic = htons(msc_endp);
+	int rc;
+
+	msg = msgb_alloc(4096, "assign");
+	copy_to_msg(msg, ass_cmd, sizeof(ass_cmd));
+	OSMO_ASSERT(bsc_nat_parse(msg, &parsed) == 0);
+	memcpy(&msg->l2h[16], &cic, sizeof(cic));
+	rc = bsc_mgcp_assign_patch(con, msg);
+	msgb_free(msg);
+	return rc;
+}
+
 static void test_mgcp_find(void)
 {
 	struct bsc_nat *nat;
@@ -584,7 +607,12 @@ static void test_mgcp_find(void)
 	printf("Testing finding of a BSC Connection\n");
 
 	nat = bsc_nat_alloc();
+	nat->bsc_endpoints = talloc_zero_array(nat, struct bsc_endpoint, 33);
+	nat->mgcp_cfg = mgcp_config_alloc();
+	nat->mgcp_cfg->trunk.number_endpoints = 32;
+	mgcp_endpoints_allocate(&nat->mgcp_cfg->trunk);
 	con = bsc_connection_alloc(nat);
+	con->cfg = bsc_config_alloc(nat, "foo", 0);
 	llist_add(&con->list_entry, &nat->bsc_connections);
 
 	sccp_con = talloc_zero(con, struct nat_sccp_connection);
@@ -592,6 +620,7 @@ static void test_mgcp_find(void)
 	sccp_con->bsc_endp = 12;
 	sccp_con->bsc = con;
 	llist_add(&sccp_con->list_entry, &nat->sccp_connections);
+	OSMO_ASSERT(assign_endp(sccp_con, 12) == 0);
 
 	if (bsc_mgcp_find_con(nat, 11) != NULL) {
 		printf("Found the wrong connection.\n");
@@ -607,6 +636,65 @@ static void test_mgcp_find(void)
 	bsc_nat_free(nat);
 }
 
+static void test_mgcp_endp_alloc(void)
+{
+	struct bsc_connection *bsc;
+	struct bsc_nat *nat;
+	struct nat_sccp_connection *cons[61];
+	int i, msc_endp, bsc_endp, first = -1;
+
+	printf("Testing MGCP endpoint allocation.\n");
+
+	nat = bsc_nat_alloc();
+	nat->bsc_endpoints = talloc_zero_array(nat, struct bsc_endpoint, 129);
+	nat->mgcp_cfg = mgcp_config_alloc();
+	nat->mgcp_cfg->trunk.number_endpoints = 128;
+	mgcp_endpoints_allocate(&nat->mgcp_cfg->trunk);
+
+	bsc = bsc_connection_alloc(nat);
+	bsc->cfg = bsc_config_alloc(nat, "foo", 0);
+	bsc->cfg->max_endpoints = 64;
+	bsc_config_add_lac(bsc->cfg, 2323);
+	bsc->last_endpoint = 0x22;
+
+	/* timeslot 0 and 31 can not be used, 60 are left */
+	msc_endp = 1;
+	for (i = 0; i < ARRAY_SIZE(cons); ++i) {
+		cons[i] = talloc_zero(nat, struct nat_sccp_connection);
+		cons[i]->bsc = bsc;
+		bsc_mgcp_init(cons[i]);
+		llist_add_tail(&cons[i]->list_entry, &nat->sccp_connections);
+
+		if (assign_endp(cons[i], msc_endp) != 0) {
+			printf("Failed to assign endpoint %d\n", i + 1);
+			break;
+		}
+		if (first == -1)
+			first = cons[i]->bsc_endp;
+		OSMO_ASSERT(bsc_mgcp_find_con(nat, msc_endp) == cons[i]);
+
+		msc_endp += (msc_endp % 32) == 30 ? 3 : 1;
+	}
+	printf("Assigned 0x%x to 0x%x\n", first, bsc->last_endpoint);
+
+	/* a freed endpoint is the only one left */
+	msc_endp = cons[10]->msc_endp;
+	bsc_mgcp_dlcx(cons[10]);
+	OSMO_ASSERT(bsc_mgcp_find_con(nat, msc_endp) == NULL);
+	OSMO_ASSERT(assign_endp(cons[60], msc_endp) == 0);
+	printf("Reassigned 0x%x\n", cons[60]->bsc_endp);
+
+	/* the MSC reuses an endpoint, the old connection is cleared */
+	bsc_endp = cons[20]->bsc_endp;
+	OSMO_ASSERT(assign_endp(cons[10], cons[20]->msc_endp) == 0);
+	OSMO_ASSERT(cons[20]->msc_endp == -1 && cons[20]->bsc_endp == -1);
+	OSMO_ASSERT(cons[10]->bsc_endp == bsc_endp);
+	OSMO_ASSERT(bsc_mgcp_find_con(nat, cons[10]->msc_endp) == cons[10]);
+
+	bsc_config_free(bsc->cfg);
+	bsc_nat_free(nat);
+}
+
 static void test_mgcp_rewrite(void)
 {
 	int i;
@@ -653,6 +741,54 @@ static void test_mgcp_rewrite(void)
 	}
 }
 
+static void test_mgcp_rewrite_input(void)
+{
+	static const char bad_audio[] = "200 1\r\nm=audio x RTP/AVP 98\r\n";
+	static const char no_avp[] = "200 1\r\nm=audio 4002 RTP/SAVP 98\r\n";
+	static const char crcx_osmux_patched[] = "CRCX 23265295 1e@mgw MGCP 1.0\nX-Osmux: 23\r\nC: 394b0439fb\r\nL: p:20, a:AMR, nt:IN\r\nM: recvonly\r\n";
+	struct msgb *output;
+	char *input;
+	int len;
+
+	printf("Testing MGCP rewriting of bounded input.\n");
+
+	/* only the given length is looked at and nothing is changed */
+	len = strlen(mdcx_resp);
+	input = malloc(len + sizeof(crcx));
+	memcpy(input, mdcx_resp, len);
+	memcpy(input + len, crcx, sizeof(crcx));
+	output = bsc_mgcp_rewrite(input, len, 0x1e, "10.0.0.23", 5555, -1,
+				  NULL, 1);
+	OSMO_ASSERT(output);
+	OSMO_ASSERT(msgb_l2len(output) == strlen(mdcx_resp_patched));
+	OSMO_ASSERT(memcmp(output->l2h, mdcx_resp_patched,
+			   msgb_l2len(output)) == 0);
+	OSMO_ASSERT(memcmp(input, mdcx_resp, len) == 0);
+	msgb_free(output);
+	free(input);
+
+	/* malformed audio lines are rejected */
+	input = strdup(bad_audio);
+	OSMO_ASSERT(!bsc_mgcp_rewrite(input, strlen(input), 0x1e, "10.0.0.23",
+				      5555, -1, NULL, 1));
+	free(input);
+	input = strdup(no_avp);
+	OSMO_ASSERT(!bsc_mgcp_rewrite(input, strlen(input), 0x1e, "10.0.0.23",
+				      5555, -1, NULL, 1));
+	free(input);
+
+	/* the Osmux CID follows the command */
+	input = strdup(crcx);
+	output = bsc_mgcp_rewrite(input, strlen(input), 0x1e, "10.0.0.23",
+				  5555, 23, NULL, 1);
+	OSMO_ASSERT(output);
+	OSMO_ASSERT(msgb_l2len(output) == strlen(crcx_osmux_patched));
+	OSMO_ASSERT(memcmp(output->l2h, crcx_osmux_patched,
+			   msgb_l2len(output)) == 0);
+	msgb_free(output);
+	free(input);
+}
+
 static void test_mgcp_parse(void)
 {
 	int code, ci;
@@ -1045,8 +1181,8 @@ static void test_setup_rewrite()
 		abort();
 	}
 
-	if (msg == out) {
-		printf("FAIL: The message should have changed\n");
+	if (msg != out) {
+		printf("FAIL: The message should have been patched in place\n");
 		abort();
 	}
 
@@ -1069,8 +1205,8 @@ static void test_setup_rewrite()
 		abort();
 	}
 
-	if (msg == out) {
-		printf("FAIL: The message should have changed\n");
+	if (msg != out) {
+		printf("FAIL: The message should have been patched in place\n");
 		abort();
 	}
 
@@ -1114,8 +1250,8 @@ static void test_setup_rewrite()
 		abort();
 	}
 
-	if (msg == out) {
-		printf("FAIL: The message should have changed %d\n", __LINE__);
+	if (msg != out) {
+		printf("FAIL: The message should have been patched in place %d\n", __LINE__);
 		abort();
 	}
 
@@ -1141,8 +1277,8 @@ static void test_setup_rewrite()
 		abort();
 	}
 
-	if (msg == out) {
-		printf("FAIL: The message should have changed %d\n", __LINE__);
+	if (msg != out) {
+		printf("FAIL: The message should have been patched in place %d\n", __LINE__);
 		abort();
 	}
 
@@ -1189,8 +1325,8 @@ static void test_setup_rewrite_prefix(void)
 		abort();
 	}
 
-	if (msg == out) {
-		printf("FAIL: The message should have changed\n");
+	if (msg != out) {
+		printf("FAIL: The message should have been patched in place\n");
 		abort();
 	}
 
@@ -1248,8 +1384,8 @@ static void test_setup_rewrite_post(void)
 		abort();
 	}
 
-	if (msg == out) {
-		printf("FAIL: The message should have changed\n");
+	if (msg != out) {
+		printf("FAIL: The message should have been patched in place\n");
 		abort();
 	}
 
@@ -1304,8 +1440,8 @@ static void test_sms_smsc_rewrite()
 	}
 
 	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
-	if (out == msg) {
-		printf("FAIL: This should have changed.\n");
+	if (out != msg) {
+		printf("FAIL: This should have been patched in place.\n");
 		abort();
 	}
 
@@ -1323,8 +1459,8 @@ static void test_sms_smsc_rewrite()
 	}
 
 	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
-	if (out == msg) {
-		printf("FAIL: This should have changed.\n");
+	if (out != msg) {
+		printf("FAIL: This should have been patched in place.\n");
 		abort();
 	}
 
@@ -1385,8 +1521,8 @@ static void test_sms_number_rewrite(void)
 	}
 
 	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
-	if (out == msg) {
-		printf("FAIL: This should have changed.\n");
+	if (out != msg) {
+		printf("FAIL: This should have been patched in place.\n");
 		abort();
 	}
 
@@ -1412,8 +1548,8 @@ static void test_sms_number_rewrite(void)
 	}
 
 	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
-	if (out == msg) {
-		printf("FAIL: This should have changed.\n");
+	if (out != msg) {
+		printf("FAIL: This should have been patched in place.\n");
 		abort();
 	}
 
@@ -1423,6 +1559,98 @@ static void test_sms_number_rewrite(void)
 	bsc_nat_free(nat);
 }
 
+static void test_setup_rewrite_copy(void)
+{
+	struct msgb *msg, *out;
+	struct bsc_nat_parsed parsed;
+	struct bsc_nat_link link;
+	int sv[2], i, rc;
+	const char *imsi = "27408000001234";
+
+	struct bsc_nat *nat = bsc_nat_alloc();
+
+	/* a fake list */
+	struct osmo_config_list entries;
+	struct osmo_config_entry entry;
+
+	INIT_LLIST_HEAD(&entries.entry);
+	entry.mcc = "274";
+	entry.mnc = "08";
+	entry.option = "^0([1-9])";
+	entry.text = "0049";
+	llist_add_tail(&entry.list, &entries.entry);
+	bsc_nat_num_rewr_entry_adapt(nat, &nat->num_rewr, &entries);
+
+	printf("Testing SETUP rewriting without tailroom.\n");
+
+	/* the number grows and there is no room to do it in place */
+	msg = msgb_alloc(ARRAY_SIZE(cc_setup_national), "no tailroom");
+	copy_to_msg(msg, cc_setup_national, ARRAY_SIZE(cc_setup_national));
+	if (bsc_nat_parse(msg, &parsed) < 0) {
+		printf("FAIL: Could not parse SETUP\n");
+		abort();
+	}
+
+	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
+	if (out == msg) {
+		printf("FAIL: A new message should be created.\n");
+		abort();
+	}
+
+	verify_msg(out, cc_setup_national_patched, ARRAY_SIZE(cc_setup_national_patched));
+	msgb_free(out);
+
+	/* frames of the link are copied once, the next one stays intact */
+	OSMO_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	OSMO_ASSERT(bsc_nat_link_init(NULL, &link) == 0);
+	for (i = 0; i < 2; ++i)
+		OSMO_ASSERT(write(sv[0], cc_setup_national, ARRAY_SIZE(cc_setup_national))
+			    == ARRAY_SIZE(cc_setup_national));
+	OSMO_ASSERT(bsc_nat_link_read(&link, sv[1]) == 2 * ARRAY_SIZE(cc_setup_national));
+
+	msg = bsc_nat_link_dequeue(&link, &rc);
+	OSMO_ASSERT(msg && rc == 0);
+	if (bsc_nat_parse(msg, &parsed) < 0) {
+		printf("FAIL: Could not parse SETUP\n");
+		abort();
+	}
+
+	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
+	OSMO_ASSERT(out && out != msg);
+	OSMO_ASSERT(msgb_tailroom(out) == 0);
+	verify_msg(out, cc_setup_national_patched, ARRAY_SIZE(cc_setup_national_patched));
+	msgb_free(out);
+
+	msg = bsc_nat_link_dequeue(&link, &rc);
+	OSMO_ASSERT(msg && rc == 0);
+	verify_msg(msg, cc_setup_national, ARRAY_SIZE(cc_setup_national));
+	msgb_free(msg);
+	close(sv[0]);
+	close(sv[1]);
+	bsc_nat_link_free(&link);
+
+	/* going back to the old length fits again */
+	entry.option = "^\\+49([1-9])";
+	entry.text = "0";
+	bsc_nat_num_rewr_entry_adapt(nat, &nat->num_rewr, &entries);
+	msg = msgb_alloc(ARRAY_SIZE(cc_setup_national_patched), "no tailroom");
+	copy_to_msg(msg, cc_setup_national_patched, ARRAY_SIZE(cc_setup_national_patched));
+	if (bsc_nat_parse(msg, &parsed) < 0) {
+		printf("FAIL: Could not parse SETUP\n");
+		abort();
+	}
+
+	out = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
+	if (out != msg) {
+		printf("FAIL: The message should have been patched in place\n");
+		abort();
+	}
+
+	verify_msg(out, cc_setup_national, ARRAY_SIZE(cc_setup_national));
+	msgb_free(out);
+	bsc_nat_free(nat);
+}
+
 static void test_barr_list_parsing(void)
 {
 	int rc;
@@ -1525,6 +1753,359 @@ static void test_nat_extract_lac()
 	bsc_nat_free(nat);
 }
 
+static void patch_ref(uint8_t *data, struct sccp_source_reference *ref)
+{
+	memcpy(data, ref, sizeof(*ref));
+}
+
+#define FIND_ROUNDS 100000
+
+static void test_mgcp_find_scaling(void)
+{
+	struct bsc_connection *bsc;
+	struct bsc_nat *nat;
+	struct nat_sccp_connection *con;
+	struct timespec start;
+	const int sizes[] = { 1000, 10000, 50000 };
+	int i, j, num = 0, endp;
+
+	printf("Testing MGCP connection lookup scaling.\n");
+
+	nat = bsc_nat_alloc();
+	nat->bsc_endpoints = talloc_zero_array(nat, struct bsc_endpoint, 1025);
+	bsc = bsc_connection_alloc(nat);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); ++i) {
+		/* every tenth connection has audio */
+		for (; num < sizes[i]; ++num) {
+			con = talloc_zero(nat, struct nat_sccp_connection);
+			con->bsc = bsc;
+			bsc_mgcp_init(con);
+			llist_add_tail(&con->list_entry, &nat->sccp_connections);
+
+			endp = 1 + (num / 10) % 1024;
+			if (num % 10 == 0 && !nat->bsc_endpoints[endp].con) {
+				con->msc_endp = endp;
+				nat->bsc_endpoints[endp].con = con;
+			}
+		}
+
+		bench_start(&start);
+		for (j = 0; j < FIND_ROUNDS; ++j)
+			OSMO_ASSERT(bsc_mgcp_find_con(nat, 1 + j % 100));
+		fprintf(stderr, "Lookup with %d connections: %.1f ns\n",
+			num, bench_elapsed_us(&start) * 1000.0 / FIND_ROUNDS);
+		printf("Found the endpoints with %d connections.\n", num);
+	}
+
+	bsc_nat_free(nat);
+}
+
+static void test_setup_rewrite_scaling(void)
+{
+	const int sizes[] = { 10, 1000, 10000 };
+	const char *imsi = "27408000001234";
+	struct osmo_config_list entries;
+	struct osmo_config_entry *entry, *tmp;
+	struct bsc_nat_parsed parsed;
+	struct bsc_nat *nat;
+	struct msgb *msg;
+	int i, j;
+
+	printf("Testing SETUP rewriting with many rules.\n");
+
+	nat = bsc_nat_alloc();
+	for (i = 0; i < ARRAY_SIZE(sizes); ++i) {
+		INIT_LLIST_HEAD(&entries.entry);
+
+		/* rules for other networks in front of the matching one */
+		for (j = 0; j < sizes[i]; ++j) {
+			entry = talloc_zero(nat, struct osmo_config_entry);
+			if (j == sizes[i] - 1) {
+				entry->mcc = "274";
+				entry->mnc = "08";
+			} else {
+				entry->mcc = talloc_asprintf(entry, "%03d", 300 + j / 100);
+				entry->mnc = talloc_asprintf(entry, "%02d", j % 100);
+			}
+			entry->option = "^0([1-9])";
+			entry->text = "0049";
+			llist_add_tail(&entry->list, &entries.entry);
+		}
+		bsc_nat_num_rewr_entry_adapt(nat, &nat->num_rewr, &entries);
+
+		msg = msgb_alloc(4096, "setup");
+		copy_to_msg(msg, cc_setup_national, ARRAY_SIZE(cc_setup_national));
+		OSMO_ASSERT(bsc_nat_parse(msg, &parsed) == 0);
+		msg = bsc_nat_rewrite_msg(nat, msg, &parsed, imsi);
+		OSMO_ASSERT(msg->len == ARRAY_SIZE(cc_setup_national_patched));
+		msgb_free(msg);
+		printf("Rewrote the SETUP with %d rules.\n", sizes[i]);
+
+		llist_for_each_entry_safe(entry, tmp, &entries.entry, list) {
+			llist_del(&entry->list);
+			talloc_free(entry);
+		}
+	}
+
+	bsc_nat_free(nat);
+}
+
+#define REWRITE_ROUNDS 100000
+
+static void test_mgcp_rewrite_speed(void)
+{
+	struct timespec start;
+	struct msgb *output;
+	double us;
+	int i, len = strlen(mdcx);
+
+	printf("Testing MGCP rewriting speed.\n");
+
+	bench_start(&start);
+	for (i = 0; i < REWRITE_ROUNDS; ++i) {
+		output = bsc_mgcp_rewrite(mdcx, len, 0x1e, "10.0.0.23",
+					  6666, -1, NULL, 1);
+		OSMO_ASSERT(output);
+		msgb_free(output);
+	}
+	us = bench_elapsed_us(&start);
+
+	fprintf(stderr, "Rewrote %d MDCX: %.0f msg/s %.1f MB/s\n",
+		REWRITE_ROUNDS, REWRITE_ROUNDS / us * 1000000.0,
+		REWRITE_ROUNDS * (double) len / us);
+}
+
+#define FAST_PATH_ROUNDS 100000
+
+static void test_fast_path(void)
+{
+	struct bsc_nat *nat;
+	struct bsc_connection *con;
+	struct nat_sccp_connection *con_found, *rc_con;
+	struct bsc_nat_parsed parsed;
+	struct timespec start;
+	uint8_t ref_msg[sizeof(bsc_rlc)];
+	struct msgb *msg, *copy;
+	double fast_us, slow_us;
+	int i;
+
+	printf("Testing the SCCP fast path.\n");
+	nat = bsc_nat_alloc();
+	con = bsc_connection_alloc(nat);
+	con->cfg = bsc_config_alloc(nat, "foo", 0);
+	con->authenticated = 1;
+	msg = msgb_alloc(4096, "test");
+
+	/* create and confirm a connection */
+	copy_to_msg(msg, bsc_cr, sizeof(bsc_cr));
+	OSMO_ASSERT(bsc_nat_parse(msg, &parsed) == 0);
+	rc_con = create_sccp_src_ref(con, &parsed);
+	OSMO_ASSERT(rc_con);
+	rc_con->msc_con = talloc_zero(nat, struct bsc_msc_connection);
+
+	copy_to_msg(msg, msc_cc, sizeof(msc_cc));
+	patch_ref(&msg->data[4], &rc_con->patched_ref);
+	OSMO_ASSERT(bsc_nat_parse(msg, &parsed) == 0);
+	con_found = patch_sccp_src_ref_to_bsc(msg, &parsed, nat);
+	OSMO_ASSERT(con_found == rc_con);
+	OSMO_ASSERT(update_sccp_src_ref(con_found, &parsed) == 0);
+
+	/* not authorized yet, this must use the regular path */
+	copy_to_msg(msg, msc_dtap, sizeof(msc_dtap));
+	patch_ref(&msg->data[4], &rc_con->patched_ref);
+	OSMO_ASSERT(!bsc_nat_fast_path_to_bsc(nat, msg, &parsed));
+	OSMO_ASSERT(memcmp(&msg->data[4], &rc_con->patched_ref, 3) == 0);
+	rc_con->authorized = 1;
+	rc_con->filter_state.imsi_checked = 1;
+
+	/* data in both directions */
+	copy_to_msg(msg, bsc_dtap, sizeof(bsc_dtap));
+	con_found = bsc_nat_fast_path_to_msc(con, msg, &parsed);
+	VERIFY(con_found, con, msg, bsc_dtap_patched, "BSC DTAP");
+
+	copy_to_msg(msg, msc_dtap, sizeof(msc_dtap));
+	patch_ref(&msg->data[4], &rc_con->patched_ref);
+	con_found = bsc_nat_fast_path_to_bsc(nat, msg, &parsed);
+	VERIFY(con_found, con, msg, msc_dtap_patched, "MSC DTAP");
+
+	/* an assignment needs MGCP handling */
+	copy_to_msg(msg, ass_cmd, sizeof(ass_cmd));
+	patch_ref(&msg->data[4], &rc_con->patched_ref);
+	OSMO_ASSERT(!bsc_nat_fast_path_to_bsc(nat, msg, &parsed));
+
+	/* a CC is never handled by the fast path */
+	copy_to_msg(msg, msc_cc, sizeof(msc_cc));
+	OSMO_ASSERT(!bsc_nat_fast_path_to_bsc(nat, msg, &parsed));
+
+	/* measure the forwarding towards the BSC */
+	copy = msgb_alloc(4096, "test");
+	copy_to_msg(copy, msc_dtap, sizeof(msc_dtap));
+	patch_ref(&copy->data[4], &rc_con->patched_ref);
+
+	bench_start(&start);
+	for (i = 0; i < FAST_PATH_ROUNDS; ++i) {
+		struct msgb *out;
+
+		copy_to_msg(msg, copy->data, copy->len);
+		OSMO_ASSERT(bsc_nat_parse(msg, &parsed) == 0);
+		OSMO_ASSERT(patch_sccp_src_ref_to_bsc(msg, &parsed, nat));
+		out = msgb_alloc_headroom(4096, 128, "to-bsc");
+		out->l2h = msgb_put(out, msgb_l2len(msg));
+		memcpy(out->l2h, msg->l2h, msgb_l2len(msg));
+		msgb_free(out);
+	}
+	slow_us = bench_elapsed_us(&start);
+
+	bench_start(&start);
+	for (i = 0; i < FAST_PATH_ROUNDS; ++i) {
+		copy_to_msg(msg, copy->data, copy->len);
+		OSMO_ASSERT(bsc_nat_fast_path_to_bsc(nat, msg, &parsed));
+	}
+	fast_us = bench_elapsed_us(&start);
+	msgb_free(copy);
+
+	fprintf(stderr, "Forwarding %d DT1: slow %.0f msg/s fast %.0f msg/s\n",
+		FAST_PATH_ROUNDS, FAST_PATH_ROUNDS / slow_us * 1000000.0,
+		FAST_PATH_ROUNDS / fast_us * 1000000.0);
+
+	/* release the connection */
+	copy_to_msg(msg, msc_rlsd, sizeof(msc_rlsd));
+	patch_ref(&msg->data[4], &rc_con->patched_ref);
+	con_found = bsc_nat_fast_path_to_bsc(nat, msg, &parsed);
+	VERIFY(con_found, con, msg, msc_rlsd_patched, "MSC RLSD");
+
+	memcpy(ref_msg, bsc_rlc_patched, sizeof(ref_msg));
+	patch_ref(&ref_msg[7], &rc_con->patched_ref);
+	copy_to_msg(msg, bsc_rlc, sizeof(bsc_rlc));
+	con_found = bsc_nat_fast_path_to_msc(con, msg, &parsed);
+	VERIFY(con_found, con, msg, ref_msg, "BSC RLC");
+	sccp_connection_destroy(con_found);
+
+	copy_to_msg(msg, bsc_rlc, sizeof(bsc_rlc));
+	OSMO_ASSERT(!bsc_nat_fast_path_to_msc(con, msg, &parsed));
+
+	bsc_config_free(con->cfg);
+	bsc_nat_free(nat);
+	msgb_free(msg);
+}
+
+static struct msgb *link_msg(const uint8_t *data, unsigned int len)
+{
+	struct msgb *msg = msgb_alloc(4096, "test");
+	memcpy(msgb_put(msg, len), data, len);
+	return msg;
+}
+
+static void test_link_batching(void)
+{
+	static const uint8_t huge[] = { 0xff, 0xff, 0xfe };
+	struct bsc_nat_link tx_link, rx_link;
+	struct osmo_wqueue queue;
+	struct msgb *msg, *msgs[4];
+	uint8_t big[3 * NAT_LINK_RX_SIZE / 2];
+	int sv[2], rc, frames;
+
+	printf("Testing batched IPA link I/O.\n");
+	OSMO_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	OSMO_ASSERT(bsc_nat_link_init(NULL, &tx_link) == 0);
+	OSMO_ASSERT(bsc_nat_link_init(NULL, &rx_link) == 0);
+
+	/* three queued messages leave with one writev */
+	osmo_wqueue_init(&queue, 10);
+	queue.bfd.fd = sv[0];
+	osmo_wqueue_enqueue(&queue, link_msg(bsc_dtap, sizeof(bsc_dtap)));
+	osmo_wqueue_enqueue(&queue, link_msg(msc_dtap, sizeof(msc_dtap)));
+	osmo_wqueue_enqueue(&queue, link_msg(bsc_rlc, sizeof(bsc_rlc)));
+
+	msg = msgb_dequeue(&queue.msg_queue);
+	queue.current_length -= 1;
+	rc = bsc_nat_link_write(&tx_link, &queue.bfd, msg, NAT_LINK_BATCH_DEFAULT);
+	msgb_free(msg);
+	OSMO_ASSERT(rc == sizeof(bsc_dtap) + sizeof(msc_dtap) + sizeof(bsc_rlc));
+	OSMO_ASSERT(llist_empty(&queue.msg_queue));
+	OSMO_ASSERT(queue.current_length == 0);
+	printf("Wrote %llu msgs with %llu syscalls\n",
+		(unsigned long long) tx_link.tx_msgs,
+		(unsigned long long) tx_link.tx_calls);
+
+	/* and are parsed from one read, without copying them */
+	OSMO_ASSERT(bsc_nat_link_read(&rx_link, sv[1]) == rc);
+	frames = 0;
+	while ((msgs[frames] = bsc_nat_link_dequeue(&rx_link, &rc))) {
+		msg = msgs[frames++];
+		OSMO_ASSERT(msg->l2h == msg->data + 3);
+		OSMO_ASSERT(msg->data >= rx_link.rx_data
+			    && msg->tail <= rx_link.rx_data + NAT_LINK_RX_SIZE);
+	}
+	OSMO_ASSERT(rc == 0);
+	OSMO_ASSERT(frames == 3);
+	printf("Read %d frames with %llu syscalls\n", frames,
+		(unsigned long long) rx_link.rx_calls);
+
+	/* the frames stay intact while the next ones are read */
+	OSMO_ASSERT(write(sv[0], bsc_rlc, sizeof(bsc_rlc)) == sizeof(bsc_rlc));
+	OSMO_ASSERT(bsc_nat_link_read(&rx_link, sv[1]) == sizeof(bsc_rlc));
+	msg = bsc_nat_link_dequeue(&rx_link, &rc);
+	OSMO_ASSERT(msg);
+	verify_msg(msg, bsc_rlc, sizeof(bsc_rlc));
+	msgb_free(msg);
+	verify_msg(msgs[0], bsc_dtap, sizeof(bsc_dtap));
+	verify_msg(msgs[1], msc_dtap, sizeof(msc_dtap));
+	verify_msg(msgs[2], bsc_rlc, sizeof(bsc_rlc));
+	while (frames > 0)
+		msgb_free(msgs[--frames]);
+
+	/* a frame split across two reads */
+	OSMO_ASSERT(write(sv[0], msc_dtap, 5) == 5);
+	OSMO_ASSERT(bsc_nat_link_read(&rx_link, sv[1]) == 5);
+	OSMO_ASSERT(!bsc_nat_link_dequeue(&rx_link, &rc) && rc == 0);
+	OSMO_ASSERT(write(sv[0], &msc_dtap[5], sizeof(msc_dtap) - 5) == sizeof(msc_dtap) - 5);
+	OSMO_ASSERT(bsc_nat_link_read(&rx_link, sv[1]) == sizeof(msc_dtap) - 5);
+	msg = bsc_nat_link_dequeue(&rx_link, &rc);
+	OSMO_ASSERT(msg);
+	verify_msg(msg, msc_dtap, sizeof(msc_dtap));
+	msgb_free(msg);
+	OSMO_ASSERT(!bsc_nat_link_dequeue(&rx_link, &rc) && rc == 0);
+	OSMO_ASSERT(rx_link.rx_len == 0);
+
+	/* a frame larger than the receive buffer is read on its own */
+	memset(big, 0x23, sizeof(big));
+	big[0] = (sizeof(big) - 3) >> 8;
+	big[1] = (sizeof(big) - 3) & 0xff;
+	big[2] = 0xfe;
+	OSMO_ASSERT(write(sv[0], msc_dtap, sizeof(msc_dtap)) == sizeof(msc_dtap));
+	OSMO_ASSERT(write(sv[0], big, sizeof(big)) == sizeof(big));
+	frames = 0;
+	while (frames < 2) {
+		OSMO_ASSERT(bsc_nat_link_read(&rx_link, sv[1]) > 0);
+		while ((msg = bsc_nat_link_dequeue(&rx_link, &rc))) {
+			if (frames++ == 0)
+				verify_msg(msg, msc_dtap, sizeof(msc_dtap));
+			else
+				verify_msg(msg, big, sizeof(big));
+			msgb_free(msg);
+		}
+		OSMO_ASSERT(rc == 0);
+	}
+	OSMO_ASSERT(!rx_link.rx_big && rx_link.rx_len == 0);
+	printf("Read a frame of %zu bytes\n", sizeof(big));
+
+	/* a frame too large for a msgb is refused */
+	OSMO_ASSERT(write(sv[0], huge, sizeof(huge)) == sizeof(huge));
+	OSMO_ASSERT(bsc_nat_link_read(&rx_link, sv[1]) == sizeof(huge));
+	OSMO_ASSERT(!bsc_nat_link_dequeue(&rx_link, &rc));
+	OSMO_ASSERT(rc == -EMSGSIZE && !rx_link.rx_big);
+	bsc_nat_link_reset(&rx_link);
+	OSMO_ASSERT(rx_link.rx_len == 0);
+	printf("Refused a frame of %d bytes\n", 3 + 0xffff);
+
+	close(sv[0]);
+	close(sv[1]);
+	bsc_nat_link_free(&tx_link);
+	bsc_nat_link_free(&rx_link);
+}
+
 int main(int argc, char **argv)
 {
 	msgb_talloc_ctx_init(NULL, 0);
@@ -1536,7 +2117,9 @@ int main(int argc, char **argv)
 	test_paging();
 	test_mgcp_ass_tracking();
 	test_mgcp_find();
+	test_mgcp_endp_alloc();
 	test_mgcp_rewrite();
+	test_mgcp_rewrite_input();
 	test_mgcp_parse();
 	test_cr_filter();
 	test_dt_filter();
@@ -1545,9 +2128,15 @@ int main(int argc, char **argv)
 	test_setup_rewrite_post();
 	test_sms_smsc_rewrite();
 	test_sms_number_rewrite();
+	test_setup_rewrite_copy();
 	test_mgcp_allocations();
 	test_barr_list_parsing();
 	test_nat_extract_lac();
+	test_fast_path();
+	test_mgcp_find_scaling();
+	test_mgcp_rewrite_speed();
+	test_setup_rewrite_scaling();
+	test_link_batching();
 
 	printf("Testing execution completed.\n");
 	return 0;
@@ -31,13 +31,21 @@
 #include <openbsc/bsc_msc_data.h>
 #include <openbsc/gsm_04_80.h>
 #include <openbsc/gsm_subscriber.h>
+#include <openbsc/bsc_subscriber.h>
+#include <openbsc/osmo_bsc_rf.h>
+#include <openbsc/paging.h>
 
 #include <osmocom/core/application.h>
 #include <osmocom/core/backtrace.h>
 #include <osmocom/core/talloc.h>
+#include <osmocom/gsm/gsm48.h>
+#include <osmocom/gsm/protocol/gsm_08_08.h>
 
 #include <stdio.h>
 #include <search.h>
+#include <inttypes.h>
+
+#include "../bench.h"
 
 enum test {
 	TEST_SCAN_TO_BTS,
@@ -196,6 +204,258 @@ out:
 	talloc_free(net);
 }
 
+#define PAGING_SUBSCRIBERS	100000
+#define PAGING_PAGED		20000
+#define PAGING_ROUNDS		10
+#define PAGING_NUM_BTS		4
+
+static struct msgb *create_paging(const char *imsi, const uint8_t *cil,
+				  uint8_t cil_len)
+{
+	struct bssmap_header *bs;
+	struct msgb *msg;
+	uint8_t mi[GSM48_MI_SIZE + 2];
+	int mi_len;
+
+	msg = msgb_alloc(256, "paging");
+	msg->l3h = msgb_put(msg, sizeof(*bs));
+	msgb_v_put(msg, BSS_MAP_MSG_PAGING);
+
+	/* skip the 04.08 IEI and length */
+	mi_len = gsm48_generate_mid_from_imsi(mi, imsi);
+	msgb_tlv_put(msg, GSM0808_IE_IMSI, mi_len - 2, mi + 2);
+	msgb_tlv_put(msg, GSM0808_IE_CELL_IDENTIFIER_LIST, cil_len, cil);
+
+	bs = (struct bssmap_header *) msg->l3h;
+	bs->type = BSSAP_MSG_BSS_MANAGEMENT;
+	bs->length = msgb_l3len(msg) - sizeof(*bs);
+	return msg;
+}
+
+static struct msgb *create_paging_lac(const char *imsi, uint16_t lac)
+{
+	uint8_t cil[3];
+
+	cil[0] = CELL_IDENT_LAC;
+	osmo_store16be(lac, &cil[1]);
+	return create_paging(imsi, cil, sizeof(cil));
+}
+
+/* BTS 0 and 1 in LAC 1, BTS 2 and 3 in LAC 2, the CI is nr + 1 */
+static struct gsm_network *paging_net_alloc(struct bsc_msc_data **msc_out)
+{
+	struct gsm_network *net;
+	struct bsc_msc_data *msc;
+	struct gsm_bts *bts;
+	int i;
+
+	net = talloc_zero(NULL, struct gsm_network);
+	INIT_LLIST_HEAD(&net->bts_list);
+	net->plmn = (struct osmo_plmn_id){ .mcc = 901, .mnc = 70 };
+	net->bsc_subscribers = bsc_subscr_list_alloc(net);
+	net->bsc_ctrs = rate_ctr_group_alloc(net, &bsc_ctrg_desc, 0);
+	net->T3113 = 60;
+	net->bsc_data = talloc_zero(net, struct osmo_bsc_data);
+	net->bsc_data->rf_ctrl = talloc_zero(net, struct osmo_bsc_rf);
+	net->bsc_data->rf_ctrl->policy = S_RF_ON;
+
+	for (i = 0; i < PAGING_NUM_BTS; i++) {
+		bts = talloc_zero(net, struct gsm_bts);
+		bts->network = net;
+		bts->nr = i;
+		bts->location_area_code = 1 + i / 2;
+		bts->cell_identity = 1 + i;
+		bts->c0 = talloc_zero(bts, struct gsm_bts_trx);
+		bts->c0->bts = bts;
+		llist_add_tail(&bts->list, &net->bts_list);
+		net->num_bts++;
+	}
+
+	msc = talloc_zero(net, struct bsc_msc_data);
+	msc->network = net;
+	msc->core_plmn.mcc = GSM_MCC_MNC_INVALID;
+	msc->core_plmn.mnc = GSM_MCC_MNC_INVALID;
+	msc->core_lac = -1;
+	msc->core_ci = -1;
+
+	*msc_out = msc;
+	return net;
+}
+
+static void paging_net_free(struct gsm_network *net)
+{
+	struct bsc_subscr *bsub, *tmp;
+	struct gsm_bts *bts;
+
+	/* the timers must be gone before the free */
+	llist_for_each_entry(bsub, net->bsc_subscribers, entry)
+		paging_request_stop(&net->bts_list, NULL, bsub, NULL, NULL);
+	llist_for_each_entry(bts, &net->bts_list, list)
+		osmo_timer_del(&bts->paging.work_timer);
+
+	/* osmo-bsc never forgets a subscriber, drop them by hand */
+	llist_for_each_entry_safe(bsub, tmp, net->bsc_subscribers, entry) {
+		int use_count = bsub->use_count;
+
+		OSMO_ASSERT(llist_empty(&bsub->paging_requests));
+		while (use_count--)
+			bsc_subscr_put(bsub);
+	}
+	OSMO_ASSERT(llist_empty(net->bsc_subscribers));
+
+	talloc_free(net);
+}
+
+static void test_paging_load(void)
+{
+	struct gsm_network *net;
+	struct bsc_msc_data *msc;
+	struct gsm_bts *bts;
+	struct bsc_subscr *bsub;
+	struct msgb **msgs;
+	struct timespec start;
+	char imsi[GSM23003_IMSI_MAX_DIGITS + 1];
+	unsigned int pending = 0;
+	double elapsed;
+	int i, round;
+
+	printf("Testing paging with %d known subscribers.\n", PAGING_SUBSCRIBERS);
+
+	net = paging_net_alloc(&msc);
+
+	/* subscribers the BSC got to know from earlier paging */
+	for (i = 0; i < PAGING_SUBSCRIBERS; i++) {
+		snprintf(imsi, sizeof(imsi), "90170%010d", i);
+		bsub = bsc_subscr_find_or_create_by_imsi(net->bsc_subscribers, imsi);
+		OSMO_ASSERT(bsub);
+	}
+	OSMO_ASSERT(llist_count(net->bsc_subscribers) == PAGING_SUBSCRIBERS);
+
+	/* page a spread of them, the MSC repeats every PAGING */
+	msgs = talloc_array(net, struct msgb *, PAGING_PAGED);
+	for (i = 0; i < PAGING_PAGED; i++) {
+		int nr = (i * 7919) % PAGING_SUBSCRIBERS;
+
+		snprintf(imsi, sizeof(imsi), "90170%010d", nr);
+		msgs[i] = create_paging_lac(imsi, 1 + i % 2);
+	}
+
+	bench_start(&start);
+	for (round = 0; round < PAGING_ROUNDS; round++) {
+		for (i = 0; i < PAGING_PAGED; i++) {
+			struct msgb *msg = msgs[i];
+
+			/* the handler moves l4h, the content stays intact */
+			bsc_handle_udt(msc, msg, msgb_l3len(msg));
+		}
+	}
+
+	elapsed = bench_elapsed_us(&start) / 1e6;
+	fprintf(stderr, "Handled %d PAGING in %.3f s (%.0f per second)\n",
+		PAGING_PAGED * PAGING_ROUNDS, elapsed,
+		PAGING_PAGED * PAGING_ROUNDS / (elapsed > 0 ? elapsed : 1e-9));
+
+	llist_for_each_entry(bts, &net->bts_list, list)
+		pending += paging_pending_requests_nr(bts);
+
+	printf("Subscribers: %d\n", llist_count(net->bsc_subscribers));
+	printf("Paging attempted: %"PRIu64" refreshed: %"PRIu64"\n",
+	       net->bsc_ctrs->ctr[BSC_CTR_PAGING_ATTEMPTED].current,
+	       net->bsc_ctrs->ctr[BSC_CTR_PAGING_REFRESHED].current);
+	printf("Pending paging requests: %u\n", pending);
+
+	/* the index still finds everyone */
+	snprintf(imsi, sizeof(imsi), "90170%010d", PAGING_SUBSCRIBERS - 1);
+	bsub = bsc_subscr_find_by_imsi(net->bsc_subscribers, imsi);
+	OSMO_ASSERT(bsub);
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(net->bsc_subscribers, 0x1234) == NULL);
+	bsc_subscr_set_tmsi(bsub, 0x1234);
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(net->bsc_subscribers, 0x1234) == bsub);
+	bsc_subscr_put(bsub);
+	bsc_subscr_put(bsub);
+
+	for (i = 0; i < PAGING_PAGED; i++)
+		msgb_free(msgs[i]);
+	paging_net_free(net);
+}
+
+static void test_paging_cell_list(void)
+{
+	struct gsm_network *net;
+	struct bsc_msc_data *msc;
+	struct gsm48_loc_area_id lai48;
+	struct osmo_location_area_id lai;
+	const uint8_t lac_list[] = { CELL_IDENT_LAC, 0x00, 0x01, 0x00, 0x02 };
+	const uint8_t lac_dup_list[] = { CELL_IDENT_LAC, 0x00, 0x02, 0x00, 0x02 };
+	const uint8_t lac_ci_list[] = {
+		CELL_IDENT_LAC_AND_CI, 0x00, 0x01, 0x00, 0x02, 0x00, 0x02, 0x00, 0x04,
+	};
+	const uint8_t ci_list[] = { CELL_IDENT_CI, 0x00, 0x01 };
+	const uint8_t bss_list[] = { CELL_IDENT_BSS };
+	uint8_t cgi_list[1 + 2 * 7];
+	const struct {
+		const char *name;
+		const uint8_t *cil;
+		uint8_t cil_len;
+	} tests[] = {
+		{ "LAC 1, LAC 2", lac_list, sizeof(lac_list) },
+		{ "LAC 2, LAC 2", lac_dup_list, sizeof(lac_dup_list) },
+		{ "LAC 1/CI 2, LAC 2/CI 4", lac_ci_list, sizeof(lac_ci_list) },
+		{ "CGI 901-70-2-3, CGI 262-01-1-1", cgi_list, sizeof(cgi_list) },
+		{ "CI 1", ci_list, sizeof(ci_list) },
+		{ "BSS", bss_list, sizeof(bss_list) },
+	};
+	uint64_t bts_paged = 0;
+	int i;
+
+	printf("Testing paging with a cell identifier list.\n");
+
+	net = paging_net_alloc(&msc);
+
+	/* one cell of ours, one of someone else */
+	cgi_list[0] = CELL_IDENT_WHOLE_GLOBAL;
+	lai = (struct osmo_location_area_id){
+		.plmn = { .mcc = 901, .mnc = 70 },
+		.lac = 2,
+	};
+	gsm48_generate_lai2(&lai48, &lai);
+	memcpy(&cgi_list[1], &lai48, sizeof(lai48));
+	osmo_store16be(3, &cgi_list[1 + 5]);
+	lai = (struct osmo_location_area_id){
+		.plmn = { .mcc = 262, .mnc = 1 },
+		.lac = 1,
+	};
+	gsm48_generate_lai2(&lai48, &lai);
+	memcpy(&cgi_list[8], &lai48, sizeof(lai48));
+	osmo_store16be(1, &cgi_list[8 + 5]);
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		struct gsm_paging_request *req;
+		struct bsc_subscr *bsub;
+		char imsi[GSM23003_IMSI_MAX_DIGITS + 1];
+		struct msgb *msg;
+		uint64_t paged;
+
+		snprintf(imsi, sizeof(imsi), "90170%010d", i);
+		msg = create_paging(imsi, tests[i].cil, tests[i].cil_len);
+		bsc_handle_udt(msc, msg, msgb_l3len(msg));
+		msgb_free(msg);
+
+		paged = net->bsc_ctrs->ctr[BSC_CTR_PAGING_BTS_PAGED].current - bts_paged;
+		bts_paged += paged;
+
+		printf("%s: %"PRIu64" BTS paged:", tests[i].name, paged);
+		bsub = bsc_subscr_find_by_imsi(net->bsc_subscribers, imsi);
+		if (bsub) {
+			llist_for_each_entry(req, &bsub->paging_requests, bsub_entry)
+				printf(" %d", req->bts->nr);
+			bsc_subscr_put(bsub);
+		}
+		printf("\n");
+	}
+
+	paging_net_free(net);
+}
 
 int main(int argc, char **argv)
 {
@@ -204,6 +464,27 @@ int main(int argc, char **argv)
 
 	test_scan();
 
+	/* keep the timing clear of per message logging */
+	log_set_log_level(osmo_stderr_target, LOGL_ERROR);
+	test_paging_load();
+	test_paging_cell_list();
+
 	printf("Testing execution completed.\n");
 	return 0;
 }
+
+/* stubs */
+int bsc_queue_for_msc(struct osmo_bsc_sccp_con *conn, struct msgb *msg)
+{
+	abort();
+}
+
+void bsc_notify_and_close_conns(struct bsc_msc_data *msc)
+{
+	abort();
+}
+
+void bsc_sccp_con_set_cic(struct osmo_bsc_sccp_con *sccp, uint16_t cic)
+{
+	abort();
+}
@@ -17,18 +17,29 @@
  *
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include <assert.h>
 
 #include <osmocom/core/application.h>
 #include <osmocom/core/select.h>
+#include <osmocom/core/socket.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
 
 #include <openbsc/common_bsc.h>
 #include <openbsc/abis_rsl.h>
 #include <openbsc/debug.h>
 #include <openbsc/gsm_subscriber.h>
+#include <openbsc/pcu_if.h>
+
+#include "../bench.h"
 
 static int s_end = 0;
 static struct gsm_subscriber_connection s_conn;
@@ -144,6 +155,211 @@ void test_dyn_ts_subslots(void)
 	OSMO_ASSERT(ts_subslots(&ts) == 0);
 }
 
+/* override, requires '-Wl,--wrap=abis_rsl_sendmsg'.
+ * Record the IMMEDIATE ASSIGNMENT REJECTs sent to the BTS. */
+static unsigned int s_rej_msgs;
+static struct gsm48_imm_ass_rej s_last_rej;
+
+int __real_abis_rsl_sendmsg(struct msgb *msg);
+int __wrap_abis_rsl_sendmsg(struct msgb *msg)
+{
+	struct abis_rsl_dchan_hdr *dh = (struct abis_rsl_dchan_hdr *) msg->data;
+
+	OSMO_ASSERT(dh->c.msg_type == RSL_MT_IMMEDIATE_ASSIGN_CMD);
+	OSMO_ASSERT(dh->data[0] == RSL_IE_FULL_IMM_ASS_INFO);
+	memcpy(&s_last_rej, &dh->data[2], sizeof(s_last_rej));
+	OSMO_ASSERT(s_last_rej.msg_type == GSM48_MT_RR_IMM_ASS_REJ);
+
+	s_rej_msgs += 1;
+	msgb_free(msg);
+	return 0;
+}
+
+static void send_chan_rqd(struct e1inp_sign_link *link, unsigned int seq)
+{
+	struct msgb *msg = msgb_alloc(128, "CHAN RQD");
+	struct abis_rsl_dchan_hdr *rqd;
+	struct gsm48_req_ref *ref;
+
+	rqd = (struct abis_rsl_dchan_hdr *) msgb_put(msg, sizeof(*rqd));
+	rqd->c.msg_discr = ABIS_RSL_MDISC_COM_CHAN;
+	rqd->c.msg_type = RSL_MT_CHAN_RQD;
+	rqd->ie_chan = RSL_IE_CHAN_NR;
+	rqd->chan_nr = RSL_CHAN_RACH;
+
+	msgb_put_u8(msg, RSL_IE_REQ_REFERENCE);
+	ref = (struct gsm48_req_ref *) msgb_put(msg, sizeof(*ref));
+	memset(ref, 0, sizeof(*ref));
+	ref->ra = 0x01; /* location updating */
+	ref->t1 = seq & 0x1f;
+	ref->t2 = (seq >> 5) & 0x1f;
+	msgb_put_u8(msg, RSL_IE_ACCESS_DELAY);
+	msgb_put_u8(msg, 0);
+
+	msg->l2h = msg->data;
+	msg->dst = link;
+	abis_rsl_rcvmsg(msg);
+}
+
+static void advance_time(unsigned int usec)
+{
+	osmo_gettimeofday_override_add(0, usec);
+	osmo_timers_update();
+}
+
+#define RACH_STORM_RATE 10000
+
+void test_rach_storm(struct gsm_network *net)
+{
+	struct e1inp_sign_link link;
+	struct gsm_bts *bts;
+	struct timespec start;
+	unsigned int i, seq = 0;
+
+	printf("Testing the RACH load controller\n");
+
+	/* no timeslot is usable, every request is rejected */
+	bts = gsm_bts_alloc_register(net, GSM_BTS_TYPE_UNKNOWN, 0);
+	OSMO_ASSERT(bts);
+	memset(&link, 0, sizeof(link));
+	link.trx = bts->c0;
+
+	osmo_gettimeofday_override = true;
+	osmo_gettimeofday_override_time.tv_sec = 23000;
+	osmo_gettimeofday_override_time.tv_usec = 0;
+
+	/* normal load, one reject per request */
+	s_rej_msgs = 0;
+	for (i = 0; i < 50; ++i) {
+		send_chan_rqd(&link, seq++);
+		advance_time(20000);
+	}
+	printf("Normal load: 50 CHAN RQD, %u IMM ASS REJ, storm %d\n",
+	       s_rej_msgs, bts->rach_load.storm);
+	OSMO_ASSERT(s_last_rej.wait_ind4 == GSM_T3122_DEFAULT);
+
+	/* replay 10k requests within one second */
+	bts->rach_load.dynamic_t3122 = true;
+	s_rej_msgs = 0;
+	bench_start(&start);
+	for (i = 0; i < RACH_STORM_RATE; ++i) {
+		send_chan_rqd(&link, seq++);
+		advance_time(1000000 / RACH_STORM_RATE);
+	}
+	printf("Storm: %u CHAN RQD, %u IMM ASS REJ, storm %d, wait indication %u\n",
+	       RACH_STORM_RATE, s_rej_msgs, bts->rach_load.storm,
+	       s_last_rej.wait_ind1);
+	fprintf(stderr, "Handled %u CHAN RQD in %.0f us\n", RACH_STORM_RATE,
+		bench_elapsed_us(&start));
+
+	/* a partial IMM ASS REJ is sent after a short delay */
+	s_rej_msgs = 0;
+	send_chan_rqd(&link, seq++);
+	send_chan_rqd(&link, seq++);
+	OSMO_ASSERT(s_rej_msgs == 0);
+	advance_time(60000);
+	OSMO_ASSERT(s_rej_msgs == 1);
+	OSMO_ASSERT(memcmp(&s_last_rej.req_ref2, &s_last_rej.req_ref4,
+			   sizeof(s_last_rej.req_ref4)) == 0);
+	OSMO_ASSERT(memcmp(&s_last_rej.req_ref1, &s_last_rej.req_ref2,
+			   sizeof(s_last_rej.req_ref2)) != 0);
+	printf("Partial IMM ASS REJ flushed with %u msg\n", s_rej_msgs);
+
+	/* calm down again */
+	advance_time(2000000);
+	s_rej_msgs = 0;
+	send_chan_rqd(&link, seq++);
+	printf("After the storm: %u IMM ASS REJ, storm %d, rate %u\n",
+	       s_rej_msgs, bts->rach_load.storm, bts->rach_load.rate);
+
+	osmo_gettimeofday_override = false;
+}
+
+void test_bts_lookup(struct gsm_network *net)
+{
+	static const unsigned int counts[] = { 16, 64, 256 };
+	struct gsm_bts *bts;
+	unsigned int c, i, found;
+
+	printf("Testing the BTS lookup\n");
+
+	for (c = 0; c < ARRAY_SIZE(counts); c++) {
+		/* configure the new BTS like the VTY would */
+		while (net->num_bts < counts[c]) {
+			bts = gsm_bts_alloc_register(net, GSM_BTS_TYPE_UNKNOWN, 0);
+			OSMO_ASSERT(bts);
+			bts->location_area_code = 100 + bts->nr % 8;
+			bts->type = GSM_BTS_TYPE_NANOBTS;
+			bts->ip_access.site_id = 1000 + bts->nr;
+			bts->ip_access.bts_id = 0;
+		}
+		gsm_net_cell_tbl_invalidate(net);
+		gsm_net_unitid_tbl_invalidate(net);
+
+		for (i = 0; i < net->num_bts; i++) {
+			bts = gsm_bts_num(net, i);
+			OSMO_ASSERT(bts && bts->nr == i);
+			OSMO_ASSERT(gsm_bts_by_unitid(net, 1000 + i, 0)
+				    == (is_ipaccess_bts(bts) ? bts : NULL));
+		}
+		OSMO_ASSERT(!gsm_bts_num(net, net->num_bts));
+		OSMO_ASSERT(!gsm_bts_by_unitid(net, 1000 + net->num_bts, 0));
+
+		found = 0;
+		for (bts = gsm_bts_by_lac(net, 101, NULL); bts;
+		     bts = gsm_bts_by_lac(net, 101, bts)) {
+			OSMO_ASSERT(bts->nr % 8 == 1);
+			found++;
+		}
+		OSMO_ASSERT(found == counts[c] / 8);
+
+		printf("%u BTS: lookups by number, unit ID and LAC agree\n",
+		       net->num_bts);
+	}
+}
+
+#define PCU_OVERFLOW 10
+
+void test_pcu_queue(struct gsm_network *net)
+{
+	struct rate_ctr *dropped = &net->bsc_ctrs->ctr[BSC_CTR_PCU_DROPPED];
+	struct gsm_bts *bts;
+	char path[64];
+	uint64_t before;
+	unsigned int i, refused = 0;
+	int fd;
+
+	printf("Testing the PCU queue limit\n");
+
+	bts = gsm_bts_alloc_register(net, GSM_BTS_TYPE_UNKNOWN, 0);
+	OSMO_ASSERT(bts);
+	snprintf(path, sizeof(path), "/tmp/channel_test_pcu.%d", getpid());
+	unlink(path);
+	OSMO_ASSERT(pcu_sock_init(path, bts) == 0);
+
+	/* a PCU that connects and never reads */
+	fd = osmo_sock_unix_init(SOCK_SEQPACKET, 0, path, OSMO_SOCK_F_CONNECT);
+	OSMO_ASSERT(fd >= 0);
+	osmo_select_main(1);
+	OSMO_ASSERT(bts->pcu_state->conn_bfd.fd >= 0);
+
+	/* nothing is written without the select loop running */
+	before = dropped->current;
+	for (i = 0; i < PCU_SOCK_QUEUE_MAX + PCU_OVERFLOW; i++) {
+		if (pcu_tx_imm_ass_sent(bts, i) == -ENOBUFS)
+			refused++;
+	}
+	printf("Queued %u, refused %u, pcu:dropped %llu\n",
+	       bts->pcu_state->upqueue_len, refused,
+	       (unsigned long long) (dropped->current - before));
+	OSMO_ASSERT(bts->pcu_state->upqueue_len == PCU_SOCK_QUEUE_MAX);
+	OSMO_ASSERT(dropped->current - before == PCU_OVERFLOW);
+
+	pcu_sock_exit(bts);
+	close(fd);
+	unlink(path);
+}
+
 int main(int argc, char **argv)
 {
 	struct gsm_network *network;
@@ -158,6 +374,9 @@ int main(int argc, char **argv)
 	test_request_chan(network);
 	test_dyn_ts_subslots();
 	test_bts_debug_print(network);
+	test_rach_storm(network);
+	test_bts_lookup(network);
+	test_pcu_queue(network);
 
 	return EXIT_SUCCESS;
 }
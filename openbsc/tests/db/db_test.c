@@ -22,6 +22,8 @@
 #include <openbsc/db.h>
 #include <openbsc/gsm_subscriber.h>
 #include <openbsc/gsm_04_11.h>
+#include <openbsc/tmsi_set.h>
+#include <openbsc/ctr_snapshot.h>
 
 #include <osmocom/core/application.h>
 
@@ -32,6 +34,8 @@
 #include <inttypes.h>
 #include <unistd.h>
 
+#include "../bench.h"
+
 static struct gsm_network dummy_net;
 static struct gsm_subscriber_group dummy_sgrp;
 
@@ -128,6 +132,129 @@ static void test_sms(void)
 	subscr_put(subscr);
 }
 
+static unsigned long long store_sms(const char *imsi, const char *text)
+{
+	struct gsm_subscriber *subscr;
+	struct gsm_sms *sms;
+	unsigned long long id;
+
+	subscr = db_get_subscriber(GSM_SUBSCRIBER_IMSI, imsi);
+	OSMO_ASSERT(subscr);
+
+	sms = sms_alloc();
+	osmo_strlcpy(sms->src.addr, "1234", sizeof(sms->src.addr));
+	osmo_strlcpy(sms->dst.addr, subscr->extension, sizeof(sms->dst.addr));
+	osmo_strlcpy(sms->text, text, sizeof(sms->text));
+	OSMO_ASSERT(db_sms_store(sms) == 0);
+	sms_free(sms);
+
+	id = subscr->id;
+	SUBSCR_PUT(subscr);
+	return id;
+}
+
+static void test_sms_batch(void)
+{
+	struct gsm_sms *sms[8];
+	unsigned long long queries, first;
+	int i, num;
+
+	printf("Testing batched SMS fetch.\n");
+
+	/* older subscribers of the test DB are skipped by the id */
+	first = store_sms("3693245423445", "A1");
+	store_sms("3693245423445", "A2");
+	store_sms("9993245423445", "B1");
+
+	queries = db_query_count();
+	num = db_sms_get_unsent_batch(&dummy_net, first, 10, sms, ARRAY_SIZE(sms));
+	printf("Fetched %d SMS with %llu queries\n", num,
+	       db_query_count() - queries);
+	OSMO_ASSERT(num == 2);
+
+	for (i = 0; i < num; i++) {
+		printf(" %s: %s\n", sms[i]->receiver->imsi, sms[i]->text);
+		OSMO_ASSERT(sms[i]->receiver->group == &dummy_sgrp);
+	}
+	/* the first one has a single IMEI only */
+	printf(" IMEI: %s\n", sms[0]->receiver->equipment.imei);
+
+	num = db_sms_get_unsent_batch(&dummy_net, sms[0]->receiver->id + 1, 10,
+				      &sms[2], 1);
+	printf("Fetched %d SMS after the first subscriber: %s\n", num,
+	       num == 1 && sms[2]->receiver == sms[1]->receiver ? "same" : "FAIL");
+	if (num == 1)
+		sms_free(sms[2]);
+
+	/* one in RAM but not in the extension index is still found */
+	subscr_ext_invalidate(sms[1]->receiver);
+	num = db_sms_get_unsent_batch(&dummy_net, sms[0]->receiver->id + 1, 10,
+				      &sms[2], 1);
+	printf("Fetched %d SMS without the extension index: %s\n", num,
+	       num == 1 && sms[2]->receiver == sms[1]->receiver ? "same" : "FAIL");
+	if (num == 1)
+		sms_free(sms[2]);
+
+	for (i = 0; i < 2; i++) {
+		db_sms_mark_delivered(sms[i]);
+		sms_free(sms[i]);
+	}
+
+	num = db_sms_get_unsent_batch(&dummy_net, first, 10, sms, ARRAY_SIZE(sms));
+	printf("Left over: %d %s\n", num, num == 1 ? sms[0]->text : "");
+	for (i = 0; i < num; i++) {
+		db_sms_mark_delivered(sms[i]);
+		sms_free(sms[i]);
+	}
+}
+
+static void store_snapshot(struct ctr_snapshot *snap, time_t time)
+{
+	snap->time = time;
+	OSMO_ASSERT(db_store_ctr_snapshot(snap) == 0);
+}
+
+static void test_ctr_snapshot(void)
+{
+	struct ctr_sample counters[] = {
+		{ NULL, "test.counter", 0, 5 },
+	};
+	struct ctr_sample rate_ctrs[] = {
+		{ "test", "rate_a", 0, 1 },
+		{ "test", "rate_b", 1, 2 },
+	};
+	struct ctr_snapshot snap = {
+		.counters = counters,
+		.num_counters = ARRAY_SIZE(counters),
+		.rate_ctrs = rate_ctrs,
+		.num_rate_ctrs = ARRAY_SIZE(rate_ctrs),
+	};
+	time_t now = time(NULL);
+	time_t hour = (now - 2 * 24 * 3600) / 3600 * 3600;
+
+	printf("Testing counter snapshots.\n");
+
+	snap.time = 1000;
+	OSMO_ASSERT(ctr_snapshot_write_csv(&snap, stdout) == 0);
+
+	/* two in the same hour two days ago, one too old and a recent one */
+	store_snapshot(&snap, hour + 60);
+	store_snapshot(&snap, hour + 600);
+	store_snapshot(&snap, now - 100 * 24 * 3600);
+	store_snapshot(&snap, now - 60);
+
+	/* nothing goes unless asked for */
+	printf("Removed by default: %d\n", db_trim_counters(now, 0, 0, 20));
+
+	/* the test DB comes with 30 counters from 2014, 20 rows per go */
+	printf("Removed: %d\n",
+	       db_trim_counters(now, 24 * 3600, 90 * 24 * 3600, 20));
+	printf("Removed: %d\n",
+	       db_trim_counters(now, 24 * 3600, 90 * 24 * 3600, 20));
+	printf("Removed again: %d\n",
+	       db_trim_counters(now, 24 * 3600, 90 * 24 * 3600, 20));
+}
+
 static void test_sms_migrate(void)
 {
 	struct gsm_subscriber *rcv_subscr;
@@ -201,6 +328,154 @@ static void test_subs(const char *imsi, char *imei1, char *imei2, bool make_ext)
 	SUBSCR_PUT(alice);
 }
 
+static int expire_cb(void *priv, long long unsigned int id)
+{
+	long long unsigned int *keep = priv;
+
+	return id == *keep;
+}
+
+static void test_subscr_expire(void)
+{
+	struct gsm_subscriber *subscr;
+	long long unsigned int keep = 0;
+	char imsi[GSM23003_IMSI_MAX_DIGITS + 1];
+	int i, rc;
+
+	printf("Testing batched subscriber expiry.\n");
+
+	for (i = 0; i < 10; i++) {
+		snprintf(imsi, sizeof(imsi), "90170000000%04d", i);
+		subscr = db_create_subscriber(imsi, GSM_MIN_EXTEN,
+					      GSM_MAX_EXTEN, false);
+		OSMO_ASSERT(subscr);
+		subscr->lac = 42;
+		subscr->expire_lu = time(NULL) - 60 + i;
+		db_sync_subscriber(subscr);
+		/* the oldest one stays attached like an active one would */
+		if (i == 0)
+			keep = subscr->id;
+		SUBSCR_PUT(subscr);
+	}
+	printf("Backlog: %d\n", db_subscriber_expire_backlog());
+
+	rc = db_subscriber_expire(&keep, expire_cb, 4);
+	printf("Expired: %d backlog: %d\n", rc, db_subscriber_expire_backlog());
+	rc = db_subscriber_expire(&keep, expire_cb, SUBSCR_EXPIRE_BATCH);
+	printf("Expired: %d backlog: %d\n", rc, db_subscriber_expire_backlog());
+
+	subscr = db_get_subscriber(GSM_SUBSCRIBER_IMSI, "901700000000005");
+	printf("LAC after expiry: %u\n", subscr->lac);
+	SUBSCR_PUT(subscr);
+}
+
+#define NUM_TMSIS 1000000
+#define NUM_TMSI_ALLOCS 100000
+
+static void test_tmsi_alloc(void)
+{
+	struct tmsi_set set = { 0 };
+	struct timespec start;
+	uint32_t tmsi;
+	double usec;
+	int i;
+
+	printf("Testing TMSI allocation with %d subscribers.\n", NUM_TMSIS);
+
+	for (i = 0; i < NUM_TMSIS; i++) {
+		OSMO_ASSERT(tmsi_set_alloc(&set, &tmsi) == 0);
+		OSMO_ASSERT(tmsi != GSM_RESERVED_TMSI);
+	}
+	OSMO_ASSERT(tmsi_set_add(&set, tmsi) == 1);
+
+	bench_start(&start);
+	for (i = 0; i < NUM_TMSI_ALLOCS; i++) {
+		OSMO_ASSERT(tmsi_set_alloc(&set, &tmsi) == 0);
+	}
+	usec = bench_elapsed_us(&start);
+
+	printf("TMSIs in use: %u\n", set.count);
+	if (getenv("DB_TEST_BENCH"))
+		printf("Allocated %d TMSIs in %.0f us, %.0f per second\n",
+		       NUM_TMSI_ALLOCS, usec,
+		       usec > 0 ? NUM_TMSI_ALLOCS * 1000000.0 / usec : 0);
+
+	tmsi_set_clear(&set);
+}
+
+#define NUM_ROUTED 100000
+
+static double route_sms(const char *ext, struct gsm_subscriber *expected)
+{
+	struct gsm_subscriber *subscr;
+	struct timespec start;
+	int i;
+
+	bench_start(&start);
+	for (i = 0; i < NUM_ROUTED; i++) {
+		subscr = subscr_get_by_extension(&dummy_sgrp, ext);
+		OSMO_ASSERT(subscr == expected);
+		if (subscr)
+			subscr_put(subscr);
+	}
+
+	return bench_elapsed_us(&start);
+}
+
+static void test_ext_routing(void)
+{
+	struct gsm_subscriber *carol, *subscr;
+	char old_ext[GSM_EXTENSION_LENGTH];
+	double on_net, off_net;
+
+	printf("Testing subscriber lookup by extension.\n");
+
+	carol = db_create_subscriber("901700000004321", GSM_MIN_EXTEN,
+				     GSM_MAX_EXTEN, true);
+	OSMO_ASSERT(carol);
+	carol->group = &dummy_sgrp;
+
+	subscr = subscr_get_by_extension(&dummy_sgrp, carol->extension);
+	printf("On-net: %s\n", subscr == carol ? "found" : "FAIL");
+	subscr_put(subscr);
+
+	subscr = subscr_get_by_extension(&dummy_sgrp, "1234567");
+	printf("Off-net: %s\n", subscr ? "FAIL" : "not found");
+	subscr = subscr_get_by_extension(&dummy_sgrp, "1234567");
+	printf("Off-net again: %s\n", subscr ? "FAIL" : "not found");
+
+	/* give the unknown number to carol, both lookups must follow */
+	osmo_strlcpy(old_ext, carol->extension, sizeof(old_ext));
+	osmo_strlcpy(carol->extension, "1234567", sizeof(carol->extension));
+	db_sync_subscriber(carol);
+
+	subscr = subscr_get_by_extension(&dummy_sgrp, "1234567");
+	printf("Changed extension: %s\n", subscr == carol ? "found" : "FAIL");
+	subscr_put(subscr);
+	subscr = subscr_get_by_extension(&dummy_sgrp, old_ext);
+	printf("Old extension: %s\n", subscr ? "FAIL" : "not found");
+
+	/* writing back an unchanged extension keeps the index entry */
+	OSMO_ASSERT(carol->ext_entry);
+	db_sync_subscriber(carol);
+	OSMO_ASSERT(carol->ext_entry);
+
+	on_net = route_sms("1234567", carol);
+	off_net = route_sms("7654321", NULL);
+	printf("Routed %d SMS on-net and %d SMS off-net.\n",
+	       NUM_ROUTED, NUM_ROUTED);
+
+	/* the timing can't go to stderr, it is compared as well */
+	if (getenv("DB_TEST_BENCH")) {
+		printf("On-net: %.0f us, %.0f per second\n", on_net,
+		       on_net > 0 ? NUM_ROUTED * 1000000.0 / on_net : 0);
+		printf("Off-net: %.0f us, %.0f per second\n", off_net,
+		       off_net > 0 ? NUM_ROUTED * 1000000.0 / off_net : 0);
+	}
+
+	subscr_put(carol);
+}
+
 int main()
 {
 	printf("Testing subscriber database code.\n");
@@ -265,6 +540,11 @@ int main()
 
 	test_sms();
 	test_sms_migrate();
+	test_sms_batch();
+	test_ctr_snapshot();
+	test_subscr_expire();
+	test_tmsi_alloc();
+	test_ext_routing();
 
 	db_fini();
 
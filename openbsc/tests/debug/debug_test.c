@@ -0,0 +1,161 @@
+/*
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <openbsc/debug.h>
+
+#include <osmocom/core/application.h>
+#include <osmocom/core/signal.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/vty/vty.h>
+
+#include <stdio.h>
+
+#include "../bench.h"
+
+static int evaluated;
+
+static const char *expensive(void)
+{
+	evaluated += 1;
+	return "arg";
+}
+
+/* the cache has to agree with the walk over the targets */
+static void check_cache(void)
+{
+	int subsys, num_lib;
+	unsigned int level;
+
+	num_lib = osmo_log_info->num_cat - osmo_log_info->num_cat_user;
+	for (subsys = -num_lib; subsys < Debug_LastEntry; ++subsys) {
+		for (level = LOGL_DEBUG; level <= LOGL_FATAL; ++level)
+			OSMO_ASSERT(!bsc_log_check_level(subsys, level)
+				    == !log_check_level(subsys, level));
+	}
+}
+
+static void log_some(const char *what)
+{
+	evaluated = 0;
+	DEBUGP(DRSL, "debug %s\n", expensive());
+	LOGP(DRSL, LOGL_NOTICE, "notice %s\n", expensive());
+	LOGP(DLMI, LOGL_NOTICE, "notice %s\n", expensive());
+	check_cache();
+	printf("%s: evaluated %d of 3 arguments\n", what, evaluated);
+}
+
+static void test_levels(void)
+{
+	printf("Testing the level cache\n");
+
+	log_set_category_filter(osmo_stderr_target, DRSL, 1, LOGL_NOTICE);
+	log_set_category_filter(osmo_stderr_target, DLMI, 1, LOGL_NOTICE);
+	bsc_log_level_cache_invalidate();
+	log_some("DRSL at notice");
+
+	/* a VTY command invalidates the cache */
+	log_set_category_filter(osmo_stderr_target, DRSL, 1, LOGL_DEBUG);
+	osmo_signal_dispatch(SS_L_VTY, S_VTY_EVENT, NULL);
+	log_some("DRSL at debug");
+
+	log_set_category_filter(osmo_stderr_target, DRSL, 0, LOGL_DEBUG);
+	bsc_log_level_cache_invalidate();
+	log_some("DRSL disabled");
+
+	log_set_category_filter(osmo_stderr_target, DRSL, 1, LOGL_DEBUG);
+	log_set_all_filter(osmo_stderr_target, 0);
+	bsc_log_level_cache_invalidate();
+	log_some("Target without filter");
+
+	log_set_all_filter(osmo_stderr_target, 1);
+	log_set_log_level(osmo_stderr_target, LOGL_ERROR);
+	bsc_log_level_cache_invalidate();
+	log_some("Target at error");
+	log_set_log_level(osmo_stderr_target, 0);
+}
+
+#define BENCH_LOOPS	1000000
+
+static void bench(const char *what)
+{
+	struct timespec start;
+	int i;
+
+	bsc_log_level_cache_invalidate();
+
+	evaluated = 0;
+	bench_start(&start);
+	for (i = 0; i < BENCH_LOOPS; ++i)
+		DEBUGP(DRSL, "%s SAPI=%u %s\n", expensive(), i, expensive());
+	fprintf(stderr, "%s: cached %.1f ns per message\n",
+		what, bench_elapsed_us(&start) * 1000.0 / BENCH_LOOPS);
+
+	bench_start(&start);
+	for (i = 0; i < BENCH_LOOPS; ++i) {
+		if (log_check_level(DRSL, LOGL_DEBUG))
+			logp2(DRSL, LOGL_DEBUG, __FILE__, __LINE__, 0,
+			      "%s SAPI=%u %s\n", expensive(), i, expensive());
+	}
+	fprintf(stderr, "%s: uncached %.1f ns per message\n",
+		what, bench_elapsed_us(&start) * 1000.0 / BENCH_LOOPS);
+
+	printf("%s: evaluated %d arguments\n", what, evaluated);
+}
+
+static void test_bench(void)
+{
+	struct log_target *tgt[3];
+	int i;
+
+	printf("Testing disabled debug messages\n");
+
+	/* like telnet sessions with logging enabled but no filter set */
+	for (i = 0; i < ARRAY_SIZE(tgt); ++i) {
+		tgt[i] = log_target_create_file("/dev/null");
+		OSMO_ASSERT(tgt[i]);
+		log_add_target(tgt[i]);
+		log_set_category_filter(tgt[i], DRSL, 1, LOGL_DEBUG);
+	}
+
+	log_set_category_filter(osmo_stderr_target, DRSL, 1, LOGL_NOTICE);
+	bench("DRSL at notice");
+
+	log_set_category_filter(osmo_stderr_target, DRSL, 0, LOGL_NOTICE);
+	bench("DRSL disabled");
+
+	for (i = 0; i < ARRAY_SIZE(tgt); ++i)
+		log_target_destroy(tgt[i]);
+	bsc_log_level_cache_invalidate();
+	check_cache();
+}
+
+int main(int argc, char **argv)
+{
+	osmo_init_logging(&log_info);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_print_timestamp(osmo_stderr_target, 0);
+	log_set_use_color(osmo_stderr_target, 0);
+
+	test_levels();
+	test_bench();
+
+	printf("Done with the tests.\n");
+	return 0;
+}
@@ -0,0 +1,366 @@
+/*
+ * Test the handover decision and the neighbor lookup
+ *
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <osmocom/core/application.h>
+#include <osmocom/core/signal.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+
+#include <openbsc/bsc_rll.h>
+#include <openbsc/chan_alloc.h>
+#include <openbsc/common_bsc.h>
+#include <openbsc/debug.h>
+#include <openbsc/gsm_data.h>
+#include <openbsc/handover.h>
+#include <openbsc/handover_decision.h>
+#include <openbsc/meas_rep.h>
+#include <openbsc/signal.h>
+
+#include "../bench.h"
+
+static void print_neighbor(struct gsm_bts *bts, uint16_t arfcn, uint8_t bsic)
+{
+	struct gsm_bts *neigh = gsm_bts_neighbor(bts, arfcn, bsic);
+
+	if (neigh)
+		printf("ARFCN %u BSIC %u is BTS %u\n", arfcn, bsic, neigh->nr);
+	else
+		printf("ARFCN %u BSIC %u is unknown\n", arfcn, bsic);
+}
+
+static struct gsm_bts *create_bts(struct gsm_network *net, uint16_t arfcn,
+				  uint8_t bsic)
+{
+	struct gsm_bts *bts;
+
+	bts = gsm_bts_alloc_register(net, GSM_BTS_TYPE_UNKNOWN, bsic);
+	OSMO_ASSERT(bts);
+	bts->c0->arfcn = arfcn;
+	gsm_net_neigh_tbl_invalidate(net);
+	return bts;
+}
+
+static void test_neighbor_lookup(struct gsm_network *net)
+{
+	struct gsm_bts *bts0, *bts1;
+
+	printf("Testing the neighbor lookup\n");
+
+	bts0 = create_bts(net, 870, 10);
+	bts1 = create_bts(net, 871, 11);
+	create_bts(net, 870, 12);
+	/* the first BTS wins */
+	create_bts(net, 870, 10);
+
+	print_neighbor(bts0, 870, 10);
+	print_neighbor(bts0, 871, 11);
+	print_neighbor(bts1, 870, 12);
+	print_neighbor(bts1, 872, 10);
+
+	/* the table follows changes of the ARFCN */
+	bts1->c0->arfcn = 872;
+	gsm_net_neigh_tbl_invalidate(net);
+	print_neighbor(bts0, 871, 11);
+	print_neighbor(bts0, 872, 11);
+}
+
+#define NUM_LCHANS	2000
+#define NUM_NEIGH	12
+#define NUM_ROUNDS	25
+
+static void send_meas_rep(struct gsm_lchan *lchan, unsigned int lchan_nr,
+			  unsigned int round)
+{
+	struct lchan_signal_data sig;
+	struct gsm_meas_rep *mr;
+	int i;
+
+	mr = lchan_next_meas_rep(lchan);
+	mr->nr = round;
+	mr->flags = MEAS_REP_F_DL_VALID;
+	mr->dl.full.rx_lev = 30;
+	mr->num_cell = 6;
+	for (i = 0; i < mr->num_cell; i++) {
+		unsigned int c = (round + lchan_nr + i * 2) % NUM_NEIGH;
+
+		mr->cell[i].arfcn = 880 + c;
+		mr->cell[i].bsic = c;
+		mr->cell[i].rxlev = (lchan_nr * 7 + round * 3 + c) % 64;
+	}
+
+	sig.lchan = lchan;
+	sig.mr = mr;
+	osmo_signal_dispatch(SS_LCHAN, S_LCHAN_MEAS_REP, &sig);
+}
+
+static int check_sums(struct gsm_lchan *lchan)
+{
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(lchan->neigh_meas); i++) {
+		struct neigh_meas_proc *nmp = &lchan->neigh_meas[i];
+		unsigned int n = ARRAY_SIZE(nmp->rxlev);
+		unsigned int sum = 0;
+
+		if (!nmp->arfcn)
+			continue;
+
+		for (j = 0; j < n; j++)
+			sum += nmp->rxlev[j];
+		if (sum != nmp->rxlev_sum_max)
+			return 0;
+
+		if (!nmp->rxlev_sum_win_len)
+			continue;
+		sum = 0;
+		for (j = 1; j <= nmp->rxlev_sum_win_len; j++)
+			sum += nmp->rxlev[(nmp->rxlev_cnt + n - j) % n];
+		if (sum != nmp->rxlev_sum_win)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void test_meas_rep_bench(struct gsm_network *net)
+{
+	struct gsm_lchan *lchans[NUM_LCHANS];
+	struct gsm_bts_trx *trx;
+	struct gsm_bts *bts;
+	struct timespec start;
+	unsigned int i, round, num = 0, ok = 0;
+	double usec;
+
+	printf("Testing measurement report processing\n");
+
+	/* one TCH/F on every timeslot of enough TRX */
+	bts = create_bts(net, 900, 1);
+	trx = bts->c0;
+	while (num < NUM_LCHANS) {
+		for (i = 0; i < TRX_NR_TS && num < NUM_LCHANS; i++) {
+			lchans[num] = &trx->ts[i].lchan[0];
+			lchans[num]->type = GSM_LCHAN_TCH_F;
+			num++;
+		}
+		if (num < NUM_LCHANS)
+			trx = gsm_bts_trx_alloc(bts);
+	}
+
+	bench_start(&start);
+	for (round = 0; round < NUM_ROUNDS; round++) {
+		/* exercise a change of the averaging window */
+		net->handover.win_rxlev_avg_neigh = round < NUM_ROUNDS / 2 ? 10 : 4;
+		for (i = 0; i < NUM_LCHANS; i++)
+			send_meas_rep(lchans[i], i, round);
+	}
+	usec = bench_elapsed_us(&start);
+	fprintf(stderr, "Processed %u measurement reports in %.0f us, %.0f per second\n",
+		NUM_LCHANS * NUM_ROUNDS, usec,
+		usec > 0 ? NUM_LCHANS * NUM_ROUNDS * 1000000.0 / usec : 0);
+
+	for (i = 0; i < NUM_LCHANS; i++)
+		ok += check_sums(lchans[i]);
+	printf("Processed %u measurement reports on %u lchans\n",
+	       NUM_LCHANS * NUM_ROUNDS, NUM_LCHANS);
+	printf("Running averages consistent on %u lchans\n", ok);
+}
+
+/* override, requires '-Wl,--wrap=abis_rsl_sendmsg'.
+ * Nothing is sent to a BTS, the messages are only counted. */
+static unsigned int s_rsl_msgs;
+
+int __real_abis_rsl_sendmsg(struct msgb *msg);
+int __wrap_abis_rsl_sendmsg(struct msgb *msg)
+{
+	s_rsl_msgs += 1;
+	msgb_free(msg);
+	return 0;
+}
+
+#define NUM_PENDING	2000
+
+/* a BTS with enough TCH/F for num lchans */
+static struct gsm_bts *create_tch_bts(struct gsm_network *net, uint16_t arfcn,
+				      uint8_t bsic, unsigned int num)
+{
+	struct gsm_bts *bts = create_bts(net, arfcn, bsic);
+	struct gsm_bts_trx *trx = bts->c0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (i && i % TRX_NR_TS == 0)
+			trx = gsm_bts_trx_alloc(bts);
+		trx->ts[i % TRX_NR_TS].pchan = GSM_PCHAN_TCH_F;
+	}
+
+	return bts;
+}
+
+static unsigned int s_rll_conf, s_rll_err;
+
+static void rll_cb(struct gsm_lchan *lchan, uint8_t link_id, void *data,
+		   enum bsc_rllr_ind type)
+{
+	OSMO_ASSERT(data == lchan);
+
+	if (type == BSC_RLLR_IND_EST_CONF)
+		s_rll_conf += 1;
+	else if (type == BSC_RLLR_IND_ERR_IND)
+		s_rll_err += 1;
+}
+
+static void test_rll_many(struct gsm_network *net)
+{
+	struct gsm_lchan *lchans[NUM_PENDING];
+	struct challoc_signal_data sig;
+	struct gsm_bts *bts;
+	unsigned int i;
+
+	printf("Testing many pending RLL establishments\n");
+
+	bts = create_tch_bts(net, 910, 2, NUM_PENDING);
+	for (i = 0; i < NUM_PENDING; i++) {
+		lchans[i] = lchan_alloc(bts, GSM_LCHAN_TCH_F, 0);
+		OSMO_ASSERT(lchans[i]);
+		OSMO_ASSERT(rll_establish(lchans[i], 3, rll_cb, lchans[i]) == 0);
+	}
+	OSMO_ASSERT(s_rsl_msgs == NUM_PENDING);
+
+	/* answer the newest first, every other one by a release */
+	for (i = NUM_PENDING; i-- > 0;) {
+		if (i % 2) {
+			rll_indication(lchans[i], 0x40 | 3, BSC_RLLR_IND_EST_CONF);
+			continue;
+		}
+
+		sig.bts = bts;
+		sig.lchan = lchans[i];
+		sig.type = lchans[i]->type;
+		osmo_signal_dispatch(SS_CHALLOC, S_CHALLOC_FREED, &sig);
+	}
+
+	OSMO_ASSERT(s_rll_conf == NUM_PENDING / 2);
+	OSMO_ASSERT(s_rll_err == NUM_PENDING / 2);
+	for (i = 0; i < NUM_PENDING; i++)
+		OSMO_ASSERT(llist_empty(&lchans[i]->rll_reqs));
+	printf("Established %u RLL links and released %u lchans\n",
+	       s_rll_conf, s_rll_err);
+}
+
+static void test_ho_many(struct gsm_network *net)
+{
+	struct gsm_lchan *old_lchans[NUM_PENDING], *new_lchans[NUM_PENDING];
+	struct gsm_subscriber_connection *conn;
+	struct lchan_signal_data sig;
+	struct gsm_bts *from, *to;
+	unsigned int i, busy = 0;
+
+	printf("Testing many pending handovers\n");
+
+	from = create_tch_bts(net, 920, 3, NUM_PENDING);
+	to = create_tch_bts(net, 921, 4, NUM_PENDING);
+	for (i = 0; i < NUM_PENDING; i++) {
+		old_lchans[i] = lchan_alloc(from, GSM_LCHAN_TCH_F, 0);
+		OSMO_ASSERT(old_lchans[i]);
+
+		conn = talloc_zero(tall_bsc_ctx, struct gsm_subscriber_connection);
+		conn->lchan = old_lchans[i];
+		conn->bts = from;
+		old_lchans[i]->conn = conn;
+
+		OSMO_ASSERT(bsc_handover_start(old_lchans[i], to) == 0);
+		new_lchans[i] = conn->ho_lchan;
+		OSMO_ASSERT(new_lchans[i]);
+	}
+
+	/* only one handover per lchan at a time */
+	for (i = 0; i < NUM_PENDING; i += 100)
+		if (bsc_handover_start(old_lchans[i], to) == -EBUSY)
+			busy += 1;
+
+	for (i = 0; i < NUM_PENDING; i++) {
+		sig.lchan = new_lchans[i];
+		sig.mr = NULL;
+		osmo_signal_dispatch(SS_LCHAN, S_LCHAN_HANDOVER_DETECT, &sig);
+	}
+
+	for (i = 0; i < NUM_PENDING; i++)
+		OSMO_ASSERT(bsc_handover_pending(new_lchans[i]) == old_lchans[i]);
+	printf("Started %u handovers, %u more were busy\n", NUM_PENDING, busy);
+
+	/* tear down half by a NACK and half from the connection */
+	for (i = 0; i < NUM_PENDING; i++) {
+		if (i % 2) {
+			bsc_clear_handover(old_lchans[i]->conn, 0);
+			continue;
+		}
+
+		sig.lchan = new_lchans[i];
+		sig.mr = NULL;
+		osmo_signal_dispatch(SS_LCHAN, S_LCHAN_ACTIVATE_NACK, &sig);
+	}
+
+	for (i = 0; i < NUM_PENDING; i++) {
+		OSMO_ASSERT(!bsc_handover_pending(new_lchans[i]));
+		OSMO_ASSERT(!old_lchans[i]->conn->ho_lchan);
+	}
+
+	/* the old lchan can be handed over again */
+	OSMO_ASSERT(bsc_handover_start(old_lchans[0], to) == 0);
+	OSMO_ASSERT(bsc_handover_pending(old_lchans[0]->conn->ho_lchan)
+		    == old_lchans[0]);
+	bsc_clear_handover(old_lchans[0]->conn, 0);
+	printf("All handovers are cleared\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct gsm_network *network;
+
+	osmo_init_logging(&log_info);
+	log_set_log_level(osmo_stderr_target, LOGL_ERROR);
+
+	network = bsc_network_init(tall_bsc_ctx, 1, 1, NULL);
+	if (!network)
+		return EXIT_FAILURE;
+	on_dso_load_ho_dec();
+
+	test_neighbor_lookup(network);
+	test_meas_rep_bench(network);
+	test_rll_many(network);
+	test_ho_many(network);
+
+	return EXIT_SUCCESS;
+}
+
+void sms_alloc() {}
+void sms_free() {}
+void gsm48_secure_channel() {}
+void vty_out() {}
+void switch_trau_mux() {}
+void rtp_socket_free() {}
+
+struct tlv_definition nm_att_tlvdef;
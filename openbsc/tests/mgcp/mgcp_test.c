@@ -32,6 +32,8 @@
 #include <time.h>
 #include <math.h>
 
+#include "../bench.h"
+
 char *strline_r(char *str, char **saveptr);
 
 const char *strline_test_data =
@@ -672,6 +674,51 @@ static void test_retransmission(void)
 	talloc_free(cfg);
 }
 
+static struct msgb *handle_str(struct mgcp_config *cfg, const char *str)
+{
+	struct msgb *inp, *msg;
+
+	inp = create_msg(str);
+	msg = mgcp_handle_message(cfg, inp);
+	msgb_free(inp);
+	return msg;
+}
+
+static void test_retransmission_history(void)
+{
+	struct mgcp_config *cfg;
+	struct msgb *msg;
+	int i;
+
+	printf("Testing retransmission of an older transaction\n");
+
+	cfg = mgcp_config_alloc();
+	cfg->trunk.number_endpoints = 64;
+	mgcp_endpoints_allocate(&cfg->trunk);
+	for (i = 0; i < cfg->trunk.number_endpoints; i++)
+		cfg->trunk.endpoints[i].bts_end.packet_duration_ms = 20;
+
+	msgb_free(handle_str(cfg, CRCX));
+	msgb_free(handle_str(cfg, RQNT));
+
+	/* the CRCX is not the last transaction anymore */
+	msg = handle_str(cfg, CRCX);
+	if (strcmp((char *) msg->data, CRCX_RET) != 0)
+		printf("CRCX failed.\nExpected:\n%s\nGot:\n%s\n",
+		       CRCX_RET, (char *) msg->data);
+	msgb_free(msg);
+	OSMO_ASSERT(mgcp_trans_cache_hits(cfg) == 1);
+
+	/* a new call may use the same transaction ids again */
+	msgb_free(handle_str(cfg, DLCX));
+	msgb_free(handle_str(cfg, CRCX));
+	OSMO_ASSERT(mgcp_trans_cache_hits(cfg) == 1);
+	OSMO_ASSERT(cfg->trunk.endpoints[1].ci == 2);
+
+	mgcp_release_endp(&cfg->trunk.endpoints[1]);
+	talloc_free(cfg);
+}
+
 static int rqnt_cb(struct mgcp_endpoint *endp, char _tone)
 {
 	ptrdiff_t tone = _tone;
@@ -1083,9 +1130,6 @@ static void test_multilple_codec(void)
 
 	/* Free the previous endpoint and the data ... */
 	mgcp_release_endp(endp);
-	talloc_free(endp->last_response);
-	talloc_free(endp->last_trans);
-	endp->last_response = endp->last_trans = NULL;
 
 	last_endpoint = -1;
 	inp = create_msg(CRCX_MULT_GSM_EXACT);
@@ -1181,6 +1225,42 @@ static void test_no_name(void)
 	talloc_free(cfg);
 }
 
+/* replay a recorded call and retransmit every command once */
+static void test_mgcp_handle_speed(void)
+{
+	static const char *call[] = { CRCX, MDCX3, RQNT, DLCX };
+	const int rounds = 2000;
+	struct mgcp_config *cfg;
+	struct timespec start;
+	int i, j;
+
+	printf("Testing MGCP message handling speed.\n");
+
+	cfg = mgcp_config_alloc();
+	cfg->trunk.number_endpoints = 64;
+	mgcp_endpoints_allocate(&cfg->trunk);
+
+	bench_start(&start);
+	for (i = 0; i < rounds; ++i) {
+		for (j = 0; j < ARRAY_SIZE(call); ++j) {
+			struct msgb *msg, *retrans;
+
+			msg = handle_str(cfg, call[j]);
+			retrans = handle_str(cfg, call[j]);
+			OSMO_ASSERT(msg && retrans);
+			OSMO_ASSERT(strcmp((char *) msg->data,
+					   (char *) retrans->data) == 0);
+			msgb_free(msg);
+			msgb_free(retrans);
+		}
+	}
+	fprintf(stderr, "Handled %d commands in %.0f us\n",
+		rounds * (int) ARRAY_SIZE(call) * 2, bench_elapsed_us(&start));
+
+	printf("Answered %u retransmissions.\n", mgcp_trans_cache_hits(cfg));
+	talloc_free(cfg);
+}
+
 static void test_osmux_cid(void)
 {
 	int id, i;
@@ -1215,6 +1295,7 @@ int main(int argc, char **argv)
 	test_values();
 	test_messages();
 	test_retransmission();
+	test_retransmission_history();
 	test_packet_loss_calc();
 	test_rqnt_cb();
 	test_mgcp_stats();
@@ -1226,6 +1307,7 @@ int main(int argc, char **argv)
 	test_no_cycle();
 	test_no_name();
 	test_osmux_cid();
+	test_mgcp_handle_speed();
 
 	OSMO_ASSERT(talloc_total_size(msgb_ctx) == 0);
 	OSMO_ASSERT(talloc_total_blocks(msgb_ctx) == 1);
@@ -23,6 +23,7 @@
 
 #include <osmocom/core/application.h>
 #include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm48.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -84,6 +85,21 @@ static void test_bsc_subscr(void)
 	assert_bsc_subscr(s2, imsi2);
 	assert_bsc_subscr(s3, imsi3);
 
+	/* Only a TMSI that was set can be found */
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(bsc_subscribers, 0) == NULL);
+	bsc_subscr_set_tmsi(s2, 0x1234);
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(bsc_subscribers, 0x1234) == s2);
+	bsc_subscr_put(s2);
+	bsc_subscr_set_tmsi(s2, GSM_RESERVED_TMSI);
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(bsc_subscribers, 0x1234) == NULL);
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(bsc_subscribers,
+					    GSM_RESERVED_TMSI) == NULL);
+
+	/* but 0 is a TMSI like any other */
+	bsc_subscr_set_tmsi(s3, 0);
+	OSMO_ASSERT(bsc_subscr_find_by_tmsi(bsc_subscribers, 0) == s3);
+	bsc_subscr_put(s3);
+
 	/* Free entry 1 */
 	bsc_subscr_put(s1);
 	s1 = NULL;
@@ -120,8 +136,7 @@ int main()
 	log_set_print_category(osmo_stderr_target, 1);
 	log_set_category_filter(osmo_stderr_target, DREF, 1, LOGL_DEBUG);
 
-	bsc_subscribers = talloc_zero(NULL, struct llist_head);
-	INIT_LLIST_HEAD(bsc_subscribers);
+	bsc_subscribers = bsc_subscr_list_alloc(NULL);
 
 	test_bsc_subscr();
 
@@ -22,14 +22,18 @@
 #include <openbsc/db.h>
 #include <openbsc/gsm_subscriber.h>
 #include <openbsc/gsm_04_11.h>
+#include <openbsc/chan_alloc.h>
 
 #include <osmocom/core/application.h>
+#include <osmocom/core/talloc.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
 
+#include "../bench.h"
+
 static struct gsm_network dummy_net;
 static struct gsm_subscriber_group dummy_sgrp;
 
@@ -101,6 +105,102 @@ static void test_subscr(void)
 	OSMO_ASSERT(llist_empty(&active_subscribers));
 }
 
+static struct gsm_subscriber_connection *conn_alloc(struct gsm_subscriber *subscr)
+{
+	struct gsm_subscriber_connection *conn;
+
+	conn = talloc_zero(NULL, struct gsm_subscriber_connection);
+	OSMO_ASSERT(conn);
+	conn->network = &dummy_net;
+	llist_add_tail(&conn->entry, &dummy_net.subscr_conns);
+	subscr_con_attach(conn, subscr);
+	return conn;
+}
+
+static void conn_free(struct gsm_subscriber_connection *conn)
+{
+	if (conn->subscr)
+		subscr_put(subscr_con_detach(conn));
+	llist_del(&conn->entry);
+	talloc_free(conn);
+}
+
+static void test_subscr_conn(void)
+{
+	struct gsm_subscriber *subscr;
+	struct gsm_subscriber_connection *conn1, *conn2;
+
+	printf("Test subscriber connection lookup\n");
+
+	dummy_sgrp.keep_subscr = 0;
+
+	subscr = subscr_get_or_create(&dummy_sgrp, "1234567890");
+	OSMO_ASSERT(connection_for_subscr(subscr) == NULL);
+
+	conn1 = conn_alloc(subscr_get(subscr));
+	conn2 = conn_alloc(subscr_get(subscr));
+	printf("Two connections: %s\n",
+	       connection_for_subscr(subscr) == conn1 ? "first" : "FAIL");
+
+	conn_free(conn1);
+	printf("First one freed: %s\n",
+	       connection_for_subscr(subscr) == conn2 ? "second" : "FAIL");
+
+	conn_free(conn2);
+	printf("Both freed: %s\n",
+	       connection_for_subscr(subscr) ? "FAIL" : "none");
+	OSMO_ASSERT(subscr->use_count == 1);
+
+	subscr_put(subscr);
+	OSMO_ASSERT(llist_empty(&active_subscribers));
+}
+
+#define NUM_CONNS 5000
+#define NUM_LOOKUPS 1000000
+
+static double lookup_time(struct gsm_subscriber *subscr,
+			  struct gsm_subscriber_connection *conn)
+{
+	struct timespec start;
+	int i;
+
+	bench_start(&start);
+	for (i = 0; i < NUM_LOOKUPS; i++)
+		OSMO_ASSERT(connection_for_subscr(subscr) == conn);
+	return bench_elapsed_us(&start);
+}
+
+static void test_subscr_conn_load(void)
+{
+	struct gsm_subscriber_connection *conns[NUM_CONNS];
+	char imsi[GSM23003_IMSI_MAX_DIGITS + 1];
+	double one, all;
+	int i;
+
+	printf("Test subscriber connection lookup with %d connections\n",
+	       NUM_CONNS);
+
+	for (i = 0; i < NUM_CONNS; i++) {
+		snprintf(imsi, sizeof(imsi), "90170%010d", i);
+		conns[i] = conn_alloc(subscr_get_or_create(&dummy_sgrp, imsi));
+	}
+
+	for (i = 0; i < NUM_CONNS; i++)
+		OSMO_ASSERT(connection_for_subscr(conns[i]->subscr) == conns[i]);
+
+	/* the lookup for the newest connection used to walk them all */
+	one = lookup_time(conns[0]->subscr, conns[0]);
+	all = lookup_time(conns[NUM_CONNS - 1]->subscr, conns[NUM_CONNS - 1]);
+	fprintf(stderr, "%d lookups: first connection %.0f us, "
+		"last of %d connections %.0f us\n",
+		NUM_LOOKUPS, one, NUM_CONNS, all);
+
+	for (i = 0; i < NUM_CONNS; i++)
+		conn_free(conns[i]);
+	OSMO_ASSERT(llist_empty(&active_subscribers));
+	printf("All connections freed\n");
+}
+
 int main()
 {
 	printf("Testing subscriber core code.\n");
@@ -109,8 +209,11 @@ int main()
 
 	dummy_net.subscr_group = &dummy_sgrp;
 	dummy_sgrp.net         = &dummy_net;
+	INIT_LLIST_HEAD(&dummy_net.subscr_conns);
 
 	test_subscr();
+	test_subscr_conn();
+	test_subscr_conn_load();
 
 	printf("Done\n");
 	return 0;
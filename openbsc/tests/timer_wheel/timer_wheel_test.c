@@ -0,0 +1,375 @@
+/*
+ * (C) 2026 by agent <agent@local>
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <openbsc/timer_wheel.h>
+
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench.h"
+
+#define TICK_MS	100
+
+static struct timer_wheel wheel;
+
+struct fired {
+	struct wheel_timer timer;
+	uint32_t armed;
+	uint32_t ticks;
+	int count;
+};
+
+static void fired_cb(void *data)
+{
+	struct fired *f = data;
+
+	f->ticks = wheel.now - f->armed;
+	f->count += 1;
+}
+
+/* move the clock and let the timers run like the main loop would */
+static void advance_ms(unsigned int ms)
+{
+	osmo_clock_override_add(CLOCK_MONOTONIC, ms / 1000,
+				(ms % 1000) * 1000000);
+	osmo_timers_update();
+}
+
+static void advance(uint32_t ticks)
+{
+	advance_ms(ticks * TICK_MS);
+}
+
+static void test_expiry(void)
+{
+	static const int timeouts_ms[] = {
+		1, 100, 150, 1000, 6300, 6400, 6500, 409500, 409600,
+		409700, 1000000, 26214400, 86400000,
+	};
+	struct fired f[ARRAY_SIZE(timeouts_ms)];
+	int i;
+
+	printf("Testing expiry of timers\n");
+
+	memset(f, 0, sizeof(f));
+	for (i = 0; i < ARRAY_SIZE(timeouts_ms); ++i) {
+		wheel_timer_setup(&f[i].timer, &wheel, fired_cb, &f[i]);
+		f[i].armed = wheel.now;
+		wheel_timer_schedule(&f[i].timer, timeouts_ms[i] / 1000,
+				     (timeouts_ms[i] % 1000) * 1000);
+		OSMO_ASSERT(wheel_timer_pending(&f[i].timer));
+	}
+
+	/* go tick by tick to catch timers that are late */
+	while (wheel.pending > 0)
+		advance(1);
+
+	for (i = 0; i < ARRAY_SIZE(timeouts_ms); ++i) {
+		OSMO_ASSERT(f[i].count == 1);
+		OSMO_ASSERT(!wheel_timer_pending(&f[i].timer));
+		printf("Timeout of %d ms expired after %u ticks\n",
+		       timeouts_ms[i], f[i].ticks);
+	}
+}
+
+static struct fired *to_cancel;
+
+static void cancel_cb(void *data)
+{
+	struct fired *f = data;
+
+	f->count += 1;
+	wheel_timer_del(&to_cancel->timer);
+
+	/* arm ourselves again from the callback */
+	if (f->count == 1)
+		wheel_timer_schedule(&f->timer, 1, 0);
+}
+
+static void test_cancel(void)
+{
+	struct fired a, b, c;
+
+	printf("Testing cancelling and moving timers\n");
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+	memset(&c, 0, sizeof(c));
+	wheel_timer_setup(&a.timer, &wheel, cancel_cb, &a);
+	wheel_timer_setup(&b.timer, &wheel, fired_cb, &b);
+	wheel_timer_setup(&c.timer, &wheel, fired_cb, &c);
+
+	/* a timer that is cancelled does not fire */
+	wheel_timer_schedule(&b.timer, 1, 0);
+	wheel_timer_del(&b.timer);
+	wheel_timer_del(&b.timer);
+	OSMO_ASSERT(!wheel_timer_pending(&b.timer));
+	OSMO_ASSERT(wheel.pending == 0);
+
+	/* moving a timer keeps one instance of it */
+	b.armed = wheel.now;
+	wheel_timer_schedule(&b.timer, 10, 0);
+	wheel_timer_schedule(&b.timer, 2, 0);
+	OSMO_ASSERT(wheel.pending == 1);
+
+	/* a callback cancels a timer of the same slot */
+	wheel_timer_schedule(&a.timer, 2, 0);
+	wheel_timer_schedule(&c.timer, 2, 0);
+	to_cancel = &c;
+	advance(20);
+	OSMO_ASSERT(a.count == 1);
+	OSMO_ASSERT(b.count == 1 && b.ticks == 20);
+	OSMO_ASSERT(c.count == 0);
+	OSMO_ASSERT(wheel_timer_pending(&a.timer));
+
+	advance(10);
+	OSMO_ASSERT(a.count == 2);
+	OSMO_ASSERT(b.count == 1);
+	OSMO_ASSERT(wheel.pending == 0);
+	printf("Cancelled timers did not fire\n");
+}
+
+static struct fired *to_arm;
+static unsigned int clock_ms;
+
+static void arm_cb(void *data)
+{
+	struct fired *f = data;
+
+	f->count += 1;
+	wheel_timer_schedule(&to_arm->timer, 1, 0);
+}
+
+static void clock_cb(void *data)
+{
+	struct fired *f = data;
+
+	f->count += 1;
+	f->ticks = clock_ms;
+}
+
+static void test_arm_in_callback(void)
+{
+	struct fired a, b, c;
+
+	printf("Testing timers armed by a callback\n");
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+	memset(&c, 0, sizeof(c));
+	wheel_timer_setup(&a.timer, &wheel, arm_cb, &a);
+	wheel_timer_setup(&b.timer, &wheel, clock_cb, &b);
+	wheel_timer_setup(&c.timer, &wheel, clock_cb, &c);
+
+	/* a arms c in the middle of a tick, b keeps the wheel busy */
+	wheel_timer_schedule(&a.timer, 0, 100000);
+	wheel_timer_schedule(&b.timer, 0, 500000);
+	to_arm = &c;
+
+	/* the first tick runs late */
+	clock_ms = 150;
+	advance_ms(150);
+	while (wheel.pending > 0) {
+		clock_ms += 50;
+		advance_ms(50);
+	}
+
+	OSMO_ASSERT(a.count == 1 && b.count == 1 && c.count == 1);
+	printf("Timeout of 500 ms expired after %u ms\n", b.ticks);
+	printf("Timeout of 1000 ms armed after 150 ms expired after %u ms\n",
+	       c.ticks);
+}
+
+static void test_arm_in_late_tick(void)
+{
+	struct fired a, b, c;
+
+	printf("Testing timers armed by a callback of a late tick\n");
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+	memset(&c, 0, sizeof(c));
+	wheel_timer_setup(&a.timer, &wheel, arm_cb, &a);
+	wheel_timer_setup(&b.timer, &wheel, clock_cb, &b);
+	wheel_timer_setup(&c.timer, &wheel, clock_cb, &c);
+
+	/* a fires on the first of the ticks the wheel catches up */
+	wheel_timer_schedule(&a.timer, 0, 100000);
+	wheel_timer_schedule(&b.timer, 2, 0);
+	to_arm = &c;
+
+	clock_ms = 550;
+	advance_ms(550);
+	OSMO_ASSERT(a.count == 1 && c.count == 0);
+	while (wheel.pending > 0) {
+		clock_ms += 50;
+		advance_ms(50);
+	}
+
+	OSMO_ASSERT(b.count == 1 && c.count == 1);
+	printf("Timeout of 2000 ms expired after %u ms\n", b.ticks);
+	printf("Timeout of 1000 ms armed after 550 ms expired after %u ms\n",
+	       c.ticks);
+}
+
+static void test_clock_going_back(void)
+{
+	struct fired a;
+
+	printf("Testing a clock going back\n");
+
+	memset(&a, 0, sizeof(a));
+	wheel_timer_setup(&a.timer, &wheel, fired_cb, &a);
+	a.armed = wheel.now;
+	wheel_timer_schedule(&a.timer, 0, 500000);
+
+	/* a tick that finds the clock before the last one moves nothing */
+	wheel.last.tv_sec += 10;
+	osmo_clock_override_add(CLOCK_MONOTONIC, 0, 100000000);
+	osmo_timer_del(&wheel.timer);
+	osmo_timer_schedule(&wheel.timer, 0, 0);
+	osmo_timers_update();
+	OSMO_ASSERT(a.count == 0 && wheel.now == a.armed);
+	wheel.last.tv_sec -= 10;
+
+	while (wheel.pending > 0)
+		advance(1);
+	OSMO_ASSERT(a.count == 1);
+	printf("Timeout of 500 ms expired after %u ticks\n", a.ticks);
+}
+
+/*
+ * The benchmark simulates connections that each have a timeout which
+ * is moved or cancelled on every message of the connection, only a
+ * few connections go silent and let it expire.
+ */
+#define CONNS		10000
+#define BENCH_TICKS	1200
+#define BENCH_EVENTS	(CONNS / 10)
+
+struct conn {
+	struct wheel_timer wtimer;
+	struct osmo_timer_list otimer;
+	int expired;
+};
+
+static unsigned int expired;
+
+static void conn_expired(void *data)
+{
+	struct conn *conn = data;
+
+	conn->expired += 1;
+	expired += 1;
+}
+
+static unsigned int run_churn(struct conn *conns, int use_wheel)
+{
+	struct timespec start;
+	uint32_t tick;
+	int i;
+
+	srand(1234);
+	expired = 0;
+	bench_start(&start);
+
+	for (i = 0; i < CONNS; ++i) {
+		if (use_wheel) {
+			wheel_timer_setup(&conns[i].wtimer, &wheel,
+					  conn_expired, &conns[i]);
+			wheel_timer_schedule(&conns[i].wtimer, 30, 0);
+		} else {
+			osmo_timer_setup(&conns[i].otimer, conn_expired,
+					 &conns[i]);
+			osmo_timer_schedule(&conns[i].otimer, 30, 0);
+		}
+	}
+
+	for (tick = 0; tick < BENCH_TICKS; ++tick) {
+		for (i = 0; i < BENCH_EVENTS; ++i) {
+			struct conn *conn = &conns[rand() % CONNS];
+			int timeout = 1 + rand() % 60;
+			int cancel = rand() % 4 == 0;
+
+			if (use_wheel) {
+				if (cancel)
+					wheel_timer_del(&conn->wtimer);
+				wheel_timer_schedule(&conn->wtimer, timeout, 0);
+			} else {
+				if (cancel)
+					osmo_timer_del(&conn->otimer);
+				osmo_timer_schedule(&conn->otimer, timeout, 0);
+			}
+		}
+
+		advance(1);
+	}
+
+	for (i = 0; i < CONNS; ++i) {
+		wheel_timer_del(&conns[i].wtimer);
+		osmo_timer_del(&conns[i].otimer);
+	}
+
+	fprintf(stderr, "%s: %d arm/cancel in %.0f ms\n",
+		use_wheel ? "wheel" : "osmo_timer",
+		BENCH_TICKS * BENCH_EVENTS, bench_elapsed_us(&start) / 1000.0);
+	return expired;
+}
+
+static void test_churn(void)
+{
+	struct conn *conns;
+	unsigned int wheel_expired, osmo_expired;
+
+	printf("Testing arm/cancel churn\n");
+
+	conns = calloc(CONNS, sizeof(*conns));
+	OSMO_ASSERT(conns);
+
+	wheel_expired = run_churn(conns, 1);
+	osmo_expired = run_churn(conns, 0);
+
+	OSMO_ASSERT(wheel_expired == osmo_expired);
+	printf("Both expired the same %u timers\n", wheel_expired);
+	free(conns);
+}
+
+int main(int argc, char **argv)
+{
+	/* the wheel and the clock move in step */
+	osmo_clock_override_enable(CLOCK_MONOTONIC, true);
+	osmo_clock_override_add(CLOCK_MONOTONIC, 1000, 0);
+
+	timer_wheel_init(&wheel, TICK_MS);
+
+	test_expiry();
+	test_cancel();
+	test_arm_in_callback();
+	test_arm_in_late_tick();
+	test_clock_going_back();
+	test_churn();
+
+	printf("Done with the tests.\n");
+	return 0;
+}
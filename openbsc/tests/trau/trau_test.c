@@ -18,8 +18,12 @@
 
 #include <osmocom/abis/trau_frame.h>
 #include <openbsc/trau_mux.h>
+#include <openbsc/debug.h>
+#include <osmocom/core/application.h>
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/utils.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -61,12 +65,147 @@ void test_trau_fr_efr(unsigned char *data)
 	msgb_free(msg);
 }
 
+static void random_frame(uint8_t *bits, const uint8_t *c_bits)
+{
+	int i;
+
+	for (i = 0; i < TRAU_FRAME_BITS; i++)
+		bits[i] = random() & 1;
+	memcpy(bits + 17, c_bits, 5);
+}
+
+static void up2down_full(uint8_t *out, const uint8_t *in)
+{
+	struct decoded_trau_frame tf;
+
+	OSMO_ASSERT(decode_trau_frame(&tf, in) == 0);
+	OSMO_ASSERT(trau_frame_up2down(&tf) == 0);
+	OSMO_ASSERT(encode_trau_frame(out, &tf) == 0);
+}
+
+void test_trau_up2down(void)
+{
+	static const uint8_t up_types[][5] = {
+		{ 0, 0, 0, 1, 0 },	/* FR uplink */
+		{ 1, 1, 0, 1, 0 },	/* EFR */
+		{ 1, 0, 0, 0, 0 },	/* idle speech uplink */
+	};
+	static const uint8_t other_types[][5] = {
+		{ 1, 1, 1, 0, 0 },	/* FR downlink */
+		{ 0, 0, 1, 1, 0 },	/* AMR */
+		{ 0, 1, 0, 0, 0 },	/* data uplink */
+		{ 0, 0, 1, 0, 1 },	/* O&M uplink */
+	};
+	uint8_t in[TRAU_FRAME_BITS];
+	uint8_t out[TRAU_FRAME_BITS], ref[TRAU_FRAME_BITS];
+	int i, n;
+
+	printf("Testing TRAU uplink to downlink.\n");
+	for (i = 0; i < ARRAY_SIZE(up_types); i++) {
+		/* random data, sync and control bits */
+		for (n = 0; n < 1000; n++) {
+			random_frame(in, up_types[i]);
+			up2down_full(ref, in);
+			OSMO_ASSERT(trau_up2down_bits(out, in) == 0);
+			OSMO_ASSERT(!memcmp(out, ref, TRAU_FRAME_BITS));
+		}
+		printf("C1..C5 %s: same bits as decode and re-encode\n",
+		       osmo_ubit_dump(up_types[i], 5));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(other_types); i++) {
+		random_frame(in, other_types[i]);
+		OSMO_ASSERT(trau_up2down_bits(out, in) == -EINVAL);
+		printf("C1..C5 %s: left to the decoder\n",
+		       osmo_ubit_dump(other_types[i], 5));
+	}
+}
+
+static uint32_t mncc_callref;
+
+static int mncc_recv(struct gsm_network *net, struct msgb *msg)
+{
+	struct gsm_data_frame *frame = (struct gsm_data_frame *) msg->data;
+
+	mncc_callref = frame->callref;
+	msgb_free(msg);
+	return 0;
+}
+
+/* which receiver got the frame of a subslot, 0 for none */
+static uint32_t input(struct gsm_e1_subslot *ss)
+{
+	static const uint8_t fr_up[] = { 0, 0, 0, 1, 0 };
+	uint8_t bits[TRAU_FRAME_BITS];
+
+	random_frame(bits, fr_up);
+	mncc_callref = 0;
+	trau_mux_input(ss, bits, TRAU_FRAME_BITS);
+	return mncc_callref;
+}
+
+void test_trau_mux_map(void)
+{
+	static struct gsm_network net;
+	struct gsm_bts bts;
+	struct gsm_bts_trx trx;
+	struct gsm_bts_trx_ts ts[4];
+	struct gsm_lchan lchan[4];
+	struct gsm_e1_subslot far = { .e1_nr = 7, .e1_ts = 255, .e1_ts_ss = 255 };
+	int i;
+
+	printf("Testing TRAU mux map.\n");
+
+	net.mncc_recv = mncc_recv;
+	bts.network = &net;
+	trx.bts = &bts;
+	for (i = 0; i < ARRAY_SIZE(ts); i++) {
+		ts[i].trx = &trx;
+		ts[i].e1_link.e1_nr = 1;
+		ts[i].e1_link.e1_ts = 2 + i / 2;
+		ts[i].e1_link.e1_ts_ss = i % 2;
+		lchan[i].ts = &ts[i];
+	}
+	/* a subslot the index does not cover */
+	ts[3].e1_link = far;
+
+	/* frames go to the latest receiver of the subslot */
+	OSMO_ASSERT(trau_recv_lchan(&lchan[0], 0x100) == 0);
+	OSMO_ASSERT(trau_recv_lchan(&lchan[1], 0x101) == 0);
+	OSMO_ASSERT(trau_recv_lchan(&lchan[3], 0x103) == 0);
+	OSMO_ASSERT(input(&ts[0].e1_link) == 0x100);
+	OSMO_ASSERT(input(&ts[1].e1_link) == 0x101);
+	OSMO_ASSERT(input(&ts[2].e1_link) == 0);
+	OSMO_ASSERT(input(&far) == 0x103);
+	OSMO_ASSERT(trau_recv_lchan(&lchan[0], 0x200) == 0);
+	OSMO_ASSERT(input(&ts[0].e1_link) == 0x200);
+	printf("Frames reach the receivers of their subslot\n");
+
+	/* mapped subslots are switched and not passed up */
+	OSMO_ASSERT(trau_mux_map_lchan(&lchan[1], &lchan[2]) == 0);
+	OSMO_ASSERT(input(&ts[1].e1_link) == 0);
+	OSMO_ASSERT(input(&ts[2].e1_link) == 0);
+	OSMO_ASSERT(input(&ts[0].e1_link) == 0x200);
+	OSMO_ASSERT(trau_mux_unmap(&ts[2].e1_link, 0) == 0);
+	OSMO_ASSERT(trau_mux_unmap(&ts[1].e1_link, 0) == -ENOENT);
+	printf("Mapped subslots bypass the receivers\n");
+
+	/* a receiver is removed by its callref or its subslot */
+	OSMO_ASSERT(trau_mux_unmap(NULL, 0x200) == 0);
+	OSMO_ASSERT(input(&ts[0].e1_link) == 0);
+	OSMO_ASSERT(trau_mux_unmap(&far, 1) == 0);
+	OSMO_ASSERT(input(&far) == 0);
+	OSMO_ASSERT(trau_mux_unmap(NULL, 0x103) == -ENOENT);
+	printf("Removed receivers get no frames\n");
+}
+
 int main()
 {
 	unsigned char data[33];
 	int i;
 
 	msgb_talloc_ctx_init(NULL, 0);
+	osmo_init_logging(&log_info);
 
 	memset(data, 0x00, sizeof(data));
 	test_trau_fr_efr(data);
@@ -76,6 +215,8 @@ int main()
 	for (i = 0; i < sizeof(data); i++)
 		data[i] = random();
 	test_trau_fr_efr(data);
+	test_trau_up2down();
+	test_trau_mux_map();
 	printf("Done\n");
 	return 0;
 }
@@ -888,10 +888,15 @@ class TestVTYNAT(TestVTYGenericBSC):
         self.vty.command("configure terminal")
         self.vty.command("nat")
         res = self.vty.command("prefix-tree %s" % cfg)
-        self.assertEqual(res, "% prefix-tree loaded 17 rules.")
+        self.assertEqual(res, "% prefix-tree is loaded in the background.")
         self.vty.command("end")
 
-        res = self.vty.command("show prefix-tree")
+        # wait for the tree to be built
+        for i in range(50):
+            res = self.vty.command("show prefix-tree")
+            if res != "% there is now prefix tree loaded.":
+                break
+            time.sleep(0.1)
         self.assertEqual(res, '1,1\r\n12,2\r\n123,3\r\n1234,4\r\n12345,5\r\n123456,6\r\n1234567,7\r\n12345678,8\r\n123456789,9\r\n1234567890,10\r\n13,11\r\n14,12\r\n15,13\r\n16,14\r\n82,16\r\n823455,15\r\n+49123,17')
 
         self.vty.command("configure terminal")